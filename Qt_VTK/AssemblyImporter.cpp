@@ -0,0 +1,266 @@
+/**
+ * @file AssemblyImporter.cpp
+ * @brief Implementation of the AssemblyImporter class.
+ */
+
+#include "AssemblyImporter.h"
+#include "BulkFileReader.h"
+#include "PointCloud.h"
+#include "TaskScheduler.h"
+#include "ZipArchive.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QFuture>
+#include <QHash>
+#include <QMutex>
+#include <QSemaphore>
+#include <algorithm>
+#include <memory>
+#include <numeric>
+
+/**
+ * Imports a folder, a ZIP archive, a single STL file or a point cloud, whichever the path names.
+ *
+ * @param path The folder, archive or file to import.
+ * @param errors Optional; receives one message per file that could not be loaded.
+ * @return A group containing the imported parts, or nullptr if nothing could be loaded.
+ */
+ModelPart* AssemblyImporter::importPath(const QString& path, QStringList* errors) {
+    QFileInfo info(path);
+    if (info.isDir())
+        return importDirectory(path, errors);
+    if (info.suffix().compare("zip", Qt::CaseInsensitive) == 0)
+        return importZip(path, errors);
+
+    QFile file(path);
+    QString error;
+    ModelPart* part = createPart(info.fileName());
+    if (PointCloud::isPointCloudFile(path)) {
+        part->loadPointCloud(path, &error);
+    }
+    else if (!file.open(QIODevice::ReadOnly)) {
+        error = file.errorString();
+    }
+    else {
+        const QByteArray contents = file.readAll();
+        part->loadSTL(contents.constData(), static_cast<size_t>(contents.size()), &error);
+    }
+    if (!part->getPolyData() && !part->getPointCloud()) {
+        delete part;
+        if (errors) errors->append(path + ": " + error);
+        return nullptr;
+    }
+
+    ModelPart* group = createPart(info.completeBaseName());
+    group->appendChild(part);
+    return group;
+}
+
+/**
+ * Imports every STL file below a folder.
+ *
+ * @param path The folder to import.
+ * @param errors Optional; receives one message per file that could not be loaded.
+ * @return A group named after the folder containing its files and subfolder groups, or nullptr
+ *         if no STL file could be loaded.
+ */
+ModelPart* AssemblyImporter::importDirectory(const QString& path, QStringList* errors) {
+    QDir root(path);
+    QStringList relativePaths = scanDirectory(root.absolutePath(), QString());
+
+    QStringList fileNames;
+    fileNames.reserve(relativePaths.size());
+    QHash<QString, int> indexOfFile;
+    for (const QString& relativePath : relativePaths) {
+        indexOfFile.insert(root.absoluteFilePath(relativePath), fileNames.size());
+        fileNames.append(root.absoluteFilePath(relativePath));
+    }
+
+    std::vector<ModelPart*> parts(fileNames.size(), nullptr);
+    QMutex mutex; // Guards errors and futures
+    QList<QFuture<void>> futures;
+    TaskScheduler* scheduler = TaskScheduler::instance();
+    auto parseSlots = std::make_shared<QSemaphore>(scheduler->concurrencyLimit(TaskScheduler::VisibleLoading));
+
+    BulkFileReader reader;
+    reader.readAll(fileNames, [&](FileReadResult& result) {
+        const int index = indexOfFile.value(result.fileName);
+        if (!result.error.isEmpty()) {
+            QMutexLocker lock(&mutex);
+            if (errors) errors->append(result.fileName + ": " + result.error);
+            return;
+        }
+
+        auto file = std::make_shared<FileReadResult>(std::move(result));
+        auto parse = [&, index, file] {
+            ModelPart* part = createPart(QFileInfo(file->fileName).fileName());
+            QString error;
+            if (part->loadSTL(file->buffer.data(), file->buffer.size(), &error)) {
+                parts[index] = part;
+            }
+            else {
+                delete part;
+                QMutexLocker lock(&mutex);
+                if (errors) errors->append(file->fileName + ": " + error);
+            }
+        };
+
+        // When the parsers are saturated, parse on the reader thread; this throttles reading
+        if (parseSlots->tryAcquire()) {
+            QFuture<void> future = scheduler->run(TaskScheduler::VisibleLoading, [parse, parseSlots] {
+                parse();
+                parseSlots->release();
+                });
+            QMutexLocker lock(&mutex);
+            futures.append(future);
+        }
+        else {
+            parse();
+        }
+        });
+
+    for (QFuture<void>& future : futures) {
+        scheduler->wait(future);
+    }
+
+    return buildHierarchy(QFileInfo(root.absolutePath()).fileName(), relativePaths, parts);
+}
+
+/**
+ * Imports every STL file in a ZIP archive. Entries are decompressed in memory and never written
+ * to disk.
+ *
+ * @param fileName The archive to import.
+ * @param errors Optional; receives one message per entry that could not be loaded, or for the
+ *        archive itself if it cannot be opened.
+ * @return A group named after the archive containing its files and folder groups, or nullptr if
+ *         no STL file could be loaded.
+ */
+ModelPart* AssemblyImporter::importZip(const QString& fileName, QStringList* errors) {
+    ZipArchive archive;
+    QString error;
+    if (!archive.open(fileName, &error)) {
+        if (errors) errors->append(fileName + ": " + error);
+        return nullptr;
+    }
+
+    std::vector<const ZipArchive::Entry*> entries;
+    for (const ZipArchive::Entry& entry : archive.entries()) {
+        if (entry.name.endsWith(".stl", Qt::CaseInsensitive)) {
+            entries.push_back(&entry);
+        }
+    }
+    std::sort(entries.begin(), entries.end(), [](const ZipArchive::Entry* a, const ZipArchive::Entry* b) {
+        return QString::compare(a->name, b->name, Qt::CaseInsensitive) < 0;
+        });
+
+    QStringList relativePaths;
+    for (const ZipArchive::Entry* entry : entries) {
+        relativePaths.append(entry->name);
+    }
+
+    // Each task decompresses and parses one entry, so only one decompressed buffer per thread is alive
+    std::vector<ModelPart*> parts(entries.size(), nullptr);
+    std::vector<int> indices(entries.size());
+    std::iota(indices.begin(), indices.end(), 0);
+    QMutex mutex; // Guards errors
+    TaskScheduler::instance()->blockingMap(TaskScheduler::VisibleLoading, indices, [&](int index) {
+        const ZipArchive::Entry& entry = *entries[index];
+        AlignedBuffer buffer;
+        QString error;
+        ModelPart* part = createPart(QFileInfo(entry.name).fileName());
+        if (archive.extract(entry, buffer, &error) && part->loadSTL(buffer.data(), buffer.size(), &error)) {
+            parts[index] = part;
+        }
+        else {
+            delete part;
+            QMutexLocker lock(&mutex);
+            if (errors) errors->append(fileName + "/" + entry.name + ": " + error);
+        }
+        });
+
+    return buildHierarchy(QFileInfo(fileName).completeBaseName(), relativePaths, parts);
+}
+
+/**
+ * Lists the STL files below a folder, scanning subfolders in parallel.
+ *
+ * @param path Absolute path of the folder to scan.
+ * @param prefix Path of the folder relative to the import root, empty for the root itself.
+ * @return Paths of the STL files relative to the import root, sorted folder by folder.
+ */
+QStringList AssemblyImporter::scanDirectory(const QString& path, const QString& prefix) {
+    QDir dir(path);
+    const QDir::SortFlags sort = QDir::Name | QDir::IgnoreCase;
+    QStringList subdirectories = dir.entryList(QDir::Dirs | QDir::NoDotAndDotDot | QDir::NoSymLinks, sort);
+
+    TaskScheduler* scheduler = TaskScheduler::instance();
+    QList<QFuture<QStringList>> scans;
+    for (const QString& subdirectory : subdirectories) {
+        QString subPrefix = prefix + subdirectory + "/";
+        QString subPath = dir.absoluteFilePath(subdirectory);
+        scans.append(scheduler->run(TaskScheduler::VisibleLoading, [subPath, subPrefix] {
+            return scanDirectory(subPath, subPrefix);
+            }));
+    }
+
+    QStringList files;
+    for (const QString& name : dir.entryList(QStringList() << "*.stl" << "*.STL", QDir::Files, sort)) {
+        files.append(prefix + name);
+    }
+    files.removeDuplicates(); // Case-insensitive file systems match both patterns
+
+    // Waiting runs queued tasks on this thread, so nested scans cannot stall the pool
+    for (QFuture<QStringList>& scan : scans) {
+        scheduler->wait(scan);
+        files.append(scan.result());
+    }
+    return files;
+}
+
+/**
+ * Creates a visible, white part with the given name.
+ */
+ModelPart* AssemblyImporter::createPart(const QString& name) {
+    ModelPart* part = new ModelPart({ QVariant(name), QVariant("true"), QVariant("255,255,255") });
+    part->setColour(255, 255, 255);
+    return part;
+}
+
+/**
+ * Arranges loaded parts into groups that mirror their folders.
+ *
+ * @param rootName Name of the top-level group.
+ * @param relativePaths Path of each part relative to the import root, using '/' separators.
+ * @param parts The part for each path, or nullptr where loading failed.
+ * @return The top-level group, or nullptr if every part failed to load.
+ */
+ModelPart* AssemblyImporter::buildHierarchy(const QString& rootName, const QStringList& relativePaths, const std::vector<ModelPart*>& parts) {
+    if (std::none_of(parts.begin(), parts.end(), [](ModelPart* part) { return part != nullptr; }))
+        return nullptr;
+
+    ModelPart* root = createPart(rootName);
+    QHash<QString, ModelPart*> groups; // Keyed by folder path relative to the root
+    for (int i = 0; i < relativePaths.size(); ++i) {
+        if (!parts[i])
+            continue;
+
+        // Groups are only created for folders that contain at least one loaded part
+        ModelPart* parent = root;
+        QStringList folders = relativePaths[i].split('/', Qt::SkipEmptyParts);
+        folders.removeLast();
+        QString folderPath;
+        for (const QString& folder : folders) {
+            folderPath += folder + "/";
+            ModelPart*& group = groups[folderPath];
+            if (!group) {
+                group = createPart(folder);
+                parent->appendChild(group);
+            }
+            parent = group;
+        }
+        parent->appendChild(parts[i]);
+    }
+    return root;
+}
@@ -0,0 +1,36 @@
+/**
+ * @file AssemblyImporter.h
+ *
+ * Defines the AssemblyImporter class, which turns a folder tree or ZIP archive of STL files into a
+ * ModelPart hierarchy with one group per folder. Folders are scanned in parallel, and files are
+ * read (or decompressed straight from the archive) and parsed concurrently. The resulting subtree is
+ * detached from the model so that it can be added to the tree in a single insertion.
+ */
+
+#ifndef VIEWER_ASSEMBLYIMPORTER_H
+#define VIEWER_ASSEMBLYIMPORTER_H
+
+#include <QString>
+#include <QStringList>
+#include <vector>
+#include "ModelPart.h"
+
+/**
+ * @class AssemblyImporter
+ * @brief Builds grouped ModelPart trees from folders and ZIP archives.
+ *
+ * All methods may be called from a worker thread; they do not touch the model or the renderer.
+ */
+class AssemblyImporter {
+public:
+    static ModelPart* importPath(const QString& path, QStringList* errors = nullptr);
+    static ModelPart* importDirectory(const QString& path, QStringList* errors = nullptr);
+    static ModelPart* importZip(const QString& fileName, QStringList* errors = nullptr);
+
+private:
+    static QStringList scanDirectory(const QString& path, const QString& prefix);
+    static ModelPart* createPart(const QString& name);
+    static ModelPart* buildHierarchy(const QString& rootName, const QStringList& relativePaths, const std::vector<ModelPart*>& parts);
+};
+
+#endif // VIEWER_ASSEMBLYIMPORTER_H
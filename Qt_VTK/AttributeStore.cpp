@@ -0,0 +1,572 @@
+/**
+ * @file AttributeStore.cpp
+ * @brief Implementation of the AttributeStore class.
+ */
+
+#include "AttributeStore.h"
+#include <QElapsedTimer>
+#include <QFile>
+#include <QRegularExpression>
+#include <QSet>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+/** Header names taken as the part name column, in order of preference. */
+const char* const kKeyColumns[] = { "name", "part", "part name", "part_name", "partname" };
+
+/** Picks the field separator from the header line: whichever of comma, semicolon and tab is most common. */
+QChar detectSeparator(const QString& text) {
+    const QString header = text.left(text.indexOf('\n'));
+    QChar best = ',';
+    int bestCount = header.count(',');
+    for (QChar candidate : { QChar(';'), QChar('\t') }) {
+        const int count = header.count(candidate);
+        if (count > bestCount) {
+            best = candidate;
+            bestCount = count;
+        }
+    }
+    return best;
+}
+
+/** Splits CSV text into records, following RFC 4180 quoting; blank lines are skipped. */
+QVector<QStringList> parseCsv(const QString& text, QChar separator) {
+    QVector<QStringList> records;
+    QStringList record;
+    QString field;
+    bool quoted = false;
+    bool fieldStarted = false;
+    for (int i = 0; i < text.size(); ++i) {
+        const QChar c = text[i];
+        if (quoted) {
+            if (c == '"') {
+                if (i + 1 < text.size() && text[i + 1] == '"') {
+                    field += '"';
+                    ++i;
+                }
+                else {
+                    quoted = false;
+                }
+            }
+            else {
+                field += c;
+            }
+        }
+        else if (c == '"') {
+            quoted = true;
+            fieldStarted = true;
+        }
+        else if (c == separator) {
+            record << field.trimmed();
+            field.clear();
+            fieldStarted = true;
+        }
+        else if (c == '\n' || c == '\r') {
+            if (fieldStarted || !field.isEmpty()) {
+                record << field.trimmed();
+                records << record;
+            }
+            record.clear();
+            field.clear();
+            fieldStarted = false;
+            if (c == '\r' && i + 1 < text.size() && text[i + 1] == '\n') ++i;
+        }
+        else {
+            field += c;
+            fieldStarted = true;
+        }
+    }
+    if (fieldStarted || !field.isEmpty()) {
+        record << field.trimmed();
+        records << record;
+    }
+    return records;
+}
+
+/** Removes one pair of surrounding quotes from a rule operand. */
+QString unquote(QString text) {
+    text = text.trimmed();
+    if (text.size() >= 2 && (text.startsWith('"') || text.startsWith('\'')) && text.endsWith(text[0]))
+        text = text.mid(1, text.size() - 2);
+    return text;
+}
+
+/** A distinct colour for each dictionary code, spreading hues by the golden angle. */
+QColor paletteColour(int code) {
+    return QColor::fromHsv(static_cast<int>(std::fmod(code * 137.508, 360.0)), 170, 230);
+}
+
+bool isNumeric(const QString& text) {
+    bool ok = false;
+    text.toDouble(&ok);
+    return ok;
+}
+
+} // namespace
+
+/**
+ * Constructor for the AttributeStore class.
+ *
+ * @param model The part tree; attributes of parts removed from it are dropped.
+ * @param parent The parent QObject.
+ */
+AttributeStore::AttributeStore(ModelPartList* model, QObject* parent)
+    : QObject(parent), model(model) {
+    connect(model, &QAbstractItemModel::rowsAboutToBeRemoved, this, &AttributeStore::onRowsAboutToBeRemoved);
+}
+
+/**
+ * Imports attributes from a CSV file with a header row. The column called name or part, or the
+ * first column if there is none, is joined to the part names; a part name matches if it is equal
+ * to the key ignoring case, surrounding spaces and an .stl extension. Every part with a matching
+ * name receives the row's other columns, replacing values it already had in those columns.
+ *
+ * @param fileName The CSV file.
+ * @param result Receives counts of what was joined.
+ * @param error Receives a description of the problem on failure.
+ * @return True if the file was read.
+ */
+bool AttributeStore::importCsv(const QString& fileName, ImportResult* result, QString* error) {
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        if (error) *error = file.errorString();
+        return false;
+    }
+    const QString text = QString::fromUtf8(file.readAll());
+    const QVector<QStringList> records = parseCsv(text, detectSeparator(text));
+    if (records.isEmpty() || records.first().isEmpty()) {
+        if (error) *error = tr("The file has no header row.");
+        return false;
+    }
+
+    // Columns of the file: the join key and the attributes
+    const QStringList header = records.first();
+    int keyColumn = 0;
+    for (int k = static_cast<int>(sizeof(kKeyColumns) / sizeof(kKeyColumns[0])) - 1; k >= 0; --k) {
+        for (int i = 0; i < header.size(); ++i) {
+            if (header[i].compare(QLatin1String(kKeyColumns[k]), Qt::CaseInsensitive) == 0) keyColumn = i;
+        }
+    }
+    QVector<int> targets(header.size(), -1);
+    ImportResult summary;
+    for (int i = 0; i < header.size(); ++i) {
+        if (i == keyColumn || header[i].isEmpty())
+            continue;
+        targets[i] = addColumn(header[i]);
+        summary.columns << header[i];
+    }
+
+    // Build side of the hash join: every part by normalised name
+    QHash<QString, QVector<ModelPart*>> partsByKey;
+    QVector<ModelPart*> stack = { model->getRootItem() };
+    while (!stack.isEmpty()) {
+        ModelPart* part = stack.takeLast();
+        if (part != model->getRootItem()) {
+            partsByKey[joinKey(part->data(0).toString())].append(part);
+        }
+        for (int i = 0; i < part->childCount(); ++i) {
+            stack.append(part->child(i));
+        }
+    }
+
+    // Probe side: each record looks up its parts
+    QSet<ModelPart*> joined;
+    for (int r = 1; r < records.size(); ++r) {
+        const QStringList& record = records[r];
+        if (keyColumn >= record.size() || record[keyColumn].isEmpty())
+            continue;
+        ++summary.rows;
+        auto match = partsByKey.constFind(joinKey(record[keyColumn]));
+        if (match == partsByKey.constEnd()) {
+            summary.unmatched << record[keyColumn];
+            continue;
+        }
+        ++summary.matched;
+        for (ModelPart* part : match.value()) {
+            int row = rowOf.value(part, -1);
+            if (row < 0) {
+                row = rowParts.size();
+                rowParts.append(part);
+                rowOf.insert(part, row);
+                for (Column& column : store) {
+                    column.codes.append(-1);
+                    column.numbers.append(std::numeric_limits<double>::quiet_NaN());
+                }
+            }
+            for (int i = 0; i < record.size() && i < targets.size(); ++i) {
+                if (targets[i] >= 0) setValue(store[targets[i]], row, record[i]);
+            }
+            joined.insert(part);
+        }
+    }
+    for (Column& column : store) {
+        column.indexed = false;
+    }
+
+    summary.parts = joined.size();
+    if (result) *result = summary;
+    return true;
+}
+
+/**
+ * Removes all attributes.
+ */
+void AttributeStore::clear() {
+    store.clear();
+    rowParts.clear();
+    rowOf.clear();
+}
+
+/**
+ * Lists the attribute columns.
+ *
+ * @return Column names in the order they were first imported.
+ */
+QStringList AttributeStore::columns() const {
+    QStringList names;
+    for (const Column& column : store) {
+        names << column.name;
+    }
+    return names;
+}
+
+/**
+ * Looks up one attribute of a part.
+ *
+ * @param part The part.
+ * @param column Column name, matched without regard to case.
+ * @return The value, or an empty string if the part has none.
+ */
+QString AttributeStore::value(ModelPart* part, const QString& column) const {
+    const int c = columnIndex(column);
+    const int row = rowOf.value(part, -1);
+    if (c < 0 || row < 0 || store[c].codes[row] < 0)
+        return QString();
+    return store[c].dictionary[store[c].codes[row]];
+}
+
+/**
+ * Finds the parts matching a query, using the column's indexes.
+ *
+ * @param query The query.
+ * @return The matching parts still in the tree, in no particular order.
+ */
+QVector<ModelPart*> AttributeStore::select(const Query& query) const {
+    QVector<ModelPart*> parts;
+    for (int row : selectRows(query)) {
+        parts.append(rowParts[row]);
+    }
+    return parts;
+}
+
+/**
+ * Works out what a list of rules does to the parts. Rules apply in order, so a later rule
+ * overrides the colour or visibility set by an earlier one. Nothing is changed here.
+ *
+ * @param rules The rules.
+ * @return The final colour and visibility of each part that any rule selected.
+ */
+AttributeStore::Outcome AttributeStore::evaluate(const QList<Rule>& rules) const {
+    QElapsedTimer timer;
+    timer.start();
+    Outcome outcome;
+    QHash<ModelPart*, int> slot;
+    auto entry = [&outcome, &slot](ModelPart* part) {
+        auto it = slot.constFind(part);
+        if (it != slot.constEnd())
+            return it.value();
+        const int i = outcome.parts.size();
+        slot.insert(part, i);
+        outcome.parts.append(part);
+        outcome.colours.append(QColor());
+        outcome.visibility.append(-1);
+        return i;
+    };
+
+    for (const Rule& rule : rules) {
+        const int c = columnIndex(rule.query.column);
+        if (c < 0) {
+            if (!outcome.unknownColumns.contains(rule.query.column)) outcome.unknownColumns << rule.query.column;
+            continue;
+        }
+        if (rule.action == Rule::ColourBy) {
+            const Column& column = indexed(c);
+            for (int code = 0; code < column.rowsByCode.size(); ++code) {
+                const QColor colour = paletteColour(code);
+                for (int row : column.rowsByCode[code]) {
+                    if (rowParts[row]) outcome.colours[entry(rowParts[row])] = colour;
+                }
+            }
+            continue;
+        }
+        for (int row : selectRows(rule.query)) {
+            const int i = entry(rowParts[row]);
+            if (rule.action == Rule::Colour) outcome.colours[i] = rule.colour;
+            else outcome.visibility[i] = rule.action == Rule::Show ? 1 : 0;
+        }
+    }
+    outcome.ms = timer.nsecsElapsed() / 1e6;
+    return outcome;
+}
+
+/**
+ * Parses one rule. Accepted forms, with keywords in any case:
+ * "colour by COLUMN", "colour COLOUR where CONDITION", "hide where CONDITION" and
+ * "show where CONDITION". COLOUR is a name such as red or #rrggbb. CONDITION is
+ * "COLUMN OP VALUE" with OP one of = != < <= > >=, "COLUMN contains TEXT" or
+ * "COLUMN between LOW and HIGH". Values may be quoted.
+ *
+ * @param text The rule.
+ * @param rule Receives the parsed rule.
+ * @param error Receives a description of the problem on failure.
+ * @return True if the rule was understood.
+ */
+bool AttributeStore::parseRule(const QString& text, Rule* rule, QString* error) {
+    static const QRegularExpression colourBy("^colou?r\\s+by\\s+(.+)$", QRegularExpression::CaseInsensitiveOption);
+    static const QRegularExpression action("^(hide|show|colou?r\\s+(\\S+))\\s+(?:where\\s+)?(.+)$", QRegularExpression::CaseInsensitiveOption);
+    static const QRegularExpression between("^(.+?)\\s+between\\s+(.+?)\\s+and\\s+(.+)$", QRegularExpression::CaseInsensitiveOption);
+    static const QRegularExpression contains("^(.+?)\\s+contains\\s+(.+)$", QRegularExpression::CaseInsensitiveOption);
+    static const QRegularExpression comparison("^(.+?)\\s*(<=|>=|!=|=|<|>)\\s*(.+)$");
+
+    Rule parsed;
+    const QString line = text.trimmed();
+    QRegularExpressionMatch match = colourBy.match(line);
+    if (match.hasMatch()) {
+        parsed.action = Rule::ColourBy;
+        parsed.query.column = unquote(match.captured(1));
+        *rule = parsed;
+        return true;
+    }
+
+    match = action.match(line);
+    if (!match.hasMatch()) {
+        if (error) *error = tr("Expected \"colour by\", \"colour\", \"hide\" or \"show\": %1").arg(line);
+        return false;
+    }
+    const QString verb = match.captured(1).toLower();
+    if (verb == "hide") parsed.action = Rule::Hide;
+    else if (verb == "show") parsed.action = Rule::Show;
+    else {
+        parsed.action = Rule::Colour;
+        parsed.colour = QColor(match.captured(2));
+        if (!parsed.colour.isValid()) {
+            if (error) *error = tr("Unknown colour: %1").arg(match.captured(2));
+            return false;
+        }
+    }
+
+    const QString condition = match.captured(3).trimmed();
+    Query& query = parsed.query;
+    if ((match = between.match(condition)).hasMatch()) {
+        query.column = unquote(match.captured(1));
+        query.op = Between;
+        query.value = unquote(match.captured(2));
+        query.upper = unquote(match.captured(3));
+    }
+    else if ((match = contains.match(condition)).hasMatch()) {
+        query.column = unquote(match.captured(1));
+        query.op = Contains;
+        query.value = unquote(match.captured(2));
+    }
+    else if ((match = comparison.match(condition)).hasMatch()) {
+        static const QHash<QString, Operator> operators = {
+            { "=", Equal }, { "!=", NotEqual }, { "<", Less }, { "<=", LessEqual }, { ">", Greater }, { ">=", GreaterEqual } };
+        query.column = unquote(match.captured(1));
+        query.op = operators.value(match.captured(2));
+        query.value = unquote(match.captured(3));
+    }
+    else {
+        if (error) *error = tr("Expected a condition such as \"type = fastener\": %1").arg(condition);
+        return false;
+    }
+
+    const bool ordered = query.op == Less || query.op == LessEqual || query.op == Greater || query.op == GreaterEqual || query.op == Between;
+    if (ordered && (!isNumeric(query.value) || (query.op == Between && !isNumeric(query.upper)))) {
+        if (error) *error = tr("Range comparisons need numbers: %1").arg(condition);
+        return false;
+    }
+    *rule = parsed;
+    return true;
+}
+
+/**
+ * Parses a rule list, one rule per line. Blank lines and lines starting with // are ignored.
+ *
+ * @param text The rules.
+ * @param rules Receives the parsed rules.
+ * @param error Receives the first problem, with its line number, on failure.
+ * @return True if every rule was understood.
+ */
+bool AttributeStore::parseRules(const QString& text, QList<Rule>* rules, QString* error) {
+    QList<Rule> parsed;
+    const QStringList lines = text.split('\n');
+    for (int i = 0; i < lines.size(); ++i) {
+        const QString line = lines[i].trimmed();
+        if (line.isEmpty() || line.startsWith("//"))
+            continue;
+        Rule rule;
+        QString problem;
+        if (!parseRule(line, &rule, &problem)) {
+            if (error) *error = tr("Line %1: %2").arg(i + 1).arg(problem);
+            return false;
+        }
+        parsed << rule;
+    }
+    *rules = parsed;
+    return true;
+}
+
+/**
+ * Drops the attributes of parts leaving the tree, so rules never reach a deleted part.
+ */
+void AttributeStore::onRowsAboutToBeRemoved(const QModelIndex& parent, int first, int last) {
+    ModelPart* parentPart = model->getItem(parent);
+    for (int row = first; row <= last; ++row) {
+        dropSubtree(parentPart->child(row));
+    }
+}
+
+void AttributeStore::dropSubtree(ModelPart* part) {
+    auto it = rowOf.find(part);
+    if (it != rowOf.end()) {
+        rowParts[it.value()] = nullptr;
+        rowOf.erase(it);
+    }
+    for (int i = 0; i < part->childCount(); ++i) {
+        dropSubtree(part->child(i));
+    }
+}
+
+int AttributeStore::columnIndex(const QString& name) const {
+    for (int i = 0; i < store.size(); ++i) {
+        if (store[i].name.compare(name, Qt::CaseInsensitive) == 0)
+            return i;
+    }
+    return -1;
+}
+
+/**
+ * Finds or creates a column, giving a new column an empty value in every existing row.
+ */
+int AttributeStore::addColumn(const QString& name) {
+    const int existing = columnIndex(name);
+    if (existing >= 0)
+        return existing;
+    Column column;
+    column.name = name;
+    column.codes.fill(-1, rowParts.size());
+    column.numbers.fill(std::numeric_limits<double>::quiet_NaN(), rowParts.size());
+    store.append(column);
+    return store.size() - 1;
+}
+
+void AttributeStore::setValue(Column& column, int row, const QString& value) {
+    if (value.isEmpty()) {
+        column.codes[row] = -1;
+        column.numbers[row] = std::numeric_limits<double>::quiet_NaN();
+        return;
+    }
+    auto it = column.codeOf.constFind(value);
+    if (it == column.codeOf.constEnd()) {
+        it = column.codeOf.insert(value, column.dictionary.size());
+        column.dictionary << value;
+    }
+    column.codes[row] = it.value();
+    bool ok = false;
+    const double number = value.toDouble(&ok);
+    column.numbers[row] = ok ? number : std::numeric_limits<double>::quiet_NaN();
+}
+
+/**
+ * Returns a column with its equality and range indexes built.
+ */
+const AttributeStore::Column& AttributeStore::indexed(int c) const {
+    const Column& column = store[c];
+    if (column.indexed)
+        return column;
+
+    column.rowsByCode = QVector<QVector<int>>(column.dictionary.size());
+    column.sorted.clear();
+    for (int row = 0; row < column.codes.size(); ++row) {
+        if (column.codes[row] < 0)
+            continue;
+        column.rowsByCode[column.codes[row]].append(row);
+        if (!std::isnan(column.numbers[row])) column.sorted.append(qMakePair(column.numbers[row], row));
+    }
+    std::sort(column.sorted.begin(), column.sorted.end());
+    column.indexed = true;
+    return column;
+}
+
+/**
+ * Evaluates a query on the indexes: text comparisons go through the dictionary, which has one
+ * entry per distinct value, and numeric ones through a binary search of the sorted values.
+ *
+ * @return Rows whose part is still in the tree.
+ */
+QVector<int> AttributeStore::selectRows(const Query& query) const {
+    QVector<int> rows;
+    const int c = columnIndex(query.column);
+    if (c < 0)
+        return rows;
+    const Column& column = indexed(c);
+
+    bool ok = false;
+    const double number = query.value.toDouble(&ok);
+    const double upper = query.upper.toDouble();
+    const double inf = std::numeric_limits<double>::infinity();
+    double low = -inf, high = inf;
+    bool lowOpen = false, highOpen = false;
+    switch (query.op) {
+    case Equal:
+    case NotEqual:
+    case Contains: {
+        // Numbers compare by value so that 2.5 matches 2.50; text ignores case
+        QVector<bool> hit(column.dictionary.size(), false);
+        for (int code = 0; code < column.dictionary.size(); ++code) {
+            const QString& entry = column.dictionary[code];
+            if (query.op == Contains) hit[code] = entry.contains(query.value, Qt::CaseInsensitive);
+            else if (ok && isNumeric(entry)) hit[code] = entry.toDouble() == number;
+            else hit[code] = entry.compare(query.value, Qt::CaseInsensitive) == 0;
+            if (query.op == NotEqual) hit[code] = !hit[code];
+        }
+        for (int code = 0; code < hit.size(); ++code) {
+            if (hit[code]) rows += column.rowsByCode[code];
+        }
+        break;
+    }
+    case Less: high = number; highOpen = true; break;
+    case LessEqual: high = number; break;
+    case Greater: low = number; lowOpen = true; break;
+    case GreaterEqual: low = number; break;
+    case Between: low = std::min(number, upper); high = std::max(number, upper); break;
+    }
+
+    if (query.op != Equal && query.op != NotEqual && query.op != Contains) {
+        auto begin = lowOpen
+            ? std::upper_bound(column.sorted.begin(), column.sorted.end(), low, [](double v, const QPair<double, int>& p) { return v < p.first; })
+            : std::lower_bound(column.sorted.begin(), column.sorted.end(), low, [](const QPair<double, int>& p, double v) { return p.first < v; });
+        auto end = highOpen
+            ? std::lower_bound(begin, column.sorted.end(), high, [](const QPair<double, int>& p, double v) { return p.first < v; })
+            : std::upper_bound(begin, column.sorted.end(), high, [](double v, const QPair<double, int>& p) { return v < p.first; });
+        for (auto it = begin; it != end; ++it) {
+            rows.append(it->second);
+        }
+    }
+
+    rows.erase(std::remove_if(rows.begin(), rows.end(), [this](int row) { return rowParts[row] == nullptr; }), rows.end());
+    return rows;
+}
+
+/**
+ * Normalises a part name or CSV key for the join: surrounding spaces, letter case and an .stl
+ * extension are ignored, as parts are usually named after their STL files.
+ */
+QString AttributeStore::joinKey(const QString& name) {
+    QString key = name.trimmed().toCaseFolded();
+    if (key.endsWith(".stl")) key.chop(4);
+    return key;
+}
@@ -0,0 +1,120 @@
+/**
+ * @file AttributeStore.h
+ *
+ * Defines the AttributeStore class, which holds BOM metadata such as supplier, material or
+ * revision for the parts in the tree and colours or hides parts by rules over it.
+ *
+ * Attributes are imported from CSV files and joined to parts by name: the parts are hashed by a
+ * normalised name once and every CSV row probes that table. They are stored by column, each part
+ * joined being one row, and each column keeps its distinct values in a dictionary so that a row
+ * holds only a small code, plus the value as a number where it parses as one. Equality queries use
+ * an index from dictionary code to rows; range queries use the rows sorted by number. Both indexes
+ * are built on first use after an import.
+ *
+ * Rules are short lines of text, e.g. "colour by supplier", "hide where type = fastener" or
+ * "colour #ff8000 where mass > 2.5". evaluate() resolves a list of them to the colour and
+ * visibility of each affected part without touching the parts, so the caller can apply the
+ * outcome to the scene in one batch.
+ */
+
+#ifndef VIEWER_ATTRIBUTESTORE_H
+#define VIEWER_ATTRIBUTESTORE_H
+
+#include <QColor>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QPair>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include "ModelPart.h"
+#include "ModelPartList.h"
+
+/**
+ * @class AttributeStore
+ * @brief Columnar part attributes with indexed queries and rule-based colouring.
+ */
+class AttributeStore : public QObject {
+    Q_OBJECT
+
+public:
+    /** Comparison in a query. */
+    enum Operator { Equal, NotEqual, Less, LessEqual, Greater, GreaterEqual, Between, Contains };
+
+    /** Selects the parts whose value in a column satisfies a comparison. */
+    struct Query {
+        QString column; ///< Column name, matched without regard to case.
+        Operator op = Equal; ///< Comparison.
+        QString value; ///< Operand; numeric comparisons parse it as a number.
+        QString upper; ///< Upper bound for Between.
+    };
+
+    /** One line of a rule list. */
+    struct Rule {
+        enum Action { Colour, ColourBy, Hide, Show };
+        Action action = Colour; ///< What to do with the selected parts.
+        Query query; ///< Parts the rule applies to; ColourBy applies to every part with a value in its column.
+        QColor colour; ///< Colour for Colour.
+    };
+
+    /** Summary of one CSV import. */
+    struct ImportResult {
+        int rows = 0; ///< Data rows read.
+        int matched = 0; ///< Rows that matched at least one part.
+        int parts = 0; ///< Parts that received attributes.
+        QStringList unmatched; ///< Keys of rows that matched no part.
+        QStringList columns; ///< Attribute columns read.
+    };
+
+    /** What a rule list does to the parts it touches. */
+    struct Outcome {
+        QVector<ModelPart*> parts; ///< Parts with a changed colour or visibility.
+        QVector<QColor> colours; ///< New colour of each, or invalid to keep it.
+        QVector<int> visibility; ///< New visibility of each: 1 shown, 0 hidden, -1 unchanged.
+        QStringList unknownColumns; ///< Columns named by rules that the store does not have.
+        double ms = 0.0; ///< Time taken to evaluate the rules.
+    };
+
+    explicit AttributeStore(ModelPartList* model, QObject* parent = nullptr);
+
+    bool importCsv(const QString& fileName, ImportResult* result, QString* error = nullptr);
+    void clear();
+    QStringList columns() const;
+    QString value(ModelPart* part, const QString& column) const;
+    QVector<ModelPart*> select(const Query& query) const;
+    Outcome evaluate(const QList<Rule>& rules) const;
+
+    static bool parseRule(const QString& text, Rule* rule, QString* error = nullptr);
+    static bool parseRules(const QString& text, QList<Rule>* rules, QString* error = nullptr);
+
+private:
+    /** One attribute over all rows. */
+    struct Column {
+        QString name; ///< Name as given in the CSV header.
+        QVector<int> codes; ///< Dictionary code of each row's value, or -1 if the row has none.
+        QStringList dictionary; ///< Distinct values.
+        QHash<QString, int> codeOf; ///< Code of each distinct value.
+        QVector<double> numbers; ///< Each row's value as a number, or NaN.
+        mutable QVector<QVector<int>> rowsByCode; ///< Equality index; empty until first needed.
+        mutable QVector<QPair<double, int>> sorted; ///< Range index: numeric values with their rows, ascending.
+        mutable bool indexed = false; ///< Whether rowsByCode and sorted are up to date.
+    };
+
+    void onRowsAboutToBeRemoved(const QModelIndex& parent, int first, int last);
+    void dropSubtree(ModelPart* part);
+    int columnIndex(const QString& name) const;
+    int addColumn(const QString& name);
+    void setValue(Column& column, int row, const QString& value);
+    const Column& indexed(int column) const;
+    QVector<int> selectRows(const Query& query) const;
+
+    static QString joinKey(const QString& name);
+
+    ModelPartList* model; ///< The part tree.
+    QVector<Column> store; ///< Attribute columns.
+    QVector<ModelPart*> rowParts; ///< Part of each row, or nullptr once it has left the tree.
+    QHash<ModelPart*, int> rowOf; ///< Row of each part with attributes.
+};
+
+#endif // VIEWER_ATTRIBUTESTORE_H
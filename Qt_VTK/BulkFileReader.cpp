@@ -0,0 +1,417 @@
+/**
+ * @file BulkFileReader.cpp
+ * @brief Implementation of the BulkFileReader and AlignedBuffer classes.
+ *
+ * Reads are buffered (not O_DIRECT) so that the posix_fadvise read-ahead hints can fill the page
+ * cache for files further down the queue while earlier files are still being read.
+ */
+
+#include "BulkFileReader.h"
+#include <QFile>
+#include <QFuture>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "TaskScheduler.h"
+
+#ifdef Q_OS_UNIX
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef Q_OS_WIN
+#include <malloc.h>
+#endif
+
+#ifdef VIEWER_HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+namespace {
+
+const size_t kChunkSize = 1 << 20; ///< Size of each read request in bytes.
+const int kReadAheadFiles = 8; ///< Number of queued files announced to the kernel ahead of time.
+
+} // namespace
+
+/**
+ * Constructs an empty buffer.
+ */
+AlignedBuffer::AlignedBuffer() : m_data(nullptr), m_size(0) {
+}
+
+/**
+ * Allocates an aligned buffer.
+ *
+ * @param size Number of bytes of data the buffer must hold.
+ */
+AlignedBuffer::AlignedBuffer(size_t size) : m_data(nullptr), m_size(size) {
+    size_t allocation = (size + 1 + alignment - 1) / alignment * alignment;
+#ifdef Q_OS_WIN
+    m_data = static_cast<char*>(_aligned_malloc(allocation, alignment));
+#else
+    void* memory = nullptr;
+    if (posix_memalign(&memory, alignment, allocation) == 0) {
+        m_data = static_cast<char*>(memory);
+    }
+#endif
+    if (m_data) {
+        m_data[size] = '\0';
+    }
+    else {
+        m_size = 0;
+    }
+}
+
+AlignedBuffer::AlignedBuffer(AlignedBuffer&& other) noexcept : m_data(other.m_data), m_size(other.m_size) {
+    other.m_data = nullptr;
+    other.m_size = 0;
+}
+
+AlignedBuffer& AlignedBuffer::operator=(AlignedBuffer&& other) noexcept {
+    std::swap(m_data, other.m_data);
+    std::swap(m_size, other.m_size);
+    return *this;
+}
+
+/**
+ * Frees the buffer.
+ */
+AlignedBuffer::~AlignedBuffer() {
+#ifdef Q_OS_WIN
+    _aligned_free(m_data);
+#else
+    std::free(m_data);
+#endif
+}
+
+char* AlignedBuffer::data() {
+    return m_data;
+}
+
+const char* AlignedBuffer::data() const {
+    return m_data;
+}
+
+size_t AlignedBuffer::size() const {
+    return m_size;
+}
+
+/**
+ * Constructor for the BulkFileReader class.
+ *
+ * @param threadCount Files the pread backend reads at once; 0 for as many as the task scheduler
+ *                    lets loading tasks run, plus the calling thread.
+ * @param queueDepth Maximum number of reads in flight for the io_uring backend.
+ */
+BulkFileReader::BulkFileReader(int threadCount, int queueDepth)
+    : threadCount(threadCount > 0 ? threadCount : TaskScheduler::instance()->concurrencyLimit(TaskScheduler::VisibleLoading) + 1),
+    queueDepth(queueDepth) {
+}
+
+/**
+ * Gets the name of the backend readAll() will try first.
+ *
+ * @return "io_uring" when built with liburing, otherwise "pread".
+ */
+QString BulkFileReader::backendName() {
+#ifdef VIEWER_HAVE_LIBURING
+    return "io_uring";
+#else
+    return "pread";
+#endif
+}
+
+/**
+ * Reads every file in the list and passes each one to the callback as soon as it is complete.
+ *
+ * Blocks until all files have been read and all callbacks have returned. Files that cannot be
+ * read are still reported, with an error message and an empty buffer.
+ *
+ * @param fileNames The files to read.
+ * @param onFileRead Called once per file with its contents.
+ * @return The total number of bytes read.
+ */
+qint64 BulkFileReader::readAll(const QStringList& fileNames, const Callback& onFileRead) {
+    bool supported = false;
+    qint64 bytes = readWithUring(fileNames, onFileRead, supported);
+    if (supported)
+        return bytes;
+    return readWithThreads(fileNames, onFileRead);
+}
+
+/**
+ * Asks the kernel to start reading a file into the page cache.
+ *
+ * @param fileName The file that will be read soon.
+ */
+void BulkFileReader::adviseWillNeed(const QString& fileName) {
+#ifdef Q_OS_UNIX
+    int fd = ::open(QFile::encodeName(fileName).constData(), O_RDONLY);
+    if (fd >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+        ::close(fd);
+    }
+#else
+    Q_UNUSED(fileName);
+#endif
+}
+
+/**
+ * Reads files with io_uring, keeping up to queueDepth chunk reads in flight across several files.
+ *
+ * @param fileNames The files to read.
+ * @param onFileRead Called from this thread once per file.
+ * @param supported Set to false if io_uring is unavailable, in which case nothing was read.
+ * @return The total number of bytes read.
+ */
+qint64 BulkFileReader::readWithUring(const QStringList& fileNames, const Callback& onFileRead, bool& supported) {
+    supported = false;
+#ifdef VIEWER_HAVE_LIBURING
+    struct io_uring ring;
+    if (io_uring_queue_init(static_cast<unsigned>(queueDepth), &ring, 0) < 0)
+        return 0; // Kernel without io_uring (or blocked by seccomp); fall back to threads
+    supported = true;
+
+    struct OpenFile {
+        int fd = -1;
+        size_t submitted = 0; ///< Bytes requested so far.
+        size_t completed = 0; ///< Bytes received so far.
+        int inflight = 0; ///< Requests not yet completed.
+        bool reported = false; ///< Whether the callback has been called.
+        FileReadResult result;
+    };
+    struct Chunk {
+        int file;
+        size_t offset;
+        size_t length;
+    };
+
+    const int count = static_cast<int>(fileNames.size());
+    std::vector<OpenFile> files(count);
+    int opened = 0; // Files [0, opened) have been opened
+    int current = 0; // First file that still has bytes to request
+    int finished = 0;
+    int inflight = 0;
+    qint64 totalBytes = 0;
+
+    auto openFile = [&](int index) {
+        OpenFile& file = files[index];
+        file.result.fileName = fileNames[index];
+        file.fd = ::open(QFile::encodeName(fileNames[index]).constData(), O_RDONLY);
+        struct stat info;
+        if (file.fd < 0 || fstat(file.fd, &info) != 0) {
+            file.result.error = QString::fromLocal8Bit(std::strerror(errno));
+            return;
+        }
+        posix_fadvise(file.fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        posix_fadvise(file.fd, 0, 0, POSIX_FADV_WILLNEED);
+        file.result.buffer = AlignedBuffer(static_cast<size_t>(info.st_size));
+        if (!file.result.buffer.data()) {
+            file.result.error = "Out of memory";
+        }
+    };
+
+    auto finishFile = [&](int index) {
+        OpenFile& file = files[index];
+        if (file.fd >= 0) ::close(file.fd);
+        file.fd = -1;
+        file.reported = true;
+        if (!file.result.error.isEmpty()) file.result.buffer = AlignedBuffer();
+        totalBytes += static_cast<qint64>(file.completed);
+        onFileRead(file.result);
+        file.result = FileReadResult();
+        ++finished;
+    };
+
+    auto submit = [&](int index, size_t offset, size_t length) {
+        struct io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+        if (!sqe) {
+            io_uring_submit(&ring); // The submission queue is full; hand its reads to the kernel
+            sqe = io_uring_get_sqe(&ring);
+        }
+        if (!sqe) {
+            // Still no free entry: read the chunk directly, as the pread backend would
+            OpenFile& file = files[index];
+            while (length > 0 && file.result.error.isEmpty()) {
+                ssize_t n = ::pread(file.fd, file.result.buffer.data() + offset, length, static_cast<off_t>(offset));
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) {
+                    file.result.error = n < 0 ? QString::fromLocal8Bit(std::strerror(errno)) : QString("File shrank while it was being read");
+                    break;
+                }
+                file.completed += static_cast<size_t>(n);
+                offset += static_cast<size_t>(n);
+                length -= static_cast<size_t>(n);
+            }
+            return;
+        }
+        Chunk* chunk = new Chunk{ index, offset, length };
+        io_uring_prep_read(sqe, files[index].fd, files[index].result.buffer.data() + offset, static_cast<unsigned>(length), offset);
+        io_uring_sqe_set_data(sqe, chunk);
+        ++files[index].inflight;
+        ++inflight;
+    };
+
+    while (finished < count) {
+        // Keep the read-ahead window of opened files ahead of the file being requested
+        while (opened < count && opened < current + kReadAheadFiles) {
+            openFile(opened++);
+        }
+
+        // Fill the submission queue
+        while (inflight < queueDepth && current < count) {
+            OpenFile& file = files[current];
+            size_t size = file.result.buffer.size();
+            if (!file.result.error.isEmpty() || file.submitted >= size) {
+                if (file.inflight == 0 && !file.reported) {
+                    finishFile(current);
+                }
+                ++current;
+                if (opened < count && opened < current + kReadAheadFiles) openFile(opened++);
+                continue;
+            }
+            size_t length = std::min(kChunkSize, size - file.submitted);
+            submit(current, file.submitted, length);
+            file.submitted += length;
+        }
+
+        if (inflight == 0)
+            continue;
+
+        io_uring_submit(&ring);
+        struct io_uring_cqe* cqe;
+        if (io_uring_wait_cqe(&ring, &cqe) < 0)
+            continue;
+
+        // Drain every completion that is ready
+        do {
+            Chunk* chunk = static_cast<Chunk*>(io_uring_cqe_get_data(cqe));
+            int res = cqe->res;
+            io_uring_cqe_seen(&ring, cqe);
+            --inflight;
+
+            OpenFile& file = files[chunk->file];
+            --file.inflight;
+            if (res < 0) {
+                file.result.error = QString::fromLocal8Bit(std::strerror(-res));
+            }
+            else if (res == 0 && chunk->length > 0) {
+                file.result.error = "File shrank while it was being read";
+            }
+            else {
+                file.completed += static_cast<size_t>(res);
+                if (static_cast<size_t>(res) < chunk->length) {
+                    submit(chunk->file, chunk->offset + res, chunk->length - res); // Short read
+                }
+            }
+
+            bool done = file.inflight == 0 && (!file.result.error.isEmpty() || file.completed >= file.result.buffer.size());
+            if (done && chunk->file < current && !file.reported) {
+                finishFile(chunk->file); // Files at or after current are reported by the submission loop
+            }
+            delete chunk;
+        } while (io_uring_peek_cqe(&ring, &cqe) == 0);
+    }
+
+    io_uring_queue_exit(&ring);
+    return totalBytes;
+#else
+    Q_UNUSED(fileNames);
+    Q_UNUSED(onFileRead);
+    return 0;
+#endif
+}
+
+/**
+ * Reads files on the calling thread and on loading tasks of the shared TaskScheduler, each
+ * reading whole files with pread (or QFile off Unix). The readers take the scheduler's threads
+ * rather than their own, so reading, and parsing in the callback, cannot oversubscribe the cores
+ * alongside the scheduler's other work.
+ *
+ * @param fileNames The files to read.
+ * @param onFileRead Called from the reader threads once per file.
+ * @return The total number of bytes read.
+ */
+qint64 BulkFileReader::readWithThreads(const QStringList& fileNames, const Callback& onFileRead) {
+    const int count = static_cast<int>(fileNames.size());
+    std::atomic<int> next(0);
+    std::atomic<qint64> totalBytes(0);
+
+    auto worker = [&]() {
+        for (int index = next++; index < count; index = next++) {
+            // Announce the file this thread will most likely read next
+            if (index + threadCount < count) {
+                adviseWillNeed(fileNames[index + threadCount]);
+            }
+
+            FileReadResult result;
+            result.fileName = fileNames[index];
+#ifdef Q_OS_UNIX
+            int fd = ::open(QFile::encodeName(result.fileName).constData(), O_RDONLY);
+            struct stat info;
+            if (fd < 0 || fstat(fd, &info) != 0) {
+                result.error = QString::fromLocal8Bit(std::strerror(errno));
+            }
+            else {
+                posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+                result.buffer = AlignedBuffer(static_cast<size_t>(info.st_size));
+                if (!result.buffer.data()) {
+                    result.error = "Out of memory";
+                }
+                size_t done = 0;
+                while (result.error.isEmpty() && done < result.buffer.size()) {
+                    ssize_t n = ::pread(fd, result.buffer.data() + done, std::min(kChunkSize, result.buffer.size() - done), static_cast<off_t>(done));
+                    if (n < 0 && errno == EINTR) continue;
+                    if (n <= 0) result.error = n < 0 ? QString::fromLocal8Bit(std::strerror(errno)) : QString("File shrank while it was being read");
+                    else done += static_cast<size_t>(n);
+                }
+                totalBytes += static_cast<qint64>(done);
+            }
+            if (fd >= 0) ::close(fd);
+#else
+            QFile file(result.fileName);
+            if (!file.open(QIODevice::ReadOnly)) {
+                result.error = file.errorString();
+            }
+            else {
+                result.buffer = AlignedBuffer(static_cast<size_t>(file.size()));
+                if (!result.buffer.data()) {
+                    result.error = "Out of memory";
+                }
+                qint64 done = 0;
+                while (result.error.isEmpty() && done < static_cast<qint64>(result.buffer.size())) {
+                    qint64 n = file.read(result.buffer.data() + done, static_cast<qint64>(result.buffer.size()) - done);
+                    if (n <= 0) {
+                        result.error = file.errorString();
+                        break;
+                    }
+                    done += n;
+                }
+                totalBytes += done;
+            }
+#endif
+            if (!result.error.isEmpty()) result.buffer = AlignedBuffer();
+            onFileRead(result);
+        }
+    };
+
+    for (int i = 0; i < std::min(threadCount, count); ++i) {
+        adviseWillNeed(fileNames[i]);
+    }
+
+    TaskScheduler* scheduler = TaskScheduler::instance();
+    std::vector<QFuture<void>> readers;
+    for (int i = 1; i < std::min(threadCount, count); ++i) {
+        readers.push_back(scheduler->run(TaskScheduler::VisibleLoading, worker));
+    }
+    worker();
+    for (const QFuture<void>& reader : readers) {
+        scheduler->wait(reader); // Readers that start after the last file was taken return at once
+    }
+    return totalBytes;
+}
@@ -0,0 +1,79 @@
+/**
+ * @file BulkFileReader.h
+ *
+ * Defines the BulkFileReader class, the I/O engine used when importing many files at once. On Linux
+ * builds with liburing it keeps a deep queue of reads in flight through io_uring; otherwise it reads
+ * with pread on the calling thread and on loading tasks of the shared TaskScheduler. Either way, upcoming files are announced to the kernel
+ * with posix_fadvise so their read-ahead overlaps with the current reads, and each file lands in a
+ * single page-aligned buffer that is handed directly to the parser.
+ */
+
+#ifndef VIEWER_BULKFILEREADER_H
+#define VIEWER_BULKFILEREADER_H
+
+#include <QString>
+#include <QStringList>
+#include <cstddef>
+#include <functional>
+
+/**
+ * @class AlignedBuffer
+ * @brief Move-only heap buffer aligned to the page size.
+ *
+ * One zero byte is kept after the data so text parsers may treat the contents as a C string.
+ */
+class AlignedBuffer {
+public:
+    AlignedBuffer();
+    explicit AlignedBuffer(size_t size);
+    AlignedBuffer(AlignedBuffer&& other) noexcept;
+    AlignedBuffer& operator=(AlignedBuffer&& other) noexcept;
+    AlignedBuffer(const AlignedBuffer&) = delete;
+    AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+    ~AlignedBuffer();
+
+    char* data();
+    const char* data() const;
+    size_t size() const;
+
+    static const size_t alignment = 4096; ///< Alignment of the data pointer in bytes.
+
+private:
+    char* m_data; ///< Start of the buffer, or nullptr when empty.
+    size_t m_size; ///< Number of bytes of file data.
+};
+
+/**
+ * @struct FileReadResult
+ * @brief The contents of one file read by BulkFileReader.
+ */
+struct FileReadResult {
+    QString fileName; ///< Path of the file that was read.
+    AlignedBuffer buffer; ///< File contents; empty if the read failed.
+    QString error; ///< Description of the failure, empty on success.
+};
+
+/**
+ * @class BulkFileReader
+ * @brief Reads a list of files as fast as the storage allows.
+ */
+class BulkFileReader {
+public:
+    /** Called once per file. May be called from several reader threads at the same time. */
+    using Callback = std::function<void(FileReadResult& result)>;
+
+    explicit BulkFileReader(int threadCount = 0, int queueDepth = 64);
+
+    qint64 readAll(const QStringList& fileNames, const Callback& onFileRead);
+    static QString backendName();
+
+private:
+    qint64 readWithUring(const QStringList& fileNames, const Callback& onFileRead, bool& supported);
+    qint64 readWithThreads(const QStringList& fileNames, const Callback& onFileRead);
+    static void adviseWillNeed(const QString& fileName);
+
+    int threadCount; ///< Files the pread backend reads at once.
+    int queueDepth; ///< Maximum number of reads in flight for the io_uring backend.
+};
+
+#endif // VIEWER_BULKFILEREADER_H
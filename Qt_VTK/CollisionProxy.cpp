@@ -0,0 +1,331 @@
+/**
+ * @file CollisionProxy.cpp
+ * @brief Implementation of the CollisionProxy class.
+ */
+
+#include "CollisionProxy.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <utility>
+
+namespace {
+
+const size_t kSampleTriangles = 200000; ///< Triangles looked at per piece when finding extreme points.
+const size_t kDepthSamples = 2000; ///< Triangle centroids tested against each hull for concavity.
+const double kPi = 3.14159265358979323846;
+
+/** A face of a hull under construction, with its outward plane. */
+struct Face {
+    int v[3]; ///< Vertex indices, counter-clockwise seen from outside.
+    double n[3]; ///< Unit outward normal.
+    double d; ///< Plane offset: n . x = d on the face.
+};
+
+/** A piece of the mesh and the hull that stands in for it. */
+struct Piece {
+    std::vector<uint32_t> triangles; ///< Indices of the piece's triangles in the mesh.
+    CollisionProxy::Hull hull; ///< Convex hull of the piece's extreme points.
+    double concavity = 0.0; ///< Deepest piece point below the hull, relative to the piece's diagonal.
+    bool final = false; ///< Whether the piece could not be split.
+};
+
+/**
+ * Spreads directions evenly over the sphere on a Fibonacci spiral.
+ */
+std::vector<double> sphereDirections(int count) {
+    std::vector<double> directions(3 * count);
+    const double golden = kPi * (3.0 - std::sqrt(5.0));
+    for (int i = 0; i < count; ++i) {
+        const double z = 1.0 - (2.0 * i + 1.0) / count;
+        const double r = std::sqrt(std::max(0.0, 1.0 - z * z));
+        directions[3 * i] = r * std::cos(golden * i);
+        directions[3 * i + 1] = r * std::sin(golden * i);
+        directions[3 * i + 2] = z;
+    }
+    return directions;
+}
+
+/**
+ * Makes a face through three points, or returns false if they are collinear.
+ */
+bool makeFace(const std::vector<double>& p, int a, int b, int c, Face& face) {
+    const double* pa = &p[3 * a];
+    const double* pb = &p[3 * b];
+    const double* pc = &p[3 * c];
+    const double e1[3] = { pb[0] - pa[0], pb[1] - pa[1], pb[2] - pa[2] };
+    const double e2[3] = { pc[0] - pa[0], pc[1] - pa[1], pc[2] - pa[2] };
+    double n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+    const double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if (length == 0.0)
+        return false;
+    face = { { a, b, c }, { n[0] / length, n[1] / length, n[2] / length }, 0.0 };
+    face.d = face.n[0] * pa[0] + face.n[1] * pa[1] + face.n[2] * pa[2];
+    return true;
+}
+
+/**
+ * Builds the faces of the convex hull of a few points by adding them one at a time and replacing
+ * the faces each new point can see. Returns no faces if the points are flat.
+ */
+std::vector<Face> convexHull(const std::vector<double>& p, double scale) {
+    const int count = static_cast<int>(p.size() / 3);
+    const double eps = 1e-9 * scale;
+    auto distance2 = [&](int a, int b) {
+        double s = 0.0;
+        for (int k = 0; k < 3; ++k) s += (p[3 * a + k] - p[3 * b + k]) * (p[3 * a + k] - p[3 * b + k]);
+        return s;
+    };
+    if (count < 4)
+        return {};
+
+    // Initial tetrahedron from far-apart points
+    int i1 = 0;
+    for (int i = 1; i < count; ++i) if (distance2(0, i) > distance2(0, i1)) i1 = i;
+    int i2 = -1;
+    double best = 0.0;
+    for (int i = 0; i < count; ++i) {
+        const double e1[3] = { p[3 * i1] - p[0], p[3 * i1 + 1] - p[1], p[3 * i1 + 2] - p[2] };
+        const double e2[3] = { p[3 * i] - p[0], p[3 * i + 1] - p[1], p[3 * i + 2] - p[2] };
+        const double n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+        const double area = n[0] * n[0] + n[1] * n[1] + n[2] * n[2];
+        if (area > best) {
+            best = area;
+            i2 = i;
+        }
+    }
+    if (i2 < 0)
+        return {};
+    Face base;
+    makeFace(p, 0, i1, i2, base);
+    int i3 = -1;
+    best = eps;
+    for (int i = 0; i < count; ++i) {
+        const double h = std::fabs(base.n[0] * p[3 * i] + base.n[1] * p[3 * i + 1] + base.n[2] * p[3 * i + 2] - base.d);
+        if (h > best) {
+            best = h;
+            i3 = i;
+        }
+    }
+    if (i3 < 0)
+        return {};
+
+    std::vector<Face> faces;
+    const int tetra[4][3] = { { 0, i1, i2 }, { 0, i2, i3 }, { 0, i3, i1 }, { i1, i3, i2 } };
+    double centre[3];
+    for (int k = 0; k < 3; ++k) centre[k] = (p[k] + p[3 * i1 + k] + p[3 * i2 + k] + p[3 * i3 + k]) / 4.0;
+    for (const auto& t : tetra) {
+        Face f;
+        makeFace(p, t[0], t[1], t[2], f);
+        if (f.n[0] * centre[0] + f.n[1] * centre[1] + f.n[2] * centre[2] > f.d) {
+            makeFace(p, t[0], t[2], t[1], f); // Turn it to face outwards
+        }
+        faces.push_back(f);
+    }
+
+    for (int i = 0; i < count; ++i) {
+        if (i == 0 || i == i1 || i == i2 || i == i3)
+            continue;
+        const double* q = &p[3 * i];
+        std::vector<char> visible(faces.size(), 0);
+        std::map<std::pair<int, int>, int> edges; // Directed edges of visible faces
+        bool any = false;
+        for (size_t f = 0; f < faces.size(); ++f) {
+            if (faces[f].n[0] * q[0] + faces[f].n[1] * q[1] + faces[f].n[2] * q[2] - faces[f].d > eps) {
+                visible[f] = 1;
+                any = true;
+                for (int e = 0; e < 3; ++e) edges[{ faces[f].v[e], faces[f].v[(e + 1) % 3] }] = 1;
+            }
+        }
+        if (!any)
+            continue;
+
+        std::vector<Face> kept;
+        for (size_t f = 0; f < faces.size(); ++f) {
+            if (!visible[f]) kept.push_back(faces[f]);
+        }
+        for (const auto& edge : edges) {
+            const int a = edge.first.first, b = edge.first.second;
+            if (edges.count({ b, a }))
+                continue; // Interior to the visible region
+            Face f;
+            if (makeFace(p, a, b, i, f)) kept.push_back(f);
+        }
+        faces.swap(kept);
+    }
+    return faces;
+}
+
+/**
+ * Fills a piece's hull with the piece's extreme points along each direction and measures how far
+ * the piece falls inside it.
+ */
+void fitHull(Piece& piece, const float* points, const uint32_t* triangles, const std::vector<double>& directions) {
+    const int directionCount = static_cast<int>(directions.size() / 3);
+    std::vector<double> bestDot(directionCount, -1e300);
+    std::vector<uint32_t> bestVertex(directionCount, 0);
+    const size_t stride = std::max<size_t>(1, piece.triangles.size() / kSampleTriangles);
+    float bounds[6] = { 1e30f, -1e30f, 1e30f, -1e30f, 1e30f, -1e30f };
+    for (size_t t = 0; t < piece.triangles.size(); t += stride) {
+        for (int c = 0; c < 3; ++c) {
+            const uint32_t v = triangles[3 * piece.triangles[t] + c];
+            const float* q = points + 3 * v;
+            for (int k = 0; k < 3; ++k) {
+                bounds[2 * k] = std::min(bounds[2 * k], q[k]);
+                bounds[2 * k + 1] = std::max(bounds[2 * k + 1], q[k]);
+            }
+            for (int d = 0; d < directionCount; ++d) {
+                const double dot = directions[3 * d] * q[0] + directions[3 * d + 1] * q[1] + directions[3 * d + 2] * q[2];
+                if (dot > bestDot[d]) {
+                    bestDot[d] = dot;
+                    bestVertex[d] = v;
+                }
+            }
+        }
+    }
+
+    std::sort(bestVertex.begin(), bestVertex.end());
+    bestVertex.erase(std::unique(bestVertex.begin(), bestVertex.end()), bestVertex.end());
+    std::vector<double> hullPoints;
+    piece.hull.vertices.clear();
+    for (uint32_t v : bestVertex) {
+        for (int k = 0; k < 3; ++k) {
+            piece.hull.vertices.push_back(points[3 * v + k]);
+            hullPoints.push_back(points[3 * v + k]);
+        }
+    }
+    for (int k = 0; k < 6; ++k) {
+        piece.hull.bounds[k] = bounds[k];
+    }
+
+    const double diagonal = std::sqrt((bounds[1] - bounds[0]) * (bounds[1] - bounds[0]) + (bounds[3] - bounds[2]) * (bounds[3] - bounds[2]) + (bounds[5] - bounds[4]) * (bounds[5] - bounds[4]));
+    const std::vector<Face> faces = convexHull(hullPoints, diagonal);
+    piece.concavity = 0.0;
+    if (faces.empty() || diagonal <= 0.0)
+        return;
+
+    const size_t depthStride = std::max<size_t>(1, piece.triangles.size() / kDepthSamples);
+    double deepest = 0.0;
+    for (size_t t = 0; t < piece.triangles.size(); t += depthStride) {
+        const uint32_t* tri = triangles + 3 * piece.triangles[t];
+        double centroid[3];
+        for (int k = 0; k < 3; ++k) {
+            centroid[k] = (double(points[3 * tri[0] + k]) + points[3 * tri[1] + k] + points[3 * tri[2] + k]) / 3.0;
+        }
+        double depth = 1e300;
+        for (const Face& face : faces) {
+            depth = std::min(depth, face.d - (face.n[0] * centroid[0] + face.n[1] * centroid[1] + face.n[2] * centroid[2]));
+        }
+        deepest = std::max(deepest, depth);
+    }
+    piece.concavity = deepest / diagonal;
+}
+
+/**
+ * Splits a piece in two across the longest axis of its bounds, at the mean triangle centroid.
+ *
+ * @return False if all triangles fell on one side.
+ */
+bool splitPiece(const Piece& piece, const float* points, const uint32_t* triangles, Piece& low, Piece& high) {
+    const float* b = piece.hull.bounds;
+    int axis = 0;
+    for (int k = 1; k < 3; ++k) {
+        if (b[2 * k + 1] - b[2 * k] > b[2 * axis + 1] - b[2 * axis]) axis = k;
+    }
+    auto centroid = [&](uint32_t t) {
+        const uint32_t* tri = triangles + 3 * t;
+        return (double(points[3 * tri[0] + axis]) + points[3 * tri[1] + axis] + points[3 * tri[2] + axis]) / 3.0;
+    };
+    double mean = 0.0;
+    for (uint32_t t : piece.triangles) mean += centroid(t);
+    mean /= piece.triangles.size();
+    for (uint32_t t : piece.triangles) {
+        (centroid(t) < mean ? low : high).triangles.push_back(t);
+    }
+    return !low.triangles.empty() && !high.triangles.empty();
+}
+
+} // namespace
+
+/**
+ * Decomposes a mesh into convex hulls.
+ *
+ * @param points Packed x, y, z coordinates.
+ * @param triangles Three vertex indices per triangle.
+ * @param triangleCount Number of triangles.
+ * @param settings Limits on the number and shape of the hulls.
+ * @return The proxy; empty if there are no triangles.
+ */
+CollisionProxy CollisionProxy::build(const float* points, const uint32_t* triangles, size_t triangleCount, const Settings& settings) {
+    CollisionProxy proxy;
+    if (triangleCount == 0)
+        return proxy;
+
+    const std::vector<double> directions = sphereDirections(std::max(6, settings.directions));
+    std::vector<Piece> pieces(1);
+    pieces[0].triangles.resize(triangleCount);
+    for (size_t t = 0; t < triangleCount; ++t) pieces[0].triangles[t] = static_cast<uint32_t>(t);
+    fitHull(pieces[0], points, triangles, directions);
+
+    // Split the least convex piece until all are convex enough or the budget is spent
+    while (static_cast<int>(pieces.size()) < settings.maxHulls) {
+        int worst = -1;
+        for (size_t i = 0; i < pieces.size(); ++i) {
+            const Piece& piece = pieces[i];
+            if (piece.final || piece.concavity <= settings.concavity || piece.triangles.size() < settings.minTriangles)
+                continue;
+            if (worst < 0 || piece.concavity > pieces[worst].concavity) worst = static_cast<int>(i);
+        }
+        if (worst < 0)
+            break;
+
+        Piece low, high;
+        if (!splitPiece(pieces[worst], points, triangles, low, high)) {
+            pieces[worst].final = true;
+            continue;
+        }
+        fitHull(low, points, triangles, directions);
+        fitHull(high, points, triangles, directions);
+        pieces[worst] = std::move(low);
+        pieces.push_back(std::move(high));
+    }
+
+    for (Piece& piece : pieces) {
+        proxy.pieces.push_back(std::move(piece.hull));
+    }
+    return proxy;
+}
+
+/**
+ * Decomposes a mesh into convex hulls with the default settings.
+ *
+ * @param points Packed x, y, z coordinates.
+ * @param triangles Three vertex indices per triangle.
+ * @param triangleCount Number of triangles.
+ * @return The proxy; empty if there are no triangles.
+ */
+CollisionProxy CollisionProxy::build(const float* points, const uint32_t* triangles, size_t triangleCount) {
+    return build(points, triangles, triangleCount, Settings());
+}
+
+/**
+ * Gets the convex pieces.
+ *
+ * @return The hulls, in the mesh's coordinates.
+ */
+const std::vector<CollisionProxy::Hull>& CollisionProxy::hulls() const {
+    return pieces;
+}
+
+/**
+ * Counts the hull vertices over all pieces.
+ *
+ * @return The number of vertices.
+ */
+size_t CollisionProxy::vertexCount() const {
+    size_t count = 0;
+    for (const Hull& hull : pieces) {
+        count += hull.vertices.size() / 3;
+    }
+    return count;
+}
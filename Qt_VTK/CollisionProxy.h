@@ -0,0 +1,52 @@
+/**
+ * @file CollisionProxy.h
+ *
+ * Defines the CollisionProxy class, an approximate convex decomposition of a triangle mesh used
+ * for interactive contact tests. The mesh is split recursively along the longest axis of each
+ * piece until every piece is close to its convex hull, measured as the deepest point of the piece
+ * below the hull surface relative to the piece's size. Each hull is spanned by the extreme points
+ * of its piece along a fixed set of directions, so it never has more than a few dozen vertices and
+ * a support-point query stays cheap however dense the mesh is.
+ *
+ * Building a proxy for a large part takes a noticeable moment, so it is done on a worker thread;
+ * the class holds no VTK or Qt state.
+ */
+
+#ifndef VIEWER_COLLISIONPROXY_H
+#define VIEWER_COLLISIONPROXY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @class CollisionProxy
+ * @brief A set of convex hulls approximating one mesh, in the mesh's coordinates.
+ */
+class CollisionProxy {
+public:
+    /** One convex piece. */
+    struct Hull {
+        std::vector<float> vertices; ///< Hull vertices, x, y, z each.
+        float bounds[6]; ///< Bounds of the vertices: xmin, xmax, ymin, ymax, zmin, zmax.
+    };
+
+    /** Limits on the decomposition. */
+    struct Settings {
+        int maxHulls = 16; ///< Pieces at most; splitting stops when reached.
+        int directions = 42; ///< Sample directions per hull, and so vertices per hull at most.
+        double concavity = 0.02; ///< Allowed depth below the hull, as a fraction of the piece's diagonal.
+        size_t minTriangles = 32; ///< Pieces with fewer triangles are not split further.
+    };
+
+    static CollisionProxy build(const float* points, const uint32_t* triangles, size_t triangleCount, const Settings& settings);
+    static CollisionProxy build(const float* points, const uint32_t* triangles, size_t triangleCount);
+
+    const std::vector<Hull>& hulls() const;
+    size_t vertexCount() const;
+
+private:
+    std::vector<Hull> pieces; ///< The convex pieces.
+};
+
+#endif // VIEWER_COLLISIONPROXY_H
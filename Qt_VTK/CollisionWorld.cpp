@@ -0,0 +1,282 @@
+/**
+ * @file CollisionWorld.cpp
+ * @brief Implementation of the CollisionWorld class.
+ */
+
+#include "CollisionWorld.h"
+#include <algorithm>
+#include <chrono>
+
+namespace {
+
+const int kMaxGjkIterations = 64; ///< GJK gives up, reporting no contact, after this many support points.
+
+/** A point or direction in the Minkowski difference of two hulls. */
+struct Vec {
+    double x, y, z;
+
+    Vec operator-(const Vec& o) const { return { x - o.x, y - o.y, z - o.z }; }
+    Vec operator-() const { return { -x, -y, -z }; }
+};
+
+double dot(const Vec& a, const Vec& b) {
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+Vec cross(const Vec& a, const Vec& b) {
+    return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+}
+
+/** The vertex of a hull furthest along a direction. */
+Vec support(const std::vector<float>& vertices, const Vec& direction) {
+    size_t best = 0;
+    double bestDot = -1e300;
+    for (size_t i = 0; i < vertices.size(); i += 3) {
+        const double d = vertices[i] * direction.x + vertices[i + 1] * direction.y + vertices[i + 2] * direction.z;
+        if (d > bestDot) {
+            bestDot = d;
+            best = i;
+        }
+    }
+    return { vertices[best], vertices[best + 1], vertices[best + 2] };
+}
+
+/** The point of the Minkowski difference a - b furthest along a direction. */
+Vec support(const std::vector<float>& a, const std::vector<float>& b, const Vec& direction) {
+    return support(a, direction) - support(b, -direction);
+}
+
+/** The centre of a hull's vertices, used as the first search direction. */
+Vec centre(const std::vector<float>& vertices) {
+    Vec c = { 0.0, 0.0, 0.0 };
+    for (size_t i = 0; i < vertices.size(); i += 3) {
+        c.x += vertices[i];
+        c.y += vertices[i + 1];
+        c.z += vertices[i + 2];
+    }
+    const double n = std::max<size_t>(1, vertices.size() / 3);
+    return { c.x / n, c.y / n, c.z / n };
+}
+
+bool boundsOverlap(const float* a, const float* b) {
+    return a[0] <= b[1] && b[0] <= a[1] && a[2] <= b[3] && b[2] <= a[3] && a[4] <= b[5] && b[4] <= a[5];
+}
+
+} // namespace
+
+/**
+ * Adds or replaces a body.
+ *
+ * @param id Identifier of the body.
+ * @param proxy Its convex hulls.
+ * @param matrix Row-major transform from the proxy's coordinates to the world.
+ */
+void CollisionWorld::setBody(int id, std::shared_ptr<const CollisionProxy> proxy, const double matrix[16]) {
+    Body& body = bodies[id];
+    body.proxy = std::move(proxy);
+    place(body, matrix);
+}
+
+/**
+ * Moves a body.
+ *
+ * @param id Identifier of the body; unknown bodies are ignored.
+ * @param matrix Row-major transform from the proxy's coordinates to the world.
+ */
+void CollisionWorld::setTransform(int id, const double matrix[16]) {
+    auto it = bodies.find(id);
+    if (it != bodies.end()) {
+        place(it->second, matrix);
+    }
+}
+
+/**
+ * Removes a body.
+ *
+ * @param id Identifier of the body.
+ */
+void CollisionWorld::removeBody(int id) {
+    bodies.erase(id);
+}
+
+/**
+ * Checks whether a body has been added.
+ *
+ * @param id Identifier of the body.
+ * @return True if the body exists.
+ */
+bool CollisionWorld::hasBody(int id) const {
+    return bodies.count(id) != 0;
+}
+
+/**
+ * Finds the bodies intersecting one body.
+ *
+ * @param id Identifier of the body to test.
+ * @return Identifiers of the bodies it touches or penetrates.
+ */
+std::vector<int> CollisionWorld::contacts(int id) {
+    const auto start = std::chrono::steady_clock::now();
+    stats = Statistics();
+    std::vector<int> touching;
+    auto it = bodies.find(id);
+    if (it == bodies.end())
+        return touching;
+
+    const Body& moving = it->second;
+    for (const auto& entry : bodies) {
+        if (entry.first == id || !boundsOverlap(moving.bounds, entry.second.bounds))
+            continue;
+        ++stats.broadPairs;
+        const Body& other = entry.second;
+        bool found = false;
+        for (size_t i = 0; i < moving.vertices.size() && !found; ++i) {
+            for (size_t j = 0; j < other.vertices.size() && !found; ++j) {
+                if (!boundsOverlap(moving.hullBounds[i].data(), other.hullBounds[j].data()))
+                    continue;
+                ++stats.hullTests;
+                found = intersects(moving.vertices[i], other.vertices[j]);
+            }
+        }
+        if (found) {
+            touching.push_back(entry.first);
+        }
+    }
+    stats.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return touching;
+}
+
+/**
+ * Returns the work done by the last contacts() call.
+ *
+ * @return Pair counts and time.
+ */
+CollisionWorld::Statistics CollisionWorld::statistics() const {
+    return stats;
+}
+
+/**
+ * Tests whether two convex hulls intersect with the Gilbert-Johnson-Keerthi algorithm: the hulls
+ * intersect if and only if their Minkowski difference contains the origin, which GJK decides by
+ * growing a simplex of support points towards the origin. Touching hulls count as intersecting.
+ *
+ * @param a Vertices of the first hull, x, y, z each.
+ * @param b Vertices of the second hull.
+ * @return True if the hulls intersect.
+ */
+bool CollisionWorld::intersects(const std::vector<float>& a, const std::vector<float>& b) {
+    if (a.empty() || b.empty())
+        return false;
+
+    // Simplex points; a is always the newest
+    Vec pa, pb, pc, pd;
+    Vec search = centre(a) - centre(b);
+    if (dot(search, search) == 0.0) search = { 1.0, 0.0, 0.0 };
+
+    pc = support(a, b, search);
+    search = -pc;
+    pb = support(a, b, search);
+    if (dot(pb, search) < 0.0)
+        return false;
+    search = cross(cross(pc - pb, -pb), pc - pb);
+    if (dot(search, search) == 0.0) {
+        // The origin is on the line through the first two points; any normal to it will do
+        search = cross(pc - pb, { 1.0, 0.0, 0.0 });
+        if (dot(search, search) == 0.0) search = cross(pc - pb, { 0.0, 0.0, -1.0 });
+    }
+
+    int dimension = 2;
+    for (int iteration = 0; iteration < kMaxGjkIterations; ++iteration) {
+        pa = support(a, b, search);
+        if (dot(pa, search) < 0.0)
+            return false; // The difference does not reach past the origin in this direction
+        ++dimension;
+
+        const Vec ao = -pa;
+        if (dimension == 3) {
+            // Triangle: keep the feature whose region holds the origin
+            const Vec ab = pb - pa, ac = pc - pa;
+            const Vec n = cross(ab, ac);
+            dimension = 2;
+            if (dot(cross(ab, n), ao) > 0.0) {
+                pc = pa;
+                search = cross(cross(ab, ao), ab);
+                continue;
+            }
+            if (dot(cross(n, ac), ao) > 0.0) {
+                pb = pa;
+                search = cross(cross(ac, ao), ac);
+                continue;
+            }
+            dimension = 3;
+            if (dot(n, ao) > 0.0) {
+                pd = pc;
+                pc = pb;
+                pb = pa;
+                search = n;
+            }
+            else {
+                pd = pb;
+                pb = pa;
+                search = -n;
+            }
+            continue;
+        }
+
+        // Tetrahedron: the origin is inside unless it is beyond one of the faces through a
+        const Vec abc = cross(pb - pa, pc - pa);
+        const Vec acd = cross(pc - pa, pd - pa);
+        const Vec adb = cross(pd - pa, pb - pa);
+        dimension = 3;
+        if (dot(abc, ao) > 0.0) {
+            pd = pc;
+            pc = pb;
+            pb = pa;
+            search = abc;
+        }
+        else if (dot(acd, ao) > 0.0) {
+            pb = pa;
+            search = acd;
+        }
+        else if (dot(adb, ao) > 0.0) {
+            pc = pd;
+            pd = pb;
+            pb = pa;
+            search = adb;
+        }
+        else {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Transforms a body's hull vertices to the world and updates its bounds.
+ */
+void CollisionWorld::place(Body& body, const double matrix[16]) {
+    const std::vector<CollisionProxy::Hull>& hulls = body.proxy->hulls();
+    body.vertices.resize(hulls.size());
+    body.hullBounds.resize(hulls.size());
+    const float empty[6] = { 1e30f, -1e30f, 1e30f, -1e30f, 1e30f, -1e30f };
+    std::copy(empty, empty + 6, body.bounds);
+    for (size_t h = 0; h < hulls.size(); ++h) {
+        const std::vector<float>& in = hulls[h].vertices;
+        std::vector<float>& out = body.vertices[h];
+        out.resize(in.size());
+        std::array<float, 6>& bounds = body.hullBounds[h];
+        std::copy(empty, empty + 6, bounds.begin());
+        for (size_t i = 0; i < in.size(); i += 3) {
+            for (int r = 0; r < 3; ++r) {
+                const float v = static_cast<float>(matrix[4 * r] * in[i] + matrix[4 * r + 1] * in[i + 1] + matrix[4 * r + 2] * in[i + 2] + matrix[4 * r + 3]);
+                out[i + r] = v;
+                bounds[2 * r] = std::min(bounds[2 * r], v);
+                bounds[2 * r + 1] = std::max(bounds[2 * r + 1], v);
+            }
+        }
+        for (int k = 0; k < 3; ++k) {
+            body.bounds[2 * k] = std::min(body.bounds[2 * k], bounds[2 * k]);
+            body.bounds[2 * k + 1] = std::max(body.bounds[2 * k + 1], bounds[2 * k + 1]);
+        }
+    }
+}
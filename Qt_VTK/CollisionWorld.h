@@ -0,0 +1,57 @@
+/**
+ * @file CollisionWorld.h
+ *
+ * Defines the CollisionWorld class, which finds the bodies touching a moved body fast enough to
+ * run every VR frame. Each body is a CollisionProxy placed by a transform. The broad phase
+ * compares world-space bounding boxes, first of whole bodies and then of their hulls; the narrow
+ * phase runs GJK on each remaining pair of hulls, which needs only the hull vertices and
+ * terminates in a handful of iterations for the small hulls a proxy is made of.
+ */
+
+#ifndef VIEWER_COLLISIONWORLD_H
+#define VIEWER_COLLISIONWORLD_H
+
+#include <array>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "CollisionProxy.h"
+
+/**
+ * @class CollisionWorld
+ * @brief Transformed collision proxies and contact queries between them.
+ */
+class CollisionWorld {
+public:
+    /** Work done by the last contacts() call. */
+    struct Statistics {
+        int broadPairs = 0; ///< Body pairs whose bounds overlapped.
+        int hullTests = 0; ///< Hull pairs passed to GJK.
+        double ms = 0.0; ///< Time taken.
+    };
+
+    void setBody(int id, std::shared_ptr<const CollisionProxy> proxy, const double matrix[16]);
+    void setTransform(int id, const double matrix[16]);
+    void removeBody(int id);
+    bool hasBody(int id) const;
+    std::vector<int> contacts(int id);
+    Statistics statistics() const;
+
+    static bool intersects(const std::vector<float>& a, const std::vector<float>& b);
+
+private:
+    /** A proxy in world coordinates. */
+    struct Body {
+        std::shared_ptr<const CollisionProxy> proxy; ///< Hulls in the body's own coordinates.
+        std::vector<std::vector<float>> vertices; ///< Hull vertices in world coordinates.
+        std::vector<std::array<float, 6>> hullBounds; ///< World bounds of each hull.
+        float bounds[6]; ///< World bounds of the whole body.
+    };
+
+    static void place(Body& body, const double matrix[16]);
+
+    std::unordered_map<int, Body> bodies; ///< Bodies by identifier.
+    Statistics stats; ///< Work done by the last query.
+};
+
+#endif // VIEWER_COLLISIONWORLD_H
@@ -0,0 +1,534 @@
+/**
+ * @file DeviationAnalysis.cpp
+ * @brief Implementation of the DeviationAnalysis class.
+ */
+
+#include "DeviationAnalysis.h"
+#include <QElapsedTimer>
+#include <vtkMatrix4x4.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "GeometryKernels.h"
+#include "TaskScheduler.h"
+
+namespace {
+
+const size_t kLeafSize = 4; ///< Triangles per leaf of the hierarchy.
+const size_t kChunk = 8192; ///< Points per parallel task.
+const int kBands = 3; ///< Colour bands on each side between the tolerance and the range.
+
+/** Band colours from the tolerance outwards, then the colour beyond the range. */
+const unsigned char kAboveColours[kBands + 1][3] = { { 255, 225, 25 }, { 245, 130, 48 }, { 230, 25, 75 }, { 128, 0, 0 } };
+const unsigned char kBelowColours[kBands + 1][3] = { { 70, 240, 240 }, { 0, 130, 200 }, { 0, 0, 180 }, { 0, 0, 90 } };
+const unsigned char kWithinColour[3] = { 60, 180, 75 };
+const unsigned char kMissingColour[3] = { 128, 128, 128 };
+
+inline float dot(const float* a, const float* b) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+/**
+ * Finds the point of a triangle closest to p, by the Voronoi region of p (Ericson, Real-Time
+ * Collision Detection, 5.1.5). Degenerate triangles fall back to their nearest vertex or edge.
+ */
+void closestPointOnTriangle(const float* p, const float* a, const float* b, const float* c, float* out) {
+    const float ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+    const float ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+    const float ap[3] = { p[0] - a[0], p[1] - a[1], p[2] - a[2] };
+    const float d1 = dot(ab, ap), d2 = dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f) {
+        std::copy(a, a + 3, out);
+        return;
+    }
+    const float bp[3] = { p[0] - b[0], p[1] - b[1], p[2] - b[2] };
+    const float d3 = dot(ab, bp), d4 = dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3) {
+        std::copy(b, b + 3, out);
+        return;
+    }
+    const float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+        const float v = d1 - d3 != 0.0f ? d1 / (d1 - d3) : 0.0f;
+        for (int k = 0; k < 3; ++k) out[k] = a[k] + v * ab[k];
+        return;
+    }
+    const float cp[3] = { p[0] - c[0], p[1] - c[1], p[2] - c[2] };
+    const float d5 = dot(ab, cp), d6 = dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6) {
+        std::copy(c, c + 3, out);
+        return;
+    }
+    const float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+        const float w = d2 - d6 != 0.0f ? d2 / (d2 - d6) : 0.0f;
+        for (int k = 0; k < 3; ++k) out[k] = a[k] + w * ac[k];
+        return;
+    }
+    const float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f) {
+        const float w = (d4 - d3) + (d5 - d6) != 0.0f ? (d4 - d3) / ((d4 - d3) + (d5 - d6)) : 0.0f;
+        for (int k = 0; k < 3; ++k) out[k] = b[k] + w * (c[k] - b[k]);
+        return;
+    }
+    const float sum = va + vb + vc;
+    const float v = sum != 0.0f ? vb / sum : 0.0f;
+    const float w = sum != 0.0f ? vc / sum : 0.0f;
+    for (int k = 0; k < 3; ++k) out[k] = a[k] + ab[k] * v + ac[k] * w;
+}
+
+/** Squared distance from a point to a box; zero inside it. */
+inline float boxDistanceSquared(const float* p, const float* bounds) {
+    float d = 0.0f;
+    for (int k = 0; k < 3; ++k) {
+        const float below = bounds[2 * k] - p[k];
+        const float above = p[k] - bounds[2 * k + 1];
+        const float outside = std::max(std::max(below, above), 0.0f);
+        d += outside * outside;
+    }
+    return d;
+}
+
+} // namespace
+
+/**
+ * Creates an empty summary.
+ *
+ * @param tolerance Distances within plus or minus this count as in tolerance.
+ * @param range The histogram covers minus range to plus range.
+ * @param binCount Number of histogram bins.
+ */
+DeviationAnalysis::Summary::Summary(double tolerance, double range, int binCount)
+    : tolerance(tolerance), range(range), bins(std::max(1, binCount), 0),
+      min(std::numeric_limits<double>::infinity()), max(-std::numeric_limits<double>::infinity()) {
+}
+
+/**
+ * Adds distances to the summary. Not-a-number distances, for points with no reference to measure
+ * against, are skipped.
+ *
+ * @param distances The distances.
+ * @param count Number of distances.
+ */
+void DeviationAnalysis::Summary::add(const float* distances, size_t count) {
+    const double scale = range > 0.0 ? bins.size() / (2.0 * range) : 0.0;
+    for (size_t i = 0; i < count; ++i) {
+        const double d = distances[i];
+        if (std::isnan(d))
+            continue;
+        ++this->count;
+        within += std::abs(d) <= tolerance;
+        min = std::min(min, d);
+        max = std::max(max, d);
+        sum += d;
+        sumSquares += d * d;
+        if (d < -range) {
+            ++below;
+        } else if (d > range) {
+            ++above;
+        } else {
+            const size_t bin = static_cast<size_t>((d + range) * scale);
+            ++bins[std::min(bin, bins.size() - 1)];
+        }
+    }
+}
+
+/**
+ * Adds another summary with the same tolerance, range and bins to this one.
+ *
+ * @param other The summary to add.
+ */
+void DeviationAnalysis::Summary::merge(const Summary& other) {
+    count += other.count;
+    within += other.within;
+    below += other.below;
+    above += other.above;
+    min = std::min(min, other.min);
+    max = std::max(max, other.max);
+    sum += other.sum;
+    sumSquares += other.sumSquares;
+    for (size_t i = 0; i < bins.size() && i < other.bins.size(); ++i) {
+        bins[i] += other.bins[i];
+    }
+}
+
+/**
+ * @return The mean signed distance, or 0 if the summary is empty.
+ */
+double DeviationAnalysis::Summary::mean() const {
+    return count ? sum / count : 0.0;
+}
+
+/**
+ * @return The root mean square distance, or 0 if the summary is empty.
+ */
+double DeviationAnalysis::Summary::rms() const {
+    return count ? std::sqrt(sumSquares / count) : 0.0;
+}
+
+/**
+ * Adds a mesh to the reference surface.
+ *
+ * @param points Vertex coordinates, x, y, z per vertex.
+ * @param pointCount The number of vertices.
+ * @param triangles Vertex indices, three per triangle.
+ * @param triangleCount The number of triangles.
+ * @param matrix Row-major transform to world coordinates; nullptr for none.
+ */
+void DeviationAnalysis::addMesh(const float* points, size_t pointCount, const uint32_t* triangles, size_t triangleCount, const double matrix[16]) {
+    const size_t base = this->points.size() / 3;
+    this->points.resize((base + pointCount) * 3);
+    if (matrix) {
+        GeometryKernels::transformPoints(points, this->points.data() + base * 3, pointCount, matrix);
+    }
+    else {
+        std::copy(points, points + pointCount * 3, this->points.begin() + base * 3);
+    }
+
+    const size_t first = this->triangles.size();
+    this->triangles.resize(first + triangleCount * 3);
+    for (size_t i = 0; i < triangleCount * 3; ++i) {
+        this->triangles[first + i] = static_cast<uint32_t>(base + triangles[i]);
+    }
+}
+
+/**
+ * Adds the geometry of a part and its descendants in world coordinates. Hidden parts are skipped.
+ *
+ * @param part The root of the subtree to add.
+ */
+void DeviationAnalysis::addPart(ModelPart* part) {
+    if (!part || !part->effectiveVisible())
+        return;
+
+    if (vtkPolyData* polyData = part->getPolyData()) {
+        std::vector<float> coordinates;
+        std::vector<uint32_t> indices;
+        ModelPart::extractMesh(polyData, coordinates, indices);
+        addMesh(coordinates.data(), coordinates.size() / 3, indices.data(), indices.size() / 3,
+            part->getTransform()->GetMatrix()->GetData());
+    }
+    for (int i = 0; i < part->childCount(); ++i) {
+        addPart(part->child(i));
+    }
+}
+
+/**
+ * Gets the number of reference triangles added so far.
+ *
+ * @return The number of triangles.
+ */
+size_t DeviationAnalysis::triangleCount() const {
+    return triangles.size() / 3;
+}
+
+/**
+ * Builds the hierarchy over the reference triangles added so far. Call once, after the last
+ * addMesh() or addPart() and before measuring.
+ */
+void DeviationAnalysis::build() {
+    QElapsedTimer timer;
+    timer.start();
+
+    const size_t triangleTotal = triangles.size() / 3;
+    std::vector<float> centroids(triangleTotal * 3);
+    for (size_t t = 0; t < triangleTotal; ++t) {
+        for (int k = 0; k < 3; ++k) {
+            centroids[3 * t + k] = (points[3 * triangles[3 * t] + k] + points[3 * triangles[3 * t + 1] + k] + points[3 * triangles[3 * t + 2] + k]) / 3.0f;
+        }
+    }
+    std::vector<uint32_t> order(triangleTotal);
+    for (size_t t = 0; t < triangleTotal; ++t) order[t] = static_cast<uint32_t>(t);
+
+    nodes.clear();
+    nodes.reserve(triangleTotal ? 2 * (triangleTotal / kLeafSize + 1) : 0);
+    if (triangleTotal > 0) {
+        buildNode(order, centroids, 0, triangleTotal);
+    }
+
+    // Copy the corners out in leaf order, so a leaf's triangles are contiguous in memory
+    corners.resize(triangleTotal * 9);
+    normals.resize(triangleTotal * 3);
+    for (size_t i = 0; i < triangleTotal; ++i) {
+        const uint32_t t = order[i];
+        float* corner = &corners[9 * i];
+        for (int v = 0; v < 3; ++v) {
+            std::copy(&points[3 * triangles[3 * t + v]], &points[3 * triangles[3 * t + v]] + 3, corner + 3 * v);
+        }
+        const float u[3] = { corner[3] - corner[0], corner[4] - corner[1], corner[5] - corner[2] };
+        const float w[3] = { corner[6] - corner[0], corner[7] - corner[1], corner[8] - corner[2] };
+        const float n[3] = { u[1] * w[2] - u[2] * w[1], u[2] * w[0] - u[0] * w[2], u[0] * w[1] - u[1] * w[0] };
+        const float length = std::sqrt(dot(n, n));
+        for (int k = 0; k < 3; ++k) normals[3 * i + k] = length > 0.0f ? n[k] / length : 0.0f;
+    }
+
+    // The hierarchy keeps its own copies; the meshes are no longer needed
+    std::vector<float>().swap(points);
+    std::vector<uint32_t>().swap(triangles);
+
+    stats = Statistics();
+    stats.triangles = triangleTotal;
+    stats.nodes = nodes.size();
+    stats.buildMs = timer.nsecsElapsed() / 1e6;
+}
+
+/**
+ * Builds the subtree over triangles order[first, last), splitting at the median centroid along the
+ * longest axis of the centroids' bounds.
+ *
+ * @return Index of the subtree's root node.
+ */
+uint32_t DeviationAnalysis::buildNode(std::vector<uint32_t>& order, const std::vector<float>& centroids, size_t first, size_t last) {
+    const uint32_t index = static_cast<uint32_t>(nodes.size());
+    nodes.emplace_back();
+
+    float bounds[6] = { std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(),
+                        std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(),
+                        std::numeric_limits<float>::max(), -std::numeric_limits<float>::max() };
+    float centroidBounds[6];
+    std::copy(bounds, bounds + 6, centroidBounds);
+    for (size_t i = first; i < last; ++i) {
+        const uint32_t t = order[i];
+        for (int v = 0; v < 3; ++v) {
+            const float* p = &points[3 * triangles[3 * t + v]];
+            for (int k = 0; k < 3; ++k) {
+                bounds[2 * k] = std::min(bounds[2 * k], p[k]);
+                bounds[2 * k + 1] = std::max(bounds[2 * k + 1], p[k]);
+            }
+        }
+        for (int k = 0; k < 3; ++k) {
+            centroidBounds[2 * k] = std::min(centroidBounds[2 * k], centroids[3 * t + k]);
+            centroidBounds[2 * k + 1] = std::max(centroidBounds[2 * k + 1], centroids[3 * t + k]);
+        }
+    }
+    std::copy(bounds, bounds + 6, nodes[index].bounds);
+
+    int axis = 0;
+    for (int k = 1; k < 3; ++k) {
+        if (centroidBounds[2 * k + 1] - centroidBounds[2 * k] > centroidBounds[2 * axis + 1] - centroidBounds[2 * axis]) axis = k;
+    }
+    if (last - first <= kLeafSize || centroidBounds[2 * axis + 1] <= centroidBounds[2 * axis]) {
+        nodes[index].first = static_cast<uint32_t>(first);
+        nodes[index].count = static_cast<uint32_t>(last - first);
+        return index;
+    }
+
+    const size_t middle = first + (last - first) / 2;
+    std::nth_element(order.begin() + first, order.begin() + middle, order.begin() + last, [&](uint32_t a, uint32_t b) {
+        return centroids[3 * a + axis] < centroids[3 * b + axis];
+        });
+    buildNode(order, centroids, first, middle);
+    const uint32_t second = buildNode(order, centroids, middle, last);
+    nodes[index].first = second;
+    nodes[index].count = 0;
+    return index;
+}
+
+/**
+ * Measures the signed distance from a point to the reference surface.
+ *
+ * The sign comes from the normal of the closest triangle. Where several triangles are equally
+ * close, at an edge or a corner, the one whose normal is best aligned with the offset decides.
+ *
+ * @param point The point, in world coordinates.
+ * @param hint A triangle likely to be near, e.g. the result for the previous point; receives the closest triangle.
+ * @return The distance, or not-a-number if the reference is empty.
+ */
+float DeviationAnalysis::signedDistance(const float point[3], uint32_t& hint) const {
+    const size_t triangleTotal = normals.size() / 3;
+    if (triangleTotal == 0)
+        return std::numeric_limits<float>::quiet_NaN();
+
+    float best = std::numeric_limits<float>::infinity();
+    float bestAlignment = 0.0f;
+    float bestSign = 1.0f;
+    uint32_t bestTriangle = 0;
+    auto consider = [&](uint32_t t) {
+        const float* c = &corners[9 * static_cast<size_t>(t)];
+        float closest[3];
+        closestPointOnTriangle(point, c, c + 3, c + 6, closest);
+        const float offset[3] = { point[0] - closest[0], point[1] - closest[1], point[2] - closest[2] };
+        const float d = dot(offset, offset);
+        if (d > best * (1.0f + 1e-5f) + std::numeric_limits<float>::min())
+            return;
+        const float along = dot(offset, &normals[3 * static_cast<size_t>(t)]);
+        const float alignment = d > 0.0f ? std::abs(along) / std::sqrt(d) : 1.0f;
+        if (d < best * (1.0f - 1e-5f) || alignment > bestAlignment) {
+            best = std::min(best, d);
+            bestAlignment = alignment;
+            bestSign = along < 0.0f ? -1.0f : 1.0f;
+            bestTriangle = t;
+        }
+    };
+    consider(std::min<uint32_t>(hint, static_cast<uint32_t>(triangleTotal - 1)));
+
+    // Each entry keeps the box distance computed when it was pushed, so no box is tested twice
+    struct Entry {
+        uint32_t node;
+        float distance;
+    };
+    Entry stack[64];
+    int depth = 0;
+    stack[depth++] = { 0, boxDistanceSquared(point, nodes[0].bounds) };
+    while (depth > 0) {
+        const Entry entry = stack[--depth];
+        if (entry.distance > best)
+            continue;
+        const Node& node = nodes[entry.node];
+        if (node.count > 0) {
+            for (uint32_t t = node.first; t < node.first + node.count; ++t) consider(t);
+            continue;
+        }
+        // Push the further child first so the nearer one is searched first
+        const Entry near = { entry.node + 1, boxDistanceSquared(point, nodes[entry.node + 1].bounds) };
+        const Entry far = { node.first, boxDistanceSquared(point, nodes[node.first].bounds) };
+        if (depth + 2 > 64)
+            continue; // Cannot happen with median splits, which keep the depth near log2 of the leaf count
+        if (near.distance <= far.distance) {
+            if (far.distance <= best) stack[depth++] = far;
+            stack[depth++] = near;
+        } else {
+            if (near.distance <= best) stack[depth++] = near;
+            stack[depth++] = far;
+        }
+    }
+    hint = bestTriangle;
+    return bestSign * std::sqrt(best);
+}
+
+/**
+ * Measures points on the calling thread, e.g. a point cloud node as it is read. Safe to call on
+ * several threads at once.
+ *
+ * @param points Point coordinates, x, y, z per point.
+ * @param count Number of points.
+ * @param matrix Row-major transform of the points to world coordinates; nullptr for none.
+ * @param distances Receives one distance per point.
+ */
+void DeviationAnalysis::measureRange(const float* points, size_t count, const double matrix[16], float* distances) const {
+    std::vector<float> world;
+    if (matrix) {
+        world.resize(count * 3);
+        GeometryKernels::transformPoints(points, world.data(), count, matrix);
+        points = world.data();
+    }
+    uint32_t hint = 0;
+    for (size_t i = 0; i < count; ++i) {
+        distances[i] = signedDistance(points + 3 * i, hint);
+    }
+}
+
+/**
+ * Measures the signed distance of every point to the reference, on all cores.
+ *
+ * @param points Point coordinates, x, y, z per point.
+ * @param count Number of points.
+ * @param matrix Row-major transform of the points to world coordinates; nullptr for none.
+ * @return One distance per point.
+ */
+std::vector<float> DeviationAnalysis::measure(const float* points, size_t count, const double matrix[16]) {
+    QElapsedTimer timer;
+    timer.start();
+
+    std::vector<float> distances(count);
+    std::vector<size_t> chunks;
+    for (size_t first = 0; first < count; first += kChunk) chunks.push_back(first);
+    TaskScheduler::instance()->blockingMap(TaskScheduler::Analysis, chunks, [&](size_t first) {
+        measureRange(points + 3 * first, std::min(kChunk, count - first), matrix, distances.data() + first);
+        });
+
+    stats.points = count;
+    stats.queryMs = timer.nsecsElapsed() / 1e6;
+    return distances;
+}
+
+/**
+ * Measures every point of a point cloud, on all cores, reading the leaves of its octree straight
+ * from the mapped file. Only the summary is kept, so clouds of any size fit in memory.
+ *
+ * @param cloud The cloud.
+ * @param matrix Row-major transform of the cloud to world coordinates; nullptr for none.
+ * @param tolerance Tolerance of the summary.
+ * @param range Range of the summary's histogram.
+ * @param binCount Number of histogram bins.
+ * @return The distribution of the distances.
+ */
+DeviationAnalysis::Summary DeviationAnalysis::measureCloud(const PointCloud& cloud, const double matrix[16], double tolerance, double range, int binCount) {
+    QElapsedTimer timer;
+    timer.start();
+
+    struct Task {
+        int node;
+        quint32 first;
+        quint32 count;
+        Summary summary;
+    };
+    std::vector<Task> tasks;
+    for (int n = 0; n < cloud.nodeCount(); ++n) {
+        const PointCloudNode& node = cloud.node(n);
+        if (std::any_of(node.children, node.children + 8, [](qint32 child) { return child >= 0; }))
+            continue; // Inner nodes hold copies of their descendants' points
+        for (quint32 first = 0; first < node.count; first += static_cast<quint32>(kChunk)) {
+            tasks.push_back({ n, first, std::min<quint32>(static_cast<quint32>(kChunk), node.count - first), Summary(tolerance, range, binCount) });
+        }
+    }
+
+    TaskScheduler::instance()->blockingMap(TaskScheduler::Analysis, tasks, [&](Task& task) {
+        const PointRecord* records = cloud.nodePoints(task.node) + task.first;
+        std::vector<float> xyz(3 * static_cast<size_t>(task.count));
+        for (quint32 i = 0; i < task.count; ++i) {
+            xyz[3 * i] = records[i].x;
+            xyz[3 * i + 1] = records[i].y;
+            xyz[3 * i + 2] = records[i].z;
+        }
+        std::vector<float> distances(task.count);
+        measureRange(xyz.data(), task.count, matrix, distances.data());
+        task.summary.add(distances.data(), distances.size());
+        });
+
+    Summary summary(tolerance, range, binCount);
+    size_t measured = 0;
+    for (const Task& task : tasks) {
+        summary.merge(task.summary);
+        measured += task.count;
+    }
+    stats.points = measured;
+    stats.queryMs = timer.nsecsElapsed() / 1e6;
+    return summary;
+}
+
+/**
+ * Gets the work done by the last build and query.
+ *
+ * @return The statistics.
+ */
+DeviationAnalysis::Statistics DeviationAnalysis::statistics() const {
+    return stats;
+}
+
+/**
+ * Colours distances in bands: green in tolerance, then three bands each of yellow to red above
+ * and cyan to blue below, up to the range, and a dark shade beyond it. Points with no distance are grey.
+ *
+ * @param distances The distances.
+ * @param count Number of distances.
+ * @param tolerance Distances within plus or minus this are green.
+ * @param range Distances beyond plus or minus this get the darkest colour.
+ * @param rgb Receives three bytes per distance.
+ */
+void DeviationAnalysis::colourMap(const float* distances, size_t count, double tolerance, double range, unsigned char* rgb) {
+    const double bandWidth = std::max(range - tolerance, 1e-30) / kBands;
+    for (size_t i = 0; i < count; ++i) {
+        const double d = distances[i];
+        const unsigned char* colour;
+        if (std::isnan(d)) {
+            colour = kMissingColour;
+        } else if (std::abs(d) <= tolerance) {
+            colour = kWithinColour;
+        } else {
+            const int band = std::abs(d) > range ? kBands : std::min(kBands - 1, static_cast<int>((std::abs(d) - tolerance) / bandWidth));
+            colour = d > 0.0 ? kAboveColours[band] : kBelowColours[band];
+        }
+        std::copy(colour, colour + 3, rgb + 3 * i);
+    }
+}
@@ -0,0 +1,93 @@
+/**
+ * @file DeviationAnalysis.h
+ *
+ * Defines the DeviationAnalysis class, which measures how far the vertices of one part, or the
+ * points of a scan, lie from the surface of a reference, e.g. a revised part against the previous
+ * revision or a scan against its CAD model. Distances are signed: positive outside the reference,
+ * along its face normals, and negative inside.
+ *
+ * The reference triangles are copied in world coordinates into a bounding volume hierarchy, split
+ * at the median along the longest axis. A query descends the nearer child first and skips every box
+ * further away than the closest triangle found so far. Queries are spread over the thread pool in
+ * chunks of consecutive points; consecutive points are usually neighbours (mesh vertices are
+ * numbered as the triangles use them, scan points follow a Morton curve), so each query starts from
+ * the triangle closest to the previous point, which bounds the search before it begins.
+ */
+
+#ifndef VIEWER_DEVIATIONANALYSIS_H
+#define VIEWER_DEVIATIONANALYSIS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "ModelPart.h"
+#include "PointCloud.h"
+
+/**
+ * @class DeviationAnalysis
+ * @brief Signed distances from points to a reference surface, with histograms and a colour map.
+ */
+class DeviationAnalysis {
+public:
+    /** Distribution of a set of signed distances. */
+    struct Summary {
+        double tolerance = 0.0; ///< Distances within plus or minus this are in tolerance.
+        double range = 0.0; ///< The histogram covers minus range to plus range.
+        std::vector<uint64_t> bins; ///< Histogram over [-range, range] in equal bins.
+        uint64_t count = 0; ///< Distances summarised.
+        uint64_t within = 0; ///< Distances in tolerance.
+        uint64_t below = 0; ///< Distances below -range, not in the histogram.
+        uint64_t above = 0; ///< Distances above range, not in the histogram.
+        double min = 0.0; ///< Smallest distance.
+        double max = 0.0; ///< Largest distance.
+        double sum = 0.0; ///< Sum of the distances.
+        double sumSquares = 0.0; ///< Sum of the squared distances.
+
+        Summary() = default;
+        Summary(double tolerance, double range, int binCount);
+        void add(const float* distances, size_t count);
+        void merge(const Summary& other);
+        double mean() const;
+        double rms() const;
+    };
+
+    /** What the last build and measurement did. */
+    struct Statistics {
+        size_t triangles = 0; ///< Reference triangles.
+        size_t nodes = 0; ///< Nodes in the hierarchy.
+        size_t points = 0; ///< Points measured by the last query.
+        double buildMs = 0.0; ///< Time to build the hierarchy.
+        double queryMs = 0.0; ///< Time taken by the last query.
+    };
+
+    void addMesh(const float* points, size_t pointCount, const uint32_t* triangles, size_t triangleCount, const double matrix[16] = nullptr);
+    void addPart(ModelPart* part);
+    size_t triangleCount() const;
+    void build();
+    float signedDistance(const float point[3], uint32_t& hint) const;
+    void measureRange(const float* points, size_t count, const double matrix[16], float* distances) const;
+    std::vector<float> measure(const float* points, size_t count, const double matrix[16] = nullptr);
+    Summary measureCloud(const PointCloud& cloud, const double matrix[16], double tolerance, double range, int binCount);
+    Statistics statistics() const;
+
+    static void colourMap(const float* distances, size_t count, double tolerance, double range, unsigned char* rgb);
+
+private:
+    /** A box of the hierarchy. Inner nodes have their first child next in the array. */
+    struct Node {
+        float bounds[6]; ///< xmin, xmax, ymin, ymax, zmin, zmax.
+        uint32_t first; ///< Leaf: first triangle; inner node: index of the second child.
+        uint32_t count; ///< Leaf: number of triangles; inner node: 0.
+    };
+
+    uint32_t buildNode(std::vector<uint32_t>& order, const std::vector<float>& centroids, size_t first, size_t last);
+
+    std::vector<float> points; ///< World coordinates of every mesh added, x, y, z per vertex.
+    std::vector<uint32_t> triangles; ///< Vertex indices into points, three per triangle.
+    std::vector<Node> nodes; ///< The hierarchy; the root is node 0.
+    std::vector<float> corners; ///< Vertices of each triangle in hierarchy order, nine floats per triangle.
+    std::vector<float> normals; ///< Unit normal of each triangle in hierarchy order.
+    Statistics stats; ///< Work done by the last build and query.
+};
+
+#endif // VIEWER_DEVIATIONANALYSIS_H
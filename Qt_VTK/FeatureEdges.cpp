@@ -0,0 +1,68 @@
+/**
+ * @file FeatureEdges.cpp
+ * @brief Implementation of the FeatureEdges class.
+ */
+
+#include "FeatureEdges.h"
+#include <algorithm>
+#include <cmath>
+#include "GeometryKernels.h"
+
+namespace {
+
+const double kPi = 3.14159265358979323846;
+
+/** One side of a triangle: the sorted vertex pair packed into a key, and the triangle. */
+struct HalfEdge {
+    uint64_t key; ///< Lower vertex index in the high word, higher in the low word.
+    uint32_t triangle; ///< Triangle the edge belongs to.
+
+    bool operator<(const HalfEdge& other) const { return key < other.key; }
+};
+
+} // namespace
+
+/**
+ * Finds the feature edges of a mesh.
+ *
+ * @param points Vertex coordinates, x, y, z per vertex.
+ * @param triangles Vertex indices, three per triangle.
+ * @param triangleCount Number of triangles.
+ * @param angleDegrees Edges between triangles whose normals differ by more than this are sharp.
+ * @return Vertex index pairs, one pair per edge.
+ */
+std::vector<uint32_t> FeatureEdges::extract(const float* points, const uint32_t* triangles, size_t triangleCount, double angleDegrees) {
+    // Unit normals; degenerate triangles get a zero normal, which makes every edge they share sharp
+    std::vector<float> normals(triangleCount * 3);
+    GeometryKernels::faceNormals(points, triangles, triangleCount, normals.data());
+
+    std::vector<HalfEdge> halfEdges(triangleCount * 3);
+    for (size_t t = 0; t < triangleCount; ++t) {
+        for (int k = 0; k < 3; ++k) {
+            const uint32_t a = triangles[3 * t + k];
+            const uint32_t b = triangles[3 * t + (k + 1) % 3];
+            halfEdges[3 * t + k] = { (static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b), static_cast<uint32_t>(t) };
+        }
+    }
+    std::sort(halfEdges.begin(), halfEdges.end());
+
+    const float cosThreshold = static_cast<float>(std::cos(angleDegrees * kPi / 180.0));
+    std::vector<uint32_t> edges;
+    for (size_t i = 0; i < halfEdges.size();) {
+        size_t j = i + 1;
+        while (j < halfEdges.size() && halfEdges[j].key == halfEdges[i].key) ++j;
+
+        bool feature = j - i != 2; // Boundary or non-manifold
+        if (!feature) {
+            const float* n0 = &normals[3 * static_cast<size_t>(halfEdges[i].triangle)];
+            const float* n1 = &normals[3 * static_cast<size_t>(halfEdges[i + 1].triangle)];
+            feature = n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2] < cosThreshold;
+        }
+        if (feature) {
+            edges.push_back(static_cast<uint32_t>(halfEdges[i].key >> 32));
+            edges.push_back(static_cast<uint32_t>(halfEdges[i].key));
+        }
+        i = j;
+    }
+    return edges;
+}
@@ -0,0 +1,33 @@
+/**
+ * @file FeatureEdges.h
+ *
+ * Defines the FeatureEdges class, which finds the edges of a triangle mesh worth outlining:
+ * boundary edges, used by one triangle; sharp edges, where the normals of the two triangles
+ * differ by more than a threshold angle; and non-manifold edges, shared by three or more.
+ *
+ * vtkFeatureEdges does the same but builds cell links and copies the points into a new data set;
+ * here the edges of every triangle are sorted by their vertex pair, so each shared edge lands next
+ * to its neighbours, and the result is only the vertex index pairs, which the line overlay draws
+ * with the part's own points. The mesh must have shared vertices, as StlParser and vtkSTLReader
+ * produce.
+ */
+
+#ifndef VIEWER_FEATUREEDGES_H
+#define VIEWER_FEATUREEDGES_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @class FeatureEdges
+ * @brief Extracts boundary, sharp and non-manifold edges of an indexed triangle mesh.
+ */
+class FeatureEdges {
+public:
+    static constexpr double kDefaultAngle = 30.0; ///< Dihedral angle, in degrees, above which an edge is sharp.
+
+    static std::vector<uint32_t> extract(const float* points, const uint32_t* triangles, size_t triangleCount, double angleDegrees = kDefaultAngle);
+};
+
+#endif // VIEWER_FEATUREEDGES_H
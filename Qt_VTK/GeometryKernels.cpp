@@ -0,0 +1,405 @@
+/**
+ * @file GeometryKernels.cpp
+ * @brief Scalar reference kernels, CPU feature detection and dispatch for GeometryKernels.
+ *
+ * The instruction set is chosen once, on the first call. Setting the VIEWER_SIMD environment
+ * variable to scalar, sse2, avx2 or avx512 caps the choice, which is useful for comparing
+ * implementations and for ruling out a kernel when chasing a rendering difference.
+ */
+
+#include "GeometryKernelsImpl.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+namespace GeometryKernelsScalar {
+
+void bounds(const float* points, size_t count, double bounds[6]) {
+    if (count == 0) {
+        // Same convention as vtkMath::UninitializeBounds
+        const double empty[6] = { 1.0, -1.0, 1.0, -1.0, 1.0, -1.0 };
+        std::copy(empty, empty + 6, bounds);
+        return;
+    }
+    float result[6] = { points[0], points[0], points[1], points[1], points[2], points[2] };
+    for (size_t i = 1; i < count; ++i) {
+        for (int k = 0; k < 3; ++k) {
+            const float v = points[i * 3 + k];
+            if (v < result[2 * k]) result[2 * k] = v;
+            if (v > result[2 * k + 1]) result[2 * k + 1] = v;
+        }
+    }
+    std::copy(result, result + 6, bounds);
+}
+
+void transformPoints(const float* in, float* out, size_t count, const double matrix[16]) {
+    float m[12];
+    for (int i = 0; i < 12; ++i) m[i] = static_cast<float>(matrix[i]);
+    for (size_t i = 0; i < count; ++i) {
+        const float x = in[i * 3], y = in[i * 3 + 1], z = in[i * 3 + 2];
+        out[i * 3] = m[0] * x + m[1] * y + m[2] * z + m[3];
+        out[i * 3 + 1] = m[4] * x + m[5] * y + m[6] * z + m[7];
+        out[i * 3 + 2] = m[8] * x + m[9] * y + m[10] * z + m[11];
+    }
+}
+
+void projectPoints(const float* in, float* out, size_t count, const double matrix[16]) {
+    float m[16];
+    for (int i = 0; i < 16; ++i) m[i] = static_cast<float>(matrix[i]);
+    for (size_t i = 0; i < count; ++i) {
+        const float x = in[i * 3], y = in[i * 3 + 1], z = in[i * 3 + 2];
+        for (int r = 0; r < 4; ++r) {
+            out[i * 4 + r] = m[r * 4] * x + m[r * 4 + 1] * y + m[r * 4 + 2] * z + m[r * 4 + 3];
+        }
+    }
+}
+
+void faceNormals(const float* points, const uint32_t* triangles, size_t triangleCount, float* normals) {
+    for (size_t t = 0; t < triangleCount; ++t) {
+        const float* a = points + triangles[t * 3] * 3;
+        const float* b = points + triangles[t * 3 + 1] * 3;
+        const float* c = points + triangles[t * 3 + 2] * 3;
+        const float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+        const float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+        const float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+        const float length = std::max(std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]), 1e-30f);
+        for (int k = 0; k < 3; ++k) {
+            normals[t * 3 + k] = n[k] / length;
+        }
+    }
+}
+
+float quantizeScale(double min, double max) {
+    return max > min ? static_cast<float>(65535.0 / (max - min)) : 0.0f;
+}
+
+void quantize(const float* points, size_t count, const double bounds[6], uint16_t* out) {
+    const float minimum[3] = { static_cast<float>(bounds[0]), static_cast<float>(bounds[2]), static_cast<float>(bounds[4]) };
+    const float scale[3] = { quantizeScale(bounds[0], bounds[1]), quantizeScale(bounds[2], bounds[3]), quantizeScale(bounds[4], bounds[5]) };
+    for (size_t i = 0; i < count * 3; ++i) {
+        const int k = static_cast<int>(i % 3);
+        const float v = std::min(std::max((points[i] - minimum[k]) * scale[k], 0.0f), 65535.0f);
+        out[i] = static_cast<uint16_t>(std::nearbyint(v)); // Round to nearest even, like the vector conversions
+    }
+}
+
+void centroidAndArea(const float* points, const uint32_t* triangles, size_t triangleCount, const float origin[3], double sums[4]) {
+    for (int i = 0; i < 4; ++i) sums[i] = 0.0;
+    for (size_t t = 0; t < triangleCount; ++t) {
+        const float* a = points + triangles[t * 3] * 3;
+        const float* b = points + triangles[t * 3 + 1] * 3;
+        const float* c = points + triangles[t * 3 + 2] * 3;
+        const double e1[3] = { double(b[0]) - a[0], double(b[1]) - a[1], double(b[2]) - a[2] };
+        const double e2[3] = { double(c[0]) - a[0], double(c[1]) - a[1], double(c[2]) - a[2] };
+        const double n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+        const double twiceArea = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        sums[0] += twiceArea;
+        for (int k = 0; k < 3; ++k) {
+            sums[k + 1] += twiceArea * ((double(a[k]) - origin[k]) + (double(b[k]) - origin[k]) + (double(c[k]) - origin[k]));
+        }
+    }
+}
+
+void volumeIntegrals(const float* points, const uint32_t* triangles, size_t triangleCount, const float origin[3], double sums[10]) {
+    static const int products[6][2] = { { 0, 0 }, { 1, 1 }, { 2, 2 }, { 0, 1 }, { 1, 2 }, { 2, 0 } };
+    for (int i = 0; i < 10; ++i) sums[i] = 0.0;
+    for (size_t t = 0; t < triangleCount; ++t) {
+        double v[3][3];
+        for (int c = 0; c < 3; ++c) {
+            const float* p = points + triangles[t * 3 + c] * 3;
+            for (int k = 0; k < 3; ++k) {
+                v[c][k] = double(p[k]) - origin[k];
+            }
+        }
+        const double cross[3] = {
+            v[1][1] * v[2][2] - v[1][2] * v[2][1],
+            v[1][2] * v[2][0] - v[1][0] * v[2][2],
+            v[1][0] * v[2][1] - v[1][1] * v[2][0]
+        };
+        const double det = v[0][0] * cross[0] + v[0][1] * cross[1] + v[0][2] * cross[2];
+        double sum[3];
+        for (int k = 0; k < 3; ++k) {
+            sum[k] = v[0][k] + v[1][k] + v[2][k];
+        }
+        sums[0] += det;
+        for (int k = 0; k < 3; ++k) {
+            sums[1 + k] += det * sum[k];
+        }
+        for (int p = 0; p < 6; ++p) {
+            const int i = products[p][0], j = products[p][1];
+            const double q = v[0][i] * v[0][j] + v[1][i] * v[1][j] + v[2][i] * v[2][j] + sum[i] * sum[j];
+            sums[4 + p] += det * q;
+        }
+    }
+}
+
+} // namespace GeometryKernelsScalar
+
+namespace {
+
+const GeometryKernelTable kScalarKernels = {
+    GeometryKernelsScalar::bounds,
+    GeometryKernelsScalar::transformPoints,
+    GeometryKernelsScalar::projectPoints,
+    GeometryKernelsScalar::faceNormals,
+    GeometryKernelsScalar::quantize,
+    GeometryKernelsScalar::centroidAndArea,
+    GeometryKernelsScalar::volumeIntegrals
+};
+
+std::atomic<const GeometryKernelTable*> activeKernels(nullptr); ///< Table used by the public functions.
+std::atomic<int> activeSet(GeometryKernels::Scalar); ///< Instruction set of activeKernels.
+
+/**
+ * Asks the CPU (and, for AVX, the operating system) which instruction sets can be used.
+ */
+GeometryKernels::InstructionSet detectInstructionSet() {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return GeometryKernels::AVX512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return GeometryKernels::AVX2;
+    if (__builtin_cpu_supports("sse2")) return GeometryKernels::SSE2;
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int info[4];
+    __cpuid(info, 0);
+    const int maxLeaf = info[0];
+    __cpuid(info, 1);
+    const bool sse2 = (info[3] & (1 << 26)) != 0;
+    const bool fma = (info[2] & (1 << 12)) != 0;
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+    const bool avxState = (xcr0 & 0x6) == 0x6; // XMM and YMM registers saved on context switch
+    const bool avx512State = (xcr0 & 0xe6) == 0xe6; // Plus opmask and ZMM registers
+    if (maxLeaf >= 7) {
+        __cpuidex(info, 7, 0);
+        if ((info[1] & (1 << 16)) && avx512State) return GeometryKernels::AVX512;
+        if ((info[1] & (1 << 5)) && fma && avxState) return GeometryKernels::AVX2;
+    }
+    if (sse2) return GeometryKernels::SSE2;
+#endif
+    return GeometryKernels::Scalar;
+}
+
+/**
+ * Gets the kernel table for an instruction set, or nullptr if it was not compiled in.
+ */
+const GeometryKernelTable* tableFor(GeometryKernels::InstructionSet set) {
+    switch (set) {
+    case GeometryKernels::AVX512: return avx512GeometryKernels();
+    case GeometryKernels::AVX2: return avx2GeometryKernels();
+    case GeometryKernels::SSE2: return sse2GeometryKernels();
+    default: return scalarGeometryKernels();
+    }
+}
+
+/**
+ * Gets the active kernel table, selecting one on first use.
+ */
+const GeometryKernelTable* kernels() {
+    const GeometryKernelTable* table = activeKernels.load(std::memory_order_acquire);
+    if (!table) {
+        GeometryKernels::InstructionSet set = GeometryKernels::bestSupported();
+        if (const char* requested = std::getenv("VIEWER_SIMD")) {
+            for (int candidate = GeometryKernels::Scalar; candidate <= GeometryKernels::AVX512; ++candidate) {
+                if (std::strcmp(requested, GeometryKernels::name(GeometryKernels::InstructionSet(candidate))) == 0) {
+                    set = std::min(set, GeometryKernels::InstructionSet(candidate));
+                }
+            }
+        }
+        GeometryKernels::setInstructionSet(set);
+        table = activeKernels.load(std::memory_order_acquire);
+    }
+    return table;
+}
+
+/**
+ * Picks the origin the integrating kernels work relative to: the first vertex of the mesh, which
+ * is never further from any other vertex than the mesh is wide.
+ */
+void meshOrigin(const float* points, const uint32_t* triangles, size_t triangleCount, float origin[3]) {
+    for (int k = 0; k < 3; ++k) {
+        origin[k] = triangleCount > 0 ? points[triangles[0] * 3 + k] : 0.0f;
+    }
+}
+
+} // namespace
+
+const GeometryKernelTable* scalarGeometryKernels() {
+    return &kScalarKernels;
+}
+
+/**
+ * Computes the axis-aligned bounds of a set of points.
+ *
+ * @param points Packed x, y, z coordinates.
+ * @param count Number of points.
+ * @param bounds Receives xmin, xmax, ymin, ymax, zmin, zmax; if count is 0, min > max as in VTK.
+ */
+void GeometryKernels::bounds(const float* points, size_t count, double bounds[6]) {
+    kernels()->bounds(points, count, bounds);
+}
+
+/**
+ * Applies an affine transform to a set of points. in and out may be the same array.
+ *
+ * @param in Packed x, y, z coordinates.
+ * @param out Receives the transformed coordinates.
+ * @param count Number of points.
+ * @param matrix Row-major 4x4 matrix; the bottom row is ignored.
+ */
+void GeometryKernels::transformPoints(const float* in, float* out, size_t count, const double matrix[16]) {
+    kernels()->transformPoints(in, out, count, matrix);
+}
+
+/**
+ * Transforms a set of points to homogeneous coordinates, e.g. clip space for a projection matrix.
+ *
+ * @param in Packed x, y, z coordinates.
+ * @param out Receives x, y, z, w per point (4 * count floats). Must not overlap in.
+ * @param count Number of points.
+ * @param matrix Row-major 4x4 matrix.
+ */
+void GeometryKernels::projectPoints(const float* in, float* out, size_t count, const double matrix[16]) {
+    kernels()->projectPoints(in, out, count, matrix);
+}
+
+/**
+ * Computes the unit normal of each triangle, following the right-hand rule.
+ *
+ * @param points Packed x, y, z coordinates.
+ * @param triangles Three vertex indices per triangle.
+ * @param triangleCount Number of triangles.
+ * @param normals Receives x, y, z per triangle; degenerate triangles get a zero vector.
+ */
+void GeometryKernels::faceNormals(const float* points, const uint32_t* triangles, size_t triangleCount, float* normals) {
+    kernels()->faceNormals(points, triangles, triangleCount, normals);
+}
+
+/**
+ * Quantises points to 16 bits per coordinate within a bounding box.
+ *
+ * @param points Packed x, y, z coordinates.
+ * @param count Number of points.
+ * @param bounds The box mapped onto 0-65535, as xmin, xmax, ymin, ymax, zmin, zmax.
+ * @param out Receives three values per point; coordinates outside the box are clamped.
+ */
+void GeometryKernels::quantize(const float* points, size_t count, const double bounds[6], uint16_t* out) {
+    kernels()->quantize(points, count, bounds, out);
+}
+
+/**
+ * Computes the surface area of a triangle mesh and the centroid of that surface.
+ *
+ * @param points Packed x, y, z coordinates.
+ * @param triangles Three vertex indices per triangle.
+ * @param triangleCount Number of triangles.
+ * @param centroid Receives the area-weighted centroid, or the origin if the area is zero.
+ * @param area Receives the total area.
+ */
+void GeometryKernels::centroidAndArea(const float* points, const uint32_t* triangles, size_t triangleCount, double centroid[3], double& area) {
+    float origin[3];
+    meshOrigin(points, triangles, triangleCount, origin);
+    double sums[4];
+    kernels()->centroidAndArea(points, triangles, triangleCount, origin, sums);
+    area = sums[0] * 0.5;
+    for (int k = 0; k < 3; ++k) {
+        centroid[k] = sums[0] > 0.0 ? origin[k] + sums[k + 1] / (3.0 * sums[0]) : 0.0;
+    }
+}
+
+/**
+ * Integrates over the solid bounded by a closed triangle mesh, using the divergence theorem to turn
+ * each integral into a sum over the tetrahedra joining the triangles to a vertex of the mesh. The
+ * moments about that vertex are moved to the world origin in double precision, so parts far from
+ * the origin lose no accuracy. Triangles must wind counter-clockwise seen from outside; inside-out
+ * meshes give negated results.
+ *
+ * @param points Packed x, y, z coordinates.
+ * @param triangles Three vertex indices per triangle.
+ * @param triangleCount Number of triangles.
+ * @param integrals Receives the volume; the integrals of x, y and z; and the integrals of xx, yy,
+ *        zz, xy, yz and zx.
+ */
+void GeometryKernels::volumeIntegrals(const float* points, const uint32_t* triangles, size_t triangleCount, double integrals[10]) {
+    float origin[3];
+    meshOrigin(points, triangles, triangleCount, origin);
+    double sums[10];
+    kernels()->volumeIntegrals(points, triangles, triangleCount, origin, sums);
+
+    // Parallel-axis shift from the origin o: x = o + r, so int x = V o + int r and
+    // int x_i x_j = int r_i r_j + o_i int r_j + o_j int r_i + V o_i o_j
+    const double volume = sums[0] / 6.0;
+    double first[3];
+    for (int k = 0; k < 3; ++k) {
+        first[k] = sums[1 + k] / 24.0;
+    }
+    static const int products[6][2] = { { 0, 0 }, { 1, 1 }, { 2, 2 }, { 0, 1 }, { 1, 2 }, { 2, 0 } };
+    for (int p = 0; p < 6; ++p) {
+        const int i = products[p][0], j = products[p][1];
+        integrals[4 + p] = sums[4 + p] / 120.0 + origin[i] * first[j] + origin[j] * first[i] + volume * origin[i] * origin[j];
+    }
+    for (int k = 0; k < 3; ++k) {
+        integrals[1 + k] = first[k] + volume * origin[k];
+    }
+    integrals[0] = volume;
+}
+
+/**
+ * Gets the instruction set the kernels are currently using.
+ *
+ * @return The active instruction set.
+ */
+GeometryKernels::InstructionSet GeometryKernels::instructionSet() {
+    kernels();
+    return InstructionSet(activeSet.load());
+}
+
+/**
+ * Gets the widest instruction set that is both supported by this CPU and compiled in.
+ *
+ * @return The best available instruction set.
+ */
+GeometryKernels::InstructionSet GeometryKernels::bestSupported() {
+    static const InstructionSet best = [] {
+        int set = detectInstructionSet();
+        while (set > Scalar && !tableFor(InstructionSet(set))) --set;
+        return InstructionSet(set);
+    }();
+    return best;
+}
+
+/**
+ * Selects the implementation used by all kernels, e.g. to benchmark one against another.
+ *
+ * @param set The instruction set to use.
+ * @return False, with no change made, if the set is not supported or not compiled in.
+ */
+bool GeometryKernels::setInstructionSet(InstructionSet set) {
+    if (set > bestSupported() || !tableFor(set))
+        return false;
+    activeSet.store(set);
+    activeKernels.store(tableFor(set), std::memory_order_release);
+    return true;
+}
+
+/**
+ * Gets the lower-case name of an instruction set, as accepted by VIEWER_SIMD.
+ *
+ * @param set The instruction set.
+ * @return Its name.
+ */
+const char* GeometryKernels::name(InstructionSet set) {
+    switch (set) {
+    case SSE2: return "sse2";
+    case AVX2: return "avx2";
+    case AVX512: return "avx512";
+    default: return "scalar";
+    }
+}
@@ -0,0 +1,48 @@
+/**
+ * @file GeometryKernels.h
+ *
+ * Defines the GeometryKernels class, a small library of vectorised loops over point and triangle
+ * arrays: bounds, transforms, projection, face normals, quantisation, surface centroid/area and
+ * solid volume integrals. Each kernel has SSE2, AVX2 and AVX-512 implementations alongside a
+ * scalar reference, and the fastest one the CPU supports is selected the first time any kernel is
+ * called.
+ *
+ * Points are stored as packed x, y, z floats and triangles as three vertex indices, the layout
+ * produced by StlParser. Matrices are row-major 4x4, as in vtkMatrix4x4.
+ */
+
+#ifndef VIEWER_GEOMETRYKERNELS_H
+#define VIEWER_GEOMETRYKERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @class GeometryKernels
+ * @brief Runtime-dispatched SIMD kernels for mesh processing.
+ */
+class GeometryKernels {
+public:
+    /** Instruction sets a kernel implementation can target, in increasing order of width. */
+    enum InstructionSet {
+        Scalar,
+        SSE2,
+        AVX2,
+        AVX512
+    };
+
+    static void bounds(const float* points, size_t count, double bounds[6]);
+    static void transformPoints(const float* in, float* out, size_t count, const double matrix[16]);
+    static void projectPoints(const float* in, float* out, size_t count, const double matrix[16]);
+    static void faceNormals(const float* points, const uint32_t* triangles, size_t triangleCount, float* normals);
+    static void quantize(const float* points, size_t count, const double bounds[6], uint16_t* out);
+    static void centroidAndArea(const float* points, const uint32_t* triangles, size_t triangleCount, double centroid[3], double& area);
+    static void volumeIntegrals(const float* points, const uint32_t* triangles, size_t triangleCount, double integrals[10]);
+
+    static InstructionSet instructionSet();
+    static InstructionSet bestSupported();
+    static bool setInstructionSet(InstructionSet set);
+    static const char* name(InstructionSet set);
+};
+
+#endif // VIEWER_GEOMETRYKERNELS_H
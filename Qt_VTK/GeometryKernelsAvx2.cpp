@@ -0,0 +1,72 @@
+/**
+ * @file GeometryKernelsAvx2.cpp
+ * @brief AVX2 implementation of the geometry kernels. Compiled with AVX2 and FMA enabled.
+ */
+
+#if defined(__AVX2__)
+
+#include <immintrin.h>
+#include <cstdint>
+
+namespace {
+
+/**
+ * @struct Avx2
+ * @brief Eight-float registers, treated as two 128-bit lanes of four points each.
+ */
+struct Avx2 {
+    typedef __m256 V;
+    static const int L = 8;
+
+    static V loadu(const float* p) { return _mm256_loadu_ps(p); }
+    static void storeu(float* p, V v) { _mm256_storeu_ps(p, v); }
+    static V loadLanes(const float* p, int stride) {
+        return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p)), _mm_loadu_ps(p + stride), 1);
+    }
+    static void storeLanes(float* p, int stride, V v) {
+        _mm_storeu_ps(p, _mm256_castps256_ps128(v));
+        _mm_storeu_ps(p + stride, _mm256_extractf128_ps(v, 1));
+    }
+    static V set1(float f) { return _mm256_set1_ps(f); }
+    static V add(V a, V b) { return _mm256_add_ps(a, b); }
+    static V sub(V a, V b) { return _mm256_sub_ps(a, b); }
+    static V mul(V a, V b) { return _mm256_mul_ps(a, b); }
+    static V div(V a, V b) { return _mm256_div_ps(a, b); }
+    static V madd(V a, V b, V c) { return _mm256_fmadd_ps(a, b, c); }
+    static V min(V a, V b) { return _mm256_min_ps(a, b); }
+    static V max(V a, V b) { return _mm256_max_ps(a, b); }
+    static V sqrt(V a) { return _mm256_sqrt_ps(a); }
+    static V unpacklo(V a, V b) { return _mm256_unpacklo_ps(a, b); }
+    static V unpackhi(V a, V b) { return _mm256_unpackhi_ps(a, b); }
+    template <int imm> static V shuffle(V a, V b) { return _mm256_shuffle_ps(a, b, imm); }
+
+    static V gather(const float* base, V indexBits) {
+        __m256i index = _mm256_castps_si256(indexBits);
+        return _mm256_i32gather_ps(base, _mm256_add_epi32(index, _mm256_add_epi32(index, index)), 4);
+    }
+
+    static void storeU16(uint16_t* p, V v) {
+        __m256i i = _mm256_cvtps_epi32(v);
+        __m128i packed = _mm_packus_epi32(_mm256_castsi256_si128(i), _mm256_extracti128_si256(i, 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p), packed);
+    }
+};
+
+} // namespace
+
+#define GEOMETRY_KERNELS_TRAITS Avx2
+#include "GeometryKernelsImpl.h"
+
+const GeometryKernelTable* avx2GeometryKernels() {
+    return &kKernels;
+}
+
+#else
+
+#include "GeometryKernelsImpl.h"
+
+const GeometryKernelTable* avx2GeometryKernels() {
+    return nullptr;
+}
+
+#endif
@@ -0,0 +1,75 @@
+/**
+ * @file GeometryKernelsAvx512.cpp
+ * @brief AVX-512 implementation of the geometry kernels. Compiled with AVX-512F enabled.
+ */
+
+#if defined(__AVX512F__)
+
+#include <immintrin.h>
+#include <cstdint>
+
+namespace {
+
+/**
+ * @struct Avx512
+ * @brief Sixteen-float registers, treated as four 128-bit lanes of four points each.
+ */
+struct Avx512 {
+    typedef __m512 V;
+    static const int L = 16;
+
+    static V loadu(const float* p) { return _mm512_loadu_ps(p); }
+    static void storeu(float* p, V v) { _mm512_storeu_ps(p, v); }
+    static V loadLanes(const float* p, int stride) {
+        V v = _mm512_castps128_ps512(_mm_loadu_ps(p));
+        v = _mm512_insertf32x4(v, _mm_loadu_ps(p + stride), 1);
+        v = _mm512_insertf32x4(v, _mm_loadu_ps(p + 2 * stride), 2);
+        return _mm512_insertf32x4(v, _mm_loadu_ps(p + 3 * stride), 3);
+    }
+    static void storeLanes(float* p, int stride, V v) {
+        _mm_storeu_ps(p, _mm512_castps512_ps128(v));
+        _mm_storeu_ps(p + stride, _mm512_extractf32x4_ps(v, 1));
+        _mm_storeu_ps(p + 2 * stride, _mm512_extractf32x4_ps(v, 2));
+        _mm_storeu_ps(p + 3 * stride, _mm512_extractf32x4_ps(v, 3));
+    }
+    static V set1(float f) { return _mm512_set1_ps(f); }
+    static V add(V a, V b) { return _mm512_add_ps(a, b); }
+    static V sub(V a, V b) { return _mm512_sub_ps(a, b); }
+    static V mul(V a, V b) { return _mm512_mul_ps(a, b); }
+    static V div(V a, V b) { return _mm512_div_ps(a, b); }
+    static V madd(V a, V b, V c) { return _mm512_fmadd_ps(a, b, c); }
+    static V min(V a, V b) { return _mm512_min_ps(a, b); }
+    static V max(V a, V b) { return _mm512_max_ps(a, b); }
+    static V sqrt(V a) { return _mm512_sqrt_ps(a); }
+    static V unpacklo(V a, V b) { return _mm512_unpacklo_ps(a, b); }
+    static V unpackhi(V a, V b) { return _mm512_unpackhi_ps(a, b); }
+    template <int imm> static V shuffle(V a, V b) { return _mm512_shuffle_ps(a, b, imm); }
+
+    static V gather(const float* base, V indexBits) {
+        __m512i index = _mm512_castps_si512(indexBits);
+        return _mm512_i32gather_ps(_mm512_add_epi32(index, _mm512_add_epi32(index, index)), base, 4);
+    }
+
+    static void storeU16(uint16_t* p, V v) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), _mm512_cvtusepi32_epi16(_mm512_cvtps_epi32(v)));
+    }
+};
+
+} // namespace
+
+#define GEOMETRY_KERNELS_TRAITS Avx512
+#include "GeometryKernelsImpl.h"
+
+const GeometryKernelTable* avx512GeometryKernels() {
+    return &kKernels;
+}
+
+#else
+
+#include "GeometryKernelsImpl.h"
+
+const GeometryKernelTable* avx512GeometryKernels() {
+    return nullptr;
+}
+
+#endif
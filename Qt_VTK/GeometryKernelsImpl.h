@@ -0,0 +1,398 @@
+/**
+ * @file GeometryKernelsImpl.h
+ *
+ * Internal to the GeometryKernels implementation. Declares the per-instruction-set kernel tables
+ * and the scalar reference kernels, and defines the vectorised kernels as templates over a small
+ * traits class that wraps the intrinsics of one instruction set.
+ *
+ * Each GeometryKernels<ISA>.cpp file defines its traits, includes this header and is compiled with
+ * the matching compiler flags. The templates are in an anonymous namespace so that code generated
+ * for a wide instruction set can never be merged with, and called from, another file.
+ *
+ * Points are loaded three registers at a time. With L floats per register that is L points, which
+ * are split into x, y and z registers with shuffles that work within each 128-bit lane; wider
+ * registers are filled lane by lane from consecutive groups of four points so the same shuffles
+ * apply unchanged.
+ */
+
+#ifndef VIEWER_GEOMETRYKERNELSIMPL_H
+#define VIEWER_GEOMETRYKERNELSIMPL_H
+
+#include "GeometryKernels.h"
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @struct GeometryKernelTable
+ * @brief Entry points of one implementation of the kernels.
+ */
+struct GeometryKernelTable {
+    void (*bounds)(const float* points, size_t count, double bounds[6]);
+    void (*transformPoints)(const float* in, float* out, size_t count, const double matrix[16]);
+    void (*projectPoints)(const float* in, float* out, size_t count, const double matrix[16]);
+    void (*faceNormals)(const float* points, const uint32_t* triangles, size_t triangleCount, float* normals);
+    void (*quantize)(const float* points, size_t count, const double bounds[6], uint16_t* out);
+    void (*centroidAndArea)(const float* points, const uint32_t* triangles, size_t triangleCount, const float origin[3], double sums[4]);
+    void (*volumeIntegrals)(const float* points, const uint32_t* triangles, size_t triangleCount, const float origin[3], double sums[10]);
+};
+
+/// Each returns nullptr if the file was built without the instruction set.
+const GeometryKernelTable* scalarGeometryKernels();
+const GeometryKernelTable* sse2GeometryKernels();
+const GeometryKernelTable* avx2GeometryKernels();
+const GeometryKernelTable* avx512GeometryKernels();
+
+/**
+ * Scalar reference kernels. They define the results the vector kernels must reproduce and also
+ * process the few elements left over after the last full register.
+ *
+ * centroidAndArea and volumeIntegrals kernels work in coordinates relative to an origin near the
+ * mesh, which GeometryKernels picks and shifts the results back from. The vector kernels sum in
+ * float between flushes to double, and coordinates thousands of units from the world origin would
+ * otherwise cancel in those sums.
+ *
+ * centroidAndArea kernels return unnormalised sums: twice the area in sums[0] and the sum over
+ * triangles of twice the area times the vertex sum in sums[1..3]. GeometryKernels turns them into
+ * a centroid and an area.
+ *
+ * volumeIntegrals kernels return, summed over the tetrahedra joining each triangle to the origin,
+ * the determinant d = a . (b x c), d times the vertex sum s, and d times sum(v_i v_j) + s_i s_j
+ * for the products xx, yy, zz, xy, yz and zx. GeometryKernels scales them into volume integrals.
+ */
+namespace GeometryKernelsScalar {
+void bounds(const float* points, size_t count, double bounds[6]);
+void transformPoints(const float* in, float* out, size_t count, const double matrix[16]);
+void projectPoints(const float* in, float* out, size_t count, const double matrix[16]);
+void faceNormals(const float* points, const uint32_t* triangles, size_t triangleCount, float* normals);
+void quantize(const float* points, size_t count, const double bounds[6], uint16_t* out);
+void centroidAndArea(const float* points, const uint32_t* triangles, size_t triangleCount, const float origin[3], double sums[4]);
+void volumeIntegrals(const float* points, const uint32_t* triangles, size_t triangleCount, const float origin[3], double sums[10]);
+float quantizeScale(double min, double max);
+}
+
+#ifdef GEOMETRY_KERNELS_TRAITS
+
+namespace {
+
+/// Shorter name for the traits of the instruction set this file is compiled for.
+typedef GEOMETRY_KERNELS_TRAITS S;
+typedef S::V V;
+
+/** Block size, in registers, after which float accumulators are flushed to double. */
+const size_t kFlushInterval = 256;
+
+#define GK_SHUFFLE(d, c, b, a) (((d) << 6) | ((c) << 4) | ((b) << 2) | (a))
+
+/**
+ * Loads 3 * L packed x, y, z floats and splits them into one register per component.
+ */
+inline void load3(const float* p, V& x, V& y, V& z) {
+    V a = S::loadLanes(p, 12), b = S::loadLanes(p + 4, 12), c = S::loadLanes(p + 8, 12);
+    V t = S::shuffle<GK_SHUFFLE(2, 1, 3, 2)>(b, c); // x2 y2 x3 y3
+    x = S::shuffle<GK_SHUFFLE(2, 0, 3, 0)>(a, t);
+    V u = S::shuffle<GK_SHUFFLE(0, 0, 1, 1)>(a, b); // y0 y0 y1 y1
+    y = S::shuffle<GK_SHUFFLE(3, 1, 2, 0)>(u, t);
+    V v = S::shuffle<GK_SHUFFLE(1, 1, 2, 2)>(a, b); // z0 z0 z1 z1
+    V w = S::shuffle<GK_SHUFFLE(3, 3, 0, 0)>(c, c); // z2 z2 z3 z3
+    z = S::shuffle<GK_SHUFFLE(2, 0, 2, 0)>(v, w);
+}
+
+/**
+ * The inverse of load3: interleaves x, y and z registers into 3 * L packed floats.
+ */
+inline void store3(float* p, V x, V y, V z) {
+    V lo = S::unpacklo(x, y); // x0 y0 x1 y1
+    V hi = S::unpackhi(x, y); // x2 y2 x3 y3
+    V a = S::shuffle<GK_SHUFFLE(2, 2, 0, 0)>(z, lo); // z0 z0 x1 x1
+    S::storeLanes(p, 12, S::shuffle<GK_SHUFFLE(2, 0, 1, 0)>(lo, a));
+    V b = S::shuffle<GK_SHUFFLE(1, 1, 3, 3)>(lo, z); // y1 y1 z1 z1
+    S::storeLanes(p + 4, 12, S::shuffle<GK_SHUFFLE(1, 0, 2, 0)>(b, hi));
+    V c = S::shuffle<GK_SHUFFLE(2, 2, 2, 2)>(z, hi); // z2 z2 x3 x3
+    V d = S::shuffle<GK_SHUFFLE(3, 3, 3, 3)>(hi, z); // y3 y3 z3 z3
+    S::storeLanes(p + 8, 12, S::shuffle<GK_SHUFFLE(2, 0, 2, 0)>(c, d));
+}
+
+/**
+ * Interleaves x, y, z and w registers into 4 * L packed floats.
+ */
+inline void store4(float* p, V x, V y, V z, V w) {
+    V a = S::unpacklo(x, y), b = S::unpacklo(z, w), c = S::unpackhi(x, y), d = S::unpackhi(z, w);
+    S::storeLanes(p, 16, S::shuffle<GK_SHUFFLE(1, 0, 1, 0)>(a, b));
+    S::storeLanes(p + 4, 16, S::shuffle<GK_SHUFFLE(3, 2, 3, 2)>(a, b));
+    S::storeLanes(p + 8, 16, S::shuffle<GK_SHUFFLE(1, 0, 1, 0)>(c, d));
+    S::storeLanes(p + 12, 16, S::shuffle<GK_SHUFFLE(3, 2, 3, 2)>(c, d));
+}
+
+/**
+ * Loads the three corners of L triangles as x, y, z registers per corner.
+ */
+inline void loadTriangles(const float* points, const uint32_t* triangles, V corner[3][3]) {
+    V i0, i1, i2;
+    load3(reinterpret_cast<const float*>(triangles), i0, i1, i2); // Shuffles move the index bits untouched
+    const V indices[3] = { i0, i1, i2 };
+    for (int c = 0; c < 3; ++c) {
+        for (int k = 0; k < 3; ++k) {
+            corner[c][k] = S::gather(points + k, indices[c]);
+        }
+    }
+}
+
+/**
+ * Moves the corners loaded by loadTriangles to coordinates relative to an origin.
+ */
+inline void relativeTo(const V origin[3], V corner[3][3]) {
+    for (int c = 0; c < 3; ++c) {
+        for (int k = 0; k < 3; ++k) {
+            corner[c][k] = S::sub(corner[c][k], origin[k]);
+        }
+    }
+}
+
+/**
+ * Builds the register at position r of a block of 3 registers, where element i holds
+ * values[(r * L + i) % 3]; packed x, y, z data then lines up with it without shuffling.
+ */
+inline V componentPattern(const float values[3], int r) {
+    float pattern[S::L];
+    for (int i = 0; i < S::L; ++i) {
+        pattern[i] = values[(r * S::L + i) % 3];
+    }
+    return S::loadu(pattern);
+}
+
+void bounds(const float* points, size_t count, double bounds[6]) {
+    const size_t blocks = count / S::L;
+    if (blocks == 0) {
+        GeometryKernelsScalar::bounds(points, count, bounds);
+        return;
+    }
+
+    V lo[3], hi[3];
+    for (int r = 0; r < 3; ++r) {
+        lo[r] = hi[r] = S::loadu(points + r * S::L);
+    }
+    for (size_t b = 1; b < blocks; ++b) {
+        const float* p = points + b * 3 * S::L;
+        for (int r = 0; r < 3; ++r) {
+            V v = S::loadu(p + r * S::L);
+            lo[r] = S::min(lo[r], v);
+            hi[r] = S::max(hi[r], v);
+        }
+    }
+
+    float low[3 * S::L], high[3 * S::L];
+    for (int r = 0; r < 3; ++r) {
+        S::storeu(low + r * S::L, lo[r]);
+        S::storeu(high + r * S::L, hi[r]);
+    }
+    float result[6] = { low[0], high[0], low[1], high[1], low[2], high[2] };
+    for (int i = 3; i < 3 * S::L; ++i) {
+        const int k = i % 3;
+        if (low[i] < result[2 * k]) result[2 * k] = low[i];
+        if (high[i] > result[2 * k + 1]) result[2 * k + 1] = high[i];
+    }
+
+    const size_t done = blocks * S::L;
+    if (done < count) {
+        double tail[6];
+        GeometryKernelsScalar::bounds(points + done * 3, count - done, tail);
+        for (int k = 0; k < 3; ++k) {
+            if (tail[2 * k] < result[2 * k]) result[2 * k] = static_cast<float>(tail[2 * k]);
+            if (tail[2 * k + 1] > result[2 * k + 1]) result[2 * k + 1] = static_cast<float>(tail[2 * k + 1]);
+        }
+    }
+    for (int i = 0; i < 6; ++i) {
+        bounds[i] = result[i];
+    }
+}
+
+void transformPoints(const float* in, float* out, size_t count, const double matrix[16]) {
+    V m[12];
+    for (int i = 0; i < 12; ++i) {
+        m[i] = S::set1(static_cast<float>(matrix[i]));
+    }
+
+    const size_t blocks = count / S::L;
+    for (size_t b = 0; b < blocks; ++b) {
+        V x, y, z;
+        load3(in + b * 3 * S::L, x, y, z);
+        V tx = S::madd(m[0], x, S::madd(m[1], y, S::madd(m[2], z, m[3])));
+        V ty = S::madd(m[4], x, S::madd(m[5], y, S::madd(m[6], z, m[7])));
+        V tz = S::madd(m[8], x, S::madd(m[9], y, S::madd(m[10], z, m[11])));
+        store3(out + b * 3 * S::L, tx, ty, tz);
+    }
+
+    const size_t done = blocks * S::L;
+    GeometryKernelsScalar::transformPoints(in + done * 3, out + done * 3, count - done, matrix);
+}
+
+void projectPoints(const float* in, float* out, size_t count, const double matrix[16]) {
+    V m[16];
+    for (int i = 0; i < 16; ++i) {
+        m[i] = S::set1(static_cast<float>(matrix[i]));
+    }
+
+    const size_t blocks = count / S::L;
+    for (size_t b = 0; b < blocks; ++b) {
+        V x, y, z;
+        load3(in + b * 3 * S::L, x, y, z);
+        V cx = S::madd(m[0], x, S::madd(m[1], y, S::madd(m[2], z, m[3])));
+        V cy = S::madd(m[4], x, S::madd(m[5], y, S::madd(m[6], z, m[7])));
+        V cz = S::madd(m[8], x, S::madd(m[9], y, S::madd(m[10], z, m[11])));
+        V cw = S::madd(m[12], x, S::madd(m[13], y, S::madd(m[14], z, m[15])));
+        store4(out + b * 4 * S::L, cx, cy, cz, cw);
+    }
+
+    const size_t done = blocks * S::L;
+    GeometryKernelsScalar::projectPoints(in + done * 3, out + done * 4, count - done, matrix);
+}
+
+void faceNormals(const float* points, const uint32_t* triangles, size_t triangleCount, float* normals) {
+    const V tiny = S::set1(1e-30f);
+    const size_t blocks = triangleCount / S::L;
+    for (size_t b = 0; b < blocks; ++b) {
+        V c[3][3];
+        loadTriangles(points, triangles + b * 3 * S::L, c);
+        V e1x = S::sub(c[1][0], c[0][0]), e1y = S::sub(c[1][1], c[0][1]), e1z = S::sub(c[1][2], c[0][2]);
+        V e2x = S::sub(c[2][0], c[0][0]), e2y = S::sub(c[2][1], c[0][1]), e2z = S::sub(c[2][2], c[0][2]);
+        V nx = S::sub(S::mul(e1y, e2z), S::mul(e1z, e2y));
+        V ny = S::sub(S::mul(e1z, e2x), S::mul(e1x, e2z));
+        V nz = S::sub(S::mul(e1x, e2y), S::mul(e1y, e2x));
+        V length = S::max(S::sqrt(S::add(S::mul(nx, nx), S::add(S::mul(ny, ny), S::mul(nz, nz)))), tiny);
+        store3(normals + b * 3 * S::L, S::div(nx, length), S::div(ny, length), S::div(nz, length));
+    }
+
+    const size_t done = blocks * S::L;
+    GeometryKernelsScalar::faceNormals(points, triangles + done * 3, triangleCount - done, normals + done * 3);
+}
+
+void quantize(const float* points, size_t count, const double bounds[6], uint16_t* out) {
+    const float minimum[3] = { static_cast<float>(bounds[0]), static_cast<float>(bounds[2]), static_cast<float>(bounds[4]) };
+    const float scale[3] = {
+        GeometryKernelsScalar::quantizeScale(bounds[0], bounds[1]),
+        GeometryKernelsScalar::quantizeScale(bounds[2], bounds[3]),
+        GeometryKernelsScalar::quantizeScale(bounds[4], bounds[5])
+    };
+    V lo[3], sc[3];
+    for (int r = 0; r < 3; ++r) {
+        lo[r] = componentPattern(minimum, r);
+        sc[r] = componentPattern(scale, r);
+    }
+    const V zero = S::set1(0.0f), top = S::set1(65535.0f);
+
+    const size_t blocks = count / S::L;
+    for (size_t b = 0; b < blocks; ++b) {
+        for (int r = 0; r < 3; ++r) {
+            const size_t offset = (b * 3 + r) * S::L;
+            V v = S::mul(S::sub(S::loadu(points + offset), lo[r]), sc[r]);
+            S::storeU16(out + offset, S::min(S::max(v, zero), top));
+        }
+    }
+
+    const size_t done = blocks * S::L;
+    GeometryKernelsScalar::quantize(points + done * 3, count - done, bounds, out + done * 3);
+}
+
+void centroidAndArea(const float* points, const uint32_t* triangles, size_t triangleCount, const float origin[3], double sums[4]) {
+    for (int i = 0; i < 4; ++i) sums[i] = 0.0;
+    const V o[3] = { S::set1(origin[0]), S::set1(origin[1]), S::set1(origin[2]) };
+
+    const size_t blocks = triangleCount / S::L;
+    for (size_t start = 0; start < blocks; start += kFlushInterval) {
+        // Accumulate a bounded number of triangles in float, then add the partial sums in double
+        V area = S::set1(0.0f), cx = area, cy = area, cz = area;
+        const size_t end = start + kFlushInterval < blocks ? start + kFlushInterval : blocks;
+        for (size_t b = start; b < end; ++b) {
+            V c[3][3];
+            loadTriangles(points, triangles + b * 3 * S::L, c);
+            relativeTo(o, c);
+            V e1x = S::sub(c[1][0], c[0][0]), e1y = S::sub(c[1][1], c[0][1]), e1z = S::sub(c[1][2], c[0][2]);
+            V e2x = S::sub(c[2][0], c[0][0]), e2y = S::sub(c[2][1], c[0][1]), e2z = S::sub(c[2][2], c[0][2]);
+            V nx = S::sub(S::mul(e1y, e2z), S::mul(e1z, e2y));
+            V ny = S::sub(S::mul(e1z, e2x), S::mul(e1x, e2z));
+            V nz = S::sub(S::mul(e1x, e2y), S::mul(e1y, e2x));
+            V twiceArea = S::sqrt(S::add(S::mul(nx, nx), S::add(S::mul(ny, ny), S::mul(nz, nz))));
+            area = S::add(area, twiceArea);
+            cx = S::madd(twiceArea, S::add(c[0][0], S::add(c[1][0], c[2][0])), cx);
+            cy = S::madd(twiceArea, S::add(c[0][1], S::add(c[1][1], c[2][1])), cy);
+            cz = S::madd(twiceArea, S::add(c[0][2], S::add(c[1][2], c[2][2])), cz);
+        }
+
+        const V partial[4] = { area, cx, cy, cz };
+        float lanes[S::L];
+        for (int i = 0; i < 4; ++i) {
+            S::storeu(lanes, partial[i]);
+            for (int k = 0; k < S::L; ++k) {
+                sums[i] += lanes[k];
+            }
+        }
+    }
+
+    const size_t done = blocks * S::L;
+    double tail[4];
+    GeometryKernelsScalar::centroidAndArea(points, triangles + done * 3, triangleCount - done, origin, tail);
+    for (int i = 0; i < 4; ++i) {
+        sums[i] += tail[i];
+    }
+}
+
+void volumeIntegrals(const float* points, const uint32_t* triangles, size_t triangleCount, const float origin[3], double sums[10]) {
+    for (int i = 0; i < 10; ++i) sums[i] = 0.0;
+    const V o[3] = { S::set1(origin[0]), S::set1(origin[1]), S::set1(origin[2]) };
+
+    const size_t blocks = triangleCount / S::L;
+    for (size_t start = 0; start < blocks; start += kFlushInterval) {
+        V acc[10];
+        for (int i = 0; i < 10; ++i) acc[i] = S::set1(0.0f);
+        const size_t end = start + kFlushInterval < blocks ? start + kFlushInterval : blocks;
+        for (size_t b = start; b < end; ++b) {
+            V c[3][3];
+            loadTriangles(points, triangles + b * 3 * S::L, c);
+            relativeTo(o, c);
+            V crossX = S::sub(S::mul(c[1][1], c[2][2]), S::mul(c[1][2], c[2][1]));
+            V crossY = S::sub(S::mul(c[1][2], c[2][0]), S::mul(c[1][0], c[2][2]));
+            V crossZ = S::sub(S::mul(c[1][0], c[2][1]), S::mul(c[1][1], c[2][0]));
+            V det = S::madd(c[0][0], crossX, S::madd(c[0][1], crossY, S::mul(c[0][2], crossZ)));
+            V sum[3];
+            for (int k = 0; k < 3; ++k) {
+                sum[k] = S::add(c[0][k], S::add(c[1][k], c[2][k]));
+            }
+            acc[0] = S::add(acc[0], det);
+            for (int k = 0; k < 3; ++k) {
+                acc[1 + k] = S::madd(det, sum[k], acc[1 + k]);
+            }
+            static const int products[6][2] = { { 0, 0 }, { 1, 1 }, { 2, 2 }, { 0, 1 }, { 1, 2 }, { 2, 0 } };
+            for (int p = 0; p < 6; ++p) {
+                const int i = products[p][0], j = products[p][1];
+                V q = S::madd(c[0][i], c[0][j], S::madd(c[1][i], c[1][j], S::madd(c[2][i], c[2][j], S::mul(sum[i], sum[j]))));
+                acc[4 + p] = S::madd(det, q, acc[4 + p]);
+            }
+        }
+
+        float lanes[S::L];
+        for (int i = 0; i < 10; ++i) {
+            S::storeu(lanes, acc[i]);
+            for (int k = 0; k < S::L; ++k) {
+                sums[i] += lanes[k];
+            }
+        }
+    }
+
+    const size_t done = blocks * S::L;
+    double tail[10];
+    GeometryKernelsScalar::volumeIntegrals(points, triangles + done * 3, triangleCount - done, origin, tail);
+    for (int i = 0; i < 10; ++i) {
+        sums[i] += tail[i];
+    }
+}
+
+/// The kernel table for this instruction set.
+const GeometryKernelTable kKernels = { bounds, transformPoints, projectPoints, faceNormals, quantize, centroidAndArea, volumeIntegrals };
+
+#undef GK_SHUFFLE
+
+} // namespace
+
+#endif // GEOMETRY_KERNELS_TRAITS
+
+#endif // VIEWER_GEOMETRYKERNELSIMPL_H
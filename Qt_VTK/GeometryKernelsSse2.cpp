@@ -0,0 +1,69 @@
+/**
+ * @file GeometryKernelsSse2.cpp
+ * @brief SSE2 implementation of the geometry kernels.
+ */
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+
+#include <emmintrin.h>
+#include <cstdint>
+
+namespace {
+
+/**
+ * @struct Sse2
+ * @brief Four-float registers. SSE2 has no gather, so triangle corners are loaded one by one.
+ */
+struct Sse2 {
+    typedef __m128 V;
+    static const int L = 4;
+
+    static V loadu(const float* p) { return _mm_loadu_ps(p); }
+    static void storeu(float* p, V v) { _mm_storeu_ps(p, v); }
+    static V loadLanes(const float* p, int) { return _mm_loadu_ps(p); }
+    static void storeLanes(float* p, int, V v) { _mm_storeu_ps(p, v); }
+    static V set1(float f) { return _mm_set1_ps(f); }
+    static V add(V a, V b) { return _mm_add_ps(a, b); }
+    static V sub(V a, V b) { return _mm_sub_ps(a, b); }
+    static V mul(V a, V b) { return _mm_mul_ps(a, b); }
+    static V div(V a, V b) { return _mm_div_ps(a, b); }
+    static V madd(V a, V b, V c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+    static V min(V a, V b) { return _mm_min_ps(a, b); }
+    static V max(V a, V b) { return _mm_max_ps(a, b); }
+    static V sqrt(V a) { return _mm_sqrt_ps(a); }
+    static V unpacklo(V a, V b) { return _mm_unpacklo_ps(a, b); }
+    static V unpackhi(V a, V b) { return _mm_unpackhi_ps(a, b); }
+    template <int imm> static V shuffle(V a, V b) { return _mm_shuffle_ps(a, b, imm); }
+
+    static V gather(const float* base, V indexBits) {
+        alignas(16) uint32_t index[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(index), _mm_castps_si128(indexBits));
+        return _mm_setr_ps(base[index[0] * 3], base[index[1] * 3], base[index[2] * 3], base[index[3] * 3]);
+    }
+
+    static void storeU16(uint16_t* p, V v) {
+        // No unsigned saturating pack before SSE4.1: shift into signed range, pack, shift back
+        __m128i i = _mm_sub_epi32(_mm_cvtps_epi32(v), _mm_set1_epi32(32768));
+        __m128i packed = _mm_xor_si128(_mm_packs_epi32(i, i), _mm_set1_epi16(static_cast<short>(0x8000)));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(p), packed);
+    }
+};
+
+} // namespace
+
+#define GEOMETRY_KERNELS_TRAITS Sse2
+#include "GeometryKernelsImpl.h"
+
+const GeometryKernelTable* sse2GeometryKernels() {
+    return &kKernels;
+}
+
+#else
+
+#include "GeometryKernelsImpl.h"
+
+const GeometryKernelTable* sse2GeometryKernels() {
+    return nullptr;
+}
+
+#endif
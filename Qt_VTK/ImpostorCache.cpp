@@ -0,0 +1,378 @@
+/**
+ * @file ImpostorCache.cpp
+ * @brief Implementation of the ImpostorCache class.
+ *
+ * Captures use a parallel projection centred on the part's bounding sphere so that the image can be
+ * drawn on a quad of the sphere's diameter. Billboards are vtkFollower actors, which keep their Y axis
+ * aligned with the camera view up, so the view up is stored and compared alongside the direction.
+ */
+
+#include "ImpostorCache.h"
+#include <vtkActor.h>
+#include <vtkCamera.h>
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <vtkPolyDataMapper.h>
+#include <vtkProperty.h>
+#include <vtkWindowToImageFilter.h>
+#include <vtkMath.h>
+#include <algorithm>
+#include <cmath>
+#include <unordered_set>
+
+namespace {
+
+const int kTextureSize = 64; ///< Width and height of captured images in pixels.
+const size_t kMaxViews = 4; ///< Number of view directions cached per part.
+
+/**
+ * Computes the centre and radius of the bounding sphere of an actor.
+ */
+void boundingSphere(vtkActor* actor, double center[3], double& radius) {
+    double bounds[6];
+    actor->GetBounds(bounds);
+    for (int i = 0; i < 3; ++i) {
+        center[i] = 0.5 * (bounds[2 * i] + bounds[2 * i + 1]);
+    }
+    radius = 0.5 * std::sqrt((bounds[1] - bounds[0]) * (bounds[1] - bounds[0]) +
+        (bounds[3] - bounds[2]) * (bounds[3] - bounds[2]) +
+        (bounds[5] - bounds[4]) * (bounds[5] - bounds[4]));
+}
+
+/**
+ * Copies the rotation/scale block of a 4x4 matrix.
+ */
+void copyOrientation(vtkMatrix4x4* matrix, double orientation[9]) {
+    for (int i = 0; i < 3; ++i)
+        for (int j = 0; j < 3; ++j)
+            orientation[3 * i + j] = matrix->GetElement(i, j);
+}
+
+} // namespace
+
+/**
+ * Constructor for the ImpostorCache class.
+ *
+ * @param sceneRenderer The renderer billboards are added to.
+ * @param parent The parent QObject.
+ */
+ImpostorCache::ImpostorCache(vtkRenderer* sceneRenderer, QObject* parent)
+    : QObject(parent), sceneRenderer(sceneRenderer), enabled(false), screenSizeThreshold(24.0), maxViewDrift(15.0), frame(0) {
+    quad = vtkSmartPointer<vtkPlaneSource>::New();
+    quad->Update();
+
+    captureRenderer = vtkSmartPointer<vtkRenderer>::New();
+    captureRenderer->SetBackground(0.0, 0.0, 0.0);
+    captureRenderer->SetBackgroundAlpha(0.0);
+
+    captureWindow = vtkSmartPointer<vtkRenderWindow>::New();
+    captureWindow->SetOffScreenRendering(1);
+    captureWindow->SetAlphaBitPlanes(1);
+    captureWindow->SetSize(kTextureSize, kTextureSize);
+    captureWindow->AddRenderer(captureRenderer);
+
+    captureTimer.setInterval(0);
+    connect(&captureTimer, &QTimer::timeout, this, &ImpostorCache::captureNext);
+}
+
+/**
+ * Destructor for the ImpostorCache class. Removes all billboards from the scene.
+ */
+ImpostorCache::~ImpostorCache() {
+    clear();
+}
+
+/**
+ * Enables or disables impostors. Disabling removes all billboards and cached images.
+ *
+ * @param enabled True to draw small parts as impostors.
+ */
+void ImpostorCache::setEnabled(bool enabled) {
+    this->enabled = enabled;
+    if (!enabled) {
+        clear();
+    }
+}
+
+/**
+ * Returns whether impostors are enabled.
+ *
+ * @return True if enabled.
+ */
+bool ImpostorCache::isEnabled() const {
+    return enabled;
+}
+
+/**
+ * Sets the projected size below which a part is drawn as an impostor.
+ *
+ * @param pixels Diameter of the part's bounding sphere on screen, in pixels.
+ */
+void ImpostorCache::setScreenSizeThreshold(double pixels) {
+    screenSizeThreshold = pixels;
+}
+
+/**
+ * Sets how far the camera may move away from a cached view before a new one is captured.
+ *
+ * @param degrees Maximum angle between the current and the cached view direction.
+ */
+void ImpostorCache::setMaxViewDrift(double degrees) {
+    maxViewDrift = degrees;
+}
+
+/**
+ * Chooses, for each part, whether to draw the actor or the impostor this frame.
+ *
+ * @param parts Parts about to be drawn; each must own an actor.
+ * @param actorVisible Visibility of each part's actor, updated to false where the impostor is used.
+ */
+void ImpostorCache::update(const std::vector<ModelPart*>& parts, std::vector<bool>& actorVisible) {
+    if (!enabled) return;
+    ++frame;
+
+    vtkCamera* camera = sceneRenderer->GetActiveCamera();
+    const int viewportHeight = std::max(1, sceneRenderer->GetSize()[1]);
+    double cameraPosition[3], projectionDirection[3], cameraUp[3];
+    camera->GetPosition(cameraPosition);
+    camera->GetDirectionOfProjection(projectionDirection);
+    camera->GetViewUp(cameraUp);
+    const double cosDrift = std::cos(vtkMath::RadiansFromDegrees(maxViewDrift));
+    const double cosFallback = std::cos(vtkMath::RadiansFromDegrees(2.0 * maxViewDrift));
+
+    // Forget impostors for parts that are no longer in the tree
+    std::unordered_set<ModelPart*> current(parts.begin(), parts.end());
+    for (auto it = impostors.begin(); it != impostors.end();) {
+        if (current.count(it->first) == 0) {
+            if (it->second.billboard) sceneRenderer->RemoveActor(it->second.billboard);
+            it = impostors.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+
+    for (size_t i = 0; i < parts.size(); ++i) {
+        ModelPart* part = parts[i];
+        auto found = impostors.find(part);
+
+        double center[3], radius;
+        boundingSphere(part->getActor(), center, radius);
+
+        double pixels;
+        double direction[3];
+        if (camera->GetParallelProjection()) {
+            pixels = radius / camera->GetParallelScale() * viewportHeight;
+            std::copy(projectionDirection, projectionDirection + 3, direction);
+        }
+        else {
+            for (int k = 0; k < 3; ++k) direction[k] = center[k] - cameraPosition[k];
+            double distance = vtkMath::Normalize(direction);
+            double halfHeight = distance * std::tan(vtkMath::RadiansFromDegrees(camera->GetViewAngle()) * 0.5);
+            pixels = halfHeight > 0.0 ? radius / halfHeight * viewportHeight : screenSizeThreshold;
+        }
+
+        if (!actorVisible[i] || pixels >= screenSizeThreshold) {
+            if (found != impostors.end()) hideBillboard(found->second);
+            continue;
+        }
+
+        Impostor& impostor = impostors[part];
+        if (isStale(part, impostor)) {
+            impostor.views.clear();
+        }
+
+        View* best = nullptr;
+        double bestAlignment = -2.0;
+        for (View& view : impostor.views) {
+            double alignment = std::min(vtkMath::Dot(view.direction, direction), vtkMath::Dot(view.viewUp, cameraUp));
+            if (alignment > bestAlignment) {
+                bestAlignment = alignment;
+                best = &view;
+            }
+        }
+
+        if ((!best || bestAlignment < cosDrift) && !impostor.queued) {
+            Request request;
+            request.part = part;
+            std::copy(direction, direction + 3, request.direction);
+            std::copy(cameraUp, cameraUp + 3, request.viewUp);
+            queue.push_back(request);
+            impostor.queued = true;
+            if (!captureTimer.isActive()) captureTimer.start();
+        }
+
+        // Until a close enough view exists, keep drawing the real actor
+        if (!best || bestAlignment < cosFallback) {
+            hideBillboard(impostor);
+            continue;
+        }
+
+        if (!impostor.billboard) {
+            vtkNew<vtkPolyDataMapper> mapper;
+            mapper->SetInputConnection(quad->GetOutputPort());
+            impostor.billboard = vtkSmartPointer<vtkFollower>::New();
+            impostor.billboard->SetMapper(mapper);
+            impostor.billboard->GetProperty()->LightingOff();
+        }
+        if (!sceneRenderer->HasViewProp(impostor.billboard)) {
+            sceneRenderer->AddActor(impostor.billboard);
+        }
+        best->lastUsed = frame;
+        impostor.billboard->SetCamera(camera);
+        impostor.billboard->SetTexture(best->texture);
+        impostor.billboard->SetPosition(center);
+        impostor.billboard->SetScale(2.0 * radius);
+        impostor.billboard->SetVisibility(1);
+        actorVisible[i] = false;
+    }
+}
+
+/**
+ * Drops the cached impostor of a part, e.g. before the part is deleted.
+ *
+ * @param part The part to forget.
+ */
+void ImpostorCache::removePart(ModelPart* part) {
+    auto found = impostors.find(part);
+    if (found != impostors.end()) {
+        if (found->second.billboard) sceneRenderer->RemoveActor(found->second.billboard);
+        impostors.erase(found);
+    }
+    queue.erase(std::remove_if(queue.begin(), queue.end(), [part](const Request& r) { return r.part == part; }), queue.end());
+}
+
+/**
+ * Removes every billboard from the scene and discards all cached images.
+ */
+void ImpostorCache::clear() {
+    for (auto& entry : impostors) {
+        if (entry.second.billboard) sceneRenderer->RemoveActor(entry.second.billboard);
+    }
+    impostors.clear();
+    queue.clear();
+    captureTimer.stop();
+}
+
+/**
+ * Captures the next queued view. Called from the event loop so that only one offscreen render
+ * happens between user events.
+ */
+void ImpostorCache::captureNext() {
+    while (!queue.empty()) {
+        Request request = queue.front();
+        queue.pop_front();
+        auto found = impostors.find(request.part);
+        if (found == impostors.end()) continue; // Part went away or impostors were cleared
+        found->second.queued = false;
+        capture(request);
+        emit impostorsUpdated();
+        break;
+    }
+    if (queue.empty()) {
+        captureTimer.stop();
+    }
+}
+
+/**
+ * Renders a part offscreen from the requested direction and stores the image as a new view,
+ * replacing the least recently used one when the cache for the part is full.
+ *
+ * @param request The part and camera orientation to capture.
+ */
+void ImpostorCache::capture(const Request& request) {
+    Impostor& impostor = impostors[request.part];
+    vtkActor* source = request.part->getActor();
+    vtkSmartPointer<vtkActor> copy = request.part->getNewActor();
+    if (!source || !copy) return;
+
+    if (isStale(request.part, impostor)) {
+        impostor.views.clear();
+    }
+
+    copy->SetUserMatrix(source->GetMatrix());
+    copy->SetVisibility(1);
+    captureRenderer->RemoveAllViewProps();
+    captureRenderer->AddActor(copy);
+
+    double center[3], radius;
+    boundingSphere(source, center, radius);
+    vtkCamera* camera = captureRenderer->GetActiveCamera();
+    camera->ParallelProjectionOn();
+    camera->SetFocalPoint(center);
+    camera->SetPosition(center[0] - request.direction[0] * radius * 4.0,
+        center[1] - request.direction[1] * radius * 4.0,
+        center[2] - request.direction[2] * radius * 4.0);
+    camera->SetViewUp(request.viewUp);
+    camera->OrthogonalizeViewUp();
+    camera->SetParallelScale(radius);
+    captureRenderer->ResetCameraClippingRange();
+    captureWindow->Render();
+
+    vtkNew<vtkWindowToImageFilter> grab;
+    grab->SetInput(captureWindow);
+    grab->SetInputBufferTypeToRGBA();
+    grab->ReadFrontBufferOff();
+    grab->ShouldRerenderOff();
+    grab->Update();
+
+    vtkNew<vtkImageData> image;
+    image->DeepCopy(grab->GetOutput());
+    captureRenderer->RemoveAllViewProps();
+
+    View view;
+    std::copy(request.direction, request.direction + 3, view.direction);
+    camera->GetViewUp(view.viewUp);
+    view.texture = vtkSmartPointer<vtkTexture>::New();
+    view.texture->SetInputData(image);
+    view.texture->InterpolateOn();
+    view.lastUsed = frame;
+
+    if (impostor.views.size() >= kMaxViews) {
+        auto oldest = std::min_element(impostor.views.begin(), impostor.views.end(),
+            [](const View& a, const View& b) { return a.lastUsed < b.lastUsed; });
+        *oldest = view;
+    }
+    else {
+        impostor.views.push_back(view);
+    }
+
+    vtkSmartPointer<vtkPolyData> polyData = request.part->getPolyData();
+    impostor.sourceTime = std::max(polyData ? polyData->GetMTime() : 0, source->GetProperty()->GetMTime());
+    copyOrientation(source->GetMatrix(), impostor.orientation);
+}
+
+/**
+ * Checks whether a part's geometry, material or orientation changed since its views were captured.
+ *
+ * @param part The part to check.
+ * @param impostor The cached state for the part.
+ * @return True if the cached views no longer match the part.
+ */
+bool ImpostorCache::isStale(ModelPart* part, const Impostor& impostor) const {
+    if (impostor.views.empty()) return false;
+
+    vtkActor* source = part->getActor();
+    vtkSmartPointer<vtkPolyData> polyData = part->getPolyData();
+    vtkMTimeType sourceTime = std::max(polyData ? polyData->GetMTime() : 0, source->GetProperty()->GetMTime());
+    if (sourceTime != impostor.sourceTime) return true;
+
+    double orientation[9];
+    copyOrientation(source->GetMatrix(), orientation);
+    for (int i = 0; i < 9; ++i) {
+        if (std::fabs(orientation[i] - impostor.orientation[i]) > 1e-6) return true;
+    }
+    return false;
+}
+
+/**
+ * Hides the billboard of an impostor if it has one.
+ *
+ * @param impostor The impostor to hide.
+ */
+void ImpostorCache::hideBillboard(Impostor& impostor) {
+    if (impostor.billboard && impostor.billboard->GetVisibility()) {
+        impostor.billboard->SetVisibility(0);
+    }
+}
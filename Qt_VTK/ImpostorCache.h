@@ -0,0 +1,97 @@
+/**
+ * @file ImpostorCache.h
+ *
+ * Defines the ImpostorCache class, which replaces parts that cover only a few pixels on screen with
+ * camera-facing billboards textured with a cached image of the part. Images are captured offscreen from
+ * a handful of view directions and regenerated lazily, one per event loop iteration, when the part
+ * changes or the camera drifts too far from every cached direction.
+ */
+
+#ifndef VIEWER_IMPOSTORCACHE_H
+#define VIEWER_IMPOSTORCACHE_H
+
+#include <QObject>
+#include <QTimer>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+#include <vtkSmartPointer.h>
+#include <vtkRenderer.h>
+#include <vtkRenderWindow.h>
+#include <vtkFollower.h>
+#include <vtkTexture.h>
+#include <vtkPlaneSource.h>
+#include "ModelPart.h"
+
+/**
+ * @class ImpostorCache
+ * @brief Manages cached billboard impostors for distant parts.
+ *
+ * Call update() once per frame with the parts about to be drawn. Parts whose projected size is below
+ * the threshold and that have a suitable cached image are drawn as a billboard and their actor is
+ * hidden for that frame. Missing or stale images are queued and captured in the background.
+ */
+class ImpostorCache : public QObject {
+    Q_OBJECT
+
+public:
+    explicit ImpostorCache(vtkRenderer* sceneRenderer, QObject* parent = nullptr);
+    ~ImpostorCache();
+
+    void setEnabled(bool enabled);
+    bool isEnabled() const;
+    void setScreenSizeThreshold(double pixels);
+    void setMaxViewDrift(double degrees);
+    void update(const std::vector<ModelPart*>& parts, std::vector<bool>& actorVisible);
+    void removePart(ModelPart* part);
+    void clear();
+
+signals:
+    void impostorsUpdated();
+
+private slots:
+    void captureNext();
+
+private:
+    /** A single cached image of a part seen from one direction. */
+    struct View {
+        double direction[3]; ///< Unit viewing direction (camera towards part) used for the capture.
+        double viewUp[3]; ///< Camera view up used for the capture.
+        vtkSmartPointer<vtkTexture> texture; ///< Captured RGBA image.
+        unsigned long lastUsed; ///< Frame counter value when this view was last shown.
+    };
+
+    /** All cached state for one part. */
+    struct Impostor {
+        std::vector<View> views; ///< Cached views, at most kMaxViews.
+        vtkSmartPointer<vtkFollower> billboard; ///< Camera-facing quad added to the scene renderer.
+        vtkMTimeType sourceTime = 0; ///< Geometry/property modification time the views were captured at.
+        double orientation[9] = {}; ///< Rotation/scale part of the actor matrix at capture time.
+        bool queued = false; ///< True while a capture request is waiting in the queue.
+    };
+
+    /** A pending capture. */
+    struct Request {
+        ModelPart* part;
+        double direction[3];
+        double viewUp[3];
+    };
+
+    void capture(const Request& request);
+    bool isStale(ModelPart* part, const Impostor& impostor) const;
+    void hideBillboard(Impostor& impostor);
+
+    vtkSmartPointer<vtkRenderer> sceneRenderer; ///< Renderer the billboards are shown in.
+    vtkSmartPointer<vtkRenderWindow> captureWindow; ///< Offscreen window used to capture images.
+    vtkSmartPointer<vtkRenderer> captureRenderer; ///< Renderer of the capture window.
+    vtkSmartPointer<vtkPlaneSource> quad; ///< Unit quad shared by all billboards.
+    std::unordered_map<ModelPart*, Impostor> impostors; ///< Cached impostors by part.
+    std::deque<Request> queue; ///< Captures waiting to be made.
+    QTimer captureTimer; ///< Drives captureNext() while the queue is not empty.
+    bool enabled; ///< Whether impostors are used at all.
+    double screenSizeThreshold; ///< Projected size in pixels below which a part uses its impostor.
+    double maxViewDrift; ///< Angle in degrees beyond which a new view is captured.
+    unsigned long frame; ///< Number of update() calls, used to age views.
+};
+
+#endif // VIEWER_IMPOSTORCACHE_H
@@ -0,0 +1,320 @@
+/**
+ * @file LoaderPool.cpp
+ * @brief Implementation of the LoaderPool class.
+ *
+ * Each dispatcher thread owns one worker process and drives it with blocking QProcess calls, so no
+ * event loop is involved and a QProcess is only ever used from the thread that created it. Mapped
+ * segments are kept alive by the VTK arrays that point into them: every array registers its data
+ * pointer here, and VTK's free callback drops that reference when the array releases its storage.
+ */
+
+#include "LoaderPool.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QProcess>
+#include <QSharedMemory>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+#include <vtkCellArray.h>
+#include <vtkFloatArray.h>
+#include <vtkNew.h>
+#include <vtkPoints.h>
+#include <vtkTypeInt32Array.h>
+#include "SharedMesh.h"
+
+namespace {
+
+const int kJobsPerWorker = 200; ///< Jobs after which a worker is replaced, bounding any slow leak in it.
+const int kJobTimeoutMs = 10 * 60 * 1000; ///< Time after which a worker that has not replied is killed.
+
+std::mutex mappedMutex; ///< Guards mappedSegments.
+std::unordered_map<void*, std::shared_ptr<QSharedMemory>> mappedSegments; ///< Segment behind each mapped VTK array.
+std::atomic<unsigned long> nextSegment(0); ///< Makes segment keys unique within this process.
+
+/**
+ * Waits for one reply line from a worker. Returns an empty array if the worker exits or times out.
+ */
+QByteArray readReply(QProcess* worker) {
+    QElapsedTimer timer;
+    timer.start();
+    while (!worker->canReadLine()) {
+        if (worker->state() != QProcess::Running || timer.hasExpired(kJobTimeoutMs)) {
+            return QByteArray();
+        }
+        worker->waitForReadyRead(1000);
+    }
+    return worker->readLine().trimmed();
+}
+
+} // namespace
+
+/**
+ * Constructs a pool and starts its dispatcher threads. Worker processes are started on first use.
+ *
+ * @param workerCount The number of worker processes; 0 uses one per hardware thread.
+ * @param parent The parent QObject.
+ */
+LoaderPool::LoaderPool(int workerCount, QObject* parent)
+    : QObject(parent),
+    stopping(false) {
+    if (workerCount <= 0) {
+        workerCount = std::max(1, QThread::idealThreadCount());
+    }
+    for (int i = 0; i < workerCount; ++i) {
+        QThread* thread = QThread::create([this] { dispatch(); });
+        thread->start();
+        dispatchers.push_back(thread);
+    }
+}
+
+/**
+ * Drops queued files, waits for the files in progress and shuts the workers down.
+ */
+LoaderPool::~LoaderPool() {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopping = true;
+        queue.clear();
+    }
+    queueChanged.notify_all();
+    for (QThread* thread : dispatchers) {
+        thread->wait();
+        delete thread;
+    }
+}
+
+/**
+ * Returns the path the worker executable is expected at: next to the viewer's own executable.
+ *
+ * @return The worker executable path.
+ */
+QString LoaderPool::workerPath() {
+#ifdef Q_OS_WIN
+    return QCoreApplication::applicationDirPath() + "/Qt_VTK_loader.exe";
+#else
+    return QCoreApplication::applicationDirPath() + "/Qt_VTK_loader";
+#endif
+}
+
+/**
+ * Checks whether files can be loaded out of process. Setting VIEWER_LOADER_WORKERS=0 in the
+ * environment forces in-process parsing, e.g. for debugging the parser.
+ *
+ * @return True if the worker executable was found and workers are not disabled.
+ */
+bool LoaderPool::available() {
+    if (qEnvironmentVariableIsSet("VIEWER_LOADER_WORKERS") && qEnvironmentVariableIntValue("VIEWER_LOADER_WORKERS") == 0) {
+        return false;
+    }
+    return QFileInfo(workerPath()).isExecutable();
+}
+
+/**
+ * Queues a file for loading. The callback runs on a dispatcher thread once the file has been
+ * parsed or has failed; it is not called if the pool is destroyed first.
+ *
+ * @param fileName The STL file to load.
+ * @param onLoaded Receives the mesh or an error.
+ */
+void LoaderPool::load(const QString& fileName, const Callback& onLoaded) {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        queue.push_back({ fileName, onLoaded });
+    }
+    queueChanged.notify_one();
+}
+
+/**
+ * Runs on each dispatcher thread: hands queued files to this thread's worker until the pool stops,
+ * starting a new worker whenever the last one crashed or has served kJobsPerWorker files.
+ */
+void LoaderPool::dispatch() {
+    QProcess* worker = nullptr;
+    int jobs = 0;
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueChanged.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (stopping) break;
+            job = std::move(queue.front());
+            queue.pop_front();
+        }
+
+        if (worker && jobs >= kJobsPerWorker) {
+            stopWorker(worker);
+            worker = nullptr;
+        }
+        QString error;
+        if (!worker) {
+            worker = startWorker(error);
+            jobs = 0;
+        }
+
+        vtkSmartPointer<vtkPolyData> polyData;
+        if (worker) {
+            polyData = run(worker, job.fileName, error);
+            ++jobs;
+        }
+        job.onLoaded(job.fileName, polyData, error);
+    }
+    stopWorker(worker);
+}
+
+/**
+ * Has a worker parse one file and maps the result. If the worker dies or hangs it is discarded,
+ * so the next file gets a fresh one.
+ *
+ * @param worker The worker to use; set to nullptr if it had to be discarded.
+ * @param fileName The file to parse.
+ * @param error Receives a description of the failure.
+ * @return The mesh, or nullptr on failure.
+ */
+vtkSmartPointer<vtkPolyData> LoaderPool::run(QProcess*& worker, const QString& fileName, QString& error) {
+    const QString key = QString("Qt_VTK_mesh_%1_%2").arg(QCoreApplication::applicationPid()).arg(nextSegment++);
+    worker->write(QString("load %1 %2\n").arg(key, fileName).toUtf8());
+
+    const QByteArray reply = readReply(worker);
+    if (reply.isEmpty()) {
+        if (worker->state() == QProcess::Running) {
+            error = "Loader worker timed out";
+        }
+        else if (worker->exitStatus() == QProcess::CrashExit) {
+            error = "Loader worker crashed";
+        }
+        else {
+            error = QString("Loader worker exited with code %1").arg(worker->exitCode());
+        }
+        stopWorker(worker);
+        worker = nullptr;
+
+        // Remove the segment if the worker created it before dying
+        QSharedMemory orphan(key);
+        if (orphan.attach()) {
+            orphan.detach();
+        }
+        return nullptr;
+    }
+    if (!reply.startsWith("mesh ")) {
+        error = QString::fromUtf8(reply.startsWith("error ") ? reply.mid(6) : reply);
+        return nullptr;
+    }
+
+    vtkSmartPointer<vtkPolyData> polyData = mapSegment(key, error);
+    worker->write("release\n");
+    worker->waitForBytesWritten();
+    return polyData;
+}
+
+/**
+ * Starts a worker process on the calling thread.
+ *
+ * @param error Receives a description of the failure.
+ * @return The running worker, or nullptr if it could not be started.
+ */
+QProcess* LoaderPool::startWorker(QString& error) {
+    QProcess* worker = new QProcess;
+    worker->setProgram(workerPath());
+    worker->setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    worker->start();
+    if (!worker->waitForStarted()) {
+        error = "Could not start loader worker: " + worker->errorString();
+        delete worker;
+        return nullptr;
+    }
+    return worker;
+}
+
+/**
+ * Asks a worker to exit by closing its input, killing it if it does not, and deletes it.
+ *
+ * @param worker The worker to stop; may be nullptr.
+ */
+void LoaderPool::stopWorker(QProcess* worker) {
+    if (!worker) return;
+
+    worker->closeWriteChannel();
+    if (!worker->waitForFinished(2000)) {
+        worker->kill();
+        worker->waitForFinished();
+    }
+    delete worker;
+}
+
+/**
+ * Maps a segment written by a worker and wraps its arrays in VTK data arrays without copying.
+ *
+ * @param key The key of the segment.
+ * @param error Receives a description of the failure.
+ * @return A poly data whose points and triangles live in the segment, or nullptr on failure.
+ */
+vtkSmartPointer<vtkPolyData> LoaderPool::mapSegment(const QString& key, QString& error) {
+    auto segment = std::make_shared<QSharedMemory>(key);
+    if (!segment->attach()) {
+        error = "Could not map loaded mesh: " + segment->errorString();
+        return nullptr;
+    }
+    if (!SharedMesh::validate(segment->constData(), segment->size(), &error)) {
+        return nullptr;
+    }
+
+    SharedMeshHeader header;
+    std::memcpy(&header, segment->constData(), sizeof(header));
+    if (header.triangleCount == 0) {
+        error = "File contains no triangles";
+        return nullptr;
+    }
+
+    char* base = static_cast<char*>(segment->data());
+    float* coordinates = reinterpret_cast<float*>(base + header.pointsOffset);
+    vtkTypeInt32* offsets = reinterpret_cast<vtkTypeInt32*>(base + header.offsetsOffset);
+    vtkTypeInt32* connectivity = reinterpret_cast<vtkTypeInt32*>(base + header.connectivityOffset);
+    {
+        std::lock_guard<std::mutex> lock(mappedMutex);
+        mappedSegments[coordinates] = segment;
+        mappedSegments[offsets] = segment;
+        mappedSegments[connectivity] = segment;
+    }
+
+    vtkNew<vtkFloatArray> pointArray;
+    pointArray->SetNumberOfComponents(3);
+    pointArray->SetArray(coordinates, static_cast<vtkIdType>(header.pointCount * 3), 0, vtkAbstractArray::VTK_DATA_ARRAY_USER_DEFINED);
+    pointArray->SetArrayFreeFunction(&LoaderPool::releaseSegment);
+    vtkNew<vtkPoints> points;
+    points->SetData(pointArray);
+
+    vtkNew<vtkTypeInt32Array> offsetArray;
+    offsetArray->SetArray(offsets, static_cast<vtkIdType>(header.triangleCount + 1), 0, vtkAbstractArray::VTK_DATA_ARRAY_USER_DEFINED);
+    offsetArray->SetArrayFreeFunction(&LoaderPool::releaseSegment);
+    vtkNew<vtkTypeInt32Array> connectivityArray;
+    connectivityArray->SetArray(connectivity, static_cast<vtkIdType>(header.triangleCount * 3), 0, vtkAbstractArray::VTK_DATA_ARRAY_USER_DEFINED);
+    connectivityArray->SetArrayFreeFunction(&LoaderPool::releaseSegment);
+    vtkNew<vtkCellArray> polys;
+    polys->SetData(offsetArray, connectivityArray);
+
+    vtkSmartPointer<vtkPolyData> polyData = vtkSmartPointer<vtkPolyData>::New();
+    polyData->SetPoints(points);
+    polyData->SetPolys(polys);
+    return polyData;
+}
+
+/**
+ * Free callback of the mapped VTK arrays. Drops the array's reference to its segment; the segment
+ * is detached once none of the mesh's arrays use it any more.
+ *
+ * @param array The data pointer of the array being released.
+ */
+void LoaderPool::releaseSegment(void* array) {
+    std::shared_ptr<QSharedMemory> segment;
+    {
+        std::lock_guard<std::mutex> lock(mappedMutex);
+        auto it = mappedSegments.find(array);
+        if (it == mappedSegments.end()) return;
+        segment = std::move(it->second);
+        mappedSegments.erase(it);
+    }
+}
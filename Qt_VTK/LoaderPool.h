@@ -0,0 +1,65 @@
+/**
+ * @file LoaderPool.h
+ *
+ * Defines the LoaderPool class, which parses STL files in separate worker processes (Qt_VTK_loader)
+ * and maps the finished meshes from shared memory straight into VTK arrays. A malformed file that
+ * crashes the parser takes down one worker and fails one file instead of the viewer, and the parse
+ * buffers are allocated and freed in the workers rather than fragmenting the viewer's heap.
+ */
+
+#ifndef VIEWER_LOADERPOOL_H
+#define VIEWER_LOADERPOOL_H
+
+#include <QObject>
+#include <QString>
+#include <QThread>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include <vtkSmartPointer.h>
+#include <vtkPolyData.h>
+
+class QProcess;
+
+/**
+ * @class LoaderPool
+ * @brief Queues STL files for parsing by a pool of loader worker processes.
+ */
+class LoaderPool : public QObject {
+    Q_OBJECT
+
+public:
+    /** Called once per file on a dispatcher thread; polyData is null and error set if loading failed. */
+    using Callback = std::function<void(const QString& fileName, vtkSmartPointer<vtkPolyData> polyData, const QString& error)>;
+
+    explicit LoaderPool(int workerCount = 0, QObject* parent = nullptr);
+    ~LoaderPool();
+
+    static QString workerPath();
+    static bool available();
+    void load(const QString& fileName, const Callback& onLoaded);
+
+private:
+    /** A file waiting for a worker. */
+    struct Job {
+        QString fileName; ///< File to parse.
+        Callback onLoaded; ///< Receives the result.
+    };
+
+    void dispatch();
+    vtkSmartPointer<vtkPolyData> run(QProcess*& worker, const QString& fileName, QString& error);
+    static QProcess* startWorker(QString& error);
+    static void stopWorker(QProcess* worker);
+    static vtkSmartPointer<vtkPolyData> mapSegment(const QString& key, QString& error);
+    static void releaseSegment(void* array);
+
+    std::vector<QThread*> dispatchers; ///< One thread per worker process, each driving its own worker.
+    std::deque<Job> queue; ///< Files not yet handed to a worker.
+    std::mutex queueMutex; ///< Guards queue and stopping.
+    std::condition_variable queueChanged; ///< Wakes dispatchers when a job arrives or the pool stops.
+    bool stopping; ///< Set by the destructor to end the dispatchers.
+};
+
+#endif // VIEWER_LOADERPOOL_H
@@ -0,0 +1,372 @@
+/**
+ * @file MassProperties.cpp
+ * @brief Implementation of the MassProperties class.
+ */
+
+#include "MassProperties.h"
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <cmath>
+#include <vector>
+#include "GeometryKernels.h"
+#include "TaskScheduler.h"
+
+namespace {
+
+/** Expands xx, yy, zz, xy, yz, zx into a symmetric row-major 3x3 matrix. */
+void unpackSymmetric(const double packed[6], double m[9]) {
+    m[0] = packed[0]; m[4] = packed[1]; m[8] = packed[2];
+    m[1] = m[3] = packed[3];
+    m[5] = m[7] = packed[4];
+    m[2] = m[6] = packed[5];
+}
+
+} // namespace
+
+/**
+ * Constructor for the MassProperties class. Starts tracking every part already in the tree.
+ *
+ * @param model The part tree.
+ * @param parent The parent QObject.
+ */
+MassProperties::MassProperties(ModelPartList* model, QObject* parent)
+    : QObject(parent), model(model) {
+    modifiedCallback = vtkSmartPointer<vtkCallbackCommand>::New();
+    modifiedCallback->SetCallback(&MassProperties::onTransformModified);
+    modifiedCallback->SetClientData(this);
+
+    connect(model, &QAbstractItemModel::rowsInserted, this, &MassProperties::onRowsInserted);
+    connect(model, &QAbstractItemModel::rowsAboutToBeRemoved, this, &MassProperties::onRowsAboutToBeRemoved);
+    registerSubtree(model->getRootItem());
+}
+
+/**
+ * Destructor for the MassProperties class. Must run while the parts still exist, as it detaches
+ * from their transforms.
+ */
+MassProperties::~MassProperties() {
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+        if (it.value().observer) it.key()->getTransform()->RemoveObserver(it.value().observer);
+    }
+}
+
+/**
+ * Computes the mass properties of a part and its descendants. Only parts changed since the last
+ * query, and their ancestors, are recomputed; meshes that need integrating are integrated in
+ * parallel.
+ *
+ * @param part The top of the subassembly.
+ * @return Its mass properties in world coordinates.
+ */
+MassProperties::Result MassProperties::compute(ModelPart* part) {
+    Result result;
+    if (!part)
+        return result;
+
+    struct Job {
+        ModelPart* part;
+        vtkPolyData* geometry;
+        double integrals[10];
+    };
+    QList<ModelPart*> stale;
+    collectStale(part, stale);
+    std::vector<Job> jobs;
+    for (ModelPart* meshPart : stale) {
+        jobs.push_back({ meshPart, meshPart->getPolyData(), {} });
+    }
+    TaskScheduler::instance()->blockingMap(TaskScheduler::Analysis, jobs, [](Job& job) {
+        std::vector<float> points;
+        std::vector<uint32_t> triangles;
+        ModelPart::extractMesh(job.geometry, points, triangles);
+        GeometryKernels::volumeIntegrals(points.data(), triangles.data(), triangles.size() / 3, job.integrals);
+        if (job.integrals[0] < 0.0) {
+            for (double& v : job.integrals) v = -v; // Wound inside out
+        }
+        });
+    for (const Job& job : jobs) {
+        Entry& entry = entries[job.part];
+        std::copy(job.integrals, job.integrals + 10, entry.integrals);
+        entry.geometry = job.geometry;
+        entry.geometryTime = job.geometry->GetMTime();
+    }
+
+    Moments world;
+    transformMoments(aggregate(part, result.recomputed), part->getTransform()->GetMatrix()->GetData(), world);
+    result.volume = world.volume;
+    result.mass = world.mass;
+    result.meshes = world.meshes;
+    if (world.mass <= 0.0)
+        return result;
+
+    // Second moments about the centre of mass, then the inertia tensor trace(S) * I - S
+    double second[9];
+    unpackSymmetric(world.second, second);
+    for (int i = 0; i < 3; ++i) {
+        result.centre[i] = world.first[i] / world.mass;
+    }
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            second[3 * i + j] -= world.mass * result.centre[i] * result.centre[j];
+        }
+    }
+    const double trace = second[0] + second[4] + second[8];
+    for (int i = 0; i < 9; ++i) {
+        result.inertia[i] = (i % 4 == 0 ? trace : 0.0) - second[i];
+    }
+    return result;
+}
+
+/**
+ * Sets a part's density and invalidates the parts whose mass it changes: the part, the
+ * descendants that inherit the density, and the ancestors.
+ *
+ * @param part The part or group.
+ * @param density Mass per cubic model unit, or 0 to inherit the parent's.
+ */
+void MassProperties::setDensity(ModelPart* part, double density) {
+    part->setDensity(density);
+    invalidate(part);
+    invalidateInheritors(part);
+}
+
+/**
+ * Records that a part's mesh was replaced or edited, so it is integrated again.
+ *
+ * @param part The part.
+ */
+void MassProperties::geometryChanged(ModelPart* part) {
+    auto it = entries.find(part);
+    if (it != entries.end()) {
+        it->geometry = nullptr;
+    }
+    invalidate(part);
+}
+
+/**
+ * Starts tracking parts added to the tree.
+ *
+ * @param parent The index under which rows were inserted.
+ * @param first The first inserted row.
+ * @param last The last inserted row.
+ */
+void MassProperties::onRowsInserted(const QModelIndex& parent, int first, int last) {
+    ModelPart* parentPart = model->getItem(parent);
+    for (int row = first; row <= last; ++row) {
+        registerSubtree(parentPart->child(row));
+    }
+    invalidate(parentPart);
+}
+
+/**
+ * Stops tracking parts about to be removed from the tree.
+ *
+ * @param parent The index under which rows are about to be removed.
+ * @param first The first row to be removed.
+ * @param last The last row to be removed.
+ */
+void MassProperties::onRowsAboutToBeRemoved(const QModelIndex& parent, int first, int last) {
+    ModelPart* parentPart = model->getItem(parent);
+    for (int row = first; row <= last; ++row) {
+        unregisterSubtree(parentPart->child(row));
+    }
+    invalidate(parentPart);
+}
+
+/**
+ * VTK callback for modifications of part transforms. Moving a part leaves its own subtree moments
+ * valid, as they are in its frame, but changes its parent's.
+ *
+ * @param caller The transform that was modified.
+ * @param eventId The event ID (unused).
+ * @param clientData The MassProperties.
+ * @param callData Event data (unused).
+ */
+void MassProperties::onTransformModified(vtkObject* caller, unsigned long eventId, void* clientData, void* callData) {
+    Q_UNUSED(eventId);
+    Q_UNUSED(callData);
+    MassProperties* self = static_cast<MassProperties*>(clientData);
+    ModelPart* part = self->transformParts.value(caller);
+    if (part) {
+        self->invalidate(part->parentItem());
+    }
+}
+
+/**
+ * Creates cache entries for a part and its descendants and watches their transforms.
+ *
+ * @param part The top of the subtree.
+ */
+void MassProperties::registerSubtree(ModelPart* part) {
+    Entry& entry = entries[part];
+    if (!entry.observer) {
+        transformParts.insert(part->getTransform(), part);
+        entry.observer = part->getTransform()->AddObserver(vtkCommand::ModifiedEvent, modifiedCallback);
+    }
+    for (int i = 0; i < part->childCount(); ++i) {
+        registerSubtree(part->child(i));
+    }
+}
+
+/**
+ * Forgets a part and its descendants.
+ *
+ * @param part The top of the subtree.
+ */
+void MassProperties::unregisterSubtree(ModelPart* part) {
+    for (int i = 0; i < part->childCount(); ++i) {
+        unregisterSubtree(part->child(i));
+    }
+    auto it = entries.find(part);
+    if (it != entries.end()) {
+        if (it->observer) part->getTransform()->RemoveObserver(it->observer);
+        entries.erase(it);
+    }
+    transformParts.remove(part->getTransform());
+}
+
+/**
+ * Marks a part and its ancestors as needing their subtree moments recomputed. An invalid part's
+ * ancestors are always invalid too, so the walk stops at the first one already marked.
+ *
+ * @param part The changed part; nullptr is ignored.
+ */
+void MassProperties::invalidate(ModelPart* part) {
+    bool changed = false;
+    for (; part; part = part->parentItem()) {
+        auto it = entries.find(part);
+        if (it == entries.end())
+            continue;
+        if (!it->valid)
+            break;
+        it->valid = false;
+        changed = true;
+    }
+    if (changed) {
+        emit invalidated();
+    }
+}
+
+/**
+ * Marks the descendants of a part that inherit its density as invalid. Their ancestors must
+ * already be invalid.
+ *
+ * @param part The part whose density changed.
+ */
+void MassProperties::invalidateInheritors(ModelPart* part) {
+    for (int i = 0; i < part->childCount(); ++i) {
+        ModelPart* child = part->child(i);
+        if (child->density() > 0.0)
+            continue;
+        auto it = entries.find(child);
+        if (it != entries.end()) it->valid = false;
+        invalidateInheritors(child);
+    }
+}
+
+/**
+ * Finds the parts in the invalid part of a subtree whose mesh has not been integrated, or has
+ * changed since.
+ *
+ * @param part The top of the subtree.
+ * @param meshes Receives the parts to integrate.
+ */
+void MassProperties::collectStale(ModelPart* part, QList<ModelPart*>& meshes) {
+    Entry& entry = entries[part];
+    if (entry.valid)
+        return;
+
+    vtkPolyData* polyData = part->getPolyData();
+    if (polyData && (entry.geometry != polyData || entry.geometryTime != polyData->GetMTime())) {
+        meshes.append(part);
+    }
+    for (int i = 0; i < part->childCount(); ++i) {
+        collectStale(part->child(i), meshes);
+    }
+}
+
+/**
+ * Returns the moments of a part's subtree in its frame, recomputing them if invalid from its own
+ * mesh and its children's moments carried through their local transforms.
+ *
+ * @param part The part.
+ * @param recomputed Incremented for every part recomputed.
+ * @return The subtree moments.
+ */
+MassProperties::Moments MassProperties::aggregate(ModelPart* part, int& recomputed) {
+    {
+        const Entry& entry = entries[part];
+        if (entry.valid)
+            return entry.subtree;
+    }
+
+    Moments moments;
+    if (part->getPolyData() && entries[part].geometry) {
+        const double* integrals = entries[part].integrals;
+        const double density = part->effectiveDensity();
+        moments.volume = integrals[0];
+        moments.mass = density * integrals[0];
+        for (int i = 0; i < 3; ++i) moments.first[i] = density * integrals[1 + i];
+        for (int i = 0; i < 6; ++i) moments.second[i] = density * integrals[4 + i];
+        moments.meshes = 1;
+    }
+
+    vtkNew<vtkMatrix4x4> worldInverse;
+    vtkMatrix4x4::Invert(part->getTransform()->GetMatrix(), worldInverse);
+    for (int c = 0; c < part->childCount(); ++c) {
+        ModelPart* child = part->child(c);
+        const Moments childMoments = aggregate(child, recomputed);
+        vtkNew<vtkMatrix4x4> local;
+        vtkMatrix4x4::Multiply4x4(worldInverse, child->getTransform()->GetMatrix(), local);
+        Moments carried;
+        transformMoments(childMoments, local->GetData(), carried);
+        moments.volume += carried.volume;
+        moments.mass += carried.mass;
+        for (int i = 0; i < 3; ++i) moments.first[i] += carried.first[i];
+        for (int i = 0; i < 6; ++i) moments.second[i] += carried.second[i];
+        moments.meshes += carried.meshes;
+    }
+
+    Entry& entry = entries[part];
+    entry.subtree = moments;
+    entry.valid = true;
+    ++recomputed;
+    return moments;
+}
+
+/**
+ * Carries moments through an affine transform x' = A x + t. Volume and mass scale by |det A|; the
+ * second moments pick up the cross terms with t, which is the parallel-axis theorem.
+ *
+ * @param in Moments in the source frame.
+ * @param matrix Row-major 4x4 transform from the source frame to the target frame.
+ * @param out Receives the moments in the target frame.
+ */
+void MassProperties::transformMoments(const Moments& in, const double matrix[16], Moments& out) {
+    const double a[9] = { matrix[0], matrix[1], matrix[2], matrix[4], matrix[5], matrix[6], matrix[8], matrix[9], matrix[10] };
+    const double t[3] = { matrix[3], matrix[7], matrix[11] };
+    const double scale = std::fabs(a[0] * (a[4] * a[8] - a[5] * a[7]) - a[1] * (a[3] * a[8] - a[5] * a[6]) + a[2] * (a[3] * a[7] - a[4] * a[6]));
+
+    double af[3];
+    for (int i = 0; i < 3; ++i) {
+        af[i] = a[3 * i] * in.first[0] + a[3 * i + 1] * in.first[1] + a[3 * i + 2] * in.first[2];
+    }
+    double s[9], as[9];
+    unpackSymmetric(in.second, s);
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            as[3 * i + j] = a[3 * i] * s[j] + a[3 * i + 1] * s[3 + j] + a[3 * i + 2] * s[6 + j];
+        }
+    }
+    static const int products[6][2] = { { 0, 0 }, { 1, 1 }, { 2, 2 }, { 0, 1 }, { 1, 2 }, { 2, 0 } };
+    for (int p = 0; p < 6; ++p) {
+        const int i = products[p][0], j = products[p][1];
+        const double asat = as[3 * i] * a[3 * j] + as[3 * i + 1] * a[3 * j + 1] + as[3 * i + 2] * a[3 * j + 2];
+        out.second[p] = scale * (asat + af[i] * t[j] + t[i] * af[j] + in.mass * t[i] * t[j]);
+    }
+    for (int i = 0; i < 3; ++i) {
+        out.first[i] = scale * (af[i] + in.mass * t[i]);
+    }
+    out.volume = scale * in.volume;
+    out.mass = scale * in.mass;
+    out.meshes = in.meshes;
+}
@@ -0,0 +1,93 @@
+/**
+ * @file MassProperties.h
+ *
+ * Defines the MassProperties class, which computes the mass, centre of mass and inertia tensor of
+ * any part or subassembly, e.g. for vehicle dynamics models. Each mesh is integrated once with the
+ * volume integral kernels; its density is applied afterwards, so changing a density does not
+ * touch the mesh again.
+ *
+ * Every part keeps the moments of its whole subtree in its own coordinate frame: mass, first
+ * moments and second moments about the frame's origin. Those are carried into the parent's frame
+ * by the child's local transform, which is where the parallel-axis shift happens, and summed.
+ * Because a subtree's moments do not depend on where it is placed, moving a part only invalidates
+ * its ancestors, and a query recomputes the invalid nodes on the path to the root and nothing else.
+ */
+
+#ifndef VIEWER_MASSPROPERTIES_H
+#define VIEWER_MASSPROPERTIES_H
+
+#include <QHash>
+#include <QObject>
+#include <vtkCallbackCommand.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+#include "ModelPart.h"
+#include "ModelPartList.h"
+
+/**
+ * @class MassProperties
+ * @brief Incrementally maintained mass properties of the parts in a tree.
+ */
+class MassProperties : public QObject {
+    Q_OBJECT
+
+public:
+    /** Mass properties of a part and its descendants, in world coordinates. */
+    struct Result {
+        double volume = 0.0; ///< Enclosed volume, in cubic model units.
+        double mass = 0.0; ///< Mass, in the units of density times volume.
+        double centre[3] = { 0.0, 0.0, 0.0 }; ///< Centre of mass.
+        double inertia[9] = { 0.0 }; ///< Inertia tensor about the centre of mass along the world axes, row-major.
+        int meshes = 0; ///< Meshes included.
+        int recomputed = 0; ///< Parts whose subtree moments had to be recomputed for this query.
+    };
+
+    explicit MassProperties(ModelPartList* model, QObject* parent = nullptr);
+    ~MassProperties();
+
+    Result compute(ModelPart* part);
+    void setDensity(ModelPart* part, double density);
+    void geometryChanged(ModelPart* part);
+
+signals:
+    /** Emitted when a change has made some cached results stale, e.g. so an open report can refresh. */
+    void invalidated();
+
+private:
+    /** Mass-weighted integrals over a subtree, in one part's frame. */
+    struct Moments {
+        double volume = 0.0; ///< Volume.
+        double mass = 0.0; ///< Integral of density.
+        double first[3] = { 0.0, 0.0, 0.0 }; ///< Integrals of density times x, y and z.
+        double second[6] = { 0.0 }; ///< Integrals of density times xx, yy, zz, xy, yz and zx.
+        int meshes = 0; ///< Meshes in the subtree.
+    };
+
+    /** What is cached for one part. */
+    struct Entry {
+        double integrals[10] = { 0.0 }; ///< Unit-density volume integrals of the part's own mesh.
+        vtkPolyData* geometry = nullptr; ///< Mesh the integrals were computed from.
+        vtkMTimeType geometryTime = 0; ///< Modification time of that mesh when integrated.
+        Moments subtree; ///< Moments of the part and its descendants in the part's frame.
+        bool valid = false; ///< Whether subtree is up to date.
+        unsigned long observer = 0; ///< Observer on the part's transform.
+    };
+
+    void onRowsInserted(const QModelIndex& parent, int first, int last);
+    void onRowsAboutToBeRemoved(const QModelIndex& parent, int first, int last);
+    static void onTransformModified(vtkObject* caller, unsigned long eventId, void* clientData, void* callData);
+    void registerSubtree(ModelPart* part);
+    void unregisterSubtree(ModelPart* part);
+    void invalidate(ModelPart* part);
+    void invalidateInheritors(ModelPart* part);
+    void collectStale(ModelPart* part, QList<ModelPart*>& meshes);
+    Moments aggregate(ModelPart* part, int& recomputed);
+    static void transformMoments(const Moments& in, const double matrix[16], Moments& out);
+
+    ModelPartList* model; ///< The tree whose parts are tracked.
+    QHash<ModelPart*, Entry> entries; ///< Cache per registered part.
+    QHash<vtkObject*, ModelPart*> transformParts; ///< Owner of each observed transform.
+    vtkSmartPointer<vtkCallbackCommand> modifiedCallback; ///< Callback observing part transforms.
+};
+
+#endif // VIEWER_MASSPROPERTIES_H
@@ -0,0 +1,439 @@
+/**
+ * @file MeshCodec.cpp
+ * @brief Implementation of the MeshCodec class.
+ *
+ * Layout: a CodecHeader, then four packed streams, one per axis and one for the indices. A packed
+ * stream is a run of blocks, each a width byte followed by sixteen values of that many bytes; the
+ * last block is padded with zeros. Axis streams hold the zigzag-coded difference between each
+ * vertex's quantised coordinate and the previous one's. The index stream codes each index against
+ * one of two bases, flagged in the low bit: the next unused index (so a vertex used for the first
+ * time is a zero), or the last index coded against this same base, which follows the band of older
+ * vertices the triangles are reusing.
+ */
+
+#include "MeshCodec.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "GeometryKernels.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define VIEWER_MESHCODEC_SSE2
+#endif
+
+namespace {
+
+const size_t kBlock = 16; ///< Values per packed block.
+const int kMaxBits = 24; ///< Finest grid whose positions all convert to float exactly; decoded coordinates are still rounded.
+const uint32_t kMaxCount = 1u << 28; ///< Most vertices or triangles a header may declare.
+
+/** Fixed-size header at the start of every encoded mesh. */
+struct CodecHeader {
+    static const uint32_t kMagic = 0x4348534d; ///< "MSHC" in little-endian byte order.
+    static const uint8_t kVersion = 1; ///< Bumped whenever the layout changes.
+
+    uint32_t magic; ///< Always kMagic.
+    uint8_t version; ///< Always kVersion.
+    uint8_t bits; ///< Grid resolution in bits per axis, or MeshCodec::kLossless.
+    uint16_t reserved; ///< Zero.
+    uint32_t pointCount; ///< Number of vertices.
+    uint32_t triangleCount; ///< Number of triangles.
+    float origin[3]; ///< Coordinate of grid position zero on each axis.
+    float step[3]; ///< Grid spacing on each axis; zero for an axis with no extent.
+    uint32_t streamBytes[4]; ///< Sizes of the x, y, z and index streams.
+};
+
+inline uint32_t zigzag(uint32_t delta) {
+    return (delta << 1) ^ static_cast<uint32_t>(static_cast<int32_t>(delta) >> 31);
+}
+
+inline uint32_t unzigzag(uint32_t value) {
+    return (value >> 1) ^ (0u - (value & 1u));
+}
+
+/**
+ * Checks that a packed stream's size is possible for a number of values: one block per sixteen,
+ * each a width byte and sixteen values of one to four bytes.
+ */
+bool streamHolds(uint32_t bytes, size_t values) {
+    const uint64_t blocks = (static_cast<uint64_t>(values) + kBlock - 1) / kBlock;
+    return bytes >= blocks * (1 + kBlock) && bytes <= blocks * (1 + 4 * kBlock);
+}
+
+/**
+ * Gets the spacing of floats at a magnitude, rounding towards the larger spacing.
+ */
+double floatSpacing(double magnitude) {
+    const float value = static_cast<float>(std::fabs(magnitude));
+    return static_cast<double>(std::nextafter(value, INFINITY)) - value;
+}
+
+/** Maps float bit patterns to integers in the same order as the floats, so neighbours differ a little. It is its own inverse. */
+inline uint32_t orderedBits(uint32_t bits) {
+    return static_cast<int32_t>(bits) < 0 ? bits ^ 0x7fffffffu : bits;
+}
+
+/**
+ * Appends values to a packed stream, padding the last block with zeros.
+ */
+void pack(const std::vector<uint32_t>& values, std::vector<uint8_t>& out) {
+    for (size_t first = 0; first < values.size(); first += kBlock) {
+        const size_t count = std::min(kBlock, values.size() - first);
+        uint32_t combined = 0;
+        for (size_t i = 0; i < count; ++i) combined |= values[first + i];
+        const int width = combined < 0x100u ? 1 : combined < 0x10000u ? 2 : combined < 0x1000000u ? 3 : 4;
+
+        out.push_back(static_cast<uint8_t>(width));
+        for (size_t i = 0; i < kBlock; ++i) {
+            const uint32_t value = i < count ? values[first + i] : 0;
+            for (int b = 0; b < width; ++b) out.push_back(static_cast<uint8_t>(value >> (8 * b)));
+        }
+    }
+}
+
+/**
+ * Reads one block of a packed stream.
+ *
+ * @param cursor Start of the block; advanced past it.
+ * @param end End of the stream.
+ * @param out Receives the sixteen values.
+ * @return False if the block is truncated or its width byte is invalid.
+ */
+bool unpack(const uint8_t*& cursor, const uint8_t* end, uint32_t out[kBlock]) {
+    if (cursor == end)
+        return false;
+    const int width = *cursor++;
+    if (width < 1 || width > 4 || static_cast<size_t>(end - cursor) < kBlock * width)
+        return false;
+
+    const uint8_t* p = cursor;
+    cursor += kBlock * width;
+#if defined(VIEWER_MESHCODEC_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    if (width == 1) {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        const __m128i low = _mm_unpacklo_epi8(bytes, zero);
+        const __m128i high = _mm_unpackhi_epi8(bytes, zero);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_unpacklo_epi16(low, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4), _mm_unpackhi_epi16(low, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 8), _mm_unpacklo_epi16(high, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 12), _mm_unpackhi_epi16(high, zero));
+        return true;
+    }
+    if (width == 2) {
+        const __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        const __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_unpacklo_epi16(low, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4), _mm_unpackhi_epi16(low, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 8), _mm_unpacklo_epi16(high, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 12), _mm_unpackhi_epi16(high, zero));
+        return true;
+    }
+#endif
+    if (width == 4) {
+        std::memcpy(out, p, kBlock * sizeof(uint32_t));
+        return true;
+    }
+    for (size_t i = 0; i < kBlock; ++i, p += width) {
+        uint32_t value = 0;
+        for (int b = 0; b < width; ++b) value |= static_cast<uint32_t>(p[b]) << (8 * b);
+        out[i] = value;
+    }
+    return true;
+}
+
+/**
+ * Turns one block of zigzag-coded deltas into coordinates.
+ *
+ * @param values The block; overwritten.
+ * @param previous Quantised coordinate before the block; updated to the last one in it.
+ * @param header Grid of the mesh.
+ * @param axis Axis the block belongs to.
+ * @param out Receives sixteen coordinates.
+ */
+void reconstruct(uint32_t values[kBlock], uint32_t& previous, const CodecHeader& header, int axis, float out[kBlock]) {
+#if defined(VIEWER_MESHCODEC_SSE2)
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i signMask = _mm_set1_epi32(0x7fffffff);
+    const __m128 origin = _mm_set1_ps(header.origin[axis]);
+    const __m128 step = _mm_set1_ps(header.step[axis]);
+    __m128i carry = _mm_set1_epi32(static_cast<int>(previous));
+    for (size_t i = 0; i < kBlock; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+        v = _mm_xor_si128(_mm_srli_epi32(v, 1), _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(v, one)));
+        v = _mm_add_epi32(v, _mm_slli_si128(v, 4)); // Prefix sum within the register
+        v = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+        v = _mm_add_epi32(v, carry);
+        carry = _mm_shuffle_epi32(v, 0xff);
+        if (header.bits == MeshCodec::kLossless) {
+            const __m128i bits = _mm_xor_si128(v, _mm_and_si128(_mm_srai_epi32(v, 31), signMask));
+            _mm_storeu_ps(out + i, _mm_castsi128_ps(bits));
+        } else {
+            _mm_storeu_ps(out + i, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(v), step), origin));
+        }
+    }
+    previous = static_cast<uint32_t>(_mm_cvtsi128_si32(carry));
+#else
+    for (size_t i = 0; i < kBlock; ++i) {
+        previous += unzigzag(values[i]);
+        if (header.bits == MeshCodec::kLossless) {
+            const uint32_t bits = orderedBits(previous);
+            std::memcpy(&out[i], &bits, sizeof(float));
+        } else {
+            out[i] = static_cast<float>(static_cast<int32_t>(previous)) * header.step[axis] + header.origin[axis];
+        }
+    }
+#endif
+}
+
+#if defined(VIEWER_MESHCODEC_SSE2)
+/**
+ * Writes four points from separate x, y and z arrays as packed x, y, z triples.
+ */
+inline void interleave(const float* x, const float* y, const float* z, float* out) {
+    const __m128 xs = _mm_loadu_ps(x);
+    const __m128 ys = _mm_loadu_ps(y);
+    const __m128 zs = _mm_loadu_ps(z);
+    const __m128 xyLow = _mm_unpacklo_ps(xs, ys); // x0 y0 x1 y1
+    const __m128 xyHigh = _mm_unpackhi_ps(xs, ys); // x2 y2 x3 y3
+    const __m128 z0x1 = _mm_shuffle_ps(zs, xyLow, _MM_SHUFFLE(2, 2, 0, 0));
+    const __m128 y1z1 = _mm_shuffle_ps(xyLow, zs, _MM_SHUFFLE(1, 1, 3, 3));
+    const __m128 z2x3 = _mm_shuffle_ps(zs, xyHigh, _MM_SHUFFLE(2, 2, 2, 2));
+    const __m128 y3z3 = _mm_shuffle_ps(xyHigh, zs, _MM_SHUFFLE(3, 3, 3, 3));
+    _mm_storeu_ps(out, _mm_shuffle_ps(xyLow, z0x1, _MM_SHUFFLE(2, 0, 1, 0)));
+    _mm_storeu_ps(out + 4, _mm_shuffle_ps(y1z1, xyHigh, _MM_SHUFFLE(1, 0, 2, 0)));
+    _mm_storeu_ps(out + 8, _mm_shuffle_ps(z2x3, y3z3, _MM_SHUFFLE(2, 0, 2, 0)));
+}
+#endif
+
+} // namespace
+
+/**
+ * Encodes a mesh.
+ *
+ * @param mesh The mesh; every index must refer to one of its vertices.
+ * @param bits Grid resolution per axis, from 1 to 24 bits, or kLossless to keep exact coordinates.
+ *             A grid of n bits places every vertex within half of 1/(2^n - 1) of the mesh's extent,
+ *             before the decoder rounds it to float; maxError() gives the bound after rounding.
+ * @return The encoded bytes.
+ */
+std::vector<uint8_t> MeshCodec::encode(const StlMesh& mesh, int bits) {
+    CodecHeader header = {};
+    header.magic = CodecHeader::kMagic;
+    header.version = CodecHeader::kVersion;
+    header.bits = static_cast<uint8_t>(bits == kLossless ? kLossless : std::clamp(bits, 1, kMaxBits));
+    header.pointCount = static_cast<uint32_t>(mesh.points.size() / 3);
+    header.triangleCount = static_cast<uint32_t>(mesh.triangles.size() / 3);
+
+    if (header.bits != kLossless && header.pointCount > 0) {
+        double bounds[6];
+        GeometryKernels::bounds(mesh.points.data(), header.pointCount, bounds);
+        const double steps = static_cast<double>((1u << header.bits) - 1);
+        for (int axis = 0; axis < 3; ++axis) {
+            // Round the step up if need be, so the top of the grid reaches the largest coordinate
+            const double extent = bounds[2 * axis + 1] - bounds[2 * axis];
+            float step = static_cast<float>(extent / steps);
+            if (static_cast<double>(step) * steps < extent) step = std::nextafter(step, INFINITY);
+            header.origin[axis] = static_cast<float>(bounds[2 * axis]);
+            header.step[axis] = step;
+        }
+    }
+
+    // Quantise against the stored float grid, which is what the decoder will use
+    std::vector<uint32_t> streams[4];
+    for (int axis = 0; axis < 3; ++axis) {
+        std::vector<uint32_t>& values = streams[axis];
+        values.resize(header.pointCount);
+        const uint32_t largest = header.bits == kLossless ? 0 : (1u << header.bits) - 1;
+        uint32_t previous = 0;
+        for (size_t i = 0; i < header.pointCount; ++i) {
+            const float coordinate = mesh.points[3 * i + axis];
+            uint32_t q;
+            if (header.bits == kLossless) {
+                std::memcpy(&q, &coordinate, sizeof(q));
+                q = orderedBits(q);
+            } else if (header.step[axis] > 0.0f) {
+                const double position = std::round((static_cast<double>(coordinate) - header.origin[axis]) / header.step[axis]);
+                q = static_cast<uint32_t>(std::clamp(position, 0.0, static_cast<double>(largest)));
+            } else {
+                q = 0;
+            }
+            values[i] = zigzag(q - previous);
+            previous = q;
+        }
+    }
+
+    // Each index is coded against whichever base is closer, with the low bit saying which
+    std::vector<uint32_t>& indices = streams[3];
+    indices.resize(mesh.triangles.size() / 3 * 3);
+    uint32_t next = 0, reused = 0;
+    for (size_t i = 0; i < indices.size(); ++i) {
+        const uint32_t index = mesh.triangles[i];
+        const uint32_t fromNext = zigzag(index - next);
+        const uint32_t fromReused = zigzag(index - reused);
+        if (fromReused < fromNext) {
+            indices[i] = (fromReused << 1) | 1u;
+            reused = index;
+        } else {
+            indices[i] = fromNext << 1;
+        }
+        next = std::max(next, index + 1);
+    }
+
+    std::vector<uint8_t> out(sizeof(CodecHeader));
+    for (int s = 0; s < 4; ++s) {
+        const size_t before = out.size();
+        pack(streams[s], out);
+        header.streamBytes[s] = static_cast<uint32_t>(out.size() - before);
+    }
+    std::memcpy(out.data(), &header, sizeof(header));
+    return out;
+}
+
+/**
+ * Decodes a mesh produced by encode().
+ *
+ * @param data The encoded bytes.
+ * @param size Number of bytes.
+ * @param mesh Receives the mesh.
+ * @param error Optional; receives a description of the problem if decoding fails.
+ * @return True on success. A mesh that fails to decode is never partly returned with indices out of range.
+ */
+bool MeshCodec::decode(const uint8_t* data, size_t size, StlMesh& mesh, std::string* error) {
+    mesh.points.clear();
+    mesh.triangles.clear();
+    if (!isEncoded(data, size)) {
+        if (error) *error = "Not an encoded mesh";
+        return false;
+    }
+    CodecHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    const uint64_t streamTotal = static_cast<uint64_t>(header.streamBytes[0]) + header.streamBytes[1] + header.streamBytes[2] + header.streamBytes[3];
+    if (header.bits > kMaxBits || streamTotal != size - sizeof(header)) {
+        if (error) *error = "Encoded mesh is truncated or has an invalid header";
+        return false;
+    }
+    // Check the counts against the streams before allocating for them, so a corrupt or hostile
+    // header cannot ask for more memory than its own size accounts for
+    const size_t indexCount = static_cast<size_t>(header.triangleCount) * 3;
+    if (header.pointCount > kMaxCount || header.triangleCount > kMaxCount
+        || !streamHolds(header.streamBytes[0], header.pointCount) || !streamHolds(header.streamBytes[1], header.pointCount)
+        || !streamHolds(header.streamBytes[2], header.pointCount) || !streamHolds(header.streamBytes[3], indexCount)) {
+        if (error) *error = "Encoded mesh declares more vertices or triangles than it holds";
+        return false;
+    }
+
+    const uint8_t* cursors[4];
+    const uint8_t* ends[4];
+    const uint8_t* position = data + sizeof(header);
+    for (int s = 0; s < 4; ++s) {
+        cursors[s] = position;
+        position += header.streamBytes[s];
+        ends[s] = position;
+    }
+
+    const size_t pointCount = header.pointCount;
+    mesh.points.resize(pointCount * 3);
+    uint32_t previous[3] = { 0, 0, 0 };
+    alignas(16) uint32_t values[kBlock];
+    alignas(16) float coordinates[3][kBlock];
+    for (size_t first = 0; first < pointCount; first += kBlock) {
+        for (int axis = 0; axis < 3; ++axis) {
+            if (!unpack(cursors[axis], ends[axis], values)) {
+                if (error) *error = "Encoded mesh has a corrupt coordinate stream";
+                mesh.points.clear();
+                return false;
+            }
+            reconstruct(values, previous[axis], header, axis, coordinates[axis]);
+        }
+        const size_t count = std::min(kBlock, pointCount - first);
+        float* out = mesh.points.data() + 3 * first;
+        size_t i = 0;
+#if defined(VIEWER_MESHCODEC_SSE2)
+        for (; i + 4 <= count; i += 4) {
+            interleave(coordinates[0] + i, coordinates[1] + i, coordinates[2] + i, out + 3 * i);
+        }
+#endif
+        for (; i < count; ++i) {
+            out[3 * i] = coordinates[0][i];
+            out[3 * i + 1] = coordinates[1][i];
+            out[3 * i + 2] = coordinates[2][i];
+        }
+    }
+
+    mesh.triangles.resize(indexCount);
+    uint32_t next = 0, reused = 0;
+    bool valid = true;
+    for (size_t first = 0; first < indexCount && valid; first += kBlock) {
+        valid = unpack(cursors[3], ends[3], values);
+        const size_t count = std::min(kBlock, indexCount - first);
+        uint32_t largest = 0;
+        for (size_t i = 0; i < count; ++i) {
+            const uint32_t value = values[i];
+            const uint32_t index = ((value & 1u) ? reused : next) + unzigzag(value >> 1);
+            reused = (value & 1u) ? index : reused;
+            next = std::max(next, index + 1);
+            largest = std::max(largest, index);
+            mesh.triangles[first + i] = index;
+        }
+        valid = valid && (count == 0 || largest < pointCount);
+    }
+    for (int s = 0; s < 4 && valid; ++s) {
+        valid = cursors[s] == ends[s];
+    }
+    if (!valid) {
+        if (error) *error = "Encoded mesh has a corrupt index stream";
+        mesh.points.clear();
+        mesh.triangles.clear();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Checks whether a buffer starts with an encoded mesh header.
+ *
+ * @param data The bytes.
+ * @param size Number of bytes.
+ * @return True if the magic number and version match.
+ */
+bool MeshCodec::isEncoded(const uint8_t* data, size_t size) {
+    if (size < sizeof(CodecHeader))
+        return false;
+    CodecHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    return header.magic == CodecHeader::kMagic && header.version == CodecHeader::kVersion;
+}
+
+/**
+ * Gets a bound on the distance, along any axis, between a coordinate and its decoded value. The
+ * decoder computes each coordinate in float as position * step + origin, and both the product and
+ * the sum are rounded, so the bound adds half a float spacing at the size of each to half the grid
+ * step. At the finest grids over large coordinates the rounding dominates.
+ *
+ * @param data An encoded mesh.
+ * @param size Number of bytes.
+ * @return The bound, or 0 for a lossless encoding or an invalid buffer.
+ */
+double MeshCodec::maxError(const uint8_t* data, size_t size) {
+    if (!isEncoded(data, size))
+        return 0.0;
+    CodecHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    if (header.bits == kLossless || header.bits > kMaxBits)
+        return 0.0;
+
+    const double largest = static_cast<double>((1u << header.bits) - 1);
+    double bound = 0.0;
+    for (int axis = 0; axis < 3; ++axis) {
+        const double step = header.step[axis];
+        if (step <= 0.0)
+            continue; // Every coordinate on the axis is the origin, which is decoded exactly
+        const double span = largest * step;
+        const double origin = header.origin[axis];
+        const double farthest = std::max(std::fabs(origin), std::fabs(origin + span)) + step;
+        bound = std::max(bound, 0.5 * step + 0.5 * floatSpacing(span) + 0.5 * floatSpacing(farthest));
+    }
+    return bound;
+}
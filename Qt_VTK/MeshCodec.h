@@ -0,0 +1,41 @@
+/**
+ * @file MeshCodec.h
+ *
+ * Defines the MeshCodec class, a compact binary encoding of indexed triangle meshes for geometry
+ * that is stored or sent rather than drawn. Coordinates are optionally quantised to a grid over the
+ * mesh bounds, or kept exactly as their float bit patterns; each axis is then delta coded against
+ * the previous vertex, which is usually a neighbour because vertices are numbered in the order the
+ * triangles first use them. Indices are coded against the next unused index, so a vertex used for
+ * the first time costs a zero, or against the last older vertex reused, whichever is closer.
+ *
+ * The small values that result are packed in blocks of sixteen with one width byte per block: one,
+ * two, three or four bytes per value. A general-purpose entropy coder would squeeze out a little
+ * more, but byte-aligned blocks decode with plain SSE2 loads, unpacks and prefix sums at memory
+ * speed, which is what loading thousands of cached parts needs. Data is little-endian.
+ */
+
+#ifndef VIEWER_MESHCODEC_H
+#define VIEWER_MESHCODEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "StlParser.h"
+
+/**
+ * @class MeshCodec
+ * @brief Encodes and decodes indexed triangle meshes.
+ */
+class MeshCodec {
+public:
+    static const int kLossless = 0; ///< Keeps every coordinate bit for bit.
+    static const int kDefaultBits = 16; ///< Grid of 65536 steps across the mesh bounds on each axis.
+
+    static std::vector<uint8_t> encode(const StlMesh& mesh, int bits = kDefaultBits);
+    static bool decode(const uint8_t* data, size_t size, StlMesh& mesh, std::string* error = nullptr);
+    static bool isEncoded(const uint8_t* data, size_t size);
+    static double maxError(const uint8_t* data, size_t size);
+};
+
+#endif // VIEWER_MESHCODEC_H
@@ -0,0 +1,64 @@
+/**
+ * @file MessageFraming.h
+ *
+ * Length-prefixed message framing shared by the socket protocols (viewer sync and remote rendering).
+ * Each message is a 32-bit big-endian payload length followed by the payload.
+ */
+
+#ifndef VIEWER_MESSAGEFRAMING_H
+#define VIEWER_MESSAGEFRAMING_H
+
+#include <QByteArray>
+#include <QIODevice>
+#include <QtEndian>
+
+namespace MessageFraming {
+
+const quint32 kMaxMessageSize = 1u << 30; ///< Larger length prefixes mean the stream is corrupt.
+
+/**
+ * Writes one message to a socket.
+ *
+ * @param device The socket.
+ * @param message The payload.
+ */
+inline void send(QIODevice* device, const QByteArray& message) {
+    char header[4];
+    qToBigEndian<quint32>(static_cast<quint32>(message.size()), header);
+    device->write(header, sizeof(header));
+    device->write(message);
+}
+
+/** What take() found at the front of a read buffer. */
+enum TakeResult {
+    Incomplete, ///< The buffer does not hold a whole message yet.
+    Taken, ///< A message was taken off the buffer.
+    Corrupt ///< The length prefix is out of range; the stream cannot be resynchronised, so the connection must be closed.
+};
+
+/**
+ * Takes the next complete message off the front of a read buffer.
+ *
+ * @param buffer Bytes received so far; the message is removed from it.
+ * @param message Receives the payload.
+ * @return Taken if a message was taken, Incomplete if more bytes are needed, or Corrupt if the
+ *         length prefix is out of range. A corrupt buffer is left as it is.
+ */
+inline TakeResult take(QByteArray& buffer, QByteArray& message) {
+    if (buffer.size() < 4)
+        return Incomplete;
+
+    const quint32 size = qFromBigEndian<quint32>(buffer.constData());
+    if (size > kMaxMessageSize)
+        return Corrupt;
+    if (static_cast<quint32>(buffer.size()) < 4 + size)
+        return Incomplete;
+
+    message = buffer.mid(4, static_cast<int>(size));
+    buffer.remove(0, static_cast<int>(4 + size));
+    return Taken;
+}
+
+} // namespace MessageFraming
+
+#endif // VIEWER_MESSAGEFRAMING_H
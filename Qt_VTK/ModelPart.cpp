@@ -16,16 +16,40 @@
 #include <vtkSTLReader.h>
 #include <vtkSmartPointer.h>
 #include <vtkDataSetMapper.h>
+#include <vtkQuadricClustering.h>
+#include <vtkCellArray.h>
+#include <vtkMatrix4x4.h>
+#include <vtkFloatArray.h>
+#include <vtkIdTypeArray.h>
+#include <vtkPoints.h>
+#include <vtkPointData.h>
+#include <vtkUnsignedCharArray.h>
+#include "PointCloud.h"
+#include "StlParser.h"
+#include <algorithm>
+
+std::atomic<unsigned long> ModelPart::visibilityEpoch(1);
 
  /**
   * Constructor for the ModelPart class.
   * Initializes a model part with the given data and parent.
   *
+  * Every part owns a scene node and a transform, even groups without geometry, so that hiding or
+  * moving a part is a single update that its whole subtree inherits when drawn. The initial
+  * visibility is taken from the "Visible?" column.
+  *
   * @param data A list of QVariant items to initialize the item's data.
   * @param parent The parent ModelPart, nullptr if it's the root.
   */
 ModelPart::ModelPart(const QList<QVariant>& data, ModelPart* parent)
-    : m_itemData(data), m_parentItem(parent), isVisible(false) {
+    : m_itemData(data), m_parentItem(parent), isVisible(data.size() > 1 && data.at(1).toString() == "true"),
+      effectiveVisibleCache(false), effectiveVisibleEpoch(0), densityValue(0.0), occluderMeshBuilt(false) {
+    node = vtkSmartPointer<vtkPropAssembly>::New();
+    node->SetVisibility(isVisible);
+    transform = vtkSmartPointer<vtkTransform>::New();
+    if (m_parentItem) {
+        transform->SetInput(m_parentItem->transform);
+    }
 }
 
 /**
@@ -43,7 +67,10 @@ ModelPart::~ModelPart() {
  */
 void ModelPart::appendChild(ModelPart* item) {
     item->m_parentItem = this;
+    item->transform->SetInput(transform);
+    node->AddPart(item->node);
     m_childItems.append(item);
+    ++visibilityEpoch; // The item now inherits this part's visibility
 }
 
 /**
@@ -128,10 +155,22 @@ int ModelPart::row() const {
  */
 void ModelPart::removeChildren(int position, int count) {
     for (int row = 0; row < count; ++row) {
-        delete m_childItems.takeAt(position);
+        ModelPart* item = m_childItems.takeAt(position);
+        node->RemovePart(item->node);
+        delete item;
     }
 }
 
+/**
+ * Reorders the item's children, keeping children that compare equal in their current order.
+ * Only the order in the tree changes; the scene is drawn the same.
+ *
+ * @param lessThan Returns true if the first child belongs before the second.
+ */
+void ModelPart::sortChildren(const std::function<bool(ModelPart*, ModelPart*)>& lessThan) {
+    std::stable_sort(m_childItems.begin(), m_childItems.end(), lessThan);
+}
+
 /**
  * Sets the color of the model part.
  *
@@ -141,6 +180,9 @@ void ModelPart::removeChildren(int position, int count) {
  */
 void ModelPart::setColour(const unsigned char R, const unsigned char G, const unsigned char B) {
     color = QColor(R, G, B);
+    if (pointCloud) {
+        pointCloud->setColor(color);
+    }
 }
 
 /**
@@ -180,7 +222,12 @@ QColor ModelPart::getColor() const {
  * @param isVisible Boolean indicating whether the part is visible.
  */
 void ModelPart::setVisible(bool isVisible) {
+    if (this->isVisible == isVisible)
+        return;
+
     this->isVisible = isVisible;
+    node->SetVisibility(isVisible);
+    ++visibilityEpoch;
 }
 
 /**
@@ -192,22 +239,186 @@ bool ModelPart::visible() {
     return isVisible;
 }
 
+/**
+ * Returns whether the part is actually shown, i.e. it and all of its ancestors are visible.
+ *
+ * The result is cached until the visibility of any part changes, so repeated queries over the
+ * whole tree cost O(1) per part.
+ *
+ * @return True if the part and every ancestor are visible.
+ */
+bool ModelPart::effectiveVisible() {
+    if (effectiveVisibleEpoch != visibilityEpoch) {
+        effectiveVisibleCache = isVisible && (!m_parentItem || m_parentItem->effectiveVisible());
+        effectiveVisibleEpoch = visibilityEpoch;
+    }
+    return effectiveVisibleCache;
+}
+
+/**
+ * Sets the density of the part's material. Groups pass their density on to every descendant
+ * that does not set its own.
+ *
+ * @param density Mass per cubic model unit, or 0 to inherit the parent's density.
+ */
+void ModelPart::setDensity(double density) {
+    densityValue = std::max(0.0, density);
+}
+
+/**
+ * Returns the density set on this part.
+ *
+ * @return Mass per cubic model unit, or 0 if the density is inherited.
+ */
+double ModelPart::density() const {
+    return densityValue;
+}
+
+/**
+ * Returns the density the part's material actually has: its own, else the nearest ancestor's,
+ * else 1.
+ *
+ * @return Mass per cubic model unit.
+ */
+double ModelPart::effectiveDensity() const {
+    for (const ModelPart* part = this; part; part = part->m_parentItem) {
+        if (part->densityValue > 0.0) return part->densityValue;
+    }
+    return 1.0;
+}
+
 /**
  * Loads an STL file and creates the associated VTK actor for rendering.
  *
  * @param fileName The path to the STL file.
  */
 void ModelPart::loadSTL(QString fileName) {
-    reader = vtkSmartPointer<vtkSTLReader>::New();
+    vtkNew<vtkSTLReader> reader;
     reader->SetFileName(fileName.toStdString().c_str());
     reader->Update();
+    setPolyData(reader->GetOutput());
+}
+
+/**
+ * Loads STL data that has already been read into memory and creates the associated VTK actor.
+ *
+ * This is the path used by bulk imports: the file is read by BulkFileReader and parsed here, so no
+ * further file I/O happens on the parsing thread.
+ *
+ * @param data The contents of a binary or ASCII STL file.
+ * @param size The number of bytes in data.
+ * @param error Optional; receives a description of the problem if the data cannot be parsed.
+ * @return True if the geometry was loaded.
+ */
+bool ModelPart::loadSTL(const char* data, size_t size, QString* error) {
+    StlMesh mesh;
+    std::string parseError;
+    if (!StlParser::parse(data, size, mesh, &parseError)) {
+        if (error) *error = QString::fromStdString(parseError);
+        return false;
+    }
+
+    setPolyData(createPolyData(mesh.points, mesh.triangles));
+    setFeatureEdges(FeatureEdges::extract(mesh.points.data(), mesh.triangles.data(), mesh.triangles.size() / 3));
+    return true;
+}
+
+/**
+ * Builds VTK triangle geometry from an indexed mesh.
+ *
+ * @param coordinates Vertex coordinates, x, y, z per vertex.
+ * @param triangles Vertex indices, three per triangle.
+ * @return The geometry, with its own copy of the arrays.
+ */
+vtkSmartPointer<vtkPolyData> ModelPart::createPolyData(const std::vector<float>& coordinates, const std::vector<uint32_t>& triangles) {
+    vtkNew<vtkFloatArray> pointArray;
+    pointArray->SetNumberOfComponents(3);
+    pointArray->SetNumberOfTuples(static_cast<vtkIdType>(coordinates.size() / 3));
+    std::copy(coordinates.begin(), coordinates.end(), pointArray->GetPointer(0));
+    vtkNew<vtkPoints> points;
+    points->SetData(pointArray);
+
+    const vtkIdType triangleCount = static_cast<vtkIdType>(triangles.size() / 3);
+    vtkNew<vtkIdTypeArray> offsets;
+    offsets->SetNumberOfValues(triangleCount + 1);
+    for (vtkIdType i = 0; i <= triangleCount; ++i) {
+        offsets->SetValue(i, i * 3);
+    }
+    vtkNew<vtkIdTypeArray> connectivity;
+    connectivity->SetNumberOfValues(static_cast<vtkIdType>(triangles.size()));
+    std::copy(triangles.begin(), triangles.end(), connectivity->GetPointer(0));
+    vtkNew<vtkCellArray> polys;
+    polys->SetData(offsets, connectivity);
+
+    vtkSmartPointer<vtkPolyData> polyData = vtkSmartPointer<vtkPolyData>::New();
+    polyData->SetPoints(points);
+    polyData->SetPolys(polys);
+    return polyData;
+}
+
+/**
+ * Converts VTK geometry to an indexed triangle list, splitting polygons into fans. This is the
+ * inverse of createPolyData().
+ *
+ * @param polyData The geometry.
+ * @param coordinates Receives vertex coordinates, x, y, z per vertex.
+ * @param triangles Receives vertex indices, three per triangle.
+ */
+void ModelPart::extractMesh(vtkPolyData* polyData, std::vector<float>& coordinates, std::vector<uint32_t>& triangles) {
+    coordinates.clear();
+    triangles.clear();
+    vtkPoints* points = polyData->GetPoints();
+    if (!points)
+        return;
+
+    const vtkIdType pointCount = points->GetNumberOfPoints();
+    coordinates.resize(static_cast<size_t>(pointCount) * 3);
+    for (vtkIdType i = 0; i < pointCount; ++i) {
+        double p[3];
+        points->GetPoint(i, p);
+        coordinates[i * 3] = static_cast<float>(p[0]);
+        coordinates[i * 3 + 1] = static_cast<float>(p[1]);
+        coordinates[i * 3 + 2] = static_cast<float>(p[2]);
+    }
+
+    vtkCellArray* polys = polyData->GetPolys();
+    triangles.reserve(static_cast<size_t>(polys->GetNumberOfCells()) * 3);
+    vtkIdType cellSize;
+    const vtkIdType* cell;
+    for (polys->InitTraversal(); polys->GetNextCell(cellSize, cell);) {
+        for (vtkIdType k = 1; k + 1 < cellSize; ++k) {
+            triangles.push_back(static_cast<uint32_t>(cell[0]));
+            triangles.push_back(static_cast<uint32_t>(cell[k]));
+            triangles.push_back(static_cast<uint32_t>(cell[k + 1]));
+        }
+    }
+}
+
+/**
+ * Sets the geometry of this part and creates the associated VTK actor for rendering.
+ *
+ * @param polyData The triangle geometry.
+ */
+void ModelPart::setPolyData(vtkSmartPointer<vtkPolyData> polyData) {
+    this->polyData = polyData;
 
     vtkNew<vtkPolyDataMapper> mapper;
-    mapper->SetInputConnection(reader->GetOutputPort());
+    mapper->SetInputData(polyData);
+
+    if (this->actor) {
+        node->RemovePart(this->actor);
+    }
 
     vtkNew<vtkActor> actor;
     actor->SetMapper(mapper);
+    actor->SetUserTransform(transform);
     this->actor = actor;
+    node->AddPart(actor);
+
+    occluderMesh.clear();
+    occluderMeshBuilt = false;
+    collisionProxy.reset();
+    edgeActor = nullptr;
 }
 
 /**
@@ -221,21 +432,27 @@ vtkSmartPointer<vtkActor> ModelPart::getActor() {
 
 /**
  * Creates and returns a new VTK actor based on the current model data.
- * Useful for creating duplicate representations of the model part.
+ * Useful for creating duplicate representations of the model part. The copy carries a snapshot
+ * of the part's world transform.
  *
- * @return A new VTK actor, or nullptr if the original actor or reader is not set.
+ * @return A new VTK actor, or nullptr if the part has no geometry.
  */
 vtkSmartPointer<vtkActor> ModelPart::getNewActor() {
-    if (!this->actor || !this->reader) {
+    if (!this->actor || !this->polyData) {
         return nullptr;
     }
 
     vtkSmartPointer<vtkPolyDataMapper> newMapper = vtkSmartPointer<vtkPolyDataMapper>::New();
-    newMapper->SetInputConnection(this->reader->GetOutputPort());
+    newMapper->SetInputData(this->polyData);
 
     vtkSmartPointer<vtkActor> newActor = vtkSmartPointer<vtkActor>::New();
     newActor->SetMapper(newMapper);
 
+    // Snapshot the world transform; the copy may be used from another thread (e.g. VR)
+    vtkNew<vtkMatrix4x4> matrix;
+    matrix->DeepCopy(transform->GetMatrix());
+    newActor->SetUserMatrix(matrix);
+
     if (this->actor->GetProperty()) {
         newActor->GetProperty()->DeepCopy(this->actor->GetProperty());
     }
@@ -243,6 +460,223 @@ vtkSmartPointer<vtkActor> ModelPart::getNewActor() {
     return newActor;
 }
 
+/**
+ * Retrieves the triangle geometry loaded for this model part.
+ *
+ * @return The loaded polydata, or nullptr if no geometry has been loaded.
+ */
+vtkSmartPointer<vtkPolyData> ModelPart::getPolyData() {
+    return this->polyData;
+}
+
+/**
+ * Retrieves a coarse level of detail of this part for use as an occluder.
+ *
+ * The mesh is built on first use by clustering the geometry onto a 16x16x16 grid and is returned
+ * as a flat list of triangle vertices in the part's own coordinates. Call this from the GUI thread;
+ * the returned vector can then be read from worker threads.
+ *
+ * @return The occluder triangles (x, y, z per vertex), empty if the part has no geometry.
+ */
+const std::vector<float>& ModelPart::getOccluderMesh() {
+    vtkSmartPointer<vtkPolyData> polyData = getPolyData();
+    if (occluderMeshBuilt || !polyData)
+        return occluderMesh;
+
+    vtkNew<vtkQuadricClustering> clustering;
+    clustering->SetInputData(polyData);
+    clustering->SetNumberOfDivisions(16, 16, 16);
+    clustering->Update();
+
+    vtkPolyData* lod = clustering->GetOutput();
+    vtkCellArray* polys = lod->GetPolys();
+    vtkIdType npts;
+    const vtkIdType* pts;
+    double point[3];
+    for (polys->InitTraversal(); polys->GetNextCell(npts, pts);) {
+        if (npts != 3)
+            continue;
+        for (vtkIdType i = 0; i < 3; ++i) {
+            lod->GetPoint(pts[i], point);
+            occluderMesh.insert(occluderMesh.end(), { static_cast<float>(point[0]), static_cast<float>(point[1]), static_cast<float>(point[2]) });
+        }
+    }
+    occluderMeshBuilt = true;
+    return occluderMesh;
+}
+
+/**
+ * Retrieves the scene node of this part.
+ *
+ * The node contains the part's actor (if it has geometry) and the nodes of all its children, so
+ * adding the root's node to a renderer draws the whole tree and hiding a node hides its subtree.
+ *
+ * @return The scene node.
+ */
+vtkSmartPointer<vtkPropAssembly> ModelPart::getNode() {
+    return node;
+}
+
+/**
+ * Retrieves the transform of this part.
+ *
+ * The transform is relative to the parent part: it is chained onto the parent's transform, so
+ * translating or rotating a group moves every descendant without touching them individually.
+ *
+ * @return The part's transform.
+ */
+vtkSmartPointer<vtkTransform> ModelPart::getTransform() {
+    return transform;
+}
+
+/**
+ * Shows a scanned point cloud (PLY or XYZ) in this part. The first time a file is loaded it is
+ * converted to an octree file, which can take minutes for large scans, so call this on a worker
+ * thread. Only the coarsest level is read here; the scene renderer streams in detail as needed.
+ *
+ * @param fileName The point cloud file.
+ * @param error Receives a description of the failure; may be nullptr.
+ * @return True if the cloud was opened.
+ */
+bool ModelPart::loadPointCloud(const QString& fileName, QString* error) {
+    std::shared_ptr<PointCloud> cloud = PointCloud::open(fileName, error);
+    if (!cloud)
+        return false;
+
+    if (pointCloud) {
+        for (int i = 0; i < pointCloud->nodeCount(); ++i) {
+            pointCloud->evictNode(i);
+        }
+    }
+    pointCloud = cloud;
+    pointCloud->attach(node, transform);
+    pointCloud->setColor(color);
+    pointCloud->setNodeData(0, pointCloud->readNode(0));
+    pointCloud->setNodeVisible(0, true); // So the camera frames the cloud before its first frame
+    return true;
+}
+
+/**
+ * Retrieves the point cloud shown by this part.
+ *
+ * @return The point cloud, or nullptr if the part shows a mesh or nothing.
+ */
+std::shared_ptr<PointCloud> ModelPart::getPointCloud() {
+    return pointCloud;
+}
+
+/**
+ * Retrieves the collision proxy built for the current geometry.
+ *
+ * @return The proxy, or nullptr if none has been built since the geometry was last set.
+ */
+std::shared_ptr<const CollisionProxy> ModelPart::getCollisionProxy() const {
+    return collisionProxy;
+}
+
+/**
+ * Stores a collision proxy built from the part's geometry, e.g. on a worker thread, so it is only
+ * built once per mesh. Setting new geometry discards it.
+ *
+ * @param proxy The proxy.
+ */
+void ModelPart::setCollisionProxy(std::shared_ptr<const CollisionProxy> proxy) {
+    collisionProxy = std::move(proxy);
+}
+
+/**
+ * Extracts the part's feature edges and creates the actor that draws them. Import calls this on
+ * the worker thread that parsed the part, so the edges are ready before the part is shown; it must
+ * not run concurrently with rendering once the part is in a scene.
+ *
+ * @param angleDegrees Edges between faces meeting at more than this angle are drawn.
+ */
+void ModelPart::buildFeatureEdges(double angleDegrees) {
+    if (!polyData)
+        return;
+
+    std::vector<float> coordinates;
+    std::vector<uint32_t> triangles;
+    extractMesh(polyData, coordinates, triangles);
+    setFeatureEdges(FeatureEdges::extract(coordinates.data(), triangles.data(), triangles.size() / 3, angleDegrees));
+}
+
+/**
+ * Retrieves the actor drawing the part's feature edges. It is not part of the part's scene node;
+ * the scene renderer draws it in its overlay layer.
+ *
+ * @return The actor, or nullptr if the edges have not been built for the current geometry.
+ */
+vtkSmartPointer<vtkActor> ModelPart::getEdgeActor() {
+    return edgeActor;
+}
+
+/**
+ * Colours the part's vertices, e.g. with a deviation colour map, in place of its own colour. The
+ * colours are drawn from a shallow copy of the geometry, so getPolyData() and everything built
+ * from it are unaffected.
+ *
+ * @param colours Three components per vertex, or nullptr to restore the part's colour.
+ */
+void ModelPart::setVertexColours(vtkSmartPointer<vtkUnsignedCharArray> colours) {
+    if (!actor || !polyData)
+        return;
+
+    vtkMapper* mapper = actor->GetMapper();
+    if (!colours || colours->GetNumberOfTuples() != polyData->GetNumberOfPoints()) {
+        vtkPolyDataMapper::SafeDownCast(mapper)->SetInputData(polyData);
+        mapper->ScalarVisibilityOff();
+        return;
+    }
+    vtkNew<vtkPolyData> coloured;
+    coloured->ShallowCopy(polyData);
+    coloured->GetPointData()->SetScalars(colours);
+    vtkPolyDataMapper::SafeDownCast(mapper)->SetInputData(coloured);
+    mapper->SetColorModeToDirectScalars();
+    mapper->ScalarVisibilityOn();
+}
+
+/**
+ * Returns a counter that changes whenever the visibility or parent of any part changes, so
+ * callers can tell when effectiveVisible() results may have changed.
+ *
+ * @return The current visibility epoch.
+ */
+unsigned long ModelPart::visibilityVersion() {
+    return visibilityEpoch;
+}
+
+/**
+ * Creates the feature edge actor from vertex index pairs into the part's points. The lines share
+ * the mesh's points rather than copying them, and follow the part's transform.
+ *
+ * @param edges Vertex index pairs.
+ */
+void ModelPart::setFeatureEdges(const std::vector<uint32_t>& edges) {
+    vtkNew<vtkIdTypeArray> connectivity;
+    connectivity->SetNumberOfValues(static_cast<vtkIdType>(edges.size()));
+    std::copy(edges.begin(), edges.end(), connectivity->GetPointer(0));
+    vtkNew<vtkCellArray> lines;
+    lines->SetData(2, connectivity);
+
+    vtkNew<vtkPolyData> edgeData;
+    edgeData->SetPoints(polyData->GetPoints());
+    edgeData->SetLines(lines);
+
+    vtkNew<vtkPolyDataMapper> edgeMapper;
+    edgeMapper->SetInputData(edgeData);
+    edgeMapper->ScalarVisibilityOff();
+    edgeMapper->SetRelativeCoincidentTopologyLineOffsetParameters(0.0, -4.0); // Win depth ties with the faces
+
+    edgeActor = vtkSmartPointer<vtkActor>::New();
+    edgeActor->SetMapper(edgeMapper);
+    edgeActor->SetUserTransform(transform);
+    edgeActor->GetProperty()->SetColor(0.05, 0.05, 0.05);
+    edgeActor->GetProperty()->SetLineWidth(1.5f);
+    edgeActor->GetProperty()->LightingOff();
+    edgeActor->PickableOff();
+}
+
 /**
  * Removes a single child from the model part at the specified position.
  *
@@ -252,5 +686,7 @@ void ModelPart::removeChild(int position) {
     if (position < 0 || position >= m_childItems.size())
         return;
 
-    delete m_childItems.takeAt(position);
+    ModelPart* item = m_childItems.takeAt(position);
+    node->RemovePart(item->node);
+    delete item;
 }
@@ -14,13 +14,23 @@
 #include <QList>
 #include <QVariant>
 #include <QColor>
+#include <atomic>
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <vector>
 #include <vtkSmartPointer.h>
 #include <vtkMapper.h>
 #include <vtkActor.h>
-#include <vtkSTLReader.h>
 #include <vtkColor.h>
+#include <vtkPolyData.h>
+#include <vtkPropAssembly.h>
+#include <vtkTransform.h>
+#include <vtkUnsignedCharArray.h>
+#include "FeatureEdges.h"
+
+class CollisionProxy;
+class PointCloud;
 
  /**
   * @class ModelPart
@@ -48,22 +58,56 @@ public:
     unsigned char getColourB() const;
     void setVisible(bool isVisible);
     bool visible();
+    bool effectiveVisible();
+    void setDensity(double density);
+    double density() const;
+    double effectiveDensity() const;
     void loadSTL(QString fileName);
+    bool loadSTL(const char* data, size_t size, QString* error = nullptr);
+    void setPolyData(vtkSmartPointer<vtkPolyData> polyData);
+    static vtkSmartPointer<vtkPolyData> createPolyData(const std::vector<float>& coordinates, const std::vector<uint32_t>& triangles);
+    static void extractMesh(vtkPolyData* polyData, std::vector<float>& coordinates, std::vector<uint32_t>& triangles);
     void removeChild(int position);
     void removeChildren(int position, int count);
+    void sortChildren(const std::function<bool(ModelPart*, ModelPart*)>& lessThan);
     vtkSmartPointer<vtkActor> getActor();
     vtkSmartPointer<vtkActor> getNewActor();
     QColor getColor() const;
+    vtkSmartPointer<vtkPolyData> getPolyData();
+    const std::vector<float>& getOccluderMesh();
+    vtkSmartPointer<vtkPropAssembly> getNode();
+    vtkSmartPointer<vtkTransform> getTransform();
+    bool loadPointCloud(const QString& fileName, QString* error = nullptr);
+    std::shared_ptr<PointCloud> getPointCloud();
+    std::shared_ptr<const CollisionProxy> getCollisionProxy() const;
+    void setCollisionProxy(std::shared_ptr<const CollisionProxy> proxy);
+    void buildFeatureEdges(double angleDegrees = FeatureEdges::kDefaultAngle);
+    vtkSmartPointer<vtkActor> getEdgeActor();
+    void setVertexColours(vtkSmartPointer<vtkUnsignedCharArray> colours);
+    static unsigned long visibilityVersion();
 
 private:
+    void setFeatureEdges(const std::vector<uint32_t>& edges);
+
     QList<ModelPart*> m_childItems; ///< Child parts of this model part.
     QList<QVariant> m_itemData; ///< Data associated with this part, like name and visibility.
     ModelPart* m_parentItem; ///< Parent part of this model part.
-    bool isVisible; ///< Visibility state of this part.
+    bool isVisible; ///< Visibility state of this part, inherited by its children.
+    bool effectiveVisibleCache; ///< Cached result of effectiveVisible().
+    unsigned long effectiveVisibleEpoch; ///< Visibility epoch effectiveVisibleCache was computed in.
+    static std::atomic<unsigned long> visibilityEpoch; ///< Incremented whenever any part's visibility or parent changes.
     QColor color; ///< Color of this part.
-    vtkSmartPointer<vtkSTLReader> reader; ///< STL reader for loading geometrical data.
+    double densityValue; ///< Mass per cubic model unit, or 0 to inherit the parent's.
+    vtkSmartPointer<vtkPolyData> polyData; ///< Triangle geometry of this part.
     vtkSmartPointer<vtkMapper> mapper; ///< Mapper for geometrical data.
     vtkSmartPointer<vtkActor> actor; ///< Actor for rendering.
+    std::vector<float> occluderMesh; ///< Coarse triangle soup used when this part acts as an occluder.
+    bool occluderMeshBuilt; ///< True once occluderMesh has been generated for the current geometry.
+    vtkSmartPointer<vtkPropAssembly> node; ///< Scene node holding this part's actor and its children's nodes.
+    vtkSmartPointer<vtkTransform> transform; ///< Local transform, chained onto the parent's transform.
+    std::shared_ptr<const CollisionProxy> collisionProxy; ///< Convex hulls for contact tests, or nullptr until built.
+    vtkSmartPointer<vtkActor> edgeActor; ///< Feature edges drawn over the part's own points, or nullptr until built.
+    std::shared_ptr<PointCloud> pointCloud; ///< Scanned points shown by this part instead of a mesh, or nullptr.
 };
 
 #endif // VIEWER_MODELPART_H
@@ -10,6 +10,9 @@
 #include "ModelPartList.h"
 #include "ModelPart.h"
 #include <QStandardItem>
+#include <QHash>
+#include <QPair>
+#include <QSet>
 
  /**
   * @brief Constructor for ModelPartList.
@@ -19,8 +22,9 @@
   * @param data String data used for initialization.
   * @param parent Pointer to the parent QObject.
   */
-ModelPartList::ModelPartList(const QString& data, QObject* parent) : QAbstractItemModel(parent) {
-    rootItem = new ModelPart({ tr("Part"), tr("Visible?"), tr("Colour") });
+ModelPartList::ModelPartList(const QString& data, QObject* parent) : QAbstractItemModel(parent), renderTotalMs(0.0), renderGpuTimed(false) {
+    rootItem = new ModelPart({ tr("Part"), tr("Visible?"), tr("Colour"), tr("Render Cost") });
+    rootItem->setVisible(true); // The root's node holds the whole scene
 }
 
 /**
@@ -50,10 +54,14 @@ int ModelPartList::columnCount(const QModelIndex& parent) const {
  * @return The data stored under the given role for the item referred to by the index.
  */
 QVariant ModelPartList::data(const QModelIndex& index, int role) const {
-    if (!index.isValid() || role != Qt::DisplayRole)
+    if (!index.isValid())
         return QVariant();
 
     auto* item = static_cast<ModelPart*>(index.internalPointer());
+    if (item && index.column() == kRenderCostColumn)
+        return renderCostData(item, role);
+    if (role != Qt::DisplayRole)
+        return QVariant();
     return item ? item->data(index.column()) : QVariant();
 }
 
@@ -153,6 +161,87 @@ QModelIndex ModelPartList::appendChild(QModelIndex& parent, const QList<QVariant
     return createIndex(rowCount(parent) - 1, 0, childPart);
 }
 
+/**
+ * @brief Appends several existing parts to a parent in one model update.
+ *
+ * The view receives a single rowsInserted notification covering all of the new rows, which is much
+ * cheaper than one notification (or a layout change) per part when importing many files.
+ *
+ * @param parent The parent index the parts are appended to; invalid for the root.
+ * @param parts The parts to append. Ownership passes to the parent part.
+ */
+void ModelPartList::insertChildren(const QModelIndex& parent, const QList<ModelPart*>& parts) {
+    if (parts.isEmpty())
+        return;
+
+    // Rows only exist under column 0, whichever column of the parent was selected
+    ModelPart* parentPart = getItem(parent);
+    QModelIndex parentIndex = indexOf(parentPart);
+    int first = parentPart->childCount();
+    beginInsertRows(parentIndex, first, first + parts.size() - 1);
+    for (ModelPart* part : parts) {
+        parentPart->appendChild(part);
+    }
+    endInsertRows();
+}
+
+/**
+ * @brief Finds the model index of a part in the tree.
+ *
+ * @param part The part to locate.
+ * @param column The column of the returned index.
+ * @return The index of the part, or an invalid index for the root or a null part.
+ */
+QModelIndex ModelPartList::indexOf(ModelPart* part, int column) const {
+    if (!part || part == rootItem)
+        return QModelIndex();
+
+    return createIndex(part->row(), column, part);
+}
+
+/**
+ * @brief Notifies views that the displayed data of a part has changed.
+ *
+ * @param part The part whose row should be refreshed.
+ */
+void ModelPartList::notifyPartChanged(ModelPart* part) {
+    QModelIndex first = indexOf(part, 0);
+    if (!first.isValid())
+        return;
+
+    emit dataChanged(first, indexOf(part, columnCount() - 1));
+}
+
+/**
+ * @brief Notifies views that many parts have changed, with one signal per parent.
+ *
+ * Each signal spans the changed children of one parent, found in a single pass over its
+ * children rather than by looking up each part's row, so batches over huge flat assemblies
+ * stay linear.
+ *
+ * @param parts The parts whose rows should be refreshed.
+ */
+void ModelPartList::notifyPartsChanged(const QVector<ModelPart*>& parts) {
+    QHash<ModelPart*, QSet<ModelPart*>> changedByParent;
+    for (ModelPart* part : parts) {
+        if (part && part != rootItem) changedByParent[part->parentItem()].insert(part);
+    }
+
+    for (auto it = changedByParent.constBegin(); it != changedByParent.constEnd(); ++it) {
+        ModelPart* parent = it.key();
+        int first = -1, last = -1;
+        for (int row = 0; row < parent->childCount(); ++row) {
+            if (it.value().contains(parent->child(row))) {
+                if (first < 0) first = row;
+                last = row;
+            }
+        }
+        if (first >= 0) {
+            emit dataChanged(createIndex(first, 0, parent->child(first)), createIndex(last, columnCount() - 1, parent->child(last)));
+        }
+    }
+}
+
 /**
  * @brief Removes a number of rows starting from a given position.
  *
@@ -168,6 +257,7 @@ bool ModelPartList::removeRows(int position, int rows, const QModelIndex& parent
 
     beginRemoveRows(parentIndex, position, position + rows - 1);
     for (int row = 0; row < rows; ++row) {
+        forgetRenderCosts(parentItem->child(position));
         parentItem->removeChild(position);
     }
     endRemoveRows();
@@ -175,6 +265,140 @@ bool ModelPartList::removeRows(int position, int rows, const QModelIndex& parent
     return true;
 }
 
+/**
+ * @brief Sorts the children of every part by render cost, keeping equal rows in their order.
+ *
+ * Groups are placed by their own cost, so the costliest assemblies come first and the
+ * costliest parts first within each. Other columns are not sortable: the tree's order is the
+ * order sync sessions and recordings reproduce, so it only changes when asked for by profiling.
+ *
+ * @param column The column to sort by; anything but kRenderCostColumn is ignored.
+ * @param order Whether the smallest or largest cost comes first.
+ */
+void ModelPartList::sort(int column, Qt::SortOrder order) {
+    if (column != kRenderCostColumn)
+        return;
+
+    std::function<bool(ModelPart*, ModelPart*)> lessThan = [this](ModelPart* a, ModelPart* b) {
+        return renderCosts.value(a).costMs() < renderCosts.value(b).costMs();
+    };
+    if (order == Qt::DescendingOrder) {
+        lessThan = [ascending = lessThan](ModelPart* a, ModelPart* b) { return ascending(b, a); };
+    }
+
+    emit layoutAboutToBeChanged({}, QAbstractItemModel::VerticalSortHint);
+    const QModelIndexList before = persistentIndexList();
+    QList<QPair<ModelPart*, int>> moved;
+    for (const QModelIndex& index : before) {
+        moved.append(qMakePair(getItem(index), index.column()));
+    }
+
+    sortSubtree(rootItem, lessThan);
+
+    QModelIndexList after;
+    for (const QPair<ModelPart*, int>& entry : moved) {
+        after.append(indexOf(entry.first, entry.second));
+    }
+    changePersistentIndexList(before, after);
+    emit layoutChanged({}, QAbstractItemModel::VerticalSortHint);
+}
+
+/**
+ * @brief Shows a render profile in the render cost column. Each group shows the sum of its
+ * descendants, so the expensive branches of an assembly can be followed down from the top.
+ *
+ * @param profile Costs from SceneRenderer::renderProfile(), taken while every part in it exists.
+ */
+void ModelPartList::setRenderProfile(const RenderProfiler::Profile& profile) {
+    renderCosts.clear();
+    for (const auto& entry : profile.parts) {
+        for (ModelPart* part = entry.first; part && part != rootItem; part = part->parentItem()) {
+            RenderProfiler::PartCost& cost = renderCosts[part];
+            cost.triangles += entry.second.triangles;
+            cost.drawCalls += entry.second.drawCalls;
+            cost.cpuMs += entry.second.cpuMs;
+            cost.gpuMs += entry.second.gpuMs;
+        }
+    }
+    renderTotalMs = profile.totalMs();
+    renderGpuTimed = profile.gpuTimed;
+    QVector<ModelPart*> profiled;
+    for (auto it = renderCosts.constBegin(); it != renderCosts.constEnd(); ++it) {
+        profiled.append(it.key());
+    }
+    notifyPartsChanged(profiled);
+}
+
+/**
+ * @brief Clears the render cost column.
+ */
+void ModelPartList::clearRenderProfile() {
+    QVector<ModelPart*> profiled;
+    for (auto it = renderCosts.constBegin(); it != renderCosts.constEnd(); ++it) {
+        profiled.append(it.key());
+    }
+    renderCosts.clear();
+    renderTotalMs = 0.0;
+    notifyPartsChanged(profiled);
+}
+
+/**
+ * @brief Returns the render cost column of a part.
+ *
+ * @param part The part.
+ * @param role The role for which data is requested.
+ * @return The part's cost and share of the frame, details as a tooltip, or nothing if it was not profiled.
+ */
+QVariant ModelPartList::renderCostData(ModelPart* part, int role) const {
+    auto it = renderCosts.constFind(part);
+    if (it == renderCosts.constEnd())
+        return QVariant();
+
+    const RenderProfiler::PartCost& cost = it.value();
+    if (role == Qt::DisplayRole) {
+        return QString("%1 ms (%2%)").arg(cost.costMs(), 0, 'f', 3)
+            .arg(renderTotalMs > 0.0 ? 100.0 * cost.costMs() / renderTotalMs : 0.0, 0, 'f', 1);
+    }
+    if (role == Qt::ToolTipRole) {
+        return tr("Triangles: %1\nDraw calls: %2\nCPU submission: %3 ms\nGPU: %4")
+            .arg(qRound64(cost.triangles)).arg(cost.drawCalls, 0, 'f', 1).arg(cost.cpuMs, 0, 'f', 3)
+            .arg(renderGpuTimed ? QString("%1 ms").arg(cost.gpuMs, 0, 'f', 3) : tr("not measured"));
+    }
+    if (role == Qt::TextAlignmentRole) {
+        return QVariant(Qt::AlignRight | Qt::AlignVCenter);
+    }
+    return QVariant();
+}
+
+/**
+ * @brief Sorts the children of a part and of all its descendants.
+ *
+ * @param part The root of the subtree.
+ * @param lessThan Returns true if the first part belongs before the second.
+ */
+void ModelPartList::sortSubtree(ModelPart* part, const std::function<bool(ModelPart*, ModelPart*)>& lessThan) {
+    part->sortChildren(lessThan);
+    for (int row = 0; row < part->childCount(); ++row) {
+        sortSubtree(part->child(row), lessThan);
+    }
+}
+
+/**
+ * @brief Drops the render costs of a subtree about to be deleted, so a part later allocated at
+ * the same address does not show them.
+ *
+ * @param part The root of the subtree.
+ */
+void ModelPartList::forgetRenderCosts(ModelPart* part) {
+    if (renderCosts.isEmpty() || !part)
+        return;
+
+    renderCosts.remove(part);
+    for (int row = 0; row < part->childCount(); ++row) {
+        forgetRenderCosts(part->child(row));
+    }
+}
+
 /**
  * @brief Retrieves the item associated with a given index.
  *
@@ -11,10 +11,13 @@
 #define VIEWER_MODELPARTLIST_H
 
 #include "ModelPart.h"
+#include "RenderProfiler.h"
 #include <QAbstractItemModel>
+#include <QHash>
 #include <QModelIndex>
 #include <QVariant>
 #include <QString>
+#include <QVector>
 
  /**
   * @class ModelPartList
@@ -28,6 +31,8 @@ class ModelPartList : public QAbstractItemModel {
     Q_OBJECT
 
 public:
+    static const int kRenderCostColumn = 3; ///< Column showing each part's share of the frame time, when profiled.
+
     explicit ModelPartList(const QString& data, QObject* parent = nullptr);
     ~ModelPartList();
 
@@ -42,10 +47,24 @@ public:
     ModelPart* getRootItem();
     ModelPart* getItem(const QModelIndex& index) const;
     QModelIndex appendChild(QModelIndex& parent, const QList<QVariant>& data);
+    void insertChildren(const QModelIndex& parent, const QList<ModelPart*>& parts);
+    QModelIndex indexOf(ModelPart* part, int column = 0) const;
+    void notifyPartChanged(ModelPart* part);
+    void notifyPartsChanged(const QVector<ModelPart*>& parts);
     bool removeRows(int position, int rows, const QModelIndex& parentIndex = QModelIndex());
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override;
+    void setRenderProfile(const RenderProfiler::Profile& profile);
+    void clearRenderProfile();
 
 private:
+    QVariant renderCostData(ModelPart* part, int role) const;
+    void sortSubtree(ModelPart* part, const std::function<bool(ModelPart*, ModelPart*)>& lessThan);
+    void forgetRenderCosts(ModelPart* part);
+
     ModelPart* rootItem; ///< Pointer to the root item of the model tree.
+    QHash<ModelPart*, RenderProfiler::PartCost> renderCosts; ///< Profiled cost of each part, groups summing their descendants.
+    double renderTotalMs; ///< Cost of the whole profiled frame.
+    bool renderGpuTimed; ///< Whether the profile measured GPU time.
 };
 
 #endif // VIEWER_MODELPARTLIST_H
@@ -0,0 +1,257 @@
+/**
+ * @file OcclusionCuller.cpp
+ * @brief Implementation of the OcclusionCuller class.
+ *
+ * Triangles are projected with a 4x4 row-major matrix (the layout used by vtkMatrix4x4), then
+ * rasterized with edge functions evaluated four pixels at a time. Depth is interpolated linearly
+ * in screen space, which is exact for normalised device depth.
+ *
+ * An occluder writes every pixel whose centre it covers, so a pixel along its silhouette can be
+ * marked as covered while part of it still shows what lies behind. Rather than shrink the
+ * occluders by half a pixel, which would also open a crack along every edge shared by two
+ * triangles and let small triangles cover nothing, the occludee test is made conservative:
+ * a bounding box is tested against its projected rectangle grown by one pixel on every side.
+ */
+
+#include "OcclusionCuller.h"
+#include "GeometryKernels.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCCLUSION_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+/// Clip-space w below which a vertex is treated as touching the near plane.
+const float kMinClipW = 1e-5f;
+
+/// Value the depth buffer is cleared to, further away than any projected depth.
+const float kFarDepth = std::numeric_limits<float>::max();
+
+/**
+ * Projects a point to screen space.
+ *
+ * @param m Row-major 4x4 projection matrix.
+ * @param x, y, z The point to project.
+ * @param width, height Size of the target buffer in pixels.
+ * @param out Receives screen x, screen y and normalised device depth.
+ * @return False if the point lies on or behind the eye plane.
+ */
+bool projectPoint(const double m[16], double x, double y, double z, int width, int height, float out[3]) {
+    double cx = m[0] * x + m[1] * y + m[2] * z + m[3];
+    double cy = m[4] * x + m[5] * y + m[6] * z + m[7];
+    double cz = m[8] * x + m[9] * y + m[10] * z + m[11];
+    double cw = m[12] * x + m[13] * y + m[14] * z + m[15];
+    if (cw < kMinClipW)
+        return false;
+
+    out[0] = static_cast<float>((cx / cw * 0.5 + 0.5) * width);
+    out[1] = static_cast<float>((cy / cw * 0.5 + 0.5) * height);
+    out[2] = static_cast<float>(cz / cw);
+    return true;
+}
+
+} // namespace
+
+/**
+ * Constructor for the OcclusionCuller class.
+ *
+ * @param width Width of the depth buffer, rounded up to a multiple of four for the SIMD loops.
+ * @param height Height of the depth buffer.
+ */
+OcclusionCuller::OcclusionCuller(int width, int height)
+    : m_width((std::max(width, 4) + 3) & ~3), m_height(std::max(height, 1)) {
+    m_depth.assign(static_cast<size_t>(m_width) * m_height, kFarDepth);
+}
+
+/**
+ * Resets every pixel of the depth buffer to "nothing drawn".
+ */
+void OcclusionCuller::clear() {
+    std::fill(m_depth.begin(), m_depth.end(), kFarDepth);
+}
+
+/**
+ * Rasterizes an occluder mesh into the depth buffer.
+ *
+ * Triangles with a vertex behind the eye are skipped rather than clipped; this only makes the
+ * buffer less complete, so the culling stays conservative.
+ *
+ * @param triangles Flat list of triangle vertices (x, y, z per vertex, three vertices per triangle).
+ * @param modelViewProjection Row-major matrix taking the mesh coordinates to clip space.
+ */
+void OcclusionCuller::rasterizeOccluder(const std::vector<float>& triangles, const double modelViewProjection[16]) {
+    // Project every vertex in one vectorised pass, then divide per triangle
+    const size_t vertexCount = triangles.size() / 3;
+    m_clip.resize(vertexCount * 4);
+    GeometryKernels::projectPoints(triangles.data(), m_clip.data(), vertexCount, modelViewProjection);
+
+    const size_t triangleCount = vertexCount / 3;
+    for (size_t t = 0; t < triangleCount; ++t) {
+        const float* clip = m_clip.data() + t * 12;
+        float screen[3][3];
+        bool inFront = true;
+        for (int v = 0; v < 3 && inFront; ++v, clip += 4) {
+            const float w = clip[3];
+            inFront = w >= kMinClipW;
+            screen[v][0] = (clip[0] / w * 0.5f + 0.5f) * m_width;
+            screen[v][1] = (clip[1] / w * 0.5f + 0.5f) * m_height;
+            screen[v][2] = clip[2] / w;
+        }
+        if (inFront) {
+            rasterizeTriangle(screen[0], screen[1], screen[2]);
+        }
+    }
+}
+
+/**
+ * Writes a single screen-space triangle into the depth buffer, keeping the nearest depth.
+ *
+ * @param v0, v1, v2 Screen-space vertices (x, y, depth).
+ */
+void OcclusionCuller::rasterizeTriangle(const float* v0, const float* v1, const float* v2) {
+    float area = (v1[0] - v0[0]) * (v2[1] - v0[1]) - (v1[1] - v0[1]) * (v2[0] - v0[0]);
+    if (std::fabs(area) < 1e-6f)
+        return;
+    if (area < 0.0f) {
+        std::swap(v1, v2); // Both windings are occluders, so normalise to counter-clockwise
+        area = -area;
+    }
+
+    int minX = std::max(0, static_cast<int>(std::floor(std::min({ v0[0], v1[0], v2[0] }))));
+    int maxX = std::min(m_width - 1, static_cast<int>(std::ceil(std::max({ v0[0], v1[0], v2[0] }))));
+    int minY = std::max(0, static_cast<int>(std::floor(std::min({ v0[1], v1[1], v2[1] }))));
+    int maxY = std::min(m_height - 1, static_cast<int>(std::ceil(std::max({ v0[1], v1[1], v2[1] }))));
+    if (minX > maxX || minY > maxY)
+        return;
+
+    // Edge functions E(x, y) = a*x + b*y + c, positive inside the triangle
+    const float a0 = v1[1] - v2[1], b0 = v2[0] - v1[0], c0 = v1[0] * v2[1] - v1[1] * v2[0];
+    const float a1 = v2[1] - v0[1], b1 = v0[0] - v2[0], c1 = v2[0] * v0[1] - v2[1] * v0[0];
+    const float a2 = v0[1] - v1[1], b2 = v1[0] - v0[0], c2 = v0[0] * v1[1] - v0[1] * v1[0];
+
+    // Depth plane from the normalised barycentric weights
+    const float invArea = 1.0f / area;
+    const float za = (a0 * v0[2] + a1 * v1[2] + a2 * v2[2]) * invArea;
+    const float zb = (b0 * v0[2] + b1 * v1[2] + b2 * v2[2]) * invArea;
+    const float zc = (c0 * v0[2] + c1 * v1[2] + c2 * v2[2]) * invArea;
+
+    minX &= ~3;
+
+    for (int y = minY; y <= maxY; ++y) {
+        const float py = y + 0.5f;
+        float* row = m_depth.data() + static_cast<size_t>(y) * m_width;
+
+#ifdef OCCLUSION_USE_SSE2
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 vA0 = _mm_set1_ps(a0), vA1 = _mm_set1_ps(a1), vA2 = _mm_set1_ps(a2), vZa = _mm_set1_ps(za);
+        const __m128 rowE0 = _mm_set1_ps(b0 * py + c0);
+        const __m128 rowE1 = _mm_set1_ps(b1 * py + c1);
+        const __m128 rowE2 = _mm_set1_ps(b2 * py + c2);
+        const __m128 rowZ = _mm_set1_ps(zb * py + zc);
+
+        for (int x = minX; x <= maxX; x += 4) {
+            const __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f));
+            __m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(vA0, px), rowE0), zero);
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(vA1, px), rowE1), zero));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(vA2, px), rowE2), zero));
+            if (_mm_movemask_ps(inside) == 0)
+                continue;
+
+            const __m128 depth = _mm_add_ps(_mm_mul_ps(vZa, px), rowZ);
+            const __m128 current = _mm_loadu_ps(row + x);
+            const __m128 nearest = _mm_min_ps(current, depth);
+            _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, current)));
+        }
+#else
+        for (int x = minX; x <= maxX; ++x) {
+            const float px = x + 0.5f;
+            if (a0 * px + b0 * py + c0 < 0.0f || a1 * px + b1 * py + c1 < 0.0f || a2 * px + b2 * py + c2 < 0.0f)
+                continue;
+            const float depth = za * px + zb * py + zc;
+            row[x] = std::min(row[x], depth);
+        }
+#endif
+    }
+}
+
+/**
+ * Tests whether any part of a bounding box could be visible past the occluders drawn so far.
+ *
+ * The box's screen rectangle is grown by one pixel on every side (see the file comment), so a
+ * box is not culled behind a silhouette pixel the occluder only partly covers. Boxes that cross
+ * the eye plane or fall entirely outside the buffer are reported as visible, leaving those cases
+ * to the renderer's own frustum culling.
+ *
+ * @param bounds World-space bounds (xmin, xmax, ymin, ymax, zmin, zmax).
+ * @param viewProjection Row-major matrix taking world coordinates to clip space.
+ * @return False only if the box is certainly hidden.
+ */
+bool OcclusionCuller::isVisible(const double bounds[6], const double viewProjection[16]) const {
+    float minX = kFarDepth, minY = kFarDepth, maxX = -kFarDepth, maxY = -kFarDepth, minZ = kFarDepth;
+    for (int corner = 0; corner < 8; ++corner) {
+        float screen[3];
+        if (!projectPoint(viewProjection, bounds[(corner & 1) ? 1 : 0], bounds[(corner & 2) ? 3 : 2],
+                bounds[(corner & 4) ? 5 : 4], m_width, m_height, screen))
+            return true;
+        minX = std::min(minX, screen[0]);
+        maxX = std::max(maxX, screen[0]);
+        minY = std::min(minY, screen[1]);
+        maxY = std::max(maxY, screen[1]);
+        minZ = std::min(minZ, screen[2]);
+    }
+    if (minZ < -1.0f)
+        return true;
+
+    int x0 = static_cast<int>(std::floor(minX));
+    int x1 = static_cast<int>(std::ceil(maxX));
+    int y0 = static_cast<int>(std::floor(minY));
+    int y1 = static_cast<int>(std::ceil(maxY));
+    if (x1 < 0 || x0 > m_width - 1 || y1 < 0 || y0 > m_height - 1)
+        return true;
+    x0 = std::max(0, x0 - 1);
+    x1 = std::min(m_width - 1, x1 + 1);
+    y0 = std::max(0, y0 - 1);
+    y1 = std::min(m_height - 1, y1 + 1);
+
+    x0 &= ~3;
+
+    for (int y = y0; y <= y1; ++y) {
+        const float* row = m_depth.data() + static_cast<size_t>(y) * m_width;
+#ifdef OCCLUSION_USE_SSE2
+        const __m128 boxDepth = _mm_set1_ps(minZ);
+        for (int x = x0; x <= x1; x += 4) {
+            if (_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row + x), boxDepth)) != 0)
+                return true;
+        }
+#else
+        for (int x = x0; x <= x1; ++x) {
+            if (row[x] >= minZ)
+                return true;
+        }
+#endif
+    }
+    return false;
+}
+
+/**
+ * Gets the width of the depth buffer.
+ *
+ * @return The width in pixels.
+ */
+int OcclusionCuller::width() const {
+    return m_width;
+}
+
+/**
+ * Gets the height of the depth buffer.
+ *
+ * @return The height in pixels.
+ */
+int OcclusionCuller::height() const {
+    return m_height;
+}
@@ -0,0 +1,43 @@
+/**
+ * @file OcclusionCuller.h
+ *
+ * Defines the OcclusionCuller class, a small CPU software rasterizer used to decide which model parts
+ * are hidden behind large occluding parts. Occluder triangles are rasterized into a low-resolution
+ * depth buffer using SSE2 where available, and part bounding boxes are then tested against it so that
+ * fully hidden parts can be skipped before their actors are submitted to the renderer.
+ */
+
+#ifndef VIEWER_OCCLUSIONCULLER_H
+#define VIEWER_OCCLUSIONCULLER_H
+
+#include <vector>
+
+/**
+ * @class OcclusionCuller
+ * @brief Software depth buffer for conservative occlusion queries.
+ *
+ * The buffer stores normalised device depth (-1 near, +1 far) for each pixel. Occluders write the
+ * nearest depth per pixel and a bounding box is reported as occluded only if every pixel it could
+ * cover already holds something nearer than the nearest corner of the box. The class holds no
+ * VTK or Qt state so it can be filled from a worker thread.
+ */
+class OcclusionCuller {
+public:
+    explicit OcclusionCuller(int width = 256, int height = 128);
+
+    void clear();
+    void rasterizeOccluder(const std::vector<float>& triangles, const double modelViewProjection[16]);
+    bool isVisible(const double bounds[6], const double viewProjection[16]) const;
+    int width() const;
+    int height() const;
+
+private:
+    void rasterizeTriangle(const float* v0, const float* v1, const float* v2);
+
+    int m_width; ///< Width of the depth buffer in pixels, always a multiple of four.
+    int m_height; ///< Height of the depth buffer in pixels.
+    std::vector<float> m_depth; ///< Row-major depth values, cleared to "infinitely far".
+    std::vector<float> m_clip; ///< Clip-space vertices of the occluder being rasterized.
+};
+
+#endif // VIEWER_OCCLUSIONCULLER_H
@@ -0,0 +1,951 @@
+/**
+ * @file PointCloud.cpp
+ * @brief Implementation of the PointCloud class and its PLY and XYZ readers.
+ */
+
+#include "PointCloud.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QTemporaryFile>
+#include <QtEndian>
+#include <vtkFloatArray.h>
+#include <vtkNew.h>
+#include <vtkPointData.h>
+#include <vtkPointGaussianMapper.h>
+#include <vtkPoints.h>
+#include <vtkProperty.h>
+#include <vtkUnsignedCharArray.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <queue>
+
+namespace {
+
+const char kMagic[8] = { 'V', 'W', 'R', 'O', 'C', 'T', 'R', 'E' };
+const quint32 kVersion = 1;
+const int kMortonBits = 21; ///< Bits per axis of the Morton codes; also the deepest octree level.
+const size_t kRunPoints = size_t(1) << 22; ///< Points sorted in memory at a time while converting.
+const size_t kChunkPoints = 65536; ///< Points passed to the reader callback at a time.
+
+std::atomic<int> liveClouds(0);
+
+/** Start of the octree file. */
+struct PointCloudHeader {
+    char magic[8];
+    quint32 version;
+    quint32 hasColour;
+    quint64 pointCount;
+    quint64 nodeCount;
+    quint64 nodesOffset;
+    qint64 sourceSize; ///< Size of the source file, to detect a stale octree.
+    qint64 sourceModified; ///< Modification time of the source file in ms since the epoch.
+};
+
+/** A point with its Morton code, as sorted while converting. */
+struct KeyedPoint {
+    quint64 code;
+    PointRecord record;
+};
+
+using ChunkCallback = std::function<void(const PointRecord* points, size_t count)>;
+
+/**
+ * Spreads the low 21 bits of a value out to every third bit.
+ */
+quint64 spreadBits(quint64 v) {
+    v &= 0x1fffff;
+    v = (v | v << 32) & 0x1f00000000ffffULL;
+    v = (v | v << 16) & 0x1f0000ff0000ffULL;
+    v = (v | v << 8) & 0x100f00f00f00f00fULL;
+    v = (v | v << 4) & 0x10c30c30c30c30c3ULL;
+    v = (v | v << 2) & 0x1249249249249249ULL;
+    return v;
+}
+
+/**
+ * Reads an XYZ file: one point per line as "x y z" or "x y z r g b", separated by spaces, tabs or
+ * commas. Colours are 0 to 255. Lines that do not start with three numbers are skipped.
+ */
+bool readXyz(QFile& file, const ChunkCallback& chunk, bool* hasColour, QString* error) {
+    std::vector<PointRecord> points;
+    points.reserve(kChunkPoints);
+    QByteArray pending;
+    bool colourKnown = false;
+    while (!file.atEnd()) {
+        QByteArray block = file.read(4 << 20);
+        if (block.isEmpty()) {
+            if (error) *error = file.errorString();
+            return false;
+        }
+        pending.append(block);
+        const int end = file.atEnd() ? pending.size() : pending.lastIndexOf('\n') + 1;
+        const char* cursor = pending.constData();
+        const char* const stop = cursor + end;
+        while (cursor < stop) {
+            const char* lineEnd = static_cast<const char*>(std::memchr(cursor, '\n', stop - cursor));
+            if (!lineEnd) lineEnd = stop;
+
+            // strtod stops at the line end or at anything that is not a number
+            double values[6];
+            int parsed = 0;
+            const char* p = cursor;
+            while (parsed < 6 && p < lineEnd) {
+                while (p < lineEnd && (*p == ' ' || *p == '\t' || *p == ',')) ++p;
+                char* next;
+                values[parsed] = std::strtod(p, &next);
+                if (next == p || next > lineEnd) break;
+                ++parsed;
+                p = next;
+            }
+            if (parsed >= 3) {
+                if (!colourKnown) {
+                    *hasColour = parsed == 6;
+                    colourKnown = true;
+                }
+                PointRecord point;
+                point.x = static_cast<float>(values[0]);
+                point.y = static_cast<float>(values[1]);
+                point.z = static_cast<float>(values[2]);
+                const bool coloured = *hasColour && parsed == 6;
+                point.r = coloured ? static_cast<quint8>(std::clamp(values[3], 0.0, 255.0)) : 255;
+                point.g = coloured ? static_cast<quint8>(std::clamp(values[4], 0.0, 255.0)) : 255;
+                point.b = coloured ? static_cast<quint8>(std::clamp(values[5], 0.0, 255.0)) : 255;
+                point.pad = 0;
+                points.push_back(point);
+                if (points.size() == kChunkPoints) {
+                    chunk(points.data(), points.size());
+                    points.clear();
+                }
+            }
+            cursor = lineEnd + 1;
+        }
+        pending.remove(0, end);
+    }
+    if (!points.empty()) {
+        chunk(points.data(), points.size());
+    }
+    return true;
+}
+
+/** A scalar property of a PLY vertex. */
+struct PlyProperty {
+    int size; ///< Bytes in binary files.
+    char type; ///< 'i' signed, 'u' unsigned or 'f' floating point.
+    int role; ///< 0 to 5 for x, y, z, red, green, blue; -1 for anything else.
+};
+
+/**
+ * Decodes a binary PLY scalar, scaling integer colours of more than 8 bits down to 0 to 255.
+ */
+double plyValue(const uchar* p, const PlyProperty& property, bool bigEndian) {
+    uchar bytes[8];
+    std::memcpy(bytes, p, property.size);
+    if (bigEndian != (Q_BYTE_ORDER == Q_BIG_ENDIAN)) {
+        std::reverse(bytes, bytes + property.size);
+    }
+    switch (property.type * 16 + property.size) {
+    case 'i' * 16 + 1: return static_cast<qint8>(bytes[0]);
+    case 'u' * 16 + 1: return bytes[0];
+    case 'i' * 16 + 2: { qint16 v; std::memcpy(&v, bytes, 2); return v; }
+    case 'u' * 16 + 2: { quint16 v; std::memcpy(&v, bytes, 2); return property.role >= 3 ? v / 257.0 : v; }
+    case 'i' * 16 + 4: { qint32 v; std::memcpy(&v, bytes, 4); return v; }
+    case 'u' * 16 + 4: { quint32 v; std::memcpy(&v, bytes, 4); return v; }
+    case 'f' * 16 + 4: { float v; std::memcpy(&v, bytes, 4); return v; }
+    case 'f' * 16 + 8: { double v; std::memcpy(&v, bytes, 8); return v; }
+    }
+    return 0.0;
+}
+
+/**
+ * Reads the vertices of a PLY file in ASCII or either binary byte order. Only x, y, z and
+ * red, green, blue are used; other vertex properties are skipped. The vertex element must come
+ * first and have no list properties, which holds for scanner output.
+ */
+bool readPly(QFile& file, const ChunkCallback& chunk, bool* hasColour, QString* error) {
+    if (file.readLine().trimmed() != "ply") {
+        if (error) *error = "Not a PLY file";
+        return false;
+    }
+
+    QByteArray format;
+    quint64 vertexCount = 0;
+    std::vector<PlyProperty> properties;
+    bool inVertex = false, vertexSeen = false;
+    while (true) {
+        if (file.atEnd()) {
+            if (error) *error = "PLY header has no end_header";
+            return false;
+        }
+        const QList<QByteArray> words = file.readLine().simplified().split(' ');
+        if (words[0] == "end_header") {
+            break;
+        }
+        if (words[0] == "format" && words.size() > 1) {
+            format = words[1];
+        }
+        else if (words[0] == "element" && words.size() > 2) {
+            inVertex = words[1] == "vertex";
+            if (inVertex) {
+                vertexCount = words[2].toULongLong();
+                vertexSeen = true;
+            }
+            else if (!vertexSeen && words[2].toULongLong() > 0) {
+                if (error) *error = "PLY elements before the vertices are not supported";
+                return false;
+            }
+        }
+        else if (words[0] == "property" && inVertex && words.size() > 2) {
+            if (words[1] == "list") {
+                if (error) *error = "PLY vertex list properties are not supported";
+                return false;
+            }
+            static const QList<QByteArray> types = { "char", "uchar", "short", "ushort", "int", "uint", "float", "double",
+                "int8", "uint8", "int16", "uint16", "int32", "uint32", "float32", "float64" };
+            static const int sizes[] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+            static const char kinds[] = { 'i', 'u', 'i', 'u', 'i', 'u', 'f', 'f' };
+            const int type = types.indexOf(words[1]) % 8;
+            if (type < 0) {
+                if (error) *error = "Unknown PLY property type " + QString::fromLatin1(words[1]);
+                return false;
+            }
+            static const QList<QByteArray> roles = { "x", "y", "z", "red", "green", "blue" };
+            QByteArray name = words[2];
+            if (name.startsWith("diffuse_")) name = name.mid(8);
+            properties.push_back({ sizes[type], kinds[type], roles.indexOf(name) });
+        }
+    }
+
+    int roleIndex[6] = { -1, -1, -1, -1, -1, -1 };
+    for (size_t i = 0; i < properties.size(); ++i) {
+        if (properties[i].role >= 0) roleIndex[properties[i].role] = static_cast<int>(i);
+    }
+    if (roleIndex[0] < 0 || roleIndex[1] < 0 || roleIndex[2] < 0) {
+        if (error) *error = "PLY vertices have no x, y and z";
+        return false;
+    }
+    *hasColour = roleIndex[3] >= 0 && roleIndex[4] >= 0 && roleIndex[5] >= 0;
+
+    std::vector<PointRecord> points;
+    points.reserve(kChunkPoints);
+    auto emitPoint = [&](const double values[6]) {
+        PointRecord point;
+        point.x = static_cast<float>(values[0]);
+        point.y = static_cast<float>(values[1]);
+        point.z = static_cast<float>(values[2]);
+        point.r = *hasColour ? static_cast<quint8>(std::clamp(values[3], 0.0, 255.0)) : 255;
+        point.g = *hasColour ? static_cast<quint8>(std::clamp(values[4], 0.0, 255.0)) : 255;
+        point.b = *hasColour ? static_cast<quint8>(std::clamp(values[5], 0.0, 255.0)) : 255;
+        point.pad = 0;
+        points.push_back(point);
+        if (points.size() == kChunkPoints) {
+            chunk(points.data(), points.size());
+            points.clear();
+        }
+    };
+
+    if (format == "ascii") {
+        for (quint64 i = 0; i < vertexCount; ++i) {
+            if (file.atEnd()) {
+                if (error) *error = "PLY file ends early";
+                return false;
+            }
+            const QList<QByteArray> words = file.readLine().simplified().split(' ');
+            if (words.size() < static_cast<int>(properties.size())) {
+                if (error) *error = QString("PLY vertex %1 is incomplete").arg(i);
+                return false;
+            }
+            double values[6] = { 0, 0, 0, 255, 255, 255 };
+            for (size_t p = 0; p < properties.size(); ++p) {
+                if (properties[p].role >= 0) values[properties[p].role] = words[static_cast<int>(p)].toDouble();
+            }
+            emitPoint(values);
+        }
+    }
+    else if (format == "binary_little_endian" || format == "binary_big_endian") {
+        const bool bigEndian = format == "binary_big_endian";
+        int stride = 0;
+        std::vector<int> offsets;
+        for (const PlyProperty& property : properties) {
+            offsets.push_back(stride);
+            stride += property.size;
+        }
+        quint64 remaining = vertexCount;
+        while (remaining > 0) {
+            const quint64 batch = std::min<quint64>(remaining, kChunkPoints);
+            const QByteArray block = file.read(static_cast<qint64>(batch * stride));
+            if (block.size() != static_cast<int>(batch * stride)) {
+                if (error) *error = "PLY file ends early";
+                return false;
+            }
+            const uchar* record = reinterpret_cast<const uchar*>(block.constData());
+            for (quint64 i = 0; i < batch; ++i, record += stride) {
+                double values[6] = { 0, 0, 0, 255, 255, 255 };
+                for (int role = 0; role < 6; ++role) {
+                    if (roleIndex[role] >= 0) values[role] = plyValue(record + offsets[roleIndex[role]], properties[roleIndex[role]], bigEndian);
+                }
+                emitPoint(values);
+            }
+            remaining -= batch;
+        }
+    }
+    else {
+        if (error) *error = "Unknown PLY format " + QString::fromLatin1(format);
+        return false;
+    }
+
+    if (!points.empty()) {
+        chunk(points.data(), points.size());
+    }
+    return true;
+}
+
+/**
+ * Reads every point of a PLY or XYZ file, passing them on in chunks.
+ */
+bool readPointFile(const QString& fileName, const ChunkCallback& chunk, bool* hasColour, QString* error) {
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        if (error) *error = file.errorString();
+        return false;
+    }
+    return fileName.endsWith(".ply", Qt::CaseInsensitive)
+        ? readPly(file, chunk, hasColour, error)
+        : readXyz(file, chunk, hasColour, error);
+}
+
+/** Reads back a sorted run of keyed points in blocks. */
+struct RunReader {
+    std::unique_ptr<QTemporaryFile> file;
+    std::vector<KeyedPoint> buffer;
+    size_t position = 0;
+
+    /** Returns the next point, refilling the buffer when it runs out; nullptr at the end. */
+    const KeyedPoint* peek() {
+        if (position == buffer.size()) {
+            buffer.resize(kChunkPoints);
+            const qint64 read = file->read(reinterpret_cast<char*>(buffer.data()), static_cast<qint64>(buffer.size() * sizeof(KeyedPoint)));
+            buffer.resize(read > 0 ? static_cast<size_t>(read) / sizeof(KeyedPoint) : 0);
+            position = 0;
+        }
+        return position < buffer.size() ? &buffer[position] : nullptr;
+    }
+};
+
+/** Splits the sorted points into octree nodes and writes the inner nodes' subsamples. */
+struct HierarchyBuilder {
+    const quint64* codes; ///< Morton code of every point, sorted.
+    const PointRecord* records; ///< The sorted points.
+    QFile* out; ///< Octree file, positioned at its end.
+    quint64 pointsOffset; ///< File offset of the first sorted point.
+    std::vector<PointCloudNode> nodes;
+    bool ok = true;
+
+    /**
+     * Creates the node for the points [first, last), which share a Morton prefix of the given level.
+     */
+    int build(quint64 first, quint64 last, int level, quint64 baseCode, const double cellMin[3], double cellEdge) {
+        const int index = static_cast<int>(nodes.size());
+        nodes.emplace_back();
+        PointCloudNode node;
+        for (int i = 0; i < 3; ++i) {
+            node.bounds[2 * i] = static_cast<float>(cellMin[i]);
+            node.bounds[2 * i + 1] = static_cast<float>(cellMin[i] + cellEdge);
+        }
+        std::fill(node.children, node.children + 8, -1);
+        node.subtreeCount = last - first;
+
+        if (last - first <= PointCloud::kNodeCapacity || level == kMortonBits) {
+            node.offset = pointsOffset + first * sizeof(PointRecord);
+            node.count = static_cast<quint32>(std::min<quint64>(last - first, UINT32_MAX));
+        }
+        else {
+            // Points are in Morton order, so an even stride through them is spread evenly in space
+            std::vector<PointRecord> sample(PointCloud::kNodeCapacity);
+            const double stride = static_cast<double>(last - first) / sample.size();
+            for (size_t i = 0; i < sample.size(); ++i) {
+                sample[i] = records[first + static_cast<quint64>(i * stride)];
+            }
+            node.offset = static_cast<quint64>(out->pos());
+            node.count = PointCloud::kNodeCapacity;
+            const qint64 bytes = static_cast<qint64>(sample.size() * sizeof(PointRecord));
+            ok = ok && out->write(reinterpret_cast<const char*>(sample.data()), bytes) == bytes;
+
+            const int shift = 3 * (kMortonBits - level - 1);
+            const double childEdge = cellEdge / 2.0;
+            quint64 childFirst = first;
+            for (int octant = 0; octant < 8 && ok; ++octant) {
+                const quint64 childBase = baseCode + (static_cast<quint64>(octant) << shift);
+                const quint64 childEnd = childBase + (quint64(1) << shift);
+                const quint64 childLast = static_cast<quint64>(std::lower_bound(codes + childFirst, codes + last, childEnd) - codes);
+                if (childLast > childFirst) {
+                    const double childMin[3] = {
+                        cellMin[0] + ((octant & 1) ? childEdge : 0.0),
+                        cellMin[1] + ((octant & 2) ? childEdge : 0.0),
+                        cellMin[2] + ((octant & 4) ? childEdge : 0.0) };
+                    node.children[octant] = build(childFirst, childLast, level + 1, childBase, childMin, childEdge);
+                }
+                childFirst = childLast;
+            }
+        }
+
+        // Scanned surfaces are two-dimensional, so points are spaced by the cell edge over sqrt(count)
+        node.spacing = static_cast<float>(cellEdge / std::sqrt(std::max<double>(1.0, node.count)));
+        nodes[index] = node;
+        return index;
+    }
+};
+
+/** Per-pixel splat shape: a shaded disc instead of VTK's default Gaussian blob. */
+const char* kSplatShader =
+    "//VTK::Color::Impl\n"
+    "float dist = dot(offsetVCVSOutput.xy, offsetVCVSOutput.xy);\n"
+    "if (dist > 1.0) {\n"
+    "  discard;\n"
+    "} else {\n"
+    "  float scale = 1.0 - 0.5 * dist;\n"
+    "  ambientColor *= scale;\n"
+    "  diffuseColor *= scale;\n"
+    "}\n";
+
+} // namespace
+
+/**
+ * Constructs an empty cloud; see open().
+ */
+PointCloud::PointCloud()
+    : data(nullptr), points(0), colour(false), color(Qt::white), resident(0) {
+    ++liveClouds;
+}
+
+/**
+ * Destructor for the PointCloud class. Unmaps the octree file.
+ */
+PointCloud::~PointCloud() {
+    for (int i = 0; i < nodeCount(); ++i) {
+        evictNode(i);
+    }
+    file.close();
+    --liveClouds;
+}
+
+/**
+ * Checks whether a file name has a point cloud extension.
+ *
+ * @param fileName The file name.
+ * @return True for PLY and XYZ files.
+ */
+bool PointCloud::isPointCloudFile(const QString& fileName) {
+    return fileName.endsWith(".ply", Qt::CaseInsensitive) || fileName.endsWith(".xyz", Qt::CaseInsensitive);
+}
+
+/**
+ * Chooses where the octree of a point cloud file is kept: next to it if the folder is writable,
+ * otherwise in the temporary folder.
+ *
+ * @param fileName The point cloud file.
+ * @return The octree file name.
+ */
+QString PointCloud::octreeFileName(const QString& fileName) {
+    const QFileInfo info(fileName);
+    if (QFileInfo(info.absolutePath()).isWritable()) {
+        return info.absoluteFilePath() + ".octree";
+    }
+    const QByteArray hash = QCryptographicHash::hash(info.absoluteFilePath().toUtf8(), QCryptographicHash::Sha1).toHex();
+    return QDir::temp().filePath(QString::fromLatin1(hash) + ".octree");
+}
+
+/**
+ * Returns the number of point clouds currently open, so per-frame work can be skipped when there
+ * are none.
+ *
+ * @return The number of PointCloud objects alive.
+ */
+int PointCloud::openCount() {
+    return liveClouds;
+}
+
+/**
+ * Converts a point cloud file into an octree file.
+ *
+ * The file is read twice: once for the bounds, then again to tag each point with its Morton code.
+ * Runs of kRunPoints points are sorted in memory and spilled to temporary files, which are then
+ * merged into the octree file. The nodes are found by binary search over the sorted codes.
+ *
+ * @param fileName The PLY or XYZ file.
+ * @param octreeFileName The octree file to write.
+ * @param error Receives a description of the failure; may be nullptr.
+ * @return True if the octree file was written.
+ */
+bool PointCloud::build(const QString& fileName, const QString& octreeFileName, QString* error) {
+    double bounds[6] = { HUGE_VAL, -HUGE_VAL, HUGE_VAL, -HUGE_VAL, HUGE_VAL, -HUGE_VAL };
+    quint64 count = 0;
+    bool hasColour = false;
+    auto measure = [&](const PointRecord* chunk, size_t size) {
+        for (size_t i = 0; i < size; ++i) {
+            const float p[3] = { chunk[i].x, chunk[i].y, chunk[i].z };
+            for (int a = 0; a < 3; ++a) {
+                bounds[2 * a] = std::min<double>(bounds[2 * a], p[a]);
+                bounds[2 * a + 1] = std::max<double>(bounds[2 * a + 1], p[a]);
+            }
+        }
+        count += size;
+    };
+    if (!readPointFile(fileName, measure, &hasColour, error))
+        return false;
+    if (count == 0) {
+        if (error) *error = "The file contains no points";
+        return false;
+    }
+
+    // The octree root is a cube around the points
+    double edge = 0.0;
+    for (int a = 0; a < 3; ++a) {
+        edge = std::max(edge, bounds[2 * a + 1] - bounds[2 * a]);
+    }
+    edge = edge > 0.0 ? edge * (1.0 + 1e-6) : 1.0;
+    const double origin[3] = { bounds[0], bounds[2], bounds[4] };
+    const double cells = static_cast<double>(1 << kMortonBits);
+
+    std::vector<RunReader> runs;
+    std::vector<KeyedPoint> run;
+    run.reserve(std::min<quint64>(count, kRunPoints));
+    bool spillFailed = false;
+    auto spill = [&] {
+        std::sort(run.begin(), run.end(), [](const KeyedPoint& a, const KeyedPoint& b) { return a.code < b.code; });
+        RunReader reader;
+        reader.file = std::make_unique<QTemporaryFile>();
+        const qint64 bytes = static_cast<qint64>(run.size() * sizeof(KeyedPoint));
+        if (!reader.file->open() || reader.file->write(reinterpret_cast<const char*>(run.data()), bytes) != bytes || !reader.file->seek(0)) {
+            spillFailed = true;
+        }
+        runs.push_back(std::move(reader));
+        run.clear();
+    };
+    auto tag = [&](const PointRecord* chunk, size_t size) {
+        for (size_t i = 0; i < size; ++i) {
+            quint64 cell[3];
+            const float p[3] = { chunk[i].x, chunk[i].y, chunk[i].z };
+            for (int a = 0; a < 3; ++a) {
+                cell[a] = static_cast<quint64>(std::clamp((p[a] - origin[a]) / edge * cells, 0.0, cells - 1.0));
+            }
+            run.push_back({ spreadBits(cell[0]) | spreadBits(cell[1]) << 1 | spreadBits(cell[2]) << 2, chunk[i] });
+            if (run.size() == kRunPoints) {
+                spill();
+            }
+        }
+    };
+    if (!readPointFile(fileName, tag, &hasColour, error))
+        return false;
+    if (!run.empty()) {
+        spill();
+    }
+    std::vector<KeyedPoint>().swap(run);
+    if (spillFailed) {
+        if (error) *error = "Could not write temporary files";
+        return false;
+    }
+
+    // Merge the runs into the octree file, keeping the codes for finding the nodes
+    const QString partialName = octreeFileName + ".partial";
+    QFile out(partialName);
+    QTemporaryFile codeFile;
+    if (!out.open(QIODevice::ReadWrite | QIODevice::Truncate) || !codeFile.open()) {
+        if (error) *error = out.errorString();
+        return false;
+    }
+    PointCloudHeader header = {};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    const quint64 pointsOffset = sizeof(header);
+
+    using Head = std::pair<quint64, size_t>; // Code and run of the smallest unmerged point of each run
+    std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+    for (size_t i = 0; i < runs.size(); ++i) {
+        if (const KeyedPoint* p = runs[i].peek()) heads.push({ p->code, i });
+    }
+    std::vector<PointRecord> records;
+    std::vector<quint64> codes;
+    records.reserve(kChunkPoints);
+    codes.reserve(kChunkPoints);
+    bool ok = true;
+    auto flush = [&] {
+        ok = ok && out.write(reinterpret_cast<const char*>(records.data()), static_cast<qint64>(records.size() * sizeof(PointRecord))) == static_cast<qint64>(records.size() * sizeof(PointRecord));
+        ok = ok && codeFile.write(reinterpret_cast<const char*>(codes.data()), static_cast<qint64>(codes.size() * sizeof(quint64))) == static_cast<qint64>(codes.size() * sizeof(quint64));
+        records.clear();
+        codes.clear();
+    };
+    while (!heads.empty()) {
+        const size_t i = heads.top().second;
+        heads.pop();
+        const KeyedPoint* p = runs[i].peek();
+        records.push_back(p->record);
+        codes.push_back(p->code);
+        ++runs[i].position;
+        if (const KeyedPoint* next = runs[i].peek()) heads.push({ next->code, i });
+        if (records.size() == kChunkPoints) flush();
+    }
+    flush();
+    runs.clear();
+    ok = ok && codeFile.flush() && out.flush();
+
+    QFile pointsView(partialName);
+    const uchar* codeMap = ok ? codeFile.map(0, static_cast<qint64>(count * sizeof(quint64))) : nullptr;
+    const uchar* pointMap = ok && pointsView.open(QIODevice::ReadOnly) ? pointsView.map(static_cast<qint64>(pointsOffset), static_cast<qint64>(count * sizeof(PointRecord))) : nullptr;
+    if (!codeMap || !pointMap) {
+        if (error) *error = "Could not write " + partialName;
+        out.remove();
+        return false;
+    }
+
+    HierarchyBuilder builder;
+    builder.codes = reinterpret_cast<const quint64*>(codeMap);
+    builder.records = reinterpret_cast<const PointRecord*>(pointMap);
+    builder.out = &out;
+    builder.pointsOffset = pointsOffset;
+    builder.build(0, count, 0, 0, origin, edge);
+    pointsView.close();
+    codeFile.close();
+
+    const QFileInfo source(fileName);
+    header.version = kVersion;
+    header.hasColour = hasColour;
+    header.pointCount = count;
+    header.nodeCount = builder.nodes.size();
+    header.nodesOffset = static_cast<quint64>(out.pos());
+    header.sourceSize = source.size();
+    header.sourceModified = source.lastModified().toMSecsSinceEpoch();
+    const qint64 nodeBytes = static_cast<qint64>(builder.nodes.size() * sizeof(PointCloudNode));
+    ok = builder.ok && out.write(reinterpret_cast<const char*>(builder.nodes.data()), nodeBytes) == nodeBytes
+        && out.seek(0) && out.write(reinterpret_cast<const char*>(&header), sizeof(header)) == sizeof(header);
+    out.close();
+    if (!ok) {
+        if (error) *error = "Could not write " + partialName;
+        QFile::remove(partialName);
+        return false;
+    }
+
+    QFile::remove(octreeFileName);
+    if (!QFile::rename(partialName, octreeFileName)) {
+        if (error) *error = "Could not create " + octreeFileName;
+        QFile::remove(partialName);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Opens a point cloud, converting it to an octree file first if there is none or the file changed
+ * since it was converted. The conversion can take minutes for large scans; call this on a worker thread.
+ *
+ * @param fileName The PLY or XYZ file.
+ * @param error Receives a description of the failure; may be nullptr.
+ * @return The cloud, or nullptr on failure.
+ */
+std::shared_ptr<PointCloud> PointCloud::open(const QString& fileName, QString* error) {
+    const QString octreeName = octreeFileName(fileName);
+    const QFileInfo source(fileName);
+    if (!source.exists()) {
+        if (error) *error = "File not found";
+        return nullptr;
+    }
+
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        std::shared_ptr<PointCloud> cloud(new PointCloud());
+        cloud->file.setFileName(octreeName);
+        PointCloudHeader header;
+        bool current = cloud->file.open(QIODevice::ReadOnly)
+            && cloud->file.read(reinterpret_cast<char*>(&header), sizeof(header)) == sizeof(header)
+            && std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0
+            && header.version == kVersion
+            && header.sourceSize == source.size()
+            && header.sourceModified == source.lastModified().toMSecsSinceEpoch();
+
+        const quint64 fileSize = static_cast<quint64>(cloud->file.size());
+        current = current && header.nodeCount > 0
+            && header.nodesOffset + header.nodeCount * sizeof(PointCloudNode) <= fileSize;
+        if (current) {
+            cloud->data = cloud->file.map(0, static_cast<qint64>(fileSize));
+            current = cloud->data != nullptr;
+        }
+        if (current) {
+            const PointCloudNode* nodes = reinterpret_cast<const PointCloudNode*>(cloud->data + header.nodesOffset);
+            cloud->nodes.assign(nodes, nodes + header.nodeCount);
+            for (const PointCloudNode& node : cloud->nodes) {
+                current = current && node.offset + quint64(node.count) * sizeof(PointRecord) <= fileSize;
+                for (int child : node.children) {
+                    current = current && child < static_cast<int>(header.nodeCount);
+                }
+            }
+        }
+        if (current) {
+            cloud->points = header.pointCount;
+            cloud->colour = header.hasColour != 0;
+            cloud->actors.resize(cloud->nodes.size());
+            cloud->lastUsedFrame.resize(cloud->nodes.size(), 0);
+            cloud->loading.resize(cloud->nodes.size(), false);
+            return cloud;
+        }
+
+        cloud->file.close();
+        if (attempt == 0 && !build(fileName, octreeName, error))
+            return nullptr;
+    }
+    if (error) *error = "Could not read " + octreeName;
+    return nullptr;
+}
+
+/**
+ * Gets the number of points in the cloud.
+ *
+ * @return The number of points.
+ */
+quint64 PointCloud::pointCount() const {
+    return points;
+}
+
+/**
+ * Gets the number of octree nodes.
+ *
+ * @return The number of nodes.
+ */
+int PointCloud::nodeCount() const {
+    return static_cast<int>(nodes.size());
+}
+
+/**
+ * Gets an octree node.
+ *
+ * @param index The node index; 0 is the root.
+ * @return The node.
+ */
+const PointCloudNode& PointCloud::node(int index) const {
+    return nodes[index];
+}
+
+/**
+ * Checks whether the source file had colours.
+ *
+ * @return True if the points are coloured.
+ */
+bool PointCloud::hasColour() const {
+    return colour;
+}
+
+/**
+ * Gets the records of the points drawn for a node, straight from the mapping. Safe to call on any
+ * thread.
+ *
+ * @param index The node index.
+ * @return node(index).count records.
+ */
+const PointRecord* PointCloud::nodePoints(int index) const {
+    return reinterpret_cast<const PointRecord*>(data + nodes[index].offset);
+}
+
+/**
+ * Reads the points drawn for a node. Safe to call on any thread.
+ *
+ * @param index The node index.
+ * @return Points and, if the cloud is coloured or a colouring is set, their colours as point scalars.
+ */
+vtkSmartPointer<vtkPolyData> PointCloud::readNode(int index) const {
+    const PointCloudNode& node = nodes[index];
+    const PointRecord* records = nodePoints(index);
+
+    vtkNew<vtkFloatArray> coordinates;
+    coordinates->SetNumberOfComponents(3);
+    coordinates->SetNumberOfTuples(node.count);
+    float* xyz = coordinates->GetPointer(0);
+    for (quint32 i = 0; i < node.count; ++i) {
+        xyz[3 * i] = records[i].x;
+        xyz[3 * i + 1] = records[i].y;
+        xyz[3 * i + 2] = records[i].z;
+    }
+    vtkNew<vtkPoints> pointSet;
+    pointSet->SetData(coordinates);
+
+    vtkSmartPointer<vtkPolyData> polyData = vtkSmartPointer<vtkPolyData>::New();
+    polyData->SetPoints(pointSet);
+    const std::shared_ptr<const Colouring> override = std::atomic_load(&colouring);
+    if (colour || override) {
+        vtkNew<vtkUnsignedCharArray> colours;
+        colours->SetName("Colors");
+        colours->SetNumberOfComponents(3);
+        colours->SetNumberOfTuples(node.count);
+        unsigned char* rgb = colours->GetPointer(0);
+        if (override) {
+            (*override)(xyz, node.count, rgb);
+        }
+        else {
+            for (quint32 i = 0; i < node.count; ++i) {
+                rgb[3 * i] = records[i].r;
+                rgb[3 * i + 1] = records[i].g;
+                rgb[3 * i + 2] = records[i].b;
+            }
+        }
+        polyData->GetPointData()->SetScalars(colours);
+    }
+    return polyData;
+}
+
+/**
+ * Connects the cloud to the scene node and transform of the part that shows it.
+ *
+ * @param assembly The part's scene node; node actors are added to it.
+ * @param transform The part's world transform.
+ */
+void PointCloud::attach(vtkSmartPointer<vtkPropAssembly> assembly, vtkSmartPointer<vtkTransform> transform) {
+    this->assembly = assembly;
+    this->transform = transform;
+}
+
+/**
+ * Sets the colour of an uncoloured cloud.
+ *
+ * @param color The colour.
+ */
+void PointCloud::setColor(const QColor& color) {
+    this->color = color;
+    for (vtkActor* actor : actors) {
+        if (actor) actor->GetProperty()->SetColor(color.redF(), color.greenF(), color.blueF());
+    }
+}
+
+/**
+ * Replaces the colours of the file, e.g. with a deviation colour map, or restores them. The
+ * colouring is called by readNode() on worker threads. Loaded nodes are evicted so they are read
+ * again with the new colours; a read already in progress may still arrive with the old ones.
+ *
+ * @param colouring The colouring, or nullptr for the file's colours.
+ */
+void PointCloud::setColouring(std::shared_ptr<const Colouring> colouring) {
+    std::atomic_store(&this->colouring, std::move(colouring));
+    for (int i = 0; i < static_cast<int>(actors.size()); ++i) {
+        evictNode(i);
+    }
+}
+
+/**
+ * Creates the actor of a node from points read by readNode(). The actor starts hidden.
+ *
+ * @param index The node index.
+ * @param polyData The node's points.
+ */
+void PointCloud::setNodeData(int index, vtkSmartPointer<vtkPolyData> polyData) {
+    evictNode(index);
+
+    vtkNew<vtkPointGaussianMapper> mapper;
+    mapper->SetInputData(polyData);
+    mapper->SetScaleFactor(nodes[index].spacing);
+    mapper->SetSplatShaderCode(kSplatShader);
+    mapper->EmissiveOff();
+    const bool scalars = polyData->GetPointData()->GetScalars() != nullptr;
+    mapper->SetScalarVisibility(scalars);
+    if (scalars) {
+        mapper->SetColorModeToDirectScalars();
+    }
+
+    vtkNew<vtkActor> actor;
+    actor->SetMapper(mapper);
+    actor->SetUserTransform(transform);
+    actor->GetProperty()->SetColor(color.redF(), color.greenF(), color.blueF());
+    actor->SetVisibility(false);
+    if (assembly) {
+        assembly->AddPart(actor);
+    }
+    actors[index] = actor;
+    resident += nodes[index].count;
+}
+
+/**
+ * Releases a node's actor and points.
+ *
+ * @param index The node index.
+ */
+void PointCloud::evictNode(int index) {
+    if (!actors[index])
+        return;
+    if (assembly) {
+        assembly->RemovePart(actors[index]);
+    }
+    actors[index] = nullptr;
+    resident -= nodes[index].count;
+}
+
+/**
+ * Checks whether a node's points are loaded.
+ *
+ * @param index The node index.
+ * @return True if the node has an actor.
+ */
+bool PointCloud::isResident(int index) const {
+    return actors[index] != nullptr;
+}
+
+/**
+ * Checks whether a node is being read.
+ *
+ * @param index The node index.
+ * @return True while a read is in progress.
+ */
+bool PointCloud::isLoading(int index) const {
+    return loading[index];
+}
+
+/**
+ * Records that a node is being read, or that the read finished.
+ *
+ * @param index The node index.
+ * @param loading True when a read starts.
+ */
+void PointCloud::setLoading(int index, bool loading) {
+    this->loading[index] = loading;
+}
+
+/**
+ * Shows or hides a loaded node.
+ *
+ * @param index The node index.
+ * @param visible True to draw the node.
+ */
+void PointCloud::setNodeVisible(int index, bool visible) {
+    vtkActor* actor = actors[index];
+    if (actor && actor->GetVisibility() != static_cast<vtkTypeBool>(visible)) {
+        actor->SetVisibility(visible);
+    }
+}
+
+/**
+ * Records that a node was used in a frame, for least-recently-used eviction.
+ *
+ * @param index The node index.
+ * @param frame The frame number.
+ */
+void PointCloud::touchNode(int index, quint64 frame) {
+    lastUsedFrame[index] = frame;
+}
+
+/**
+ * Gets the frame in which a node was last used.
+ *
+ * @param index The node index.
+ * @return The frame number; 0 if never used.
+ */
+quint64 PointCloud::lastUsed(int index) const {
+    return lastUsedFrame[index];
+}
+
+/**
+ * Gets the number of points held by loaded nodes.
+ *
+ * @return The number of resident points.
+ */
+quint64 PointCloud::residentPoints() const {
+    return resident;
+}
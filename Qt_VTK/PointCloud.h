@@ -0,0 +1,109 @@
+/**
+ * @file PointCloud.h
+ *
+ * Defines the PointCloud class, which holds a scanned point cloud (PLY or XYZ) of up to hundreds
+ * of millions of points as an octree on disk. The first time a file is opened it is converted to an
+ * octree file next to it with an external sort, so the conversion needs far less memory than the
+ * cloud. The octree file is memory-mapped: node points are read on demand and only the nodes
+ * chosen for display are kept as VTK actors.
+ *
+ * Points are sorted along a Morton curve, so every octree node is a contiguous run of the file.
+ * Nodes with more than kNodeCapacity points are split; each inner node additionally stores an evenly
+ * spread subsample of its points, drawn instead of its children when the view allows less detail.
+ */
+
+#ifndef VIEWER_POINTCLOUD_H
+#define VIEWER_POINTCLOUD_H
+
+#include <QColor>
+#include <QFile>
+#include <QString>
+#include <QtGlobal>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <vtkSmartPointer.h>
+#include <vtkActor.h>
+#include <vtkPolyData.h>
+#include <vtkPropAssembly.h>
+#include <vtkTransform.h>
+
+/** One point as stored in the octree file. */
+struct PointRecord {
+    float x, y, z; ///< Position.
+    quint8 r, g, b; ///< Colour; white if the source has none.
+    quint8 pad; ///< Keeps records 16 bytes long.
+};
+
+/** An octree node as stored in the octree file. */
+struct PointCloudNode {
+    float bounds[6]; ///< Cube covered by the node: xmin, xmax, ymin, ymax, zmin, zmax.
+    float spacing; ///< Typical distance between the node's drawn points; used as the splat size.
+    quint32 count; ///< Points drawn for this node: all of a leaf's points, or an inner node's subsample.
+    quint64 offset; ///< File offset of the drawn points.
+    quint64 subtreeCount; ///< Points in the node and all its descendants.
+    qint32 children[8]; ///< Child node indices by octant, or -1.
+};
+
+/**
+ * @class PointCloud
+ * @brief Octree of a point cloud on disk, with the display state of the nodes currently loaded.
+ *
+ * open() and readNode() may be called on any thread. The display functions must be called on the
+ * GUI thread.
+ */
+class PointCloud {
+public:
+    static const quint32 kNodeCapacity = 32768; ///< Points above which a node is split.
+
+    /** Computes colours for points read from the file: three bytes per point from its x, y, z. */
+    using Colouring = std::function<void(const float* xyz, quint32 count, unsigned char* rgb)>;
+
+    ~PointCloud();
+
+    static bool isPointCloudFile(const QString& fileName);
+    static std::shared_ptr<PointCloud> open(const QString& fileName, QString* error = nullptr);
+    static bool build(const QString& fileName, const QString& octreeFileName, QString* error = nullptr);
+    static QString octreeFileName(const QString& fileName);
+    static int openCount();
+
+    quint64 pointCount() const;
+    int nodeCount() const;
+    const PointCloudNode& node(int index) const;
+    bool hasColour() const;
+    const PointRecord* nodePoints(int index) const;
+    vtkSmartPointer<vtkPolyData> readNode(int index) const;
+
+    void attach(vtkSmartPointer<vtkPropAssembly> assembly, vtkSmartPointer<vtkTransform> transform);
+    void setColor(const QColor& color);
+    void setColouring(std::shared_ptr<const Colouring> colouring);
+    void setNodeData(int index, vtkSmartPointer<vtkPolyData> polyData);
+    void evictNode(int index);
+    bool isResident(int index) const;
+    bool isLoading(int index) const;
+    void setLoading(int index, bool loading);
+    void setNodeVisible(int index, bool visible);
+    void touchNode(int index, quint64 frame);
+    quint64 lastUsed(int index) const;
+    quint64 residentPoints() const;
+
+private:
+    PointCloud();
+
+    QFile file; ///< The octree file, mapped for the lifetime of the object.
+    const uchar* data; ///< Start of the mapping.
+    quint64 points; ///< Points in the cloud.
+    bool colour; ///< Whether the source file had colours.
+    std::vector<PointCloudNode> nodes; ///< Octree nodes; the root is node 0.
+
+    vtkSmartPointer<vtkPropAssembly> assembly; ///< Scene node the node actors are added to.
+    vtkSmartPointer<vtkTransform> transform; ///< World transform of the owning part.
+    QColor color; ///< Colour used when the source has none.
+    std::shared_ptr<const Colouring> colouring; ///< Replaces the file's colours if set; read with std::atomic_load.
+    std::vector<vtkSmartPointer<vtkActor>> actors; ///< Actor of each loaded node, or nullptr.
+    std::vector<quint64> lastUsedFrame; ///< Frame in which each node was last selected for display.
+    std::vector<bool> loading; ///< Whether each node is being read on a worker thread.
+    quint64 resident; ///< Points held by loaded nodes.
+};
+
+#endif // VIEWER_POINTCLOUD_H
@@ -0,0 +1,287 @@
+/**
+ * @file PointCloudLod.cpp
+ * @brief Implementation of the PointCloudLod class.
+ */
+
+#include "PointCloudLod.h"
+#include "TaskScheduler.h"
+#include <QFutureWatcher>
+#include <vtkCamera.h>
+#include <vtkMath.h>
+#include <vtkMatrix4x4.h>
+#include <algorithm>
+#include <cmath>
+#include <queue>
+
+namespace {
+
+const int kMaxLoadsInFlight = 4; ///< Node reads queued at once; more would delay the most important ones.
+const long long kResidentFactor = 3; ///< Points kept in memory, as a multiple of the point budget.
+
+/** A node waiting to be considered for refinement, ordered by its size on screen. */
+struct Candidate {
+    double pixels; ///< Projected radius of the node's bounds, in pixels.
+    size_t cloud; ///< Index of the cloud.
+    int node; ///< Index of the node in the cloud.
+
+    bool operator<(const Candidate& other) const { return pixels < other.pixels; }
+};
+
+/** Camera quantities needed to test and rank nodes. */
+struct View {
+    double planes[24]; ///< Frustum planes with inward normals.
+    double position[3]; ///< Camera position.
+    double pixelsPerRadian; ///< Viewport height over the vertical view angle, for projecting sizes.
+};
+
+/**
+ * Transforms a node's bounds to world space and measures it against the view.
+ *
+ * @return The projected radius in pixels, or a negative value if the node is outside the frustum.
+ */
+double projectNode(const PointCloudNode& node, vtkMatrix4x4* world, const View& view, double* spacingPixels) {
+    double bounds[6] = { VTK_DOUBLE_MAX, -VTK_DOUBLE_MAX, VTK_DOUBLE_MAX, -VTK_DOUBLE_MAX, VTK_DOUBLE_MAX, -VTK_DOUBLE_MAX };
+    for (int corner = 0; corner < 8; ++corner) {
+        double p[4] = { node.bounds[corner & 1], node.bounds[2 + ((corner >> 1) & 1)], node.bounds[4 + ((corner >> 2) & 1)], 1.0 };
+        world->MultiplyPoint(p, p);
+        for (int a = 0; a < 3; ++a) {
+            bounds[2 * a] = std::min(bounds[2 * a], p[a]);
+            bounds[2 * a + 1] = std::max(bounds[2 * a + 1], p[a]);
+        }
+    }
+
+    for (int plane = 0; plane < 6; ++plane) {
+        const double* n = view.planes + 4 * plane;
+        // The corner furthest along the inward normal; if even that is outside, the box is
+        const double x = n[0] >= 0 ? bounds[1] : bounds[0];
+        const double y = n[1] >= 0 ? bounds[3] : bounds[2];
+        const double z = n[2] >= 0 ? bounds[5] : bounds[4];
+        if (n[0] * x + n[1] * y + n[2] * z + n[3] < 0)
+            return -1.0;
+    }
+
+    double centre[3], radius = 0.0;
+    for (int a = 0; a < 3; ++a) {
+        centre[a] = (bounds[2 * a] + bounds[2 * a + 1]) / 2.0;
+        radius += (bounds[2 * a + 1] - bounds[2 * a]) * (bounds[2 * a + 1] - bounds[2 * a]) / 4.0;
+    }
+    radius = std::sqrt(radius);
+    const double distance = std::sqrt(vtkMath::Distance2BetweenPoints(centre, view.position));
+    const double scale = view.pixelsPerRadian / std::max(distance - radius, radius * 1e-3 + 1e-9);
+    const double localRadius = (node.bounds[1] - node.bounds[0]) * 0.8660254; // Half the cube diagonal
+    *spacingPixels = node.spacing * (radius / std::max(localRadius, 1e-12)) * scale;
+    return radius * scale;
+}
+
+} // namespace
+
+/**
+ * Constructor for the PointCloudLod class.
+ *
+ * @param parent The parent QObject.
+ */
+PointCloudLod::PointCloudLod(QObject* parent)
+    : QObject(parent), budget(5000000), frame(0), loadsInFlight(0) {
+}
+
+/**
+ * Sets how many points may be drawn per frame across all clouds.
+ *
+ * @param points The point budget.
+ */
+void PointCloudLod::setPointBudget(long long points) {
+    budget = std::max(1LL, points);
+}
+
+/**
+ * Gets the point budget.
+ *
+ * @return Points drawn per frame at most.
+ */
+long long PointCloudLod::pointBudget() const {
+    return budget;
+}
+
+/**
+ * Chooses the nodes to draw this frame and shows only their actors.
+ *
+ * Every visible cloud starts from its root. The selected node that is largest on screen is
+ * replaced by its children in the frustum while they fit in the budget, are all loaded, and its
+ * points are more than a pixel apart; missing children are requested instead.
+ *
+ * @param root The root of the part tree.
+ * @param renderer The renderer about to draw, for the camera and viewport.
+ * @return The number of nodes and points selected.
+ */
+PointCloudLod::Selection PointCloudLod::update(ModelPart* root, vtkRenderer* renderer) {
+    ++frame;
+    std::vector<ModelPart*> parts;
+    collectClouds(root, parts);
+
+    View view;
+    vtkCamera* camera = renderer->GetActiveCamera();
+    camera->GetFrustumPlanes(renderer->GetTiledAspectRatio(), view.planes);
+    camera->GetPosition(view.position);
+    const int* size = renderer->GetSize();
+    view.pixelsPerRadian = std::max(1, size[1]) / (2.0 * std::tan(vtkMath::RadiansFromDegrees(camera->GetViewAngle()) / 2.0));
+
+    std::vector<std::shared_ptr<PointCloud>> clouds;
+    std::vector<vtkMatrix4x4*> worlds;
+    std::vector<std::vector<char>> selected;
+    for (ModelPart* part : parts) {
+        clouds.push_back(part->getPointCloud());
+        worlds.push_back(part->getTransform()->GetMatrix());
+        selected.emplace_back(clouds.back()->nodeCount(), 0);
+    }
+
+    Selection selection;
+    std::priority_queue<Candidate> candidates;
+    auto consider = [&](size_t c, int index, double pixels) {
+        selected[c][index] = 1;
+        selection.points += clouds[c]->node(index).count;
+        ++selection.nodes;
+        candidates.push({ pixels, c, index });
+    };
+
+    for (size_t c = 0; c < clouds.size(); ++c) {
+        double spacingPixels;
+        const double pixels = projectNode(clouds[c]->node(0), worlds[c], view, &spacingPixels);
+        if (pixels < 0)
+            continue;
+        if (!clouds[c]->isResident(0)) {
+            requestLoad(clouds[c], 0);
+        }
+        else if (selection.points + clouds[c]->node(0).count <= budget) {
+            consider(c, 0, pixels);
+        }
+    }
+
+    while (!candidates.empty()) {
+        const Candidate candidate = candidates.top();
+        candidates.pop();
+        PointCloud& cloud = *clouds[candidate.cloud];
+        const PointCloudNode& node = cloud.node(candidate.node);
+
+        struct Child { int index; double pixels; };
+        std::vector<Child> children;
+        long long childPoints = 0;
+        bool allResident = true;
+        double spacingPixels = 0.0;
+        projectNode(node, worlds[candidate.cloud], view, &spacingPixels);
+        if (spacingPixels < 1.0)
+            continue; // The points already touch on screen; more detail would not show
+
+        for (int index : node.children) {
+            if (index < 0)
+                continue;
+            double childSpacing;
+            const double pixels = projectNode(cloud.node(index), worlds[candidate.cloud], view, &childSpacing);
+            if (pixels < 0)
+                continue;
+            children.push_back({ index, pixels });
+            childPoints += cloud.node(index).count;
+            allResident = allResident && cloud.isResident(index);
+        }
+        if (children.empty() || selection.points - node.count + childPoints > budget)
+            continue;
+        if (!allResident) {
+            for (const Child& child : children) {
+                if (!cloud.isResident(child.index)) requestLoad(clouds[candidate.cloud], child.index);
+            }
+            continue;
+        }
+
+        selected[candidate.cloud][candidate.node] = 0;
+        selection.points -= node.count;
+        --selection.nodes;
+        for (const Child& child : children) {
+            consider(candidate.cloud, child.index, child.pixels);
+        }
+    }
+
+    for (size_t c = 0; c < clouds.size(); ++c) {
+        for (int i = 0; i < clouds[c]->nodeCount(); ++i) {
+            if (!clouds[c]->isResident(i))
+                continue;
+            clouds[c]->setNodeVisible(i, selected[c][i] != 0);
+            if (selected[c][i]) clouds[c]->touchNode(i, frame);
+        }
+    }
+    evictUnused(clouds);
+    return selection;
+}
+
+/**
+ * Collects the visible parts that show a point cloud.
+ *
+ * @param part The root of the subtree to search.
+ * @param parts Receives the point cloud parts.
+ */
+void PointCloudLod::collectClouds(ModelPart* part, std::vector<ModelPart*>& parts) {
+    if (!part || !part->effectiveVisible())
+        return;
+
+    if (part->getPointCloud()) {
+        parts.push_back(part);
+    }
+    for (int i = 0; i < part->childCount(); ++i) {
+        collectClouds(part->child(i), parts);
+    }
+}
+
+/**
+ * Reads a node's points on the thread pool, unless it is already being read or too many reads are
+ * queued. The actor is created on this thread when the read finishes.
+ *
+ * @param cloud The cloud.
+ * @param node The node index.
+ */
+void PointCloudLod::requestLoad(const std::shared_ptr<PointCloud>& cloud, int node) {
+    if (cloud->isLoading(node) || loadsInFlight >= kMaxLoadsInFlight)
+        return;
+
+    cloud->setLoading(node, true);
+    ++loadsInFlight;
+    auto* watcher = new QFutureWatcher<vtkSmartPointer<vtkPolyData>>(this);
+    connect(watcher, &QFutureWatcher<vtkSmartPointer<vtkPolyData>>::finished, this, [this, watcher, cloud, node] {
+        --loadsInFlight;
+        cloud->setLoading(node, false);
+        cloud->setNodeData(node, watcher->result());
+        watcher->deleteLater();
+        emit nodesLoaded();
+        });
+    watcher->setFuture(TaskScheduler::instance()->run(TaskScheduler::VisibleLoading, [cloud, node] { return cloud->readNode(node); }));
+}
+
+/**
+ * Releases the least recently drawn nodes once the clouds hold more points than the memory budget.
+ * Roots are kept so every cloud can always be drawn and framed.
+ *
+ * @param clouds The clouds in the scene.
+ */
+void PointCloudLod::evictUnused(const std::vector<std::shared_ptr<PointCloud>>& clouds) {
+    quint64 resident = 0;
+    for (const auto& cloud : clouds) {
+        resident += cloud->residentPoints();
+    }
+    const quint64 limit = static_cast<quint64>(budget * kResidentFactor);
+    if (resident <= limit)
+        return;
+
+    struct Entry { quint64 lastUsed; size_t cloud; int node; };
+    std::vector<Entry> entries;
+    for (size_t c = 0; c < clouds.size(); ++c) {
+        for (int i = 1; i < clouds[c]->nodeCount(); ++i) {
+            if (clouds[c]->isResident(i) && clouds[c]->lastUsed(i) < frame) {
+                entries.push_back({ clouds[c]->lastUsed(i), c, i });
+            }
+        }
+    }
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.lastUsed < b.lastUsed; });
+    for (const Entry& entry : entries) {
+        if (resident <= limit)
+            break;
+        resident -= clouds[entry.cloud]->node(entry.node).count;
+        clouds[entry.cloud]->evictNode(entry.node);
+    }
+}
@@ -0,0 +1,55 @@
+/**
+ * @file PointCloudLod.h
+ *
+ * Defines the PointCloudLod class, which chooses every frame which octree nodes of the point clouds
+ * in the scene to draw. Nodes are refined in order of their size on screen until a shared point
+ * budget is spent, so the frame rate stays steady however many points the clouds hold. Nodes that
+ * are not in memory are read on the thread pool; the coarser parent is drawn until all of its
+ * children have arrived. Nodes not used for a while are released once a memory budget is exceeded.
+ */
+
+#ifndef VIEWER_POINTCLOUDLOD_H
+#define VIEWER_POINTCLOUDLOD_H
+
+#include <QObject>
+#include <memory>
+#include <vector>
+#include <vtkRenderer.h>
+#include "ModelPart.h"
+#include "PointCloud.h"
+
+/**
+ * @class PointCloudLod
+ * @brief Per-frame level-of-detail selection and streaming for point cloud parts.
+ */
+class PointCloudLod : public QObject {
+    Q_OBJECT
+
+public:
+    /** What the last update selected. */
+    struct Selection {
+        int nodes = 0; ///< Octree nodes drawn; one draw call each.
+        long long points = 0; ///< Points drawn.
+    };
+
+    explicit PointCloudLod(QObject* parent = nullptr);
+
+    void setPointBudget(long long points);
+    long long pointBudget() const;
+    Selection update(ModelPart* root, vtkRenderer* renderer);
+
+signals:
+    /** Emitted when node points have been read; the scene should be rendered again. */
+    void nodesLoaded();
+
+private:
+    void collectClouds(ModelPart* part, std::vector<ModelPart*>& parts);
+    void requestLoad(const std::shared_ptr<PointCloud>& cloud, int node);
+    void evictUnused(const std::vector<std::shared_ptr<PointCloud>>& clouds);
+
+    long long budget; ///< Points drawn per frame at most, across all clouds.
+    quint64 frame; ///< Number of the current frame, for least-recently-used eviction.
+    int loadsInFlight; ///< Node reads running on the thread pool.
+};
+
+#endif // VIEWER_POINTCLOUDLOD_H
@@ -0,0 +1,370 @@
+/**
+ * @file RemoteClient.cpp
+ * @brief Implementation of the RemoteClient widget.
+ */
+
+#include "RemoteClient.h"
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QKeyEvent>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QTcpSocket>
+#include <QWheelEvent>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include "MessageFraming.h"
+#include "RemoteProtocol.h"
+
+using namespace RemoteProtocol;
+
+namespace {
+
+/**
+ * Summarises a series of samples as mean, percentiles and maximum.
+ */
+QJsonObject summarize(std::vector<double> samples) {
+    QJsonObject summary;
+    if (samples.empty())
+        return summary;
+
+    std::sort(samples.begin(), samples.end());
+    auto percentile = [&samples](double p) {
+        return samples[std::min(samples.size() - 1, static_cast<size_t>(p / 100.0 * samples.size()))];
+    };
+    summary["mean"] = std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+    summary["p50"] = percentile(50);
+    summary["p95"] = percentile(95);
+    summary["p99"] = percentile(99);
+    summary["max"] = samples.back();
+    return summary;
+}
+
+} // namespace
+
+/**
+ * Constructs an unconnected client.
+ *
+ * @param parent The parent widget.
+ */
+RemoteClient::RemoteClient(QWidget* parent)
+    : QWidget(parent),
+    socket(nullptr),
+    nextInput(1),
+    png(false),
+    quality(80),
+    scriptFrames(0),
+    bytesReceived(0),
+    framesReceived(0),
+    tilesReceived(0),
+    firstFrameAt(0),
+    windowStart(0),
+    windowBytes(0),
+    windowFrames(0) {
+    setFocusPolicy(Qt::StrongFocus);
+    setAttribute(Qt::WA_OpaquePaintEvent); // Every pixel comes from the framebuffer
+    clock.start();
+}
+
+/**
+ * Chooses the tile encoding to ask the server for. Takes effect on connection.
+ *
+ * @param png True for lossless PNG tiles, false for JPEG.
+ * @param quality JPEG quality from 0 to 100.
+ */
+void RemoteClient::setTileFormat(bool png, int quality) {
+    this->png = png;
+    this->quality = std::clamp(quality, 0, 100);
+}
+
+/**
+ * Switches to scripted mode: after the first frame the client orbits the camera one step per frame
+ * received, then writes a report and quits. This exercises the whole loop without a user.
+ *
+ * @param frames The number of orbit steps.
+ * @param reportFile Where to write the report; standard output if empty.
+ */
+void RemoteClient::setScript(int frames, const QString& reportFile) {
+    scriptFrames = frames;
+    this->reportFile = reportFile.isNull() ? QString("") : reportFile; // Not null, so scripted mode is recognised
+}
+
+/**
+ * Connects to a server and asks for frames at the widget's size.
+ *
+ * @param host The server's host name or address.
+ * @param port The server's port.
+ * @param error Receives a description of the failure; may be nullptr.
+ * @return True if connected.
+ */
+bool RemoteClient::connectToServer(const QString& host, quint16 port, QString* error) {
+    socket = new QTcpSocket(this);
+    socket->connectToHost(host, port);
+    if (!socket->waitForConnected(5000)) {
+        if (error) *error = socket->errorString();
+        return false;
+    }
+    socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+    connect(socket, &QTcpSocket::readyRead, this, &RemoteClient::onReadyRead);
+    connect(socket, &QTcpSocket::disconnected, this, [this] {
+        setWindowTitle("Disconnected from render server");
+        });
+
+    QByteArray hello;
+    QDataStream out(&hello, QIODevice::WriteOnly);
+    out.setVersion(kStreamVersion);
+    out << quint8(kHello) << kVersion << quint16(width()) << quint16(height())
+        << quint8(png ? kPng : kJpeg) << quint8(quality);
+    MessageFraming::send(socket, hello);
+    return true;
+}
+
+/**
+ * Writes frame rate, bandwidth, latency and server timings as JSON.
+ *
+ * @param fileName The file to write; standard output if empty.
+ * @return True if the report was written.
+ */
+bool RemoteClient::writeReport(const QString& fileName) const {
+    const double seconds = framesReceived > 1 ? (clock.nsecsElapsed() - firstFrameAt) / 1e9 : 0.0;
+    QJsonObject report;
+    report["frames"] = static_cast<double>(framesReceived);
+    report["seconds"] = seconds;
+    report["framesPerSecond"] = seconds > 0 ? framesReceived / seconds : 0.0;
+    report["megabytes"] = bytesReceived / (1024.0 * 1024.0);
+    report["kilobytesPerSecond"] = seconds > 0 ? bytesReceived / 1024.0 / seconds : 0.0;
+    report["kilobytesPerFrame"] = framesReceived > 0 ? bytesReceived / 1024.0 / framesReceived : 0.0;
+    report["tilesPerFrame"] = framesReceived > 0 ? static_cast<double>(tilesReceived) / framesReceived : 0.0;
+    report["inputToPhotonMs"] = summarize(latencies);
+    report["serverMs"] = summarize(serverMs);
+    report["tileFormat"] = png ? "png" : "jpeg";
+    report["width"] = framebuffer.width();
+    report["height"] = framebuffer.height();
+
+    const QByteArray json = QJsonDocument(report).toJson();
+    if (fileName.isEmpty()) {
+        fwrite(json.constData(), 1, static_cast<size_t>(json.size()), stdout);
+        return true;
+    }
+    QFile file(fileName);
+    return file.open(QIODevice::WriteOnly) && file.write(json) == json.size();
+}
+
+/**
+ * Paints the current framebuffer.
+ *
+ * @param event The paint event (unused).
+ */
+void RemoteClient::paintEvent(QPaintEvent* event) {
+    Q_UNUSED(event);
+    QPainter painter(this);
+    painter.fillRect(rect(), Qt::black);
+    painter.drawImage(0, 0, framebuffer);
+}
+
+/**
+ * Asks the server for frames at the new size.
+ *
+ * @param event The resize event.
+ */
+void RemoteClient::resizeEvent(QResizeEvent* event) {
+    QWidget::resizeEvent(event);
+    if (!socket || socket->state() != QAbstractSocket::ConnectedState)
+        return;
+
+    QByteArray message;
+    QDataStream out(&message, QIODevice::WriteOnly);
+    out.setVersion(kStreamVersion);
+    out << quint8(kResize) << quint16(width()) << quint16(height());
+    MessageFraming::send(socket, message);
+}
+
+/**
+ * Starts a drag.
+ *
+ * @param event The mouse event.
+ */
+void RemoteClient::mousePressEvent(QMouseEvent* event) {
+    lastMousePosition = event->pos();
+}
+
+/**
+ * Orbits with the left button and pans with the middle or right button.
+ *
+ * @param event The mouse event.
+ */
+void RemoteClient::mouseMoveEvent(QMouseEvent* event) {
+    const QPoint delta = event->pos() - lastMousePosition;
+    lastMousePosition = event->pos();
+    if (event->buttons() & Qt::LeftButton) {
+        sendInput(kOrbit, delta.x(), delta.y());
+    }
+    else if (event->buttons() & (Qt::MiddleButton | Qt::RightButton)) {
+        sendInput(kPan, delta.x(), delta.y());
+    }
+}
+
+/**
+ * Zooms; one wheel notch moves 10% closer or further.
+ *
+ * @param event The wheel event.
+ */
+void RemoteClient::wheelEvent(QWheelEvent* event) {
+    sendInput(kZoom, static_cast<float>(std::pow(1.1, event->angleDelta().y() / 120.0)), 0.0f);
+}
+
+/**
+ * Resets the camera on R.
+ *
+ * @param event The key event.
+ */
+void RemoteClient::keyPressEvent(QKeyEvent* event) {
+    if (event->key() == Qt::Key_R) {
+        sendInput(kResetCamera, 0.0f, 0.0f);
+    }
+    else {
+        QWidget::keyPressEvent(event);
+    }
+}
+
+/**
+ * Handles every complete message the server has sent.
+ */
+void RemoteClient::onReadyRead() {
+    readBuffer.append(socket->readAll());
+    QByteArray message;
+    MessageFraming::TakeResult taken;
+    while ((taken = MessageFraming::take(readBuffer, message)) == MessageFraming::Taken) {
+        if (!message.isEmpty() && static_cast<quint8>(message.at(0)) == kFrame) {
+            handleFrame(message);
+        }
+    }
+    if (taken == MessageFraming::Corrupt) {
+        readBuffer.clear();
+        socket->abort();
+        setWindowTitle("Disconnected: the render server sent a corrupt message");
+    }
+}
+
+/**
+ * Decodes a frame's tiles into the framebuffer, paints it, records the latency of the inputs it
+ * answers and acknowledges it.
+ *
+ * @param message The frame message.
+ */
+void RemoteClient::handleFrame(const QByteArray& message) {
+    QDataStream in(message);
+    in.setVersion(kStreamVersion);
+    quint8 type;
+    quint32 frame, lastInput;
+    quint16 frameWidth, frameHeight, tileCount;
+    float renderMs, readbackMs, encodeMs;
+    in >> type >> frame >> lastInput >> frameWidth >> frameHeight >> renderMs >> readbackMs >> encodeMs >> tileCount;
+
+    if (framebuffer.width() != frameWidth || framebuffer.height() != frameHeight) {
+        framebuffer = QImage(frameWidth, frameHeight, QImage::Format_RGB888);
+        framebuffer.fill(Qt::black);
+    }
+    {
+        QPainter painter(&framebuffer);
+        for (int i = 0; i < tileCount && in.status() == QDataStream::Ok; ++i) {
+            quint16 x, y, tileWidth, tileHeight;
+            quint8 format;
+            QByteArray bytes;
+            in >> x >> y >> tileWidth >> tileHeight >> format >> bytes;
+            QImage tile;
+            if (tile.loadFromData(bytes, format == kPng ? "PNG" : "JPG")) {
+                painter.drawImage(x, y, tile);
+            }
+        }
+    }
+    repaint(); // Paint now, so the latency includes getting the pixels on screen
+
+    const qint64 now = clock.nsecsElapsed();
+    for (auto it = inputSentAt.begin(); it != inputSentAt.end();) {
+        if (it.key() <= lastInput) {
+            latencies.push_back((now - it.value()) / 1e6);
+            it = inputSentAt.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+    serverMs.push_back(renderMs + readbackMs + encodeMs);
+    if (framesReceived == 0) {
+        firstFrameAt = now;
+        windowStart = now;
+    }
+    ++framesReceived;
+    tilesReceived += tileCount;
+    bytesReceived += message.size();
+    ++windowFrames;
+    windowBytes += message.size();
+
+    QByteArray ack;
+    QDataStream out(&ack, QIODevice::WriteOnly);
+    out.setVersion(kStreamVersion);
+    out << quint8(kAck) << frame;
+    MessageFraming::send(socket, ack);
+
+    if (now - windowStart >= 1000000000LL) {
+        updateTitle();
+    }
+
+    if (scriptFrames > 0) {
+        --scriptFrames;
+        sendInput(kOrbit, 4.0f, 0.0f);
+    }
+    else if (!reportFile.isNull() && inputSentAt.isEmpty()) {
+        writeReport(reportFile);
+        QCoreApplication::quit();
+    }
+}
+
+/**
+ * Sends one input event and remembers when it was sent.
+ *
+ * @param type The RemoteProtocol::InputType.
+ * @param a The first argument of the input.
+ * @param b The second argument of the input.
+ */
+void RemoteClient::sendInput(quint8 type, float a, float b) {
+    if (!socket || socket->state() != QAbstractSocket::ConnectedState)
+        return;
+
+    const quint32 sequence = nextInput++;
+    QByteArray message;
+    QDataStream out(&message, QIODevice::WriteOnly);
+    out.setVersion(kStreamVersion);
+    out << quint8(kInput) << sequence << type << a << b;
+    inputSentAt.insert(sequence, clock.nsecsElapsed());
+    MessageFraming::send(socket, message);
+}
+
+/**
+ * Shows the last second's frame rate, bandwidth and latency in the title bar.
+ */
+void RemoteClient::updateTitle() {
+    const qint64 now = clock.nsecsElapsed();
+    const double seconds = (now - windowStart) / 1e9;
+    const size_t recent = std::min<size_t>(latencies.size(), 100);
+    std::vector<double> lastLatencies(latencies.end() - recent, latencies.end());
+    std::sort(lastLatencies.begin(), lastLatencies.end());
+
+    QString title = QString("Remote view: %1 frames/s, %2 kB/s")
+        .arg(windowFrames / seconds, 0, 'f', 1)
+        .arg(windowBytes / 1024.0 / seconds, 0, 'f', 0);
+    if (!lastLatencies.empty()) {
+        title += QString(", input-to-photon %1 ms (p95 %2 ms)")
+            .arg(lastLatencies[lastLatencies.size() / 2], 0, 'f', 1)
+            .arg(lastLatencies[std::min(lastLatencies.size() - 1, lastLatencies.size() * 95 / 100)], 0, 'f', 1);
+    }
+    setWindowTitle(title);
+    windowStart = now;
+    windowBytes = 0;
+    windowFrames = 0;
+}
@@ -0,0 +1,76 @@
+/**
+ * @file RemoteClient.h
+ *
+ * Defines the RemoteClient widget, the thin client of the remote rendering mode. It shows frames
+ * streamed by Qt_VTK_server and sends mouse and keyboard input back. It needs no VTK and no GPU.
+ * Input-to-photon latency is measured from sending an input to painting the first frame that
+ * includes it. This and the bandwidth are shown in the title bar and can be written to a JSON report.
+ */
+
+#ifndef VIEWER_REMOTECLIENT_H
+#define VIEWER_REMOTECLIENT_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QImage>
+#include <QPoint>
+#include <QString>
+#include <QWidget>
+#include <vector>
+
+class QTcpSocket;
+
+/**
+ * @class RemoteClient
+ * @brief Displays a remotely rendered scene and forwards interaction to the server.
+ */
+class RemoteClient : public QWidget {
+    Q_OBJECT
+
+public:
+    explicit RemoteClient(QWidget* parent = nullptr);
+
+    void setTileFormat(bool png, int quality);
+    void setScript(int frames, const QString& reportFile);
+    bool connectToServer(const QString& host, quint16 port, QString* error = nullptr);
+    bool writeReport(const QString& fileName) const;
+
+protected:
+    void paintEvent(QPaintEvent* event) override;
+    void resizeEvent(QResizeEvent* event) override;
+    void mousePressEvent(QMouseEvent* event) override;
+    void mouseMoveEvent(QMouseEvent* event) override;
+    void wheelEvent(QWheelEvent* event) override;
+    void keyPressEvent(QKeyEvent* event) override;
+
+private:
+    void onReadyRead();
+    void handleFrame(const QByteArray& message);
+    void sendInput(quint8 type, float a, float b);
+    void updateTitle();
+
+    QTcpSocket* socket; ///< Connection to the server.
+    QByteArray readBuffer; ///< Partial message received from the server.
+    QImage framebuffer; ///< Current picture, updated tile by tile.
+    QElapsedTimer clock; ///< Time base for latency measurements.
+    quint32 nextInput; ///< Sequence number of the next input sent.
+    QHash<quint32, qint64> inputSentAt; ///< Send time of inputs not yet seen in a frame, in ns.
+    QPoint lastMousePosition; ///< Pointer position at the previous mouse event.
+    bool png; ///< Whether to ask for lossless tiles.
+    int quality; ///< JPEG quality to ask for.
+    int scriptFrames; ///< Orbit steps left to send in scripted mode; 0 when interactive.
+    QString reportFile; ///< Where scripted mode writes its report.
+
+    std::vector<double> latencies; ///< Input-to-photon latency of every input, in ms.
+    std::vector<double> serverMs; ///< Render, readback and encode time reported by the server per frame.
+    qint64 bytesReceived; ///< Frame bytes received in total.
+    qint64 framesReceived; ///< Frames received in total.
+    qint64 tilesReceived; ///< Tiles received in total.
+    qint64 firstFrameAt; ///< Arrival time of the first frame, in ns.
+    qint64 windowStart; ///< Start of the current title bar averaging window, in ns.
+    qint64 windowBytes; ///< Bytes received in the current window.
+    int windowFrames; ///< Frames received in the current window.
+};
+
+#endif // VIEWER_REMOTECLIENT_H
@@ -0,0 +1,54 @@
+/**
+ * @file RemoteProtocol.h
+ *
+ * Message types of the remote rendering protocol between Qt_VTK_server and Qt_VTK_client. Messages
+ * are framed with MessageFraming and serialised with QDataStream; the first byte is the type.
+ *
+ *   client -> server  hello   version, width, height, tile format, JPEG quality
+ *                     resize  width, height
+ *                     input   sequence number, input type, two arguments
+ *                     ack     frame number, once the frame is on screen
+ *   server -> client  frame   frame number, last input applied, size, timings, changed tiles
+ *
+ * The server keeps at most a couple of frames unacknowledged, so on a slow link input is coalesced
+ * into the next frame instead of queueing up behind stale ones.
+ */
+
+#ifndef VIEWER_REMOTEPROTOCOL_H
+#define VIEWER_REMOTEPROTOCOL_H
+
+#include <QDataStream>
+
+namespace RemoteProtocol {
+
+const quint16 kVersion = 1; ///< Bumped whenever a message layout changes.
+const quint16 kDefaultPort = 47110; ///< TCP port the server listens on unless told otherwise.
+const int kTileSize = 64; ///< Edge length of the tiles the frame is divided into for change detection.
+const QDataStream::Version kStreamVersion = QDataStream::Qt_5_12; ///< Serialisation format of payloads.
+
+/** First byte of every message. */
+enum MessageType : quint8 {
+    kHello = 1,
+    kResize = 2,
+    kInput = 3,
+    kAck = 4,
+    kFrame = 5,
+};
+
+/** Interaction sent by the client; the server maps it onto the camera. */
+enum InputType : quint8 {
+    kOrbit = 1, ///< Arguments: horizontal and vertical drag in pixels.
+    kPan = 2, ///< Arguments: horizontal and vertical drag in pixels.
+    kZoom = 3, ///< Argument: dolly factor, above 1 to move closer.
+    kResetCamera = 4, ///< No arguments.
+};
+
+/** Encoding of a tile. */
+enum TileFormat : quint8 {
+    kJpeg = 1, ///< Lossy and small; for shaded geometry.
+    kPng = 2, ///< Lossless; for inspecting fine detail.
+};
+
+} // namespace RemoteProtocol
+
+#endif // VIEWER_REMOTEPROTOCOL_H
@@ -0,0 +1,329 @@
+/**
+ * @file RemoteRenderServer.cpp
+ * @brief Implementation of the RemoteRenderServer class.
+ */
+
+#include "RemoteRenderServer.h"
+#include "TaskScheduler.h"
+#include <QBuffer>
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <vtkCamera.h>
+#include <vtkMath.h>
+#include <vtkNew.h>
+#include <vtkUnsignedCharArray.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <functional>
+#include "MessageFraming.h"
+#include "RemoteProtocol.h"
+
+using namespace RemoteProtocol;
+
+namespace {
+
+const int kMaxFramesInFlight = 2; ///< Unacknowledged frames after which rendering waits for the client.
+const int kMaxSize = 8192; ///< Largest frame edge accepted from a client.
+
+} // namespace
+
+/**
+ * Constructs a server for a part tree. The tree must outlive the server.
+ *
+ * @param root The root of the tree to render.
+ * @param parent The parent QObject.
+ */
+RemoteRenderServer::RemoteRenderServer(ModelPart* root, QObject* parent)
+    : QObject(parent),
+    server(nullptr),
+    client(nullptr),
+    tileFormat(kJpeg),
+    quality(80),
+    frameNumber(0),
+    lastInput(0),
+    framesInFlight(0),
+    dirty(false),
+    frameScheduled(false),
+    bytesSent(0),
+    framesSent(0) {
+    renderWindow = vtkSmartPointer<vtkRenderWindow>::New();
+    renderWindow->SetOffScreenRendering(1);
+    renderWindow->SetSize(1280, 720);
+    renderWindow->AddRenderer(scene.getRenderer());
+    scene.setRoot(root);
+    connect(&scene, &SceneRenderer::impostorsUpdated, this, [this] {
+        dirty = true;
+        scheduleFrame();
+        });
+    connect(&scene, &SceneRenderer::pointCloudsUpdated, this, [this] {
+        dirty = true;
+        scheduleFrame();
+        });
+
+    QTimer* reportTimer = new QTimer(this);
+    connect(reportTimer, &QTimer::timeout, this, [this] {
+        if (client && framesSent > 0) {
+            emit statusMessage(QString("%1 frames/s, %2 kB/s").arg(framesSent).arg(bytesSent / 1024.0, 0, 'f', 1));
+        }
+        framesSent = 0;
+        bytesSent = 0;
+        });
+    reportTimer->start(1000);
+}
+
+/**
+ * Closes the connection and detaches the scene.
+ */
+RemoteRenderServer::~RemoteRenderServer() {
+    scene.setRoot(nullptr);
+}
+
+/**
+ * Starts accepting a client on a TCP port.
+ *
+ * @param port The port to listen on, on all interfaces.
+ * @param error Receives a description of the failure; may be nullptr.
+ * @return True if the server is listening.
+ */
+bool RemoteRenderServer::listen(quint16 port, QString* error) {
+    server = new QTcpServer(this);
+    if (!server->listen(QHostAddress::Any, port)) {
+        if (error) *error = server->errorString();
+        return false;
+    }
+    connect(server, &QTcpServer::newConnection, this, &RemoteRenderServer::onNewConnection);
+    return true;
+}
+
+/**
+ * Accepts a client, or turns it away if another client is already connected.
+ */
+void RemoteRenderServer::onNewConnection() {
+    while (QTcpSocket* socket = server->nextPendingConnection()) {
+        if (client) {
+            socket->disconnectFromHost();
+            socket->deleteLater();
+            emit statusMessage("Refused a second client");
+            continue;
+        }
+
+        client = socket;
+        client->setSocketOption(QAbstractSocket::LowDelayOption, 1); // Small input messages must not wait for Nagle
+        readBuffer.clear();
+        previousFrame = QImage();
+        framesInFlight = 0;
+        connect(client, &QTcpSocket::readyRead, this, &RemoteRenderServer::onReadyRead);
+        connect(client, &QTcpSocket::disconnected, this, [this] {
+            client->deleteLater();
+            client = nullptr;
+            emit statusMessage("Client disconnected");
+            });
+        emit statusMessage("Client connected from " + client->peerAddress().toString());
+    }
+}
+
+/**
+ * Handles every complete message the client has sent.
+ */
+void RemoteRenderServer::onReadyRead() {
+    readBuffer.append(client->readAll());
+    QByteArray message;
+    MessageFraming::TakeResult taken = MessageFraming::Incomplete;
+    while (client && (taken = MessageFraming::take(readBuffer, message)) == MessageFraming::Taken) {
+        handleMessage(message);
+    }
+    if (client && taken == MessageFraming::Corrupt) {
+        emit statusMessage("Client sent a corrupt message; closing the connection");
+        readBuffer.clear();
+        client->abort();
+    }
+}
+
+/**
+ * Handles one message from the client.
+ *
+ * @param message The message payload.
+ */
+void RemoteRenderServer::handleMessage(const QByteArray& message) {
+    QDataStream in(message);
+    in.setVersion(kStreamVersion);
+    quint8 type;
+    in >> type;
+
+    if (type == kHello || type == kResize) {
+        quint16 width, height;
+        if (type == kHello) {
+            quint16 version;
+            quint8 format, jpegQuality;
+            in >> version >> width >> height >> format >> jpegQuality;
+            if (version != kVersion) {
+                emit statusMessage(QString("Refused client with protocol version %1").arg(version));
+                client->disconnectFromHost();
+                return;
+            }
+            tileFormat = format == kPng ? kPng : kJpeg;
+            quality = std::min<int>(jpegQuality, 100);
+        }
+        else {
+            in >> width >> height;
+        }
+        renderWindow->SetSize(std::clamp<int>(width, 1, kMaxSize), std::clamp<int>(height, 1, kMaxSize));
+        previousFrame = QImage(); // The client needs every tile again
+        dirty = true;
+    }
+    else if (type == kInput) {
+        quint32 sequence;
+        quint8 inputType;
+        float a, b;
+        in >> sequence >> inputType >> a >> b;
+        applyInput(inputType, a, b);
+        lastInput = sequence;
+        dirty = true; // Even input that changes nothing gets a frame, so the client can time it
+    }
+    else if (type == kAck) {
+        framesInFlight = std::max(0, framesInFlight - 1);
+    }
+    scheduleFrame();
+}
+
+/**
+ * Moves the camera in response to client input.
+ *
+ * @param type The RemoteProtocol::InputType.
+ * @param a The first argument of the input.
+ * @param b The second argument of the input.
+ */
+void RemoteRenderServer::applyInput(quint8 type, float a, float b) {
+    vtkCamera* camera = scene.getRenderer()->GetActiveCamera();
+    if (type == kOrbit) {
+        camera->Azimuth(-0.4 * a);
+        camera->Elevation(0.4 * b);
+        camera->OrthogonalizeViewUp();
+    }
+    else if (type == kPan) {
+        // Move the camera parallel to the view plane so the geometry follows the pointer
+        double position[3], focalPoint[3], up[3], direction[3], right[3];
+        camera->GetPosition(position);
+        camera->GetFocalPoint(focalPoint);
+        camera->GetViewUp(up);
+        camera->GetDirectionOfProjection(direction);
+        vtkMath::Cross(direction, up, right);
+        vtkMath::Normalize(right);
+        const double worldPerPixel = 2.0 * camera->GetDistance()
+            * std::tan(vtkMath::RadiansFromDegrees(camera->GetViewAngle()) / 2.0) / renderWindow->GetSize()[1];
+        for (int i = 0; i < 3; ++i) {
+            const double offset = (-a * right[i] + b * up[i]) * worldPerPixel;
+            position[i] += offset;
+            focalPoint[i] += offset;
+        }
+        camera->SetPosition(position);
+        camera->SetFocalPoint(focalPoint);
+    }
+    else if (type == kZoom && a > 0.0f) {
+        camera->Dolly(a);
+    }
+    else if (type == kResetCamera) {
+        scene.resetCamera();
+    }
+    scene.getRenderer()->ResetCameraClippingRange();
+}
+
+/**
+ * Queues a frame if the scene changed and the client is keeping up.
+ */
+void RemoteRenderServer::scheduleFrame() {
+    if (client && dirty && !frameScheduled && framesInFlight < kMaxFramesInFlight) {
+        frameScheduled = true;
+        QTimer::singleShot(0, this, &RemoteRenderServer::renderFrame);
+    }
+}
+
+/**
+ * Renders a frame, finds the tiles that changed, compresses them on the thread pool and sends them.
+ */
+void RemoteRenderServer::renderFrame() {
+    frameScheduled = false;
+    if (!client || !dirty || framesInFlight >= kMaxFramesInFlight)
+        return;
+    dirty = false;
+
+    QElapsedTimer timer;
+    timer.start();
+    renderWindow->Render();
+    const double renderMs = timer.nsecsElapsed() / 1e6;
+
+    // VTK returns bottom-up RGB rows
+    timer.restart();
+    const int width = renderWindow->GetSize()[0];
+    const int height = renderWindow->GetSize()[1];
+    vtkNew<vtkUnsignedCharArray> pixels;
+    renderWindow->GetPixelData(0, 0, width - 1, height - 1, 1, pixels);
+    QImage image(width, height, QImage::Format_RGB888);
+    for (int y = 0; y < height; ++y) {
+        std::memcpy(image.scanLine(height - 1 - y), pixels->GetPointer(static_cast<vtkIdType>(y) * width * 3), static_cast<size_t>(width) * 3);
+    }
+    const double readbackMs = timer.nsecsElapsed() / 1e6;
+
+    timer.restart();
+    const QVector<QRect> tiles = changedTiles(image);
+    const char* format = tileFormat == kPng ? "PNG" : "JPG";
+    const int tileQuality = tileFormat == kPng ? -1 : quality;
+    std::function<QByteArray(const QRect&)> encode = [&image, format, tileQuality](const QRect& rect) {
+        QByteArray bytes;
+        QBuffer buffer(&bytes);
+        buffer.open(QIODevice::WriteOnly);
+        image.copy(rect).save(&buffer, format, tileQuality);
+        return bytes;
+    };
+    QList<QByteArray> encoded(tiles.size());
+    std::vector<int> indices(tiles.size());
+    std::iota(indices.begin(), indices.end(), 0);
+    TaskScheduler::instance()->blockingMap(TaskScheduler::Interactive, indices, [&](int i) { encoded[i] = encode(tiles[i]); });
+    const double encodeMs = timer.nsecsElapsed() / 1e6;
+
+    QByteArray message;
+    QDataStream out(&message, QIODevice::WriteOnly);
+    out.setVersion(kStreamVersion);
+    out << quint8(kFrame) << ++frameNumber << lastInput << quint16(width) << quint16(height)
+        << float(renderMs) << float(readbackMs) << float(encodeMs) << quint16(tiles.size());
+    for (int i = 0; i < tiles.size(); ++i) {
+        const QRect& rect = tiles[i];
+        out << quint16(rect.x()) << quint16(rect.y()) << quint16(rect.width()) << quint16(rect.height())
+            << quint8(tileFormat) << encoded[i];
+    }
+    MessageFraming::send(client, message);
+
+    previousFrame = image;
+    ++framesInFlight;
+    ++framesSent;
+    bytesSent += message.size();
+}
+
+/**
+ * Compares a frame with the previous one tile by tile.
+ *
+ * @param image The new frame.
+ * @return The tiles whose pixels differ, or every tile if there is no previous frame of this size.
+ */
+QVector<QRect> RemoteRenderServer::changedTiles(const QImage& image) const {
+    QVector<QRect> tiles;
+    const bool full = previousFrame.size() != image.size();
+    for (int y = 0; y < image.height(); y += kTileSize) {
+        for (int x = 0; x < image.width(); x += kTileSize) {
+            const QRect rect(x, y, std::min(kTileSize, image.width() - x), std::min(kTileSize, image.height() - y));
+            bool changed = full;
+            for (int row = rect.top(); !changed && row <= rect.bottom(); ++row) {
+                changed = std::memcmp(image.constScanLine(row) + x * 3, previousFrame.constScanLine(row) + x * 3, static_cast<size_t>(rect.width()) * 3) != 0;
+            }
+            if (changed) {
+                tiles.append(rect);
+            }
+        }
+    }
+    return tiles;
+}
@@ -0,0 +1,67 @@
+/**
+ * @file RemoteRenderServer.h
+ *
+ * Defines the RemoteRenderServer class, which renders a scene offscreen for a thin client on another
+ * machine. Each frame is divided into tiles; only tiles whose pixels changed since the previous
+ * frame are compressed (in parallel) and sent. The client sends camera input back.
+ */
+
+#ifndef VIEWER_REMOTERENDERSERVER_H
+#define VIEWER_REMOTERENDERSERVER_H
+
+#include <QByteArray>
+#include <QImage>
+#include <QObject>
+#include <QRect>
+#include <QVector>
+#include <vtkSmartPointer.h>
+#include <vtkRenderWindow.h>
+#include "SceneRenderer.h"
+
+class QTcpServer;
+class QTcpSocket;
+
+/**
+ * @class RemoteRenderServer
+ * @brief Streams offscreen renderings of a part tree to one remote client at a time.
+ */
+class RemoteRenderServer : public QObject {
+    Q_OBJECT
+
+public:
+    explicit RemoteRenderServer(ModelPart* root, QObject* parent = nullptr);
+    ~RemoteRenderServer();
+
+    bool listen(quint16 port, QString* error = nullptr);
+
+signals:
+    /** Emitted when a client connects or disconnects, and once a second with throughput figures. */
+    void statusMessage(const QString& message);
+
+private:
+    void onNewConnection();
+    void onReadyRead();
+    void handleMessage(const QByteArray& message);
+    void applyInput(quint8 type, float a, float b);
+    void scheduleFrame();
+    void renderFrame();
+    QVector<QRect> changedTiles(const QImage& image) const;
+
+    SceneRenderer scene; ///< Scene setup shared with the desktop viewer.
+    vtkSmartPointer<vtkRenderWindow> renderWindow; ///< Offscreen window the frames are rendered in.
+    QTcpServer* server; ///< Listening socket.
+    QTcpSocket* client; ///< The connected client, or nullptr.
+    QByteArray readBuffer; ///< Partial message received from the client.
+    QImage previousFrame; ///< Last frame sent, for change detection; null forces a full frame.
+    quint8 tileFormat; ///< RemoteProtocol::TileFormat requested by the client.
+    int quality; ///< JPEG quality requested by the client.
+    quint32 frameNumber; ///< Number of the last frame sent.
+    quint32 lastInput; ///< Sequence number of the last input applied.
+    int framesInFlight; ///< Frames sent but not yet acknowledged.
+    bool dirty; ///< Whether the scene changed since the last frame was rendered.
+    bool frameScheduled; ///< Whether renderFrame() is already queued.
+    qint64 bytesSent; ///< Frame bytes sent since the last throughput report.
+    int framesSent; ///< Frames sent since the last throughput report.
+};
+
+#endif // VIEWER_REMOTERENDERSERVER_H
@@ -0,0 +1,374 @@
+/**
+ * @file RenderProfiler.cpp
+ * @brief Implementation of the RenderProfiler class.
+ */
+
+#include "RenderProfiler.h"
+#include <vtkCommand.h>
+#include <vtkOpenGLRenderTimer.h>
+#include <vtkPolyData.h>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+const double kHeatDecades = 3.0; ///< Costs this many decades below the costliest part get the coldest colour.
+
+/** Heat map colours from cold to hot, spaced evenly over the logarithm of the cost. */
+const unsigned char kHeatRamp[][3] = {
+    { 0, 0, 140 },
+    { 0, 130, 200 },
+    { 60, 180, 75 },
+    { 255, 225, 25 },
+    { 245, 130, 48 },
+    { 230, 25, 75 },
+};
+
+const unsigned char kNotDrawn[3] = { 110, 110, 110 }; ///< Colour of parts that cost nothing, e.g. culled ones.
+
+} // namespace
+
+/**
+ * The cost used for ranking: a draw holds up the frame for as long as the slower of the CPU
+ * submitting it and the GPU executing it.
+ *
+ * @return The larger of cpuMs and gpuMs.
+ */
+double RenderProfiler::PartCost::costMs() const {
+    return std::max(cpuMs, gpuMs);
+}
+
+/**
+ * @return The cost of every part and the unattributed draws, per frame.
+ */
+double RenderProfiler::Profile::totalMs() const {
+    double total = unattributed.costMs();
+    for (const auto& entry : parts) {
+        total += entry.second.costMs();
+    }
+    return total;
+}
+
+/**
+ * Constructor for the RenderProfiler class. Profiling starts disabled.
+ *
+ * @param renderer The renderer drawing the part tree.
+ * @param edgeRenderer The renderer drawing the feature edges in the layer above.
+ */
+RenderProfiler::RenderProfiler(vtkRenderer* renderer, vtkRenderer* edgeRenderer)
+    : renderer(renderer), edgeRenderer(edgeRenderer), enabled(false), frameOpen(false), gpuSupported(false),
+      gpuChecked(false), gpuComplete(true), rendererTags{ 0, 0 }, windowTag(0), intervalOpen(false),
+      intervalPart(nullptr), frames(0) {
+    mapperCallback = vtkSmartPointer<vtkCallbackCommand>::New();
+    mapperCallback->SetCallback(&RenderProfiler::onMapperStart);
+    mapperCallback->SetClientData(this);
+    rendererCallback = vtkSmartPointer<vtkCallbackCommand>::New();
+    rendererCallback->SetCallback(&RenderProfiler::onRendererEnd);
+    rendererCallback->SetClientData(this);
+    windowCallback = vtkSmartPointer<vtkCallbackCommand>::New();
+    windowCallback->SetCallback(&RenderProfiler::onWindowEnd);
+    windowCallback->SetClientData(this);
+}
+
+/**
+ * Destructor for the RenderProfiler class. Stops every observed object calling back into it.
+ */
+RenderProfiler::~RenderProfiler() {
+    setEnabled(false);
+}
+
+/**
+ * Starts or stops profiling. Starting discards the costs collected before.
+ *
+ * @param enabled True to profile every frame from the next one on.
+ */
+void RenderProfiler::setEnabled(bool enabled) {
+    if (enabled == this->enabled)
+        return;
+
+    this->enabled = enabled;
+    if (enabled) {
+        totals.clear();
+        frames = 0;
+        gpuChecked = false;
+        gpuComplete = true;
+        rendererTags[0] = renderer->AddObserver(vtkCommand::EndEvent, rendererCallback);
+        rendererTags[1] = edgeRenderer->AddObserver(vtkCommand::EndEvent, rendererCallback);
+        return;
+    }
+
+    renderer->RemoveObserver(rendererTags[0]);
+    edgeRenderer->RemoveObserver(rendererTags[1]);
+    detachMappers();
+    detachWindow();
+    timers.clear();
+    timerParts.clear();
+    frameCosts.clear();
+    intervalOpen = false;
+    frameOpen = false;
+}
+
+/**
+ * Checks whether frames are being profiled.
+ *
+ * @return True while profiling.
+ */
+bool RenderProfiler::isEnabled() const {
+    return enabled;
+}
+
+/**
+ * Prepares to profile the frame about to be drawn. Call at the start of the frame, with the GL
+ * context current, after deciding what is drawn.
+ *
+ * The mappers are observed afresh every frame, so parts added since the last frame are included
+ * and deleted ones leave nothing behind.
+ *
+ * @param parts The parts with actors in the tree.
+ * @param floor The floor's mapper, the first prop drawn after the tree.
+ */
+void RenderProfiler::beginFrame(const std::vector<ModelPart*>& parts, vtkMapper* floor) {
+    if (!enabled)
+        return;
+    if (frameOpen) {
+        endFrame(); // The last frame did not reach its window's end, e.g. no window was attached yet
+    }
+
+    vtkRenderWindow* current = renderer->GetRenderWindow();
+    if (current != window) {
+        detachWindow();
+        window = current;
+        if (window) {
+            windowTag = window->AddObserver(vtkCommand::EndEvent, windowCallback);
+        }
+    }
+    if (!gpuChecked) {
+        gpuSupported = vtkOpenGLRenderTimer::IsSupported();
+        gpuChecked = true;
+    }
+
+    detachMappers();
+    for (ModelPart* part : parts) {
+        observe(part->getActor()->GetMapper(), part);
+        if (vtkActor* edges = part->getEdgeActor()) {
+            observe(edges->GetMapper(), part);
+        }
+    }
+    observe(floor, nullptr);
+    frameOpen = true;
+}
+
+/**
+ * Forgets a part about to be deleted. Its children are not affected.
+ *
+ * @param part The part.
+ */
+void RenderProfiler::removePart(ModelPart* part) {
+    totals.erase(part);
+    frameCosts.erase(part);
+    for (auto it = partByMapper.begin(); it != partByMapper.end(); ++it) {
+        if (it->second == part) it->second = nullptr;
+    }
+}
+
+/**
+ * Gets the costs collected since profiling was enabled, averaged per frame.
+ *
+ * @return The profile; empty until a frame has been drawn with profiling on.
+ */
+RenderProfiler::Profile RenderProfiler::profile() const {
+    Profile profile;
+    profile.frames = frames;
+    profile.gpuTimed = gpuSupported && gpuComplete;
+    if (frames == 0)
+        return profile;
+
+    auto average = [this](PartCost cost) {
+        cost.triangles /= frames;
+        cost.drawCalls /= frames;
+        cost.cpuMs /= frames;
+        cost.gpuMs /= frames;
+        return cost;
+    };
+    for (const auto& entry : totals) {
+        if (entry.first) {
+            profile.parts.emplace(entry.first, average(entry.second));
+        }
+        else {
+            profile.unattributed = average(entry.second);
+        }
+    }
+    return profile;
+}
+
+/**
+ * Maps a cost to a heat map colour, on a logarithmic scale up to the costliest part, so the few
+ * expensive parts stand out without every cheap one looking the same.
+ *
+ * @param cost The part's cost.
+ * @param maxCost The cost of the costliest part.
+ * @param rgb Receives the colour.
+ */
+void RenderProfiler::heatColour(double cost, double maxCost, unsigned char rgb[3]) {
+    if (!(cost > 0.0) || !(maxCost > 0.0)) {
+        std::copy(kNotDrawn, kNotDrawn + 3, rgb);
+        return;
+    }
+
+    const int stops = static_cast<int>(sizeof(kHeatRamp) / sizeof(kHeatRamp[0]));
+    const double t = std::min(1.0, std::max(0.0, 1.0 + std::log10(cost / maxCost) / kHeatDecades)) * (stops - 1);
+    const int low = std::min(stops - 2, static_cast<int>(t));
+    const double f = t - low;
+    for (int c = 0; c < 3; ++c) {
+        rgb[c] = static_cast<unsigned char>(std::lround(kHeatRamp[low][c] + f * (kHeatRamp[low + 1][c] - kHeatRamp[low][c])));
+    }
+}
+
+/**
+ * VTK callback invoked when a mapper starts drawing, which ends the previous mapper's interval.
+ *
+ * @param caller The mapper.
+ * @param eventId The VTK event identifier (StartEvent).
+ * @param clientData The RenderProfiler that registered the callback.
+ * @param callData Unused event data.
+ */
+void RenderProfiler::onMapperStart(vtkObject* caller, unsigned long eventId, void* clientData, void* callData) {
+    RenderProfiler* self = static_cast<RenderProfiler*>(clientData);
+    auto it = self->partByMapper.find(caller);
+    if (self->frameOpen && it != self->partByMapper.end()) {
+        self->openInterval(it->second, static_cast<vtkMapper*>(caller));
+    }
+}
+
+/**
+ * VTK callback invoked when a renderer has drawn its props, which ends the last interval.
+ *
+ * @param caller The renderer.
+ * @param eventId The VTK event identifier (EndEvent).
+ * @param clientData The RenderProfiler that registered the callback.
+ * @param callData Unused event data.
+ */
+void RenderProfiler::onRendererEnd(vtkObject* caller, unsigned long eventId, void* clientData, void* callData) {
+    static_cast<RenderProfiler*>(clientData)->closeInterval();
+}
+
+/**
+ * VTK callback invoked when the render window has finished a frame.
+ *
+ * @param caller The render window.
+ * @param eventId The VTK event identifier (EndEvent).
+ * @param clientData The RenderProfiler that registered the callback.
+ * @param callData Unused event data.
+ */
+void RenderProfiler::onWindowEnd(vtkObject* caller, unsigned long eventId, void* clientData, void* callData) {
+    static_cast<RenderProfiler*>(clientData)->endFrame();
+}
+
+/**
+ * Observes a mapper for the current frame.
+ *
+ * @param mapper The mapper, or nullptr to do nothing.
+ * @param part The part its draws are charged to, or nullptr for unattributed draws.
+ */
+void RenderProfiler::observe(vtkMapper* mapper, ModelPart* part) {
+    if (!mapper || !partByMapper.emplace(mapper, part).second)
+        return;
+
+    Observed entry;
+    entry.mapper = mapper;
+    entry.tag = mapper->AddObserver(vtkCommand::StartEvent, mapperCallback);
+    observed.push_back(entry);
+}
+
+/**
+ * Stops observing the mappers of the last frame that still exist.
+ */
+void RenderProfiler::detachMappers() {
+    for (const Observed& entry : observed) {
+        if (entry.mapper) entry.mapper->RemoveObserver(entry.tag);
+    }
+    observed.clear();
+    partByMapper.clear();
+}
+
+/**
+ * Stops observing the render window.
+ */
+void RenderProfiler::detachWindow() {
+    if (window) {
+        window->RemoveObserver(windowTag);
+    }
+    window = nullptr;
+}
+
+/**
+ * Starts timing a mapper's draw, ending the interval before it.
+ *
+ * @param part The part the draw is charged to, or nullptr.
+ * @param mapper The mapper about to draw.
+ */
+void RenderProfiler::openInterval(ModelPart* part, vtkMapper* mapper) {
+    closeInterval();
+
+    PartCost& cost = frameCosts[part];
+    cost.drawCalls += 1.0;
+    if (vtkPolyData* polyData = vtkPolyData::SafeDownCast(mapper->GetInputDataObject(0, 0))) {
+        cost.triangles += static_cast<double>(polyData->GetNumberOfPolys());
+    }
+    if (gpuSupported) {
+        timers.emplace_back(new vtkOpenGLRenderTimer);
+        timers.back()->Start();
+        timerParts.push_back(part);
+    }
+    intervalPart = part;
+    intervalOpen = true;
+    intervalStart = std::chrono::steady_clock::now();
+}
+
+/**
+ * Charges the time since the open interval started to its part.
+ */
+void RenderProfiler::closeInterval() {
+    if (!intervalOpen)
+        return;
+
+    frameCosts[intervalPart].cpuMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - intervalStart).count();
+    if (gpuSupported && !timers.empty()) {
+        timers.back()->Stop();
+    }
+    intervalOpen = false;
+}
+
+/**
+ * Waits for the frame's GPU queries and adds the frame's costs to the totals.
+ */
+void RenderProfiler::endFrame() {
+    if (!frameOpen)
+        return;
+
+    closeInterval();
+    if (!timers.empty()) {
+        if (window) window->WaitForCompletion();
+        for (size_t i = 0; i < timers.size(); ++i) {
+            if (timers[i]->Ready()) {
+                frameCosts[timerParts[i]].gpuMs += timers[i]->GetElapsedMilliseconds();
+            }
+            else {
+                gpuComplete = false;
+            }
+        }
+        timers.clear(); // Frees the queries while the frame's context is still current
+        timerParts.clear();
+    }
+
+    for (const auto& entry : frameCosts) {
+        PartCost& total = totals[entry.first];
+        total.triangles += entry.second.triangles;
+        total.drawCalls += entry.second.drawCalls;
+        total.cpuMs += entry.second.cpuMs;
+        total.gpuMs += entry.second.gpuMs;
+    }
+    frameCosts.clear();
+    ++frames;
+    frameOpen = false;
+}
@@ -0,0 +1,116 @@
+/**
+ * @file RenderProfiler.h
+ *
+ * Defines the RenderProfiler class, which attributes the cost of drawing a frame to the parts that
+ * were drawn, so the parts worth decimating or instancing can be found. Every mapper announces
+ * itself when the renderer reaches it, and the mappers of one renderer draw one after the other,
+ * so the time from one mapper's announcement to the next is the time spent submitting the first
+ * one's geometry. Each of those intervals is also bracketed by a pair of GPU timestamp queries
+ * where the OpenGL implementation supports them, giving the GPU time of the same draw calls.
+ *
+ * A part's meshes may be drawn several times a frame, e.g. into the shadow maps and for its feature
+ * edges, and every pass counts towards the part. The floor, impostor billboards and the shadow
+ * overlay are drawn after the tree and counted as unattributed. Point cloud nodes have no mapper
+ * of their own part here and fall into the interval of the mesh drawn just before them.
+ *
+ * Profiling waits for the GPU at the end of every frame to read the queries, so frames are slower
+ * while it is on and the absolute numbers are a little pessimistic; the shares are what matter.
+ */
+
+#ifndef VIEWER_RENDERPROFILER_H
+#define VIEWER_RENDERPROFILER_H
+
+#include <chrono>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <vtkCallbackCommand.h>
+#include <vtkMapper.h>
+#include <vtkRenderWindow.h>
+#include <vtkRenderer.h>
+#include <vtkSmartPointer.h>
+#include <vtkWeakPointer.h>
+#include "ModelPart.h"
+
+class vtkOpenGLRenderTimer;
+
+/**
+ * @class RenderProfiler
+ * @brief Per-part triangles, draw calls, CPU submission time and GPU time of rendered frames.
+ */
+class RenderProfiler {
+public:
+    /** What drawing one part cost, averaged over the profiled frames. */
+    struct PartCost {
+        double triangles = 0.0; ///< Triangles submitted per frame, over all passes.
+        double drawCalls = 0.0; ///< Mapper draws per frame, over all passes.
+        double cpuMs = 0.0; ///< Time spent submitting the part's draws per frame.
+        double gpuMs = 0.0; ///< GPU time of the part's draws per frame, if measured.
+
+        double costMs() const;
+    };
+
+    /** The costs collected since profiling was enabled. */
+    struct Profile {
+        int frames = 0; ///< Frames profiled.
+        bool gpuTimed = false; ///< Whether gpuMs was measured with timer queries.
+        std::unordered_map<ModelPart*, PartCost> parts; ///< Cost of each part drawn at least once.
+        PartCost unattributed; ///< Floor, billboards and overlays drawn after the tree.
+
+        double totalMs() const;
+    };
+
+    RenderProfiler(vtkRenderer* renderer, vtkRenderer* edgeRenderer);
+    ~RenderProfiler();
+
+    void setEnabled(bool enabled);
+    bool isEnabled() const;
+    void beginFrame(const std::vector<ModelPart*>& parts, vtkMapper* floor);
+    void removePart(ModelPart* part);
+    Profile profile() const;
+
+    static void heatColour(double cost, double maxCost, unsigned char rgb[3]);
+
+private:
+    /** A mapper observed for the current frame. */
+    struct Observed {
+        vtkWeakPointer<vtkMapper> mapper; ///< The mapper, which may be deleted with its part.
+        unsigned long tag; ///< Observer tag to remove.
+    };
+
+    static void onMapperStart(vtkObject* caller, unsigned long eventId, void* clientData, void* callData);
+    static void onRendererEnd(vtkObject* caller, unsigned long eventId, void* clientData, void* callData);
+    static void onWindowEnd(vtkObject* caller, unsigned long eventId, void* clientData, void* callData);
+    void observe(vtkMapper* mapper, ModelPart* part);
+    void detachMappers();
+    void detachWindow();
+    void openInterval(ModelPart* part, vtkMapper* mapper);
+    void closeInterval();
+    void endFrame();
+
+    vtkRenderer* renderer; ///< Renderer drawing the parts; it must outlive this object.
+    vtkRenderer* edgeRenderer; ///< Renderer drawing the feature edges; it must outlive this object.
+    bool enabled; ///< Whether frames are being profiled.
+    bool frameOpen; ///< Whether beginFrame() has run for the frame being drawn.
+    bool gpuSupported; ///< Whether the context supports timer queries; checked on the first frame.
+    bool gpuChecked; ///< Whether gpuSupported has been checked.
+    bool gpuComplete; ///< Whether every query so far returned a result.
+    vtkSmartPointer<vtkCallbackCommand> mapperCallback; ///< Opens an interval when a mapper starts.
+    vtkSmartPointer<vtkCallbackCommand> rendererCallback; ///< Closes the interval when a renderer finishes.
+    vtkSmartPointer<vtkCallbackCommand> windowCallback; ///< Collects the frame when the window finishes.
+    unsigned long rendererTags[2]; ///< Observer tags on renderer and edgeRenderer.
+    vtkWeakPointer<vtkRenderWindow> window; ///< Window whose end of frame is observed.
+    unsigned long windowTag; ///< Observer tag on window.
+    std::vector<Observed> observed; ///< Mappers observed for the current frame.
+    std::unordered_map<vtkObject*, ModelPart*> partByMapper; ///< Part drawn by each observed mapper; nullptr for unattributed ones.
+    bool intervalOpen; ///< Whether an interval is being timed.
+    ModelPart* intervalPart; ///< Part the open interval is charged to.
+    std::chrono::steady_clock::time_point intervalStart; ///< CPU time the open interval started.
+    std::vector<std::unique_ptr<vtkOpenGLRenderTimer>> timers; ///< GPU queries of this frame's intervals.
+    std::vector<ModelPart*> timerParts; ///< Part each query in timers is charged to.
+    std::unordered_map<ModelPart*, PartCost> frameCosts; ///< Costs of the frame being drawn.
+    std::unordered_map<ModelPart*, PartCost> totals; ///< Costs summed over the profiled frames.
+    int frames; ///< Frames summed into totals.
+};
+
+#endif // VIEWER_RENDERPROFILER_H
@@ -0,0 +1,570 @@
+/**
+ * @file SceneRenderer.cpp
+ * @brief Implementation of the SceneRenderer class.
+ */
+
+#include "SceneRenderer.h"
+#include "TaskScheduler.h"
+#include <vtkCamera.h>
+#include <vtkMatrix4x4.h>
+#include <vtkPlaneSource.h>
+#include <vtkPolyDataMapper.h>
+#include <vtkProperty.h>
+#include <vtkTransform.h>
+#include <vtkTransformPolyDataFilter.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+
+/**
+ * Constructor for the SceneRenderer class.
+ *
+ * @param parent The parent QObject.
+ */
+SceneRenderer::SceneRenderer(QObject* parent)
+    : QObject(parent), featureEdgesEnabled(false), edgeVisibilityEpoch(0), root(nullptr), occlusionCullingEnabled(false),
+      lastCulled(-1), lastTested(-1), frameVisibilityApplied(false), collectStatistics(false) {
+    renderer = vtkSmartPointer<vtkRenderer>::New();
+
+    // Toggling edges only switches this layer on or off; nothing is rebuilt
+    edgeRenderer = vtkSmartPointer<vtkRenderer>::New();
+    edgeRenderer->SetLayer(1);
+    edgeRenderer->SetActiveCamera(renderer->GetActiveCamera());
+    edgeRenderer->InteractiveOff();
+    edgeRenderer->PreserveDepthBufferOn();
+    edgeRenderer->DrawOff();
+
+    renderStartCallback = vtkSmartPointer<vtkCallbackCommand>::New();
+    renderStartCallback->SetCallback(&SceneRenderer::onRenderStart);
+    renderStartCallback->SetClientData(this);
+    renderer->AddObserver(vtkCommand::StartEvent, renderStartCallback);
+
+    impostorCache = new ImpostorCache(renderer, this);
+    connect(impostorCache, &ImpostorCache::impostorsUpdated, this, &SceneRenderer::impostorsUpdated);
+
+    pointClouds = new PointCloudLod(this);
+    connect(pointClouds, &PointCloudLod::nodesLoaded, this, &SceneRenderer::pointCloudsUpdated);
+
+    addFloor();
+    shadowCache = new ShadowCache(renderer);
+    shadowCache->setFloorHeight(floorActor->GetBounds()[4]);
+    profiler = new RenderProfiler(renderer, edgeRenderer);
+}
+
+/**
+ * Destructor for the SceneRenderer class. Stops the renderer calling back into this object.
+ */
+SceneRenderer::~SceneRenderer() {
+    renderer->RemoveObserver(renderStartCallback);
+    delete profiler;
+    delete shadowCache;
+}
+
+/**
+ * Gets the VTK renderer, to be added to a render window.
+ *
+ * @return The renderer.
+ */
+vtkSmartPointer<vtkRenderer> SceneRenderer::getRenderer() {
+    return renderer;
+}
+
+/**
+ * Gets the renderer for the feature edge overlay. Add it to the same render window as
+ * getRenderer(), which then needs two layers.
+ *
+ * @return The overlay renderer.
+ */
+vtkSmartPointer<vtkRenderer> SceneRenderer::getEdgeRenderer() {
+    return edgeRenderer;
+}
+
+/**
+ * Sets the part tree to draw and frames it with the camera.
+ *
+ * The root part's scene node contains the node of every part in the tree, so it is the only prop
+ * that needs adding besides the floor.
+ *
+ * @param root The root of the part tree.
+ */
+void SceneRenderer::setRoot(ModelPart* root) {
+    this->root = root;
+    renderer->RemoveAllViewProps();
+    if (root) {
+        renderer->AddViewProp(root->getNode());
+    }
+    renderer->AddActor(floorActor);
+    shadowCache->restoreActors();
+    refreshFeatureEdges();
+    resetCamera();
+}
+
+/**
+ * Places the camera so the whole scene is in view, looking down at it from an angle.
+ */
+void SceneRenderer::resetCamera() {
+    renderer->ResetCamera();
+    renderer->GetActiveCamera()->Azimuth(30);
+    renderer->GetActiveCamera()->Elevation(30);
+    renderer->ResetCameraClippingRange();
+}
+
+/**
+ * Enables or disables occlusion culling.
+ *
+ * @param enabled True to cull hidden parts every frame.
+ */
+void SceneRenderer::setOcclusionCulling(bool enabled) {
+    occlusionCullingEnabled = enabled;
+    lastCulled = lastTested = -1;
+}
+
+/**
+ * Checks whether occlusion culling is enabled.
+ *
+ * @return True if hidden parts are culled every frame.
+ */
+bool SceneRenderer::occlusionCulling() const {
+    return occlusionCullingEnabled;
+}
+
+/**
+ * Enables or disables billboard impostors for distant parts.
+ *
+ * @param enabled True to draw parts smaller than a few pixels as cached images.
+ */
+void SceneRenderer::setImpostors(bool enabled) {
+    impostorCache->setEnabled(enabled);
+}
+
+/**
+ * Checks whether impostors are enabled.
+ *
+ * @return True if distant parts may be drawn as billboards.
+ */
+bool SceneRenderer::impostors() const {
+    return impostorCache->isEnabled();
+}
+
+/**
+ * Sets how many point cloud points may be drawn per frame, across all clouds.
+ *
+ * @param points The point budget.
+ */
+void SceneRenderer::setPointBudget(long long points) {
+    pointClouds->setPointBudget(points);
+}
+
+/**
+ * Gets the point cloud point budget.
+ *
+ * @return Points drawn per frame at most.
+ */
+long long SceneRenderer::pointBudget() const {
+    return pointClouds->pointBudget();
+}
+
+/**
+ * Shows or hides the feature edges of every part as a line overlay.
+ *
+ * @param enabled True to draw the edges.
+ */
+void SceneRenderer::setFeatureEdges(bool enabled) {
+    featureEdgesEnabled = enabled;
+    edgeRenderer->SetDraw(enabled);
+    refreshFeatureEdges();
+}
+
+/**
+ * Checks whether feature edges are drawn.
+ *
+ * @return True if the edge overlay is on.
+ */
+bool SceneRenderer::featureEdges() const {
+    return featureEdgesEnabled;
+}
+
+/**
+ * Chooses whether parts hide the edges behind them. With removal off the overlay ignores the
+ * scene's depth, showing every edge through the surfaces.
+ *
+ * @param enabled True to hide edges behind surfaces.
+ */
+void SceneRenderer::setHiddenLineRemoval(bool enabled) {
+    edgeRenderer->SetPreserveDepthBuffer(enabled);
+}
+
+/**
+ * Checks whether edges behind surfaces are hidden.
+ *
+ * @return True if hidden-line removal is on.
+ */
+bool SceneRenderer::hiddenLineRemoval() const {
+    return edgeRenderer->GetPreserveDepthBuffer();
+}
+
+/**
+ * Turns shadow maps on or off. The maps are rendered again only when a part, its transform or
+ * its visibility changes, so a static scene costs little more than without shadows.
+ *
+ * @param enabled True for parts to cast shadows on each other and the floor.
+ */
+void SceneRenderer::setShadows(bool enabled) {
+    shadowCache->setShadows(enabled);
+}
+
+/**
+ * Checks whether shadow maps are on.
+ *
+ * @return True if parts cast shadows.
+ */
+bool SceneRenderer::shadows() const {
+    return shadowCache->shadows();
+}
+
+/**
+ * Shows or hides a soft contact shadow on the floor under the parts. It does not need shadow
+ * maps and is rebuilt only when the scene changes.
+ *
+ * @param enabled True to darken the floor under the parts.
+ */
+void SceneRenderer::setContactShadow(bool enabled) {
+    shadowCache->setContactShadow(enabled);
+}
+
+/**
+ * Checks whether the contact shadow is shown.
+ *
+ * @return True if the floor is darkened under the parts.
+ */
+bool SceneRenderer::contactShadow() const {
+    return shadowCache->contactShadow();
+}
+
+/**
+ * Gets how often the shadows have been rebuilt.
+ *
+ * @return The shadow statistics.
+ */
+ShadowCache::Statistics SceneRenderer::shadowStatistics() const {
+    return shadowCache->statistics();
+}
+
+/**
+ * Releases everything cached for a part and its descendants. Call before deleting parts.
+ *
+ * @param part The root of the subtree being removed.
+ */
+void SceneRenderer::removePart(ModelPart* part) {
+    if (!part) return;
+
+    impostorCache->removePart(part);
+    profiler->removePart(part);
+    if (vtkActor* edges = part->getEdgeActor()) {
+        edgeRenderer->RemoveActor(edges);
+    }
+    for (int i = 0; i < part->childCount(); ++i) {
+        removePart(part->child(i));
+    }
+}
+
+/**
+ * Enables or disables collection of per-frame statistics. Collecting them walks the part tree
+ * every frame even when culling and impostors are off.
+ *
+ * @param enabled True to fill in lastFrameStats() every frame.
+ */
+void SceneRenderer::setCollectStatistics(bool enabled) {
+    collectStatistics = enabled;
+}
+
+/**
+ * Gets the statistics of the last frame drawn while statistics collection was enabled.
+ *
+ * @return The frame statistics.
+ */
+SceneRenderer::FrameStats SceneRenderer::lastFrameStats() const {
+    return lastStats;
+}
+
+/**
+ * Starts or stops charging the cost of each frame to the parts drawn in it. Starting discards
+ * the last profile. Frames are slower while profiling, as each waits for the GPU to finish.
+ *
+ * @param enabled True to profile every frame from the next one on.
+ */
+void SceneRenderer::setRenderProfiling(bool enabled) {
+    profiler->setEnabled(enabled);
+}
+
+/**
+ * Checks whether frames are being profiled.
+ *
+ * @return True while profiling.
+ */
+bool SceneRenderer::renderProfiling() const {
+    return profiler->isEnabled();
+}
+
+/**
+ * Gets the per-part costs of the frames drawn since profiling was last started. The profile
+ * stays available after profiling is stopped.
+ *
+ * @return The costs, averaged per frame.
+ */
+RenderProfiler::Profile SceneRenderer::renderProfile() const {
+    return profiler->profile();
+}
+
+/**
+ * VTK callback invoked by the renderer at the start of every frame.
+ *
+ * @param caller The renderer that is about to draw.
+ * @param eventId The VTK event identifier (StartEvent).
+ * @param clientData The SceneRenderer that registered the callback.
+ * @param callData Unused event data.
+ */
+void SceneRenderer::onRenderStart(vtkObject* caller, unsigned long eventId, void* clientData, void* callData) {
+    static_cast<SceneRenderer*>(clientData)->prepareFrame();
+}
+
+/**
+ * Performs per-frame work before any actors are drawn.
+ *
+ * Runs after the camera for the frame is known but before the renderer gathers its visible props,
+ * so actor visibility changed here takes effect in the same frame. User visibility lives on the
+ * parts' scene nodes; actor visibility only records whether culling or impostors replaced the part
+ * for this frame. When neither is enabled and no point clouds are open the tree is not walked at all.
+ */
+void SceneRenderer::prepareFrame() {
+    PointCloudLod::Selection points;
+    if (root && PointCloud::openCount() > 0) {
+        points = pointClouds->update(root, renderer);
+    }
+    if (featureEdgesEnabled && edgeVisibilityEpoch != ModelPart::visibilityVersion()) {
+        updateEdgeVisibility();
+    }
+    shadowCache->update(root);
+
+    bool active = occlusionCullingEnabled || impostorCache->isEnabled();
+    if (!root || (!active && !frameVisibilityApplied && !collectStatistics && !profiler->isEnabled())) return;
+    frameVisibilityApplied = active; // One more pass after disabling restores every actor
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<ModelPart*> parts;
+    collectRenderableParts(root, parts);
+    profiler->beginFrame(parts, floorActor->GetMapper());
+
+    std::vector<bool> actorVisible(parts.size());
+    int visibleParts = 0;
+    for (size_t i = 0; i < parts.size(); ++i) {
+        actorVisible[i] = parts[i]->effectiveVisible();
+        visibleParts += actorVisible[i];
+    }
+
+    const int culled = cullOccludedParts(parts, actorVisible);
+    const int notCulled = static_cast<int>(std::count(actorVisible.begin(), actorVisible.end(), true));
+    impostorCache->update(parts, actorVisible);
+
+    // Parts hidden by the user are already hidden by their node; leave their actor untouched
+    FrameStats stats;
+    for (size_t i = 0; i < parts.size(); ++i) {
+        vtkActor* actor = parts[i]->getActor();
+        bool visible = actorVisible[i] || !parts[i]->effectiveVisible();
+        if (actor->GetVisibility() != static_cast<vtkTypeBool>(visible)) {
+            actor->SetVisibility(visible);
+        }
+        vtkActor* edges = featureEdgesEnabled ? parts[i]->getEdgeActor().GetPointer() : nullptr;
+        if (edges && edges->GetVisibility() != static_cast<vtkTypeBool>(actorVisible[i])) {
+            edges->SetVisibility(actorVisible[i]);
+        }
+        if (collectStatistics && actorVisible[i]) {
+            ++stats.drawnProps;
+            stats.triangles += parts[i]->getPolyData()->GetNumberOfPolys();
+        }
+    }
+
+    if (collectStatistics) {
+        stats.parts = visibleParts;
+        stats.culled = culled;
+        stats.impostors = notCulled - static_cast<int>(std::count(actorVisible.begin(), actorVisible.end(), true));
+        stats.drawnProps += stats.impostors + 1 + points.nodes; // Billboards, the floor and point cloud nodes
+        stats.points = points.points;
+        stats.triangles += 2LL * (stats.impostors + 1);
+        stats.prepareMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        lastStats = stats;
+    }
+}
+
+/**
+ * Collects every part in a subtree that has an actor to draw.
+ *
+ * @param part The root of the subtree to search.
+ * @param parts Receives the parts that own an actor.
+ */
+void SceneRenderer::collectRenderableParts(ModelPart* part, std::vector<ModelPart*>& parts) {
+    if (!part) return;
+
+    if (part->getActor()) {
+        parts.push_back(part);
+    }
+    for (int i = 0; i < part->childCount(); ++i) {
+        collectRenderableParts(part->child(i), parts);
+    }
+}
+
+/**
+ * Hides parts whose bounds are completely covered by large occluding parts.
+ *
+ * The largest visible parts are rasterized at coarse detail into a software depth buffer on a worker
+ * thread while this thread gathers the bounds of every other part. Each remaining part is then
+ * tested against the buffer. cullingChanged() is emitted when the result differs from the last one.
+ *
+ * @param parts The parts about to be drawn.
+ * @param actorVisible Visibility of each part's actor, set to false for occluded parts.
+ * @return The number of parts culled.
+ */
+int SceneRenderer::cullOccludedParts(const std::vector<ModelPart*>& parts, std::vector<bool>& actorVisible) {
+    if (!occlusionCullingEnabled) return 0;
+
+    const size_t maxOccluders = 8;
+    auto start = std::chrono::steady_clock::now();
+
+    // Use the parts with the largest bounding boxes as occluders
+    std::vector<std::pair<double, ModelPart*>> candidates;
+    for (size_t i = 0; i < parts.size(); ++i) {
+        if (actorVisible[i]) {
+            candidates.emplace_back(parts[i]->getActor()->GetLength(), parts[i]);
+        }
+    }
+    const size_t occluderCount = std::min(maxOccluders, candidates.size());
+    std::partial_sort(candidates.begin(), candidates.begin() + occluderCount, candidates.end(),
+        [](const std::pair<double, ModelPart*>& a, const std::pair<double, ModelPart*>& b) { return a.first > b.first; });
+
+    vtkMatrix4x4* viewProjectionMatrix = renderer->GetActiveCamera()->GetCompositeProjectionTransformMatrix(
+        renderer->GetTiledAspectRatio(), -1, 1);
+    std::array<double, 16> viewProjection;
+    std::copy(&viewProjectionMatrix->Element[0][0], &viewProjectionMatrix->Element[0][0] + 16, viewProjection.begin());
+
+    struct Occluder {
+        const std::vector<float>* mesh;
+        std::array<double, 16> modelViewProjection;
+    };
+    std::vector<Occluder> occluders;
+    std::vector<ModelPart*> occluderParts;
+    for (size_t i = 0; i < occluderCount; ++i) {
+        ModelPart* part = candidates[i].second;
+        Occluder occluder;
+        occluder.mesh = &part->getOccluderMesh();
+        vtkMatrix4x4::Multiply4x4(viewProjection.data(), &part->getActor()->GetMatrix()->Element[0][0], occluder.modelViewProjection.data());
+        occluders.push_back(occluder);
+        occluderParts.push_back(part);
+    }
+
+    // Rasterize the occluders and gather the bounds at the same time; the frame is waiting, so
+    // both run as interactive work ahead of any loading or analysis
+    std::vector<std::array<double, 6>> bounds(parts.size());
+    int jobs[] = { 0, 1 };
+    TaskScheduler::instance()->blockingMap(TaskScheduler::Interactive, jobs, [&](int job) {
+        if (job == 0) {
+            occlusionCuller.clear();
+            for (const Occluder& occluder : occluders) {
+                occlusionCuller.rasterizeOccluder(*occluder.mesh, occluder.modelViewProjection.data());
+            }
+            return;
+        }
+        for (size_t i = 0; i < parts.size(); ++i) {
+            parts[i]->getActor()->GetBounds(bounds[i].data());
+        }
+    });
+
+    int tested = 0;
+    int culled = 0;
+    for (size_t i = 0; i < parts.size(); ++i) {
+        if (!actorVisible[i] || std::find(occluderParts.begin(), occluderParts.end(), parts[i]) != occluderParts.end())
+            continue;
+        ++tested;
+        if (!occlusionCuller.isVisible(bounds[i].data(), viewProjection.data())) {
+            actorVisible[i] = false;
+            ++culled;
+        }
+    }
+
+    // Only report when the result changes, not on every frame
+    if (culled != lastCulled || tested != lastTested) {
+        lastCulled = culled;
+        lastTested = tested;
+        emit cullingChanged(culled, tested, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    return culled;
+}
+
+/**
+ * Creates the floor plane shown under the parts.
+ */
+void SceneRenderer::addFloor() {
+    vtkSmartPointer<vtkPlaneSource> planeSource = vtkSmartPointer<vtkPlaneSource>::New();
+    planeSource->Update();
+
+    double scale = 500.0; // Adjust the scale as needed
+
+    vtkSmartPointer<vtkTransform> transform = vtkSmartPointer<vtkTransform>::New();
+    transform->Translate(50.0, 50.0, -10.0); // Adjust positioning if needed
+    transform->RotateX(0); // Rotating 90 degrees around the X-axis
+    transform->Scale(scale, scale, 1); // Scaling the plane
+
+    vtkSmartPointer<vtkTransformPolyDataFilter> transformFilter = vtkSmartPointer<vtkTransformPolyDataFilter>::New();
+    transformFilter->SetInputConnection(planeSource->GetOutputPort());
+    transformFilter->SetTransform(transform);
+    transformFilter->Update();
+
+    vtkSmartPointer<vtkPolyDataMapper> mapper = vtkSmartPointer<vtkPolyDataMapper>::New();
+    mapper->SetInputConnection(transformFilter->GetOutputPort());
+
+    floorActor = vtkSmartPointer<vtkActor>::New();
+    floorActor->SetMapper(mapper);
+    floorActor->GetProperty()->SetColor(0.8, 0.8, 0.8); // Set the floor color
+
+    renderer->AddActor(floorActor);
+}
+
+/**
+ * Puts the edge actor of every part in the tree into the overlay, extracting edges in parallel
+ * for parts that were not given them at import, e.g. geometry received from a sync session.
+ * Does nothing while the overlay is off.
+ */
+void SceneRenderer::refreshFeatureEdges() {
+    edgeRenderer->RemoveAllViewProps();
+    if (!featureEdgesEnabled || !root)
+        return;
+
+    std::vector<ModelPart*> parts;
+    collectRenderableParts(root, parts);
+    std::vector<ModelPart*> missing;
+    for (ModelPart* part : parts) {
+        if (!part->getEdgeActor()) missing.push_back(part);
+    }
+    TaskScheduler::instance()->blockingMap(TaskScheduler::Interactive, missing, [](ModelPart* part) { part->buildFeatureEdges(); });
+
+    for (ModelPart* part : parts) {
+        if (vtkActor* edges = part->getEdgeActor()) edgeRenderer->AddActor(edges);
+    }
+    updateEdgeVisibility();
+}
+
+/**
+ * Hides the edges of parts the user has hidden. The edge actors are not inside the parts' scene
+ * nodes, so they do not inherit the nodes' visibility.
+ */
+void SceneRenderer::updateEdgeVisibility() {
+    edgeVisibilityEpoch = ModelPart::visibilityVersion();
+    std::vector<ModelPart*> parts;
+    collectRenderableParts(root, parts);
+    for (ModelPart* part : parts) {
+        vtkActor* edges = part->getEdgeActor();
+        if (edges && edges->GetVisibility() != static_cast<vtkTypeBool>(part->effectiveVisible())) {
+            edges->SetVisibility(part->effectiveVisible());
+        }
+    }
+}
@@ -0,0 +1,115 @@
+/**
+ * @file SceneRenderer.h
+ *
+ * Defines the SceneRenderer class, which owns the VTK renderer that draws the part tree together
+ * with the per-frame work done before each frame: occlusion culling, impostor substitution and
+ * point cloud level of detail. Feature edges are drawn by a second renderer in the layer above,
+ * which shares the camera and, with hidden-line removal, the depth buffer.
+ * Shadows, when enabled, come from a ShadowCache that bakes them only when the scene changes.
+ * A RenderProfiler can charge the cost of each frame to the parts drawn in it.
+ * The main window attaches its renderer to the on-screen render window; the benchmark harness
+ * attaches the same configuration to an offscreen window.
+ */
+
+#ifndef VIEWER_SCENERENDERER_H
+#define VIEWER_SCENERENDERER_H
+
+#include <QObject>
+#include <vector>
+#include <vtkSmartPointer.h>
+#include <vtkRenderer.h>
+#include <vtkCallbackCommand.h>
+#include <vtkActor.h>
+#include "ModelPart.h"
+#include "OcclusionCuller.h"
+#include "ImpostorCache.h"
+#include "PointCloudLod.h"
+#include "ShadowCache.h"
+#include "RenderProfiler.h"
+
+/**
+ * @class SceneRenderer
+ * @brief Draws a ModelPart tree with optional occlusion culling and impostors.
+ */
+class SceneRenderer : public QObject {
+    Q_OBJECT
+
+public:
+    /** What the last frame drew, collected when statistics are enabled. */
+    struct FrameStats {
+        int parts = 0; ///< Parts with geometry that the user has not hidden.
+        int culled = 0; ///< Parts skipped by occlusion culling.
+        int impostors = 0; ///< Parts drawn as billboards.
+        int drawnProps = 0; ///< Actors and billboards drawn, including the floor; about one draw call each.
+        long long triangles = 0; ///< Triangles submitted, counting two per billboard.
+        long long points = 0; ///< Point cloud points drawn as splats.
+        double prepareMs = 0.0; ///< Time spent in the per-frame work before drawing.
+    };
+
+    explicit SceneRenderer(QObject* parent = nullptr);
+    ~SceneRenderer();
+
+    vtkSmartPointer<vtkRenderer> getRenderer();
+    vtkSmartPointer<vtkRenderer> getEdgeRenderer();
+    void setRoot(ModelPart* root);
+    void resetCamera();
+    void setOcclusionCulling(bool enabled);
+    bool occlusionCulling() const;
+    void setImpostors(bool enabled);
+    bool impostors() const;
+    void setPointBudget(long long points);
+    long long pointBudget() const;
+    void setFeatureEdges(bool enabled);
+    bool featureEdges() const;
+    void setHiddenLineRemoval(bool enabled);
+    bool hiddenLineRemoval() const;
+    void setShadows(bool enabled);
+    bool shadows() const;
+    void setContactShadow(bool enabled);
+    bool contactShadow() const;
+    ShadowCache::Statistics shadowStatistics() const;
+    void removePart(ModelPart* part);
+    void setCollectStatistics(bool enabled);
+    FrameStats lastFrameStats() const;
+    void setRenderProfiling(bool enabled);
+    bool renderProfiling() const;
+    RenderProfiler::Profile renderProfile() const;
+
+signals:
+    /** Emitted when the number of culled parts changes. */
+    void cullingChanged(int culled, int tested, double elapsedMs);
+    /** Emitted when new impostor images are ready; the scene should be rendered again. */
+    void impostorsUpdated();
+    /** Emitted when more point cloud detail has been loaded; the scene should be rendered again. */
+    void pointCloudsUpdated();
+
+private:
+    static void onRenderStart(vtkObject* caller, unsigned long eventId, void* clientData, void* callData);
+    void prepareFrame();
+    int cullOccludedParts(const std::vector<ModelPart*>& parts, std::vector<bool>& actorVisible);
+    void collectRenderableParts(ModelPart* part, std::vector<ModelPart*>& parts);
+    void addFloor();
+    void refreshFeatureEdges();
+    void updateEdgeVisibility();
+
+    vtkSmartPointer<vtkRenderer> renderer; ///< Renderer drawing the scene.
+    vtkSmartPointer<vtkCallbackCommand> renderStartCallback; ///< Runs per-frame work before the renderer draws.
+    vtkSmartPointer<vtkActor> floorActor; ///< Floor plane under the parts.
+    vtkSmartPointer<vtkRenderer> edgeRenderer; ///< Overlay layer drawing the parts' feature edges.
+    bool featureEdgesEnabled; ///< Whether the edge overlay is drawn.
+    unsigned long edgeVisibilityEpoch; ///< Part visibility epoch the edge actors were last matched to.
+    ModelPart* root; ///< Root of the part tree, or nullptr before setRoot().
+    OcclusionCuller occlusionCuller; ///< Software depth buffer used to skip hidden parts.
+    bool occlusionCullingEnabled; ///< Whether hidden parts are culled each frame.
+    int lastCulled; ///< Culled count last reported through cullingChanged().
+    int lastTested; ///< Tested count last reported through cullingChanged().
+    ImpostorCache* impostorCache; ///< Billboard impostors for parts that cover only a few pixels.
+    PointCloudLod* pointClouds; ///< Chooses and streams the point cloud nodes to draw.
+    ShadowCache* shadowCache; ///< Cached shadow maps and the floor contact shadow.
+    RenderProfiler* profiler; ///< Per-part frame costs, collected while profiling is on.
+    bool frameVisibilityApplied; ///< Whether the last frame changed any actor's visibility.
+    bool collectStatistics; ///< Whether lastStats is filled in every frame.
+    FrameStats lastStats; ///< Statistics of the last frame.
+};
+
+#endif // VIEWER_SCENERENDERER_H
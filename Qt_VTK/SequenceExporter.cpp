@@ -0,0 +1,270 @@
+/**
+ * @file SequenceExporter.cpp
+ * @brief Implementation of the SequenceExporter class.
+ */
+
+#include "SequenceExporter.h"
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QImage>
+#include <QImageWriter>
+#include <QMutex>
+#include <QSemaphore>
+#include <vtkCamera.h>
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <vtkRenderWindow.h>
+#include <vtkUnsignedCharArray.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <vector>
+#include "SceneRenderer.h"
+#include "TaskScheduler.h"
+
+namespace {
+
+/** A part that moves as one unit in the exploded view, with the data to move it. */
+struct ExplodedPart {
+    ModelPart* part; ///< The part; its descendants move with it.
+    double centre[3]; ///< Centre of its world bounds before exploding.
+    vtkSmartPointer<vtkMatrix4x4> local; ///< Local matrix before exploding, restored afterwards.
+    vtkSmartPointer<vtkMatrix4x4> world; ///< World matrix before exploding.
+    vtkSmartPointer<vtkMatrix4x4> parentInverse; ///< Inverse of the parent's world matrix.
+};
+
+/**
+ * Collects the topmost parts with geometry: each is pushed apart from the others with its
+ * sub-parts attached, so nested parts are not moved twice.
+ */
+void collectExplodedParts(ModelPart* part, std::vector<ExplodedPart>& parts) {
+    if (part->getPolyData() && part->getActor()) {
+        ExplodedPart entry;
+        entry.part = part;
+        double bounds[6];
+        part->getActor()->GetBounds(bounds);
+        for (int i = 0; i < 3; ++i) {
+            entry.centre[i] = (bounds[2 * i] + bounds[2 * i + 1]) / 2.0;
+        }
+        entry.world = vtkSmartPointer<vtkMatrix4x4>::New();
+        entry.world->DeepCopy(part->getTransform()->GetMatrix());
+        entry.parentInverse = vtkSmartPointer<vtkMatrix4x4>::New();
+        if (ModelPart* parent = part->parentItem()) {
+            vtkMatrix4x4::Invert(parent->getTransform()->GetMatrix(), entry.parentInverse);
+        }
+        entry.local = vtkSmartPointer<vtkMatrix4x4>::New();
+        vtkMatrix4x4::Multiply4x4(entry.parentInverse, entry.world, entry.local);
+        parts.push_back(entry);
+        return;
+    }
+    for (int i = 0; i < part->childCount(); ++i) {
+        collectExplodedParts(part->child(i), parts);
+    }
+}
+
+/**
+ * Replaces the local transform of a part, keeping it chained onto its parent's transform.
+ */
+void setLocalMatrix(ModelPart* part, vtkMatrix4x4* matrix) {
+    vtkTransform* transform = part->getTransform();
+    transform->Identity();
+    transform->Concatenate(matrix);
+}
+
+/**
+ * Moves every part away from the assembly centre by a multiple of its distance from it.
+ */
+void applyExplosion(std::vector<ExplodedPart>& parts, const double centre[3], double spread) {
+    vtkNew<vtkMatrix4x4> offsetWorld, local;
+    for (ExplodedPart& entry : parts) {
+        // Translate in world space, then divide the parent's transform back out
+        offsetWorld->DeepCopy(entry.world);
+        for (int i = 0; i < 3; ++i) {
+            offsetWorld->SetElement(i, 3, entry.world->GetElement(i, 3) + (entry.centre[i] - centre[i]) * spread);
+        }
+        vtkMatrix4x4::Multiply4x4(entry.parentInverse, offsetWorld, local);
+        setLocalMatrix(entry.part, local);
+    }
+}
+
+} // namespace
+
+/**
+ * Constructs an exporter.
+ *
+ * @param settings What to render and where to write it.
+ */
+SequenceExporter::SequenceExporter(const Settings& settings)
+    : settings(settings) {
+}
+
+/**
+ * Renders the animation and writes every frame. The part tree is left as it was found.
+ *
+ * @param root The root of the tree to render. It must not be rendered elsewhere during the export.
+ * @param error Receives a description of the failure; may be nullptr.
+ * @param progress Called after each frame is rendered; may be empty.
+ * @return True if every frame was written.
+ */
+bool SequenceExporter::run(ModelPart* root, QString* error, const Progress& progress) {
+    stats = Statistics();
+    if (settings.frameRate <= 0 || settings.duration <= 0.0 || settings.width <= 0 || settings.height <= 0) {
+        if (error) *error = "Frame rate, duration and size must be positive";
+        return false;
+    }
+    if (!QDir().mkpath(settings.directory)) {
+        if (error) *error = "Could not create " + settings.directory;
+        return false;
+    }
+    const QDir directory(settings.directory);
+    const int frames = std::max(1, static_cast<int>(std::lround(settings.frameRate * settings.duration)));
+    // Encoding runs as analysis on the shared scheduler, so it cannot take more threads than
+    // analysis may, and leaves the scheduler's reserved thread to interactive work
+    TaskScheduler* scheduler = TaskScheduler::instance();
+    const int allowed = std::min(scheduler->concurrencyLimit(TaskScheduler::Analysis), scheduler->backgroundLimit());
+    const int encoders = settings.encoders > 0 ? std::min(settings.encoders, allowed) : allowed;
+    const int quality = 100 - std::clamp(settings.compression, 0, 100);
+    stats.encoders = encoders;
+
+    std::vector<ExplodedPart> parts;
+    double centre[3] = { 0.0, 0.0, 0.0 };
+    if (settings.explode > 0.0) {
+        collectExplodedParts(root, parts);
+        double bounds[6] = { VTK_DOUBLE_MAX, -VTK_DOUBLE_MAX, VTK_DOUBLE_MAX, -VTK_DOUBLE_MAX, VTK_DOUBLE_MAX, -VTK_DOUBLE_MAX };
+        for (const ExplodedPart& entry : parts) {
+            for (int i = 0; i < 3; ++i) {
+                bounds[2 * i] = std::min(bounds[2 * i], entry.centre[i]);
+                bounds[2 * i + 1] = std::max(bounds[2 * i + 1], entry.centre[i]);
+            }
+        }
+        for (int i = 0; i < 3 && !parts.empty(); ++i) {
+            centre[i] = (bounds[2 * i] + bounds[2 * i + 1]) / 2.0;
+        }
+    }
+
+    SceneRenderer scene;
+    scene.setRoot(root);
+    vtkNew<vtkRenderWindow> renderWindow;
+    renderWindow->SetOffScreenRendering(1);
+    renderWindow->SetMultiSamples(std::max(0, settings.samples));
+    renderWindow->SetSize(settings.width, settings.height);
+    renderWindow->AddRenderer(scene.getRenderer());
+
+    // Frame the fully exploded scene, so nothing leaves the picture as it spreads
+    applyExplosion(parts, centre, settings.explode);
+    vtkRenderer* renderer = scene.getRenderer();
+    renderer->ResetCamera();
+    renderer->GetActiveCamera()->Elevation(settings.elevation);
+    renderer->GetActiveCamera()->OrthogonalizeViewUp();
+    vtkNew<vtkCamera> startCamera;
+    startCamera->DeepCopy(renderer->GetActiveCamera());
+
+    QSemaphore queueSlots(encoders); // A slot per frame posted and not yet written
+    QMutex errorMutex;
+    QString encodeError;
+    std::atomic<bool> failed(false);
+    std::atomic<qint64> bytes(0), encodeNs(0);
+
+    double renderMs = 0.0, readbackMs = 0.0, stallMs = 0.0;
+    bool cancelled = false;
+    int rendered = 0;
+    QElapsedTimer total, timer;
+    total.start();
+    for (int frame = 0; frame < frames && !failed && !cancelled; ++frame) {
+        // The pose is computed from the frame number alone, so rounding does not accumulate
+        const double time = static_cast<double>(frame) / settings.frameRate;
+        const double fraction = frames > 1 ? static_cast<double>(frame) / (frames - 1) : 1.0;
+        if (!parts.empty()) {
+            const double eased = fraction * fraction * (3.0 - 2.0 * fraction);
+            applyExplosion(parts, centre, settings.explode * eased);
+        }
+        vtkCamera* camera = renderer->GetActiveCamera();
+        camera->DeepCopy(startCamera);
+        camera->Azimuth(settings.turntableDegrees * time / settings.duration);
+        renderer->ResetCameraClippingRange();
+
+        timer.start();
+        renderWindow->Render();
+        renderWindow->WaitForCompletion();
+        renderMs += timer.nsecsElapsed() / 1e6;
+
+        timer.restart();
+        vtkSmartPointer<vtkUnsignedCharArray> pixels = vtkSmartPointer<vtkUnsignedCharArray>::New();
+        renderWindow->GetPixelData(0, 0, settings.width - 1, settings.height - 1, 1, pixels);
+        readbackMs += timer.nsecsElapsed() / 1e6;
+
+        timer.restart();
+        queueSlots.acquire();
+        stallMs += timer.nsecsElapsed() / 1e6;
+
+        const QString fileName = directory.filePath(QString("%1%2.png").arg(settings.prefix).arg(frame, 5, 10, QChar('0')));
+        const int width = settings.width;
+        const int height = settings.height;
+        scheduler->post(TaskScheduler::Analysis, [&, pixels, fileName, width, height] {
+            QElapsedTimer encodeTimer;
+            encodeTimer.start();
+            // VTK returns bottom-up rows; mirrored() flips them and makes a copy the writer owns
+            const QImage image = QImage(pixels->GetPointer(0), width, height, width * 3, QImage::Format_RGB888).mirrored();
+            QImageWriter writer(fileName, "png");
+            writer.setQuality(quality);
+            if (writer.write(image)) {
+                bytes += QFileInfo(fileName).size();
+            }
+            else if (!failed.exchange(true)) {
+                QMutexLocker lock(&errorMutex);
+                encodeError = fileName + ": " + writer.errorString();
+            }
+            encodeNs += encodeTimer.nsecsElapsed();
+            queueSlots.release();
+        }, CancellationToken(), [&, fileName] {
+            if (!failed.exchange(true)) {
+                QMutexLocker lock(&errorMutex);
+                encodeError = fileName + ": not written, the task scheduler is shutting down";
+            }
+            queueSlots.release();
+        });
+        ++rendered;
+
+        if (progress && !progress(frame + 1, frames)) {
+            cancelled = true;
+        }
+    }
+    queueSlots.acquire(encoders); // Every frame posted has been written once all slots are back
+    const double seconds = total.nsecsElapsed() / 1e9;
+
+    for (const ExplodedPart& entry : parts) {
+        setLocalMatrix(entry.part, entry.local);
+    }
+    scene.setRoot(nullptr);
+
+    stats.frames = rendered;
+    stats.seconds = seconds;
+    stats.framesPerSecond = seconds > 0.0 ? stats.frames / seconds : 0.0;
+    if (rendered > 0) {
+        stats.renderMs = renderMs / rendered;
+        stats.readbackMs = readbackMs / rendered;
+        stats.encodeMs = encodeNs / 1e6 / rendered;
+    }
+    stats.stallMs = stallMs;
+    stats.bytes = bytes;
+
+    if (failed) {
+        if (error) *error = encodeError;
+        return false;
+    }
+    if (cancelled) {
+        if (error) *error = "Cancelled";
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Returns how the last run went.
+ *
+ * @return Frame rate, timings and output size of the last run().
+ */
+SequenceExporter::Statistics SequenceExporter::statistics() const {
+    return stats;
+}
@@ -0,0 +1,66 @@
+/**
+ * @file SequenceExporter.h
+ *
+ * Defines the SequenceExporter class, which renders turntable and exploded-view animations offscreen
+ * to numbered PNG files. The animation advances by a fixed timestep per frame, so the result does
+ * not depend on how fast the machine renders. Compressing and writing the images happens as
+ * analysis tasks on the shared TaskScheduler while the next frames are rendered; the renderer only
+ * waits when as many frames as there are encoders are still being written.
+ */
+
+#ifndef VIEWER_SEQUENCEEXPORTER_H
+#define VIEWER_SEQUENCEEXPORTER_H
+
+#include <QString>
+#include <functional>
+#include "ModelPart.h"
+
+/**
+ * @class SequenceExporter
+ * @brief Renders an animated part tree frame by frame to an image sequence.
+ */
+class SequenceExporter {
+public:
+    /** What to render and where to write it. */
+    struct Settings {
+        QString directory; ///< Directory the frames are written to; created if missing.
+        QString prefix = "frame_"; ///< File name prefix; frames are named prefix00000.png and so on.
+        int width = 1920; ///< Frame width in pixels.
+        int height = 1080; ///< Frame height in pixels.
+        int frameRate = 30; ///< Frames per second of animation time; sets the timestep.
+        double duration = 12.0; ///< Length of the animation in seconds.
+        double turntableDegrees = 360.0; ///< Camera rotation about the scene's vertical axis over the animation.
+        double elevation = 20.0; ///< Camera elevation above the floor, in degrees.
+        double explode = 0.0; ///< Exploded-view spread reached at the end, as a multiple of each part's distance from the centre.
+        int samples = 8; ///< Multisamples per pixel for antialiasing; 0 disables it.
+        int encoders = 0; ///< Frames encoded at once; 0, or more than the scheduler allows analysis, for its limit.
+        int compression = 50; ///< PNG compression from 0 (fast, large) to 100 (slow, small).
+    };
+
+    /** How the export went. */
+    struct Statistics {
+        int frames = 0; ///< Frames written.
+        double seconds = 0.0; ///< Wall time from the first render to the last file written.
+        double framesPerSecond = 0.0; ///< Frames written per second of wall time.
+        double renderMs = 0.0; ///< Mean time to render a frame.
+        double readbackMs = 0.0; ///< Mean time to copy a frame from the GPU.
+        double encodeMs = 0.0; ///< Mean time for an encoder to compress and write a frame.
+        double stallMs = 0.0; ///< Total time the renderer waited for a free encoder.
+        qint64 bytes = 0; ///< Total size of the files written.
+        int encoders = 0; ///< Frames encoded at once.
+    };
+
+    /** Called after each frame is rendered with its index and the frame count; return false to cancel. */
+    using Progress = std::function<bool(int frame, int frames)>;
+
+    explicit SequenceExporter(const Settings& settings);
+
+    bool run(ModelPart* root, QString* error = nullptr, const Progress& progress = Progress());
+    Statistics statistics() const;
+
+private:
+    Settings settings; ///< What to render and where.
+    Statistics stats; ///< Result of the last run().
+};
+
+#endif // VIEWER_SEQUENCEEXPORTER_H
@@ -0,0 +1,458 @@
+/**
+ * @file ShadowCache.cpp
+ * @brief Implementation of the ShadowCache class.
+ */
+
+#include "ShadowCache.h"
+#include <vtkLightCollection.h>
+#include <vtkMatrix4x4.h>
+#include <vtkObjectFactory.h>
+#include <vtkPolyDataMapper.h>
+#include <vtkProp.h>
+#include <vtkProperty.h>
+#include <vtkRenderPassCollection.h>
+#include <vtkRenderState.h>
+#include <vtkRenderStepsPass.h>
+#include <vtkSequencePass.h>
+#include <vtkShadowMapBakerPass.h>
+#include <vtkShadowMapPass.h>
+#include <vtkTexture.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace {
+
+const int kContactResolution = 256; ///< Contact shadow texels along the longer side of the scene.
+const int kContactBlurRadius = 3; ///< Box blur radius, in texels; two passes approximate a Gaussian.
+const double kContactFalloff = 0.1; ///< Height, as a fraction of the scene footprint, at which contact darkness drops to 1/e.
+const double kContactMargin = 0.1; ///< Border around the parts' footprint, as a fraction of its size, left for the blur.
+const unsigned char kContactOpacity = 160; ///< Alpha of the darkest contact shadow texel.
+
+/**
+ * Runs a vtkShadowMapBakerPass only when the scene has changed.
+ *
+ * The shadow maps stay in the baker's textures between frames, and vtkShadowMapPass reads them
+ * from there whether or not they were redrawn this frame.
+ */
+class CachedShadowBakerPass : public vtkRenderPass {
+public:
+    static CachedShadowBakerPass* New();
+    vtkTypeMacro(CachedShadowBakerPass, vtkRenderPass);
+
+    void Render(const vtkRenderState* s) override;
+    void ReleaseGraphicsResources(vtkWindow* w) override;
+
+    vtkSmartPointer<vtkShadowMapBakerPass> Baker; ///< Pass that draws the shadow maps.
+    ShadowCache::Statistics* Stats = nullptr; ///< Counters updated on every frame.
+    bool Valid = false; ///< Whether the baker's maps match Signature and PropCount.
+
+protected:
+    CachedShadowBakerPass() = default;
+
+private:
+    vtkMTimeType Signature = 0; ///< Latest prop or light modification time at the last bake.
+    int PropCount = 0; ///< Number of props drawn at the last bake.
+};
+
+vtkStandardNewMacro(CachedShadowBakerPass);
+
+/**
+ * Bakes the shadow maps if any prop or light was modified since the last bake.
+ *
+ * A prop's modification time covers its transform, so moving or hiding a part causes a bake while
+ * moving the camera does not. Occlusion culling changes which actors are drawn, so frames where the
+ * culled set changes bake too.
+ *
+ * @param s Render state of the frame.
+ */
+void CachedShadowBakerPass::Render(const vtkRenderState* s) {
+    ++Stats->frames;
+    NumberOfRenderedProps = 0;
+
+    vtkMTimeType signature = 0;
+    for (int i = 0; i < s->GetPropArrayCount(); ++i) {
+        signature = std::max(signature, s->GetPropArray()[i]->GetMTime());
+    }
+    vtkLightCollection* lights = s->GetRenderer()->GetLights();
+    vtkCollectionSimpleIterator it;
+    lights->InitTraversal(it);
+    while (vtkLight* light = lights->GetNextLight(it)) {
+        signature = std::max(signature, light->GetMTime());
+    }
+    if (Valid && signature == Signature && s->GetPropArrayCount() == PropCount)
+        return;
+
+    auto start = std::chrono::steady_clock::now();
+    Baker->Render(s);
+    NumberOfRenderedProps = Baker->GetNumberOfRenderedProps();
+    Signature = signature;
+    PropCount = s->GetPropArrayCount();
+    Valid = true;
+    ++Stats->bakes;
+    Stats->lastBakeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * Releases the shadow map textures; the next frame bakes them again.
+ *
+ * @param w Window whose graphics resources are released.
+ */
+void CachedShadowBakerPass::ReleaseGraphicsResources(vtkWindow* w) {
+    Baker->ReleaseGraphicsResources(w);
+    Valid = false;
+}
+
+/**
+ * Creates a fixed directional scene light.
+ *
+ * @param from Direction the light shines from.
+ * @param intensity Light intensity.
+ * @return The light.
+ */
+vtkSmartPointer<vtkLight> makeSceneLight(const double from[3], double intensity) {
+    auto light = vtkSmartPointer<vtkLight>::New();
+    light->SetLightTypeToSceneLight();
+    light->PositionalOff();
+    light->SetPosition(from[0], from[1], from[2]);
+    light->SetFocalPoint(0.0, 0.0, 0.0);
+    light->SetIntensity(intensity);
+    return light;
+}
+
+/**
+ * Blurs a single-channel image in place with a box filter along rows then columns.
+ *
+ * @param image Values, row by row.
+ * @param width Image width.
+ * @param height Image height.
+ * @param radius Filter radius in texels.
+ */
+void boxBlur(std::vector<float>& image, int width, int height, int radius) {
+    std::vector<float> line(std::max(width, height));
+    const float scale = 1.0f / static_cast<float>(2 * radius + 1);
+    auto blurLine = [&](float* data, int count, int stride) {
+        for (int i = 0; i < count; ++i) line[i] = data[static_cast<size_t>(i) * stride];
+        float sum = 0.0f;
+        for (int i = -radius; i <= radius; ++i) sum += line[std::clamp(i, 0, count - 1)];
+        for (int i = 0; i < count; ++i) {
+            data[static_cast<size_t>(i) * stride] = sum * scale;
+            sum += line[std::min(i + radius + 1, count - 1)] - line[std::max(i - radius, 0)];
+        }
+    };
+    for (int y = 0; y < height; ++y) blurLine(image.data() + static_cast<size_t>(y) * width, width, 1);
+    for (int x = 0; x < width; ++x) blurLine(image.data() + x, height, width);
+}
+
+/**
+ * Collects the visible parts with geometry in a subtree.
+ *
+ * @param part Root of the subtree.
+ * @param parts Receives the parts.
+ */
+void collectShadowCasters(ModelPart* part, std::vector<ModelPart*>& parts) {
+    if (!part->effectiveVisible())
+        return;
+    if (part->getActor())
+        parts.push_back(part);
+    for (int i = 0; i < part->childCount(); ++i) {
+        collectShadowCasters(part->child(i), parts);
+    }
+}
+
+} // namespace
+
+/**
+ * Constructs a shadow cache for a renderer, with shadows and the contact shadow off.
+ *
+ * @param renderer Renderer to draw shadows in.
+ */
+ShadowCache::ShadowCache(vtkRenderer* renderer)
+    : renderer(renderer), savedAutomaticLights(true), contactEnabled(false), floorHeight(0.0), contactSignature(0) {
+    auto cachedBaker = vtkSmartPointer<CachedShadowBakerPass>::New();
+    cachedBaker->Stats = &stats;
+    cachedBaker->Baker = vtkSmartPointer<vtkShadowMapBakerPass>::New();
+    cachedBaker->Baker->SetResolution(2048);
+
+    auto shadowMapPass = vtkSmartPointer<vtkShadowMapPass>::New();
+    shadowMapPass->SetShadowMapBakerPass(cachedBaker->Baker);
+
+    // The usual render steps with shadowed opaque geometry, so translucent props such as the contact shadow still draw
+    auto steps = vtkSmartPointer<vtkRenderStepsPass>::New();
+    steps->SetOpaquePass(shadowMapPass);
+
+    auto passes = vtkSmartPointer<vtkRenderPassCollection>::New();
+    passes->AddItem(cachedBaker);
+    passes->AddItem(steps);
+    auto sequence = vtkSmartPointer<vtkSequencePass>::New();
+    sequence->SetPasses(passes);
+    shadowPass = sequence;
+    baker = cachedBaker;
+
+    // Key light from above and to one side casts the visible shadows; the fill keeps their far side readable
+    const double key[3] = { 1.0, -1.5, 3.0 };
+    const double fill[3] = { -1.0, 1.0, 1.0 };
+    rig.push_back(makeSceneLight(key, 0.8));
+    rig.push_back(makeSceneLight(fill, 0.3));
+
+    contactPlane = vtkSmartPointer<vtkPlaneSource>::New();
+    contactImage = vtkSmartPointer<vtkImageData>::New();
+    auto texture = vtkSmartPointer<vtkTexture>::New();
+    texture->SetInputData(contactImage);
+    texture->InterpolateOn();
+    texture->SetColorModeToDirectScalars();
+    auto mapper = vtkSmartPointer<vtkPolyDataMapper>::New();
+    mapper->SetInputConnection(contactPlane->GetOutputPort());
+    contactActor = vtkSmartPointer<vtkActor>::New();
+    contactActor->SetMapper(mapper);
+    contactActor->SetTexture(texture);
+    contactActor->GetProperty()->SetLighting(false);
+    contactActor->PickableOff();
+    contactActor->VisibilityOff();
+}
+
+/**
+ * Restores the renderer's own passes, lights and props.
+ */
+ShadowCache::~ShadowCache() {
+    setShadows(false);
+    setContactShadow(false);
+}
+
+/**
+ * Turns the shadow maps on or off.
+ *
+ * While on, the renderer draws through the shadow passes and is lit by a fixed scene light rig in
+ * place of its own lights, which are put back when shadows are turned off.
+ *
+ * @param enabled Whether parts cast shadows.
+ */
+void ShadowCache::setShadows(bool enabled) {
+    if (enabled == shadows())
+        return;
+
+    vtkLightCollection* lights = renderer->GetLights();
+    if (enabled) {
+        savedAutomaticLights = renderer->GetAutomaticLightCreation();
+        savedLights.clear();
+        vtkCollectionSimpleIterator it;
+        lights->InitTraversal(it);
+        while (vtkLight* light = lights->GetNextLight(it)) {
+            savedLights.push_back(light);
+        }
+        renderer->RemoveAllLights();
+        renderer->AutomaticLightCreationOff();
+        for (vtkLight* light : rig) {
+            renderer->AddLight(light);
+        }
+        static_cast<CachedShadowBakerPass*>(baker.GetPointer())->Valid = false;
+        renderer->SetPass(shadowPass);
+    } else {
+        renderer->SetPass(nullptr);
+        renderer->RemoveAllLights();
+        for (vtkLight* light : savedLights) {
+            renderer->AddLight(light);
+        }
+        savedLights.clear();
+        renderer->SetAutomaticLightCreation(savedAutomaticLights);
+    }
+}
+
+/**
+ * Checks whether shadow maps are on.
+ *
+ * @return True if the renderer draws through the shadow passes.
+ */
+bool ShadowCache::shadows() const {
+    return renderer->GetPass() == shadowPass.GetPointer();
+}
+
+/**
+ * Turns the contact shadow on or off.
+ *
+ * @param enabled Whether the floor is darkened under the parts.
+ */
+void ShadowCache::setContactShadow(bool enabled) {
+    if (enabled == contactEnabled)
+        return;
+    contactEnabled = enabled;
+    contactSignature = 0;
+    if (enabled) {
+        renderer->AddActor(contactActor);
+    } else {
+        renderer->RemoveActor(contactActor);
+    }
+}
+
+/**
+ * Checks whether the contact shadow is on.
+ *
+ * @return True if the floor is darkened under the parts.
+ */
+bool ShadowCache::contactShadow() const {
+    return contactEnabled;
+}
+
+/**
+ * Sets the height of the floor the contact shadow is drawn on.
+ *
+ * @param z Floor height.
+ */
+void ShadowCache::setFloorHeight(double z) {
+    if (z == floorHeight)
+        return;
+    floorHeight = z;
+    contactSignature = 0;
+}
+
+/**
+ * Forces the shadow maps and the contact shadow to be rebuilt on the next frame, for changes
+ * that do not show in a prop's modification time.
+ */
+void ShadowCache::invalidate() {
+    static_cast<CachedShadowBakerPass*>(baker.GetPointer())->Valid = false;
+    contactSignature = 0;
+}
+
+/**
+ * Adds the contact shadow back to the renderer after its props were cleared, and rebuilds it
+ * for the new scene.
+ */
+void ShadowCache::restoreActors() {
+    contactSignature = 0;
+    if (contactEnabled) {
+        renderer->AddActor(contactActor);
+    }
+}
+
+/**
+ * Rebuilds the contact shadow if the scene changed since it was built.
+ *
+ * Called before each frame. The scene node's modification time includes every part below it and
+ * their transforms and visibility, so checking it is cheap next to rasterising.
+ *
+ * @param root Root of the part tree, or nullptr for an empty scene.
+ */
+void ShadowCache::update(ModelPart* root) {
+    if (!contactEnabled)
+        return;
+    if (!root) {
+        contactActor->VisibilityOff();
+        return;
+    }
+    const vtkMTimeType signature = root->getNode()->GetMTime();
+    if (signature == contactSignature)
+        return;
+    contactSignature = signature;
+    bakeContactShadow(root);
+}
+
+/**
+ * Retrieves the rebuild counts.
+ *
+ * @return The statistics.
+ */
+ShadowCache::Statistics ShadowCache::statistics() const {
+    return stats;
+}
+
+/**
+ * Rasterises the parts' occluder meshes onto a grid over the floor.
+ *
+ * Each triangle darkens the texels it covers by how close its lowest point is to the floor, so
+ * parts resting on the floor leave a dark footprint and parts far above leave none; triangles
+ * too high to matter are skipped before rasterising. The grid is blurred to soften the edges.
+ *
+ * @param root Root of the part tree.
+ */
+void ShadowCache::bakeContactShadow(ModelPart* root) {
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<ModelPart*> parts;
+    collectShadowCasters(root, parts);
+
+    // World-space triangles, transformed with each actor's matrix
+    std::vector<float> triangles;
+    double bounds[4] = { 1e300, -1e300, 1e300, -1e300 };
+    for (ModelPart* part : parts) {
+        const std::vector<float>& mesh = part->getOccluderMesh();
+        vtkMatrix4x4* matrix = part->getActor()->GetMatrix();
+        for (size_t i = 0; i + 2 < mesh.size(); i += 3) {
+            const double local[4] = { mesh[i], mesh[i + 1], mesh[i + 2], 1.0 };
+            double world[4];
+            matrix->MultiplyPoint(local, world);
+            triangles.insert(triangles.end(), { static_cast<float>(world[0]), static_cast<float>(world[1]), static_cast<float>(world[2]) });
+            bounds[0] = std::min(bounds[0], world[0]);
+            bounds[1] = std::max(bounds[1], world[0]);
+            bounds[2] = std::min(bounds[2], world[1]);
+            bounds[3] = std::max(bounds[3], world[1]);
+        }
+    }
+    if (triangles.empty()) {
+        contactActor->VisibilityOff();
+        return;
+    }
+
+    const double size = std::max({ bounds[1] - bounds[0], bounds[3] - bounds[2], 1e-6 });
+    const double margin = kContactMargin * size;
+    const double x0 = bounds[0] - margin, y0 = bounds[2] - margin;
+    const double texel = (size + 2.0 * margin) / kContactResolution;
+    const int width = std::max(1, static_cast<int>(std::ceil((bounds[1] - bounds[0] + 2.0 * margin) / texel)));
+    const int height = std::max(1, static_cast<int>(std::ceil((bounds[3] - bounds[2] + 2.0 * margin) / texel)));
+    const double falloff = kContactFalloff * size;
+
+    std::vector<float> darkness(static_cast<size_t>(width) * height, 0.0f);
+    for (size_t t = 0; t + 8 < triangles.size(); t += 9) {
+        const float* v = &triangles[t];
+        const double lowest = std::min({ v[2], v[5], v[8] }) - floorHeight;
+        const float strength = static_cast<float>(std::exp(-std::max(lowest, 0.0) / falloff));
+        if (strength < 0.02f)
+            continue;
+
+        // Vertices in texel units; pixel centres inside the triangle are covered
+        const double ax = (v[0] - x0) / texel, ay = (v[1] - y0) / texel;
+        const double bx = (v[3] - x0) / texel, by = (v[4] - y0) / texel;
+        const double cx = (v[6] - x0) / texel, cy = (v[7] - y0) / texel;
+        const double area = (bx - ax) * (cy - ay) - (by - ay) * (cx - ax);
+        if (area == 0.0)
+            continue;
+        const int minX = std::max(0, static_cast<int>(std::floor(std::min({ ax, bx, cx }))));
+        const int maxX = std::min(width - 1, static_cast<int>(std::ceil(std::max({ ax, bx, cx }))));
+        const int minY = std::max(0, static_cast<int>(std::floor(std::min({ ay, by, cy }))));
+        const int maxY = std::min(height - 1, static_cast<int>(std::ceil(std::max({ ay, by, cy }))));
+        for (int y = minY; y <= maxY; ++y) {
+            const double py = y + 0.5;
+            for (int x = minX; x <= maxX; ++x) {
+                const double px = x + 0.5;
+                const double w0 = ((bx - px) * (cy - py) - (by - py) * (cx - px)) / area;
+                const double w1 = ((cx - px) * (ay - py) - (cy - py) * (ax - px)) / area;
+                const double w2 = 1.0 - w0 - w1;
+                if (w0 < 0.0 || w1 < 0.0 || w2 < 0.0)
+                    continue;
+                float& texelValue = darkness[static_cast<size_t>(y) * width + x];
+                texelValue = std::max(texelValue, strength);
+            }
+        }
+    }
+    boxBlur(darkness, width, height, kContactBlurRadius);
+    boxBlur(darkness, width, height, kContactBlurRadius);
+
+    contactImage->SetDimensions(width, height, 1);
+    contactImage->AllocateScalars(VTK_UNSIGNED_CHAR, 4);
+    unsigned char* pixels = static_cast<unsigned char*>(contactImage->GetScalarPointer());
+    for (size_t i = 0; i < darkness.size(); ++i) {
+        pixels[4 * i] = pixels[4 * i + 1] = pixels[4 * i + 2] = 0;
+        pixels[4 * i + 3] = static_cast<unsigned char>(std::min(darkness[i], 1.0f) * kContactOpacity);
+    }
+    contactImage->Modified();
+
+    // Just above the floor so it is not lost to depth fighting with it
+    const double z = floorHeight + 1e-3 * size;
+    contactPlane->SetOrigin(x0, y0, z);
+    contactPlane->SetPoint1(x0 + width * texel, y0, z);
+    contactPlane->SetPoint2(x0, y0 + height * texel, z);
+    contactActor->VisibilityOn();
+
+    ++stats.contactBakes;
+    stats.lastContactMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
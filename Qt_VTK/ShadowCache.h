@@ -0,0 +1,75 @@
+/**
+ * @file ShadowCache.h
+ *
+ * Defines the ShadowCache class, which adds shadows to a renderer without paying for them every
+ * frame. Shadow maps are rendered by VTK's shadow map passes, but the baking step is wrapped in a
+ * pass that only runs it when a prop or light has been modified since the last bake: shadows from
+ * fixed scene lights do not depend on the camera, so orbiting or flying through a static scene
+ * reuses the maps, and VR renders both eyes from one bake. The check is a walk over modification
+ * times, with no drawing.
+ *
+ * The optional contact shadow is a soft dark patch on the floor under the parts, rasterised on the
+ * CPU from the parts' coarse occluder meshes, blurred and shown as a texture just above the floor.
+ * It too is rebuilt only when the scene changes.
+ */
+
+#ifndef VIEWER_SHADOWCACHE_H
+#define VIEWER_SHADOWCACHE_H
+
+#include <vector>
+#include <vtkActor.h>
+#include <vtkImageData.h>
+#include <vtkLight.h>
+#include <vtkPlaneSource.h>
+#include <vtkRenderPass.h>
+#include <vtkRenderer.h>
+#include <vtkSmartPointer.h>
+#include "ModelPart.h"
+
+/**
+ * @class ShadowCache
+ * @brief Cached shadow maps and a baked contact shadow for one renderer.
+ */
+class ShadowCache {
+public:
+    /** How often the shadows had to be rebuilt. */
+    struct Statistics {
+        int frames = 0; ///< Frames drawn with shadow maps on.
+        int bakes = 0; ///< Frames that re-rendered the shadow maps.
+        double lastBakeMs = 0.0; ///< Time of the last shadow map bake.
+        int contactBakes = 0; ///< Contact shadow rebuilds.
+        double lastContactMs = 0.0; ///< Time of the last contact shadow rebuild.
+    };
+
+    explicit ShadowCache(vtkRenderer* renderer);
+    ~ShadowCache();
+
+    void setShadows(bool enabled);
+    bool shadows() const;
+    void setContactShadow(bool enabled);
+    bool contactShadow() const;
+    void setFloorHeight(double z);
+    void invalidate();
+    void restoreActors();
+    void update(ModelPart* root);
+    Statistics statistics() const;
+
+private:
+    void bakeContactShadow(ModelPart* root);
+
+    vtkRenderer* renderer; ///< Renderer the shadows are drawn in; it must outlive this object.
+    vtkSmartPointer<vtkRenderPass> shadowPass; ///< Sequence of the cached baker and the render steps with shadowed opaque geometry.
+    vtkSmartPointer<vtkRenderPass> baker; ///< The pass that skips baking while nothing has changed.
+    std::vector<vtkSmartPointer<vtkLight>> savedLights; ///< The renderer's own lights, restored when shadows are turned off.
+    bool savedAutomaticLights; ///< The renderer's automatic light creation setting before shadows.
+    std::vector<vtkSmartPointer<vtkLight>> rig; ///< Fixed scene lights that cast the shadows.
+    bool contactEnabled; ///< Whether the contact shadow is drawn.
+    double floorHeight; ///< Height of the floor the contact shadow lies on.
+    vtkMTimeType contactSignature; ///< Scene modification time the contact shadow was built for.
+    vtkSmartPointer<vtkPlaneSource> contactPlane; ///< Quad carrying the contact shadow texture.
+    vtkSmartPointer<vtkImageData> contactImage; ///< Contact shadow darkness as RGBA, black with varying alpha.
+    vtkSmartPointer<vtkActor> contactActor; ///< Draws the contact shadow.
+    Statistics stats; ///< Rebuild counts; the baker pass updates the shadow map fields.
+};
+
+#endif // VIEWER_SHADOWCACHE_H
@@ -0,0 +1,116 @@
+/**
+ * @file SharedMesh.cpp
+ * @brief Implementation of the SharedMesh class.
+ */
+
+#include "SharedMesh.h"
+#include <cstring>
+#include <limits>
+
+namespace {
+
+/** Rounds an offset up to the next cache line, which also satisfies any SIMD load alignment. */
+uint64_t alignUp(uint64_t offset) {
+    return (offset + 63) & ~uint64_t(63);
+}
+
+} // namespace
+
+/**
+ * Computes where each array of a mesh of the given size is placed in its segment.
+ *
+ * @param pointCount The number of points.
+ * @param triangleCount The number of triangles.
+ * @return A header with every offset and the total size filled in.
+ */
+SharedMeshHeader SharedMesh::layout(uint64_t pointCount, uint64_t triangleCount) {
+    SharedMeshHeader header = {};
+    header.magic = SharedMeshHeader::kMagic;
+    header.version = SharedMeshHeader::kVersion;
+    header.pointCount = pointCount;
+    header.triangleCount = triangleCount;
+    header.pointsOffset = alignUp(sizeof(SharedMeshHeader));
+    header.offsetsOffset = alignUp(header.pointsOffset + pointCount * 3 * sizeof(float));
+    header.connectivityOffset = alignUp(header.offsetsOffset + (triangleCount + 1) * sizeof(int32_t));
+    header.size = header.connectivityOffset + triangleCount * 3 * sizeof(int32_t);
+    return header;
+}
+
+/**
+ * Creates a segment under the segment's key and copies a mesh into it. The caller must keep the
+ * segment attached until the reader has attached to it too, or the system may remove it.
+ *
+ * @param mesh The mesh to write.
+ * @param segment A segment with its key set and not yet created.
+ * @param error Receives a description of the failure; may be nullptr.
+ * @return True if the mesh was written.
+ */
+bool SharedMesh::write(const StlMesh& mesh, QSharedMemory& segment, QString* error) {
+    const uint64_t pointCount = mesh.points.size() / 3;
+    const uint64_t triangleCount = mesh.triangles.size() / 3;
+    if (mesh.triangles.size() >= static_cast<uint64_t>(std::numeric_limits<int32_t>::max())) {
+        if (error) *error = QString("%1 triangles exceed the 32-bit index limit").arg(triangleCount);
+        return false;
+    }
+
+    const SharedMeshHeader header = layout(pointCount, triangleCount);
+    if (!segment.create(static_cast<qsizetype>(header.size))) {
+        if (error) *error = "Could not create shared memory: " + segment.errorString();
+        return false;
+    }
+    if (static_cast<uint64_t>(segment.size()) < header.size) { // Qt 5 limits segments to 2 GB
+        if (error) *error = QString("Mesh of %1 bytes is too large for shared memory").arg(header.size);
+        segment.detach();
+        return false;
+    }
+
+    char* base = static_cast<char*>(segment.data());
+    std::memcpy(base, &header, sizeof(header));
+    std::memcpy(base + header.pointsOffset, mesh.points.data(), mesh.points.size() * sizeof(float));
+    int32_t* offsets = reinterpret_cast<int32_t*>(base + header.offsetsOffset);
+    for (uint64_t i = 0; i <= triangleCount; ++i) {
+        offsets[i] = static_cast<int32_t>(i * 3);
+    }
+    std::memcpy(base + header.connectivityOffset, mesh.triangles.data(), mesh.triangles.size() * sizeof(uint32_t));
+    return true;
+}
+
+/**
+ * Checks that a mapped segment holds a mesh in the expected layout and that every array fits
+ * inside it, so a corrupt or truncated segment is rejected before anything reads from it.
+ *
+ * @param data Start of the mapped segment.
+ * @param size Size of the mapped segment in bytes.
+ * @param error Receives a description of the problem; may be nullptr.
+ * @return True if the segment can be read as a mesh.
+ */
+bool SharedMesh::validate(const void* data, qint64 size, QString* error) {
+    if (!data || size < static_cast<qint64>(sizeof(SharedMeshHeader))) {
+        if (error) *error = "Shared mesh segment is too small";
+        return false;
+    }
+
+    SharedMeshHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    if (header.magic != SharedMeshHeader::kMagic || header.version != SharedMeshHeader::kVersion) {
+        if (error) *error = "Shared mesh segment has an unknown format";
+        return false;
+    }
+
+    const uint64_t limit = static_cast<uint64_t>(std::numeric_limits<int32_t>::max());
+    const SharedMeshHeader expected = layout(header.pointCount, header.triangleCount);
+    if (header.pointCount > limit || header.triangleCount * 3 >= limit
+        || std::memcmp(&header, &expected, sizeof(header)) != 0 || header.size > static_cast<uint64_t>(size)) {
+        if (error) *error = "Shared mesh segment header is inconsistent";
+        return false;
+    }
+
+    const int32_t* connectivity = reinterpret_cast<const int32_t*>(static_cast<const char*>(data) + header.connectivityOffset);
+    for (uint64_t i = 0; i < header.triangleCount * 3; ++i) {
+        if (connectivity[i] < 0 || static_cast<uint64_t>(connectivity[i]) >= header.pointCount) {
+            if (error) *error = "Shared mesh segment has an out-of-range vertex index";
+            return false;
+        }
+    }
+    return true;
+}
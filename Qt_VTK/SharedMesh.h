@@ -0,0 +1,47 @@
+/**
+ * @file SharedMesh.h
+ *
+ * Defines the layout of a triangle mesh in a shared-memory segment, as written by the loader worker
+ * processes and mapped by the viewer. The arrays are laid out exactly as VTK stores them (float
+ * points, 32-bit cell offsets and connectivity) so the viewer can use the segment as the storage of
+ * its data arrays without copying.
+ */
+
+#ifndef VIEWER_SHAREDMESH_H
+#define VIEWER_SHAREDMESH_H
+
+#include <QSharedMemory>
+#include <QString>
+#include <cstdint>
+#include "StlParser.h"
+
+/**
+ * @struct SharedMeshHeader
+ * @brief Header at the start of a shared mesh segment. Offsets are in bytes from the segment start.
+ */
+struct SharedMeshHeader {
+    static const uint32_t kMagic = 0x4853454d; ///< "MESH" in little-endian byte order.
+    static const uint32_t kVersion = 1; ///< Bumped whenever the layout changes.
+
+    uint32_t magic; ///< Always kMagic.
+    uint32_t version; ///< Always kVersion.
+    uint64_t pointCount; ///< Number of points; the points array holds three floats each.
+    uint64_t triangleCount; ///< Number of triangles.
+    uint64_t pointsOffset; ///< Start of the float point coordinates.
+    uint64_t offsetsOffset; ///< Start of the triangleCount + 1 int32 cell offsets.
+    uint64_t connectivityOffset; ///< Start of the 3 * triangleCount int32 vertex indices.
+    uint64_t size; ///< Total number of bytes used, header included.
+};
+
+/**
+ * @class SharedMesh
+ * @brief Writes meshes into shared memory in the layout described by SharedMeshHeader.
+ */
+class SharedMesh {
+public:
+    static SharedMeshHeader layout(uint64_t pointCount, uint64_t triangleCount);
+    static bool write(const StlMesh& mesh, QSharedMemory& segment, QString* error = nullptr);
+    static bool validate(const void* data, qint64 size, QString* error = nullptr);
+};
+
+#endif // VIEWER_SHAREDMESH_H
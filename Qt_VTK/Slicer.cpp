@@ -0,0 +1,423 @@
+/**
+ * @file Slicer.cpp
+ * @brief Implementation of the Slicer class.
+ */
+
+#include "Slicer.h"
+#include <QElapsedTimer>
+#include <QFile>
+#include <QThread>
+#include <vtkCellArray.h>
+#include <vtkFloatArray.h>
+#include <vtkIdTypeArray.h>
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <vtkPoints.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include "GeometryKernels.h"
+#include "TaskScheduler.h"
+
+namespace {
+
+/** One triangle's cut through a layer, oriented with the material on its left. */
+struct Segment {
+    float ax, ay, bx, by;
+};
+
+/**
+ * Packs a point's exact bit pattern into a key, so segment ends can be matched without tolerance.
+ */
+uint64_t pointKey(float x, float y) {
+    x += 0.0f; // Turns -0 into +0
+    y += 0.0f;
+    uint32_t xb, yb;
+    std::memcpy(&xb, &x, 4);
+    std::memcpy(&yb, &y, 4);
+    return static_cast<uint64_t>(xb) << 32 | yb;
+}
+
+/**
+ * Where an edge crosses the plane. The endpoints are put in a fixed order first, so the two
+ * triangles sharing the edge compute exactly the same point.
+ */
+void edgeCrossing(const float* p, const float* q, double z, float& x, float& y) {
+    if (std::lexicographical_compare(q, q + 3, p, p + 3)) std::swap(p, q);
+    const double t = (z - p[2]) / (static_cast<double>(q[2]) - p[2]);
+    x = static_cast<float>(p[0] + t * (static_cast<double>(q[0]) - p[0]));
+    y = static_cast<float>(p[1] + t * (static_cast<double>(q[1]) - p[1]));
+}
+
+/**
+ * Intersects a triangle with the plane at height z. Vertices on the plane count as above it, so
+ * a plane through a vertex or an edge still yields one segment per crossing and a triangle lying
+ * in the plane yields none.
+ *
+ * @return True if the triangle crosses the plane.
+ */
+bool intersect(const float* v0, const float* v1, const float* v2, double z, Segment& segment) {
+    const float* v[3] = { v0, v1, v2 };
+    const bool above[3] = { v0[2] >= z, v1[2] >= z, v2[2] >= z };
+    if (above[0] == above[1] && above[1] == above[2])
+        return false;
+
+    float x[2], y[2];
+    int found = 0;
+    for (int i = 0; i < 3; ++i) {
+        const int j = (i + 1) % 3;
+        if (above[i] != above[j]) {
+            edgeCrossing(v[i], v[j], z, x[found], y[found]);
+            ++found;
+        }
+    }
+
+    // Travel along z x normal, which keeps the inside of the solid on the left
+    const double e1[2] = { static_cast<double>(v1[0]) - v0[0], static_cast<double>(v1[1]) - v0[1] };
+    const double e2[2] = { static_cast<double>(v2[0]) - v0[0], static_cast<double>(v2[1]) - v0[1] };
+    const double e1z = static_cast<double>(v1[2]) - v0[2], e2z = static_cast<double>(v2[2]) - v0[2];
+    const double nx = e1[1] * e2z - e1z * e2[1];
+    const double ny = e1z * e2[0] - e1[0] * e2z;
+    if ((x[1] - x[0]) * -ny + (y[1] - y[0]) * nx < 0) {
+        std::swap(x[0], x[1]);
+        std::swap(y[0], y[1]);
+    }
+    segment = { x[0], y[0], x[1], y[1] };
+    return true;
+}
+
+/**
+ * Joins a layer's segments end to end into contours. Chains with a loose start are walked first,
+ * so open contours come out whole; everything left over is a closed loop.
+ */
+void stitch(const std::vector<Segment>& segments, std::vector<Slicer::Contour>& contours) {
+    const size_t count = segments.size();
+    std::vector<std::pair<uint64_t, uint32_t>> starts(count);
+    std::vector<uint64_t> ends(count);
+    for (size_t i = 0; i < count; ++i) {
+        starts[i] = { pointKey(segments[i].ax, segments[i].ay), static_cast<uint32_t>(i) };
+        ends[i] = pointKey(segments[i].bx, segments[i].by);
+    }
+    std::sort(starts.begin(), starts.end());
+    std::vector<uint64_t> sortedEnds = ends;
+    std::sort(sortedEnds.begin(), sortedEnds.end());
+
+    std::vector<char> used(count, 0);
+    auto nextFrom = [&](uint64_t key) -> int64_t {
+        auto it = std::lower_bound(starts.begin(), starts.end(), std::make_pair(key, uint32_t(0)));
+        for (; it != starts.end() && it->first == key; ++it) {
+            if (!used[it->second]) return it->second;
+        }
+        return -1;
+    };
+    auto walk = [&](size_t first) {
+        Slicer::Contour contour;
+        const uint64_t startKey = pointKey(segments[first].ax, segments[first].ay);
+        contour.points.push_back(segments[first].ax);
+        contour.points.push_back(segments[first].ay);
+        int64_t s = static_cast<int64_t>(first);
+        while (s >= 0) {
+            used[s] = 1;
+            if (ends[s] == startKey) {
+                contour.closed = true;
+                break;
+            }
+            contour.points.push_back(segments[s].bx);
+            contour.points.push_back(segments[s].by);
+            s = nextFrom(ends[s]);
+        }
+        if (contour.closed) {
+            double area = 0.0; // Shoelace formula; positive for counter-clockwise loops
+            const size_t n = contour.points.size() / 2;
+            for (size_t i = 0; i < n; ++i) {
+                const size_t j = (i + 1) % n;
+                area += static_cast<double>(contour.points[2 * i]) * contour.points[2 * j + 1]
+                    - static_cast<double>(contour.points[2 * j]) * contour.points[2 * i + 1];
+            }
+            contour.outer = area > 0.0;
+        }
+        if (contour.points.size() >= 4) {
+            contours.push_back(std::move(contour));
+        }
+    };
+
+    for (size_t i = 0; i < count; ++i) {
+        const uint64_t start = starts[i].first;
+        if (!used[starts[i].second] && !std::binary_search(sortedEnds.begin(), sortedEnds.end(), start)) {
+            walk(starts[i].second);
+        }
+    }
+    for (size_t i = 0; i < count; ++i) {
+        if (!used[i]) walk(i);
+    }
+}
+
+} // namespace
+
+/**
+ * Adds a mesh to be sliced.
+ *
+ * @param points Vertex coordinates, x, y, z per vertex.
+ * @param pointCount The number of vertices.
+ * @param triangles Vertex indices, three per triangle.
+ * @param triangleCount The number of triangles.
+ * @param matrix Row-major transform to world coordinates; nullptr for none.
+ */
+void Slicer::addMesh(const float* points, size_t pointCount, const uint32_t* triangles, size_t triangleCount, const double matrix[16]) {
+    const size_t base = this->points.size() / 3;
+    this->points.resize((base + pointCount) * 3);
+    if (matrix) {
+        GeometryKernels::transformPoints(points, this->points.data() + base * 3, pointCount, matrix);
+    }
+    else {
+        std::copy(points, points + pointCount * 3, this->points.begin() + base * 3);
+    }
+
+    const size_t first = this->triangles.size();
+    this->triangles.resize(first + triangleCount * 3);
+    for (size_t i = 0; i < triangleCount * 3; ++i) {
+        this->triangles[first + i] = static_cast<uint32_t>(base + triangles[i]);
+    }
+}
+
+/**
+ * Adds the geometry of a part and its descendants in world coordinates. Hidden parts are skipped.
+ *
+ * @param part The root of the subtree to add.
+ */
+void Slicer::addPart(ModelPart* part) {
+    if (!part || !part->effectiveVisible())
+        return;
+
+    if (vtkPolyData* polyData = part->getPolyData()) {
+        std::vector<float> coordinates;
+        std::vector<uint32_t> indices;
+        ModelPart::extractMesh(polyData, coordinates, indices);
+        addMesh(coordinates.data(), coordinates.size() / 3, indices.data(), indices.size() / 3,
+            part->getTransform()->GetMatrix()->GetData());
+    }
+    for (int i = 0; i < part->childCount(); ++i) {
+        addPart(part->child(i));
+    }
+}
+
+/**
+ * Gets the number of triangles added so far.
+ *
+ * @return The number of triangles.
+ */
+size_t Slicer::triangleCount() const {
+    return triangles.size() / 3;
+}
+
+/**
+ * Cuts the meshes at heights spacing / 2, 3 * spacing / 2, ... above their lowest point.
+ *
+ * @param spacing Distance between layers, in model units.
+ * @return The layers from the bottom up.
+ */
+std::vector<Slicer::Layer> Slicer::slice(double spacing) {
+    stats = Statistics();
+    const size_t triangleTotal = triangles.size() / 3;
+    stats.triangles = triangleTotal;
+    if (triangleTotal == 0 || !(spacing > 0.0))
+        return {};
+
+    QElapsedTimer timer;
+    timer.start();
+    double bounds[6];
+    GeometryKernels::bounds(points.data(), points.size() / 3, bounds);
+    const double zMin = bounds[4];
+    const int layerCount = static_cast<int>(std::max(0.0, std::ceil((bounds[5] - zMin) / spacing - 0.5)));
+    std::vector<Layer> layers(layerCount);
+    for (int k = 0; k < layerCount; ++k) {
+        layers[k].z = zMin + (k + 0.5) * spacing;
+    }
+    stats.layers = layerCount;
+    if (layerCount == 0)
+        return layers;
+
+    // Layers each triangle crosses, widened by one either way; intersect() makes the exact test
+    std::vector<int> firstLayer(triangleTotal), lastLayer(triangleTotal);
+    std::vector<uint32_t> bucketStart(layerCount + 1, 0);
+    for (size_t t = 0; t < triangleTotal; ++t) {
+        const float* v0 = &points[triangles[3 * t] * 3];
+        const float* v1 = &points[triangles[3 * t + 1] * 3];
+        const float* v2 = &points[triangles[3 * t + 2] * 3];
+        const double lo = std::min({ v0[2], v1[2], v2[2] });
+        const double hi = std::max({ v0[2], v1[2], v2[2] });
+        firstLayer[t] = std::max(0, static_cast<int>(std::floor((lo - zMin) / spacing - 0.5)));
+        lastLayer[t] = std::min(layerCount - 1, static_cast<int>(std::floor((hi - zMin) / spacing - 0.5)) + 1);
+        if (lo == hi || firstLayer[t] > lastLayer[t]) {
+            lastLayer[t] = -1; // Flat or out of range: never crosses a plane
+            continue;
+        }
+        ++bucketStart[firstLayer[t] + 1];
+    }
+    for (int k = 0; k < layerCount; ++k) {
+        bucketStart[k + 1] += bucketStart[k];
+    }
+    std::vector<uint32_t> order(bucketStart[layerCount]);
+    std::vector<uint32_t> fill(bucketStart.begin(), bucketStart.end() - 1);
+    for (size_t t = 0; t < triangleTotal; ++t) {
+        if (lastLayer[t] >= 0) order[fill[firstLayer[t]]++] = static_cast<uint32_t>(t);
+    }
+
+    // Bands of consecutive layers for the workers; triangles spanning a band boundary are carried in
+    const int bandCount = std::min(layerCount, std::max(1, QThread::idealThreadCount()) * 8);
+    std::vector<int> bandStart(bandCount + 1);
+    for (int b = 0; b <= bandCount; ++b) {
+        bandStart[b] = static_cast<int>(static_cast<long long>(b) * layerCount / bandCount);
+    }
+    std::vector<std::vector<uint32_t>> carried(bandCount);
+    for (uint32_t t : order) {
+        int band = static_cast<int>(std::upper_bound(bandStart.begin(), bandStart.end(), firstLayer[t]) - bandStart.begin()) - 1;
+        for (++band; band < bandCount && bandStart[band] <= lastLayer[t]; ++band) {
+            carried[band].push_back(t);
+        }
+    }
+    stats.sortMs = timer.nsecsElapsed() / 1e6;
+
+    timer.restart();
+    std::atomic<size_t> segmentTotal(0), contourTotal(0), openTotal(0);
+    std::vector<int> bands(bandCount);
+    for (int b = 0; b < bandCount; ++b) bands[b] = b;
+    TaskScheduler::instance()->blockingMap(TaskScheduler::Analysis, bands, [&](int band) {
+        std::vector<uint32_t> active = carried[band];
+        std::vector<Segment> segments;
+        size_t bandSegments = 0, bandContours = 0, bandOpen = 0;
+        for (int k = bandStart[band]; k < bandStart[band + 1]; ++k) {
+            active.insert(active.end(), order.begin() + bucketStart[k], order.begin() + bucketStart[k + 1]);
+            segments.clear();
+            for (size_t i = 0; i < active.size();) {
+                const uint32_t t = active[i];
+                if (lastLayer[t] < k) {
+                    active[i] = active.back();
+                    active.pop_back();
+                    continue;
+                }
+                Segment segment;
+                if (intersect(&points[triangles[3 * t] * 3], &points[triangles[3 * t + 1] * 3], &points[triangles[3 * t + 2] * 3], layers[k].z, segment)) {
+                    segments.push_back(segment);
+                }
+                ++i;
+            }
+            stitch(segments, layers[k].contours);
+            bandSegments += segments.size();
+            bandContours += layers[k].contours.size();
+            for (const Contour& contour : layers[k].contours) {
+                bandOpen += !contour.closed;
+            }
+        }
+        segmentTotal += bandSegments;
+        contourTotal += bandContours;
+        openTotal += bandOpen;
+        });
+    stats.sliceMs = timer.nsecsElapsed() / 1e6;
+    stats.segments = segmentTotal;
+    stats.contours = contourTotal;
+    stats.openContours = openTotal;
+    return layers;
+}
+
+/**
+ * Returns what the last slice() did.
+ *
+ * @return Counts and timings of the last slice().
+ */
+Slicer::Statistics Slicer::statistics() const {
+    return stats;
+}
+
+/**
+ * Writes layers in the ASCII Common Layer Interface format read by most additive manufacturing
+ * build processors. Coordinates are written in model units with a unit size of 1 mm.
+ *
+ * @param fileName The file to write.
+ * @param layers The layers.
+ * @param error Receives a description of the failure; may be nullptr.
+ * @return True if the file was written.
+ */
+bool Slicer::writeCli(const QString& fileName, const std::vector<Layer>& layers, QString* error) {
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        if (error) *error = file.errorString();
+        return false;
+    }
+
+    std::string text = "$$HEADERSTART\n$$ASCII\n$$UNITS/1.0\n$$VERSION/200\n$$LAYERS/" + std::to_string(layers.size()) + "\n$$HEADEREND\n$$GEOMETRYSTART\n";
+    char number[32];
+    for (const Layer& layer : layers) {
+        std::snprintf(number, sizeof(number), "%.6f", layer.z);
+        text += "$$LAYER/";
+        text += number;
+        text += '\n';
+        for (const Contour& contour : layer.contours) {
+            // Direction: 0 clockwise (hole), 1 counter-clockwise (outer), 2 open; closed polylines repeat their first point
+            const size_t n = contour.points.size() / 2;
+            const int direction = !contour.closed ? 2 : contour.outer ? 1 : 0;
+            text += "$$POLYLINE/1," + std::to_string(direction) + "," + std::to_string(n + (contour.closed ? 1 : 0));
+            for (size_t i = 0; i <= n; ++i) {
+                if (i == n && !contour.closed) break;
+                std::snprintf(number, sizeof(number), ",%.5f,%.5f", contour.points[2 * (i % n)], contour.points[2 * (i % n) + 1]);
+                text += number;
+            }
+            text += '\n';
+        }
+        if (text.size() > (1 << 20)) {
+            if (file.write(text.data(), static_cast<qint64>(text.size())) != static_cast<qint64>(text.size())) {
+                if (error) *error = file.errorString();
+                return false;
+            }
+            text.clear();
+        }
+    }
+    text += "$$GEOMETRYEND\n";
+    if (file.write(text.data(), static_cast<qint64>(text.size())) != static_cast<qint64>(text.size())) {
+        if (error) *error = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Converts layers to VTK polylines for previewing in the viewport.
+ *
+ * @param layers The layers.
+ * @param every Only every this many layers are included, to keep dense stacks readable.
+ * @return Lines at each layer's height.
+ */
+vtkSmartPointer<vtkPolyData> Slicer::toPolyData(const std::vector<Layer>& layers, int every) {
+    vtkNew<vtkFloatArray> coordinates;
+    coordinates->SetNumberOfComponents(3);
+    vtkNew<vtkIdTypeArray> offsets;
+    vtkNew<vtkIdTypeArray> connectivity;
+    offsets->InsertNextValue(0);
+    vtkIdType pointId = 0;
+    for (size_t k = 0; k < layers.size(); k += std::max(1, every)) {
+        const float z = static_cast<float>(layers[k].z);
+        for (const Contour& contour : layers[k].contours) {
+            const vtkIdType first = pointId;
+            for (size_t i = 0; i + 1 < contour.points.size(); i += 2) {
+                const float p[3] = { contour.points[i], contour.points[i + 1], z };
+                coordinates->InsertNextTypedTuple(p);
+                connectivity->InsertNextValue(pointId++);
+            }
+            if (contour.closed) {
+                connectivity->InsertNextValue(first);
+            }
+            offsets->InsertNextValue(connectivity->GetNumberOfValues());
+        }
+    }
+
+    vtkNew<vtkPoints> pointSet;
+    pointSet->SetData(coordinates);
+    vtkNew<vtkCellArray> lines;
+    lines->SetData(offsets, connectivity);
+    vtkSmartPointer<vtkPolyData> polyData = vtkSmartPointer<vtkPolyData>::New();
+    polyData->SetPoints(pointSet);
+    polyData->SetLines(lines);
+    return polyData;
+}
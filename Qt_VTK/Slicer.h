@@ -0,0 +1,72 @@
+/**
+ * @file Slicer.h
+ *
+ * Defines the Slicer class, which cuts meshes into horizontal layers for additive manufacturing.
+ * Each layer's cross-section is returned as contour polylines in the XY plane: closed loops for
+ * watertight input, outer boundaries counter-clockwise and holes clockwise.
+ *
+ * Triangles are bucketed by the first layer they cross, so a sweep upwards through the layers only
+ * has to add the triangles starting at each layer and drop the ones that have ended. The layers
+ * are divided into bands that are swept in parallel. Each triangle crossing a layer contributes
+ * one oriented segment. The segments are joined end to end, so shared edges must produce
+ * bit-identical crossing points, which they do because every crossing is computed from its edge's
+ * endpoints in a fixed order.
+ */
+
+#ifndef VIEWER_SLICER_H
+#define VIEWER_SLICER_H
+
+#include <QString>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <vtkSmartPointer.h>
+#include <vtkPolyData.h>
+#include "ModelPart.h"
+
+/**
+ * @class Slicer
+ * @brief Computes layer contours of a set of meshes at a fixed Z spacing.
+ */
+class Slicer {
+public:
+    /** A polyline in one layer. */
+    struct Contour {
+        std::vector<float> points; ///< x, y per vertex; a closed contour does not repeat its first vertex.
+        bool closed = false; ///< Whether the last vertex joins the first.
+        bool outer = false; ///< Whether a closed contour runs counter-clockwise, bounding material from outside.
+    };
+
+    /** The cross-section at one height. */
+    struct Layer {
+        double z = 0.0; ///< Height of the cutting plane.
+        std::vector<Contour> contours; ///< Contours at this height.
+    };
+
+    /** What the last slice() did. */
+    struct Statistics {
+        size_t triangles = 0; ///< Triangles sliced.
+        size_t segments = 0; ///< Triangle-plane intersections.
+        int layers = 0; ///< Layers computed.
+        size_t contours = 0; ///< Contours in all layers.
+        size_t openContours = 0; ///< Contours that did not close; non-zero for meshes with holes.
+        double sortMs = 0.0; ///< Time to bucket the triangles by layer.
+        double sliceMs = 0.0; ///< Time to intersect and join segments.
+    };
+
+    void addMesh(const float* points, size_t pointCount, const uint32_t* triangles, size_t triangleCount, const double matrix[16] = nullptr);
+    void addPart(ModelPart* part);
+    size_t triangleCount() const;
+    std::vector<Layer> slice(double spacing);
+    Statistics statistics() const;
+
+    static bool writeCli(const QString& fileName, const std::vector<Layer>& layers, QString* error = nullptr);
+    static vtkSmartPointer<vtkPolyData> toPolyData(const std::vector<Layer>& layers, int every = 1);
+
+private:
+    std::vector<float> points; ///< World coordinates of every mesh added, x, y, z per vertex.
+    std::vector<uint32_t> triangles; ///< Vertex indices into points, three per triangle.
+    Statistics stats; ///< Result of the last slice().
+};
+
+#endif // VIEWER_SLICER_H
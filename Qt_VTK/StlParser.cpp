@@ -0,0 +1,230 @@
+/**
+ * @file StlParser.cpp
+ * @brief Implementation of the StlParser class.
+ *
+ * A file is treated as binary when its size matches the triangle count in the binary header,
+ * otherwise as ASCII when it starts with "solid". Some exporters write binary files whose header
+ * also starts with "solid", so the size check is done first.
+ */
+
+#include "StlParser.h"
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_map>
+
+namespace {
+
+const size_t kBinaryHeaderSize = 84; ///< 80-byte comment plus 32-bit triangle count.
+const size_t kBinaryTriangleSize = 50; ///< Normal, three vertices and a 16-bit attribute.
+
+/**
+ * Merges bit-identical vertices into a single indexed vertex.
+ */
+class VertexWelder {
+public:
+    VertexWelder(StlMesh& mesh, size_t expectedVertices) : m_mesh(mesh) {
+        m_indices.reserve(expectedVertices);
+        m_mesh.points.reserve(expectedVertices * 3);
+    }
+
+    uint32_t add(float x, float y, float z) {
+        // Adding zero turns -0.0 into +0.0 so both spellings weld together
+        Key key = { x + 0.0f, y + 0.0f, z + 0.0f };
+        auto inserted = m_indices.emplace(key, static_cast<uint32_t>(m_mesh.points.size() / 3));
+        if (inserted.second) {
+            m_mesh.points.insert(m_mesh.points.end(), { key.x, key.y, key.z });
+        }
+        return inserted.first->second;
+    }
+
+private:
+    struct Key {
+        float x, y, z;
+        bool operator==(const Key& other) const {
+            return std::memcmp(this, &other, sizeof(Key)) == 0;
+        }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const {
+            uint32_t bits[3];
+            std::memcpy(bits, &key, sizeof(bits));
+            uint64_t h = 1469598103934665603ull;
+            for (uint32_t b : bits) {
+                h = (h ^ b) * 1099511628211ull;
+            }
+            return static_cast<size_t>(h ^ (h >> 29));
+        }
+    };
+
+    StlMesh& m_mesh;
+    std::unordered_map<Key, uint32_t, KeyHash> m_indices;
+};
+
+uint32_t readUint32(const char* p) {
+    const unsigned char* b = reinterpret_cast<const unsigned char*>(p);
+    return uint32_t(b[0]) | (uint32_t(b[1]) << 8) | (uint32_t(b[2]) << 16) | (uint32_t(b[3]) << 24);
+}
+
+float readFloat(const char* p) {
+    uint32_t bits = readUint32(p);
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/**
+ * Minimal whitespace tokenizer over a buffer that need not be null-terminated.
+ */
+class Tokenizer {
+public:
+    Tokenizer(const char* data, size_t size) : m_pos(data), m_end(data + size) {}
+
+    bool next(const char*& token, size_t& length) {
+        while (m_pos < m_end && std::isspace(static_cast<unsigned char>(*m_pos))) ++m_pos;
+        if (m_pos >= m_end) return false;
+        token = m_pos;
+        while (m_pos < m_end && !std::isspace(static_cast<unsigned char>(*m_pos))) ++m_pos;
+        length = static_cast<size_t>(m_pos - token);
+        return true;
+    }
+
+    bool nextFloat(float& value) {
+        const char* token;
+        size_t length;
+        if (!next(token, length) || length >= 64) return false;
+        char buffer[64];
+        std::memcpy(buffer, token, length);
+        buffer[length] = '\0';
+        char* end;
+        value = std::strtof(buffer, &end);
+        return end == buffer + length;
+    }
+
+    void skipLine() {
+        while (m_pos < m_end && *m_pos != '\n') ++m_pos;
+    }
+
+private:
+    const char* m_pos;
+    const char* m_end;
+};
+
+bool tokenIs(const char* token, size_t length, const char* keyword) {
+    return std::strlen(keyword) == length && std::strncmp(token, keyword, length) == 0;
+}
+
+} // namespace
+
+/**
+ * Parses an STL file held in memory.
+ *
+ * @param data The file contents.
+ * @param size The number of bytes in data.
+ * @param mesh Receives the indexed mesh; any previous contents are discarded.
+ * @param error Optional; receives a description of the problem if parsing fails.
+ * @return True on success.
+ */
+bool StlParser::parse(const char* data, size_t size, StlMesh& mesh, std::string* error) {
+    mesh.points.clear();
+    mesh.triangles.clear();
+
+    if (isBinary(data, size))
+        return parseBinary(data, size, mesh, error);
+
+    size_t start = 0;
+    while (start < size && std::isspace(static_cast<unsigned char>(data[start]))) ++start;
+    if (size - start >= 5 && std::strncmp(data + start, "solid", 5) == 0)
+        return parseAscii(data, size, mesh, error);
+
+    if (error) *error = "Not an STL file (size does not match binary header and no 'solid' keyword)";
+    return false;
+}
+
+/**
+ * Checks whether a buffer holds a complete binary STL file.
+ *
+ * @param data The file contents.
+ * @param size The number of bytes in data.
+ * @return True if the size matches the triangle count in the binary header.
+ */
+bool StlParser::isBinary(const char* data, size_t size) {
+    if (size < kBinaryHeaderSize)
+        return false;
+    return kBinaryHeaderSize + static_cast<uint64_t>(binaryTriangleCount(data, size)) * kBinaryTriangleSize == size;
+}
+
+/**
+ * Reads the triangle count from a binary STL header.
+ *
+ * @param data The file contents.
+ * @param size The number of bytes in data.
+ * @return The triangle count stored in the header, or 0 if the buffer is too short.
+ */
+uint32_t StlParser::binaryTriangleCount(const char* data, size_t size) {
+    return size < kBinaryHeaderSize ? 0 : readUint32(data + 80);
+}
+
+/**
+ * Parses the triangles of a binary STL file. Facet normals are ignored. A file shorter than its
+ * header's triangle count needs is rejected rather than read past its end.
+ */
+bool StlParser::parseBinary(const char* data, size_t size, StlMesh& mesh, std::string* error) {
+    const uint32_t count = binaryTriangleCount(data, size);
+    if (size < kBinaryHeaderSize || size - kBinaryHeaderSize < static_cast<uint64_t>(count) * kBinaryTriangleSize) {
+        if (error) *error = "Binary STL is truncated (header declares " + std::to_string(count) + " triangles)";
+        return false;
+    }
+    VertexWelder welder(mesh, count / 2 + 3); // Closed meshes have about half as many vertices as triangles
+    mesh.triangles.reserve(static_cast<size_t>(count) * 3);
+
+    const char* facet = data + kBinaryHeaderSize;
+    for (uint32_t t = 0; t < count; ++t, facet += kBinaryTriangleSize) {
+        const char* v = facet + 12;
+        for (int i = 0; i < 3; ++i, v += 12) {
+            mesh.triangles.push_back(welder.add(readFloat(v), readFloat(v + 4), readFloat(v + 8)));
+        }
+    }
+    return true;
+}
+
+/**
+ * Parses the facets of an ASCII STL file. Facets with other than three vertices are rejected.
+ */
+bool StlParser::parseAscii(const char* data, size_t size, StlMesh& mesh, std::string* error) {
+    VertexWelder welder(mesh, size / 200);
+    Tokenizer tokens(data, size);
+    const char* token;
+    size_t length;
+
+    tokens.skipLine(); // "solid <name>"
+    int facetVertices = 0;
+    while (tokens.next(token, length)) {
+        if (tokenIs(token, length, "vertex")) {
+            float x, y, z;
+            if (!tokens.nextFloat(x) || !tokens.nextFloat(y) || !tokens.nextFloat(z)) {
+                if (error) *error = "Malformed vertex in ASCII STL";
+                return false;
+            }
+            mesh.triangles.push_back(welder.add(x, y, z));
+            ++facetVertices;
+        }
+        else if (tokenIs(token, length, "endfacet")) {
+            if (facetVertices != 3) {
+                if (error) *error = "ASCII STL facet does not have three vertices";
+                return false;
+            }
+            facetVertices = 0;
+        }
+        else if (tokenIs(token, length, "endsolid")) {
+            tokens.skipLine(); // Some files hold several solids; keep going
+        }
+    }
+
+    if (facetVertices != 0 || mesh.triangles.empty()) {
+        if (error) *error = "ASCII STL is truncated or has no facets";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,42 @@
+/**
+ * @file StlParser.h
+ *
+ * Defines the StlParser class, which decodes binary and ASCII STL data that is already in memory.
+ * Unlike vtkSTLReader it does not open files itself, so the import path can read files with its own
+ * I/O engine and hand the buffers straight to the parser. Duplicate vertices are merged, matching
+ * the indexed output of vtkSTLReader.
+ */
+
+#ifndef VIEWER_STLPARSER_H
+#define VIEWER_STLPARSER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @struct StlMesh
+ * @brief Indexed triangle mesh produced by StlParser.
+ */
+struct StlMesh {
+    std::vector<float> points; ///< Vertex coordinates, x, y, z per vertex.
+    std::vector<uint32_t> triangles; ///< Vertex indices, three per triangle.
+};
+
+/**
+ * @class StlParser
+ * @brief Parses STL files from memory buffers.
+ */
+class StlParser {
+public:
+    static bool parse(const char* data, size_t size, StlMesh& mesh, std::string* error = nullptr);
+    static bool isBinary(const char* data, size_t size);
+    static uint32_t binaryTriangleCount(const char* data, size_t size);
+
+private:
+    static bool parseBinary(const char* data, size_t size, StlMesh& mesh, std::string* error);
+    static bool parseAscii(const char* data, size_t size, StlMesh& mesh, std::string* error);
+};
+
+#endif // VIEWER_STLPARSER_H
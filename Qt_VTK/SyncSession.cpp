@@ -0,0 +1,1272 @@
+/**
+ * @file SyncSession.cpp
+ * @brief Implementation of the SyncSession and SyncRelay classes.
+ *
+ * Wire format: every message (see MessageFraming.h) is a QDataStream payload whose first byte is the
+ * message type. A frame carries a record count and then records: reset, add, remove, property
+ * update (only the fields that changed, flagged in a bit mask) and camera (likewise).
+ * Parts are identified by numbers the publisher hands out, so records do not depend on row positions.
+ * Meshes are sent MeshCodec-encoded without quantisation, so they arrive bit for bit and the content
+ * hash still checks them; a relay keeps them encoded in its cache.
+ *
+ * Recording format: an 8-byte magic and the protocol version, then one framed entry per message:
+ * the milliseconds since the recording started, 32-bit big-endian, followed by the message. A
+ * recording cut short by a crash replays up to its last complete entry.
+ */
+
+#include "SyncSession.h"
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QFile>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QPointer>
+#include <vtkCamera.h>
+#include <vtkCellArray.h>
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <vtkPoints.h>
+#include <vtkProperty.h>
+#include <vector>
+#include "MeshCodec.h"
+#include "MessageFraming.h"
+
+namespace {
+
+const quint16 kProtocolVersion = 2; ///< Sent in the hello message; peers with another version are refused.
+const int kFrameIntervalMs = 16; ///< Changes are collected for this long and sent as one frame.
+const QDataStream::Version kStreamVersion = QDataStream::Qt_5_12; ///< Serialisation format of payloads.
+const char kRecordingMagic[8] = { 'V', 'W', 'R', 'S', 'E', 'S', 'S', 'N' }; ///< Start of a session recording.
+
+/** First byte of every message. */
+enum MessageType : quint8 {
+    kHello = 1, ///< Follower to publisher: protocol version; asks for a snapshot.
+    kFrame = 2, ///< Publisher to followers: a batch of records.
+    kGeometryRequest = 3, ///< Follower to publisher: hashes of meshes it does not have.
+    kGeometry = 4, ///< Publisher to followers: one mesh and its hash.
+    kEvent = 5, ///< Recordings only: a view setting or VR command, by name.
+};
+
+/** First byte of every record in a frame. */
+enum RecordType : quint8 {
+    kReset = 1, ///< Remove every mirrored part; a snapshot follows.
+    kAdd = 2, ///< A new part with all its properties.
+    kRemove = 3, ///< A part and its children were removed.
+    kUpdate = 4, ///< Changed properties of a part.
+    kCamera = 5, ///< Changed camera parameters.
+};
+
+/** Bits of the field mask of an update record. */
+enum UpdateField : quint8 {
+    kName = 1,
+    kVisible = 2,
+    kColour = 4,
+    kMatrix = 8,
+};
+
+/** Bits of the field mask of a camera record. */
+enum CameraField : quint8 {
+    kPosition = 1,
+    kFocalPoint = 2,
+    kViewUp = 4,
+    kViewAngle = 8,
+};
+
+/**
+ * Returns the type byte of a message without consuming it.
+ */
+quint8 messageType(const QByteArray& message) {
+    return message.isEmpty() ? 0 : static_cast<quint8>(message.at(0));
+}
+
+/**
+ * Content hash of an indexed mesh. Identical meshes loaded from different files get the same hash.
+ */
+QByteArray hashMesh(const std::vector<float>& coordinates, const std::vector<uint32_t>& triangles) {
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(QByteArray::fromRawData(reinterpret_cast<const char*>(coordinates.data()), static_cast<int>(coordinates.size() * sizeof(float))));
+    hash.addData(QByteArray::fromRawData(reinterpret_cast<const char*>(triangles.data()), static_cast<int>(triangles.size() * sizeof(uint32_t))));
+    return hash.result();
+}
+
+/**
+ * Geometry message carrying a mesh and its content hash.
+ */
+QByteArray geometryMessage(const QByteArray& hash, vtkPolyData* polyData) {
+    StlMesh mesh;
+    ModelPart::extractMesh(polyData, mesh.points, mesh.triangles);
+    const std::vector<uint8_t> encoded = MeshCodec::encode(mesh, MeshCodec::kLossless);
+
+    QByteArray message;
+    QDataStream out(&message, QIODevice::WriteOnly);
+    out.setVersion(kStreamVersion);
+    out << quint8(kGeometry) << hash << QByteArray::fromRawData(reinterpret_cast<const char*>(encoded.data()), static_cast<int>(encoded.size()));
+    return message;
+}
+
+/**
+ * Local transform of a part: its world matrix with the parent's world matrix divided out.
+ */
+std::array<double, 16> localMatrix(ModelPart* part) {
+    vtkNew<vtkMatrix4x4> local;
+    local->DeepCopy(part->getTransform()->GetMatrix());
+    if (ModelPart* parent = part->parentItem()) {
+        vtkNew<vtkMatrix4x4> parentInverse;
+        vtkMatrix4x4::Invert(parent->getTransform()->GetMatrix(), parentInverse);
+        vtkMatrix4x4::Multiply4x4(parentInverse, local, local);
+    }
+
+    std::array<double, 16> matrix;
+    std::copy(local->GetData(), local->GetData() + 16, matrix.begin());
+    return matrix;
+}
+
+/**
+ * Replaces the local transform of a part, keeping it chained onto its parent's transform.
+ */
+void setLocalMatrix(ModelPart* part, const std::array<double, 16>& matrix) {
+    vtkTransform* transform = part->getTransform();
+    transform->Identity();
+    transform->Concatenate(matrix.data());
+}
+
+bool isIdentity(const std::array<double, 16>& matrix) {
+    for (int i = 0; i < 16; ++i) {
+        if (matrix[i] != (i % 5 == 0 ? 1.0 : 0.0))
+            return false;
+    }
+    return true;
+}
+
+void writeVector(QDataStream& out, const std::array<double, 3>& v) {
+    out << v[0] << v[1] << v[2];
+}
+
+void readVector(QDataStream& in, std::array<double, 3>& v) {
+    in >> v[0] >> v[1] >> v[2];
+}
+
+} // namespace
+
+/**
+ * Constructs an idle session for a model and its scene. Call publish() or follow() to start it.
+ *
+ * @param model The part tree to publish or mirror into.
+ * @param scene The scene whose camera is published or mirrored.
+ * @param parent The parent QObject.
+ */
+SyncSession::SyncSession(ModelPartList* model, SceneRenderer* scene, QObject* parent)
+    : QObject(parent),
+    model(model),
+    scene(scene),
+    server(nullptr),
+    upstream(nullptr),
+    nextId(1),
+    pendingRecordCount(0),
+    cameraDirty(false),
+    cameraObserver(0),
+    recording(nullptr),
+    replaying(false) {
+    modifiedCallback = vtkSmartPointer<vtkCallbackCommand>::New();
+    modifiedCallback->SetCallback(&SyncSession::onObservedModified);
+    modifiedCallback->SetClientData(this);
+
+    frameTimer.setSingleShot(true);
+    frameTimer.setInterval(kFrameIntervalMs);
+    connect(&frameTimer, &QTimer::timeout, this, &SyncSession::flushFrame);
+
+    connect(model, &QAbstractItemModel::rowsInserted, this, &SyncSession::onRowsInserted);
+    connect(model, &QAbstractItemModel::rowsAboutToBeRemoved, this, &SyncSession::onRowsAboutToBeRemoved);
+    connect(model, &QAbstractItemModel::dataChanged, this, &SyncSession::onDataChanged);
+}
+
+/**
+ * Ends the session, closing all connections.
+ */
+SyncSession::~SyncSession() {
+    stop();
+}
+
+/**
+ * Starts publishing this viewer's scene under a local socket name.
+ *
+ * @param name The socket name followers connect to.
+ * @param error Receives a description of the failure; may be nullptr.
+ * @return True if the session is listening.
+ */
+bool SyncSession::publish(const QString& name, QString* error) {
+    stop();
+
+    server = new QLocalServer(this);
+    QLocalServer::removeServer(name); // Clear a socket left behind by a crashed publisher
+    if (!server->listen(name)) {
+        if (error) *error = server->errorString();
+        delete server;
+        server = nullptr;
+        return false;
+    }
+    connect(server, &QLocalServer::newConnection, this, &SyncSession::onNewConnection);
+
+    ModelPart* root = model->getRootItem();
+    for (int i = 0; i < root->childCount(); ++i) {
+        registerSubtree(root->child(i));
+    }
+    cameraObserver = scene->getRenderer()->GetActiveCamera()->AddObserver(vtkCommand::ModifiedEvent, modifiedCallback);
+    emit statusMessage(QString("Publishing scene as \"%1\"").arg(name));
+    return true;
+}
+
+/**
+ * Starts mirroring the scene of a publisher. The local tree is replaced by the publisher's.
+ *
+ * @param name The socket name of the publisher or of a relay.
+ * @param error Receives a description of the failure; may be nullptr.
+ * @return True if the session is connected.
+ */
+bool SyncSession::follow(const QString& name, QString* error) {
+    stop();
+
+    upstream = new QLocalSocket(this);
+    upstream->connectToServer(name);
+    if (!upstream->waitForConnected(3000)) {
+        if (error) *error = upstream->errorString();
+        delete upstream;
+        upstream = nullptr;
+        return false;
+    }
+    QLocalSocket* socket = upstream;
+    connect(socket, &QLocalSocket::readyRead, this, [this, socket] { onReadyRead(socket); });
+    connect(socket, &QLocalSocket::disconnected, this, [this] {
+        emit statusMessage("Lost connection to the publishing viewer");
+        });
+
+    QByteArray hello;
+    QDataStream out(&hello, QIODevice::WriteOnly);
+    out.setVersion(kStreamVersion);
+    out << quint8(kHello) << kProtocolVersion;
+    MessageFraming::send(upstream, hello);
+    emit statusMessage(QString("Following scene \"%1\"").arg(name));
+    return true;
+}
+
+/**
+ * Starts recording this viewer's scene to a file: a snapshot of the current scene, then every
+ * change as it would be published, until stop(). Replaces a session in progress.
+ *
+ * @param fileName The recording to write; an existing file is overwritten.
+ * @param error Receives a description of the failure; may be nullptr.
+ * @return True if the recording started.
+ */
+bool SyncSession::record(const QString& fileName, QString* error) {
+    stop();
+
+    recording = new QFile(fileName, this);
+    if (!recording->open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        if (error) *error = recording->errorString();
+        delete recording;
+        recording = nullptr;
+        return false;
+    }
+    char version[2];
+    qToBigEndian<quint16>(kProtocolVersion, version);
+    recording->write(kRecordingMagic, sizeof(kRecordingMagic));
+    recording->write(version, sizeof(version));
+
+    ModelPart* root = model->getRootItem();
+    for (int i = 0; i < root->childCount(); ++i) {
+        registerSubtree(root->child(i));
+    }
+    cameraObserver = scene->getRenderer()->GetActiveCamera()->AddObserver(vtkCommand::ModifiedEvent, modifiedCallback);
+    recordingClock.start();
+    writeRecord(snapshot());
+    emit statusMessage(QString("Recording session to %1").arg(fileName));
+    return true;
+}
+
+/**
+ * Records a view setting or VR command, after the changes collected so far, so a replay applies
+ * it between the same frames. Does nothing unless recording.
+ *
+ * @param name What was set, e.g. "occlusionCulling".
+ * @param value The new value.
+ */
+void SyncSession::recordEvent(const QString& name, const QVariant& value) {
+    if (!recording)
+        return;
+
+    flushFrame();
+    QByteArray message;
+    QDataStream out(&message, QIODevice::WriteOnly);
+    out.setVersion(kStreamVersion);
+    out << quint8(kEvent) << name << value;
+    writeRecord(message);
+}
+
+/**
+ * Closes all connections and forgets the session state. Mirrored parts stay in the tree.
+ */
+void SyncSession::stop() {
+    if (recording) {
+        flushFrame(); // The last changes would otherwise be lost with the timer
+    }
+    frameTimer.stop();
+    if (cameraObserver) {
+        scene->getRenderer()->GetActiveCamera()->RemoveObserver(cameraObserver);
+        cameraObserver = 0;
+    }
+    for (auto it = ids.constBegin(); it != ids.constEnd(); ++it) {
+        it.key()->getTransform()->RemoveObserver(transformObservers.value(it.value()));
+    }
+
+    // Closing the connections below emits disconnected(); the handlers must not run by then
+    if (server) {
+        for (QLocalSocket* socket : server->findChildren<QLocalSocket*>()) {
+            socket->disconnect(this);
+        }
+    }
+    if (upstream) {
+        upstream->disconnect(this);
+    }
+    delete server; // Also deletes the follower connections it accepted
+    server = nullptr;
+    delete upstream;
+    upstream = nullptr;
+    peers.clear();
+    readBuffers.clear();
+    delete recording; // Flushes and closes the file
+    recording = nullptr;
+    recordedGeometry.clear();
+
+    ids.clear();
+    parts.clear();
+    sentState.clear();
+    partGeometry.clear();
+    geometryByHash.clear();
+    transformIds.clear();
+    transformObservers.clear();
+    pendingRecords.clear();
+    pendingRecordCount = 0;
+    dirtyParts.clear();
+    cameraDirty = false;
+
+    remoteParts.clear();
+    remoteIds.clear();
+    awaitingGeometry.clear();
+    replaying = false;
+}
+
+/**
+ * @return True while publishing to followers or recording.
+ */
+bool SyncSession::isPublishing() const {
+    return server != nullptr || recording != nullptr;
+}
+
+/**
+ * @return True while following a publisher or replaying a recording.
+ */
+bool SyncSession::isFollowing() const {
+    return upstream != nullptr || replaying;
+}
+
+/**
+ * @return True while recording to a file.
+ */
+bool SyncSession::isRecording() const {
+    return recording != nullptr;
+}
+
+/**
+ * Reads a session recording written by record().
+ *
+ * @param fileName The recording.
+ * @param messages Receives the messages in the order they were recorded.
+ * @param error Receives a description of the failure; may be nullptr.
+ * @return False if the file cannot be read or is not a recording of this protocol version.
+ */
+bool SyncSession::loadRecording(const QString& fileName, QList<RecordedMessage>& messages, QString* error) {
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        if (error) *error = file.errorString();
+        return false;
+    }
+    const QByteArray data = file.readAll();
+    const int headerSize = sizeof(kRecordingMagic) + 2;
+    if (data.size() < headerSize || !data.startsWith(QByteArray::fromRawData(kRecordingMagic, sizeof(kRecordingMagic)))) {
+        if (error) *error = "Not a session recording";
+        return false;
+    }
+    const quint16 version = qFromBigEndian<quint16>(data.constData() + sizeof(kRecordingMagic));
+    if (version != kProtocolVersion) {
+        if (error) *error = QString("Recorded with protocol version %1; this viewer reads version %2").arg(version).arg(kProtocolVersion);
+        return false;
+    }
+
+    // Entries are read in place; a truncated last entry ends the recording
+    messages.clear();
+    qint64 offset = headerSize;
+    while (offset + 9 <= data.size()) {
+        const quint32 size = qFromBigEndian<quint32>(data.constData() + offset);
+        if (size < 5 || size > MessageFraming::kMaxMessageSize || offset + 4 + size > data.size())
+            break;
+        RecordedMessage entry;
+        entry.timeMs = qFromBigEndian<quint32>(data.constData() + offset + 4);
+        entry.message = data.mid(static_cast<int>(offset + 8), static_cast<int>(size - 4));
+        const quint8 type = messageType(entry.message);
+        entry.kind = type == kGeometry ? RecordedGeometry : type == kEvent ? RecordedEvent : RecordedFrame;
+        if (type == kFrame || type == kGeometry || type == kEvent) {
+            messages.append(entry);
+        }
+        offset += 4 + size;
+    }
+    return true;
+}
+
+/**
+ * Prepares to replay a recording into the tree, which is cleared by the recording's first frame.
+ * Ends a session in progress.
+ */
+void SyncSession::beginReplay() {
+    stop();
+    replaying = true;
+}
+
+/**
+ * Applies one recorded message, as a follower applies a message from its publisher. Meshes come
+ * from the recording itself, so nothing is requested.
+ *
+ * @param message A message from loadRecording().
+ */
+void SyncSession::replay(const QByteArray& message) {
+    if (replaying) {
+        handleMessage(nullptr, message);
+    }
+}
+
+/**
+ * Accepts follower connections. A follower receives frames once it has said hello.
+ */
+void SyncSession::onNewConnection() {
+    while (QLocalSocket* socket = server->nextPendingConnection()) {
+        connect(socket, &QLocalSocket::readyRead, this, [this, socket] { onReadyRead(socket); });
+        connect(socket, &QLocalSocket::disconnected, this, [this, socket] {
+            peers.removeAll(socket);
+            readBuffers.remove(socket);
+            socket->deleteLater();
+            emit statusMessage(QString("Sync follower disconnected, %1 remaining").arg(peers.size()));
+            });
+    }
+}
+
+/**
+ * Publishes parts added to the tree, children included.
+ *
+ * @param parent The index under which rows were inserted.
+ * @param first The first inserted row.
+ * @param last The last inserted row.
+ */
+void SyncSession::onRowsInserted(const QModelIndex& parent, int first, int last) {
+    if (!isPublishing())
+        return;
+
+    ModelPart* parentPart = model->getItem(parent);
+    QDataStream records(&pendingRecords, QIODevice::WriteOnly | QIODevice::Append);
+    records.setVersion(kStreamVersion);
+    for (int row = first; row <= last; ++row) {
+        ModelPart* part = parentPart->child(row);
+        registerSubtree(part);
+        writeSubtree(part, records, pendingRecordCount);
+    }
+    scheduleFrame();
+}
+
+/**
+ * Publishes the removal of parts, or on a follower stops mirroring parts the user removed locally.
+ *
+ * @param parent The index under which rows are about to be removed.
+ * @param first The first row to be removed.
+ * @param last The last row to be removed.
+ */
+void SyncSession::onRowsAboutToBeRemoved(const QModelIndex& parent, int first, int last) {
+    ModelPart* parentPart = model->getItem(parent);
+    if (upstream || replaying) {
+        for (int row = first; row <= last; ++row) {
+            forgetSubtree(parentPart->child(row));
+        }
+        return;
+    }
+    if (!isPublishing())
+        return;
+
+    QDataStream records(&pendingRecords, QIODevice::WriteOnly | QIODevice::Append);
+    records.setVersion(kStreamVersion);
+    for (int row = first; row <= last; ++row) {
+        ModelPart* part = parentPart->child(row);
+        if (ids.contains(part)) {
+            records << quint8(kRemove) << ids.value(part);
+            ++pendingRecordCount;
+            unregisterSubtree(part);
+        }
+    }
+    scheduleFrame();
+}
+
+/**
+ * Marks parts whose tree row changed, so the next frame sends whichever properties differ.
+ *
+ * @param topLeft The first changed index.
+ * @param bottomRight The last changed index.
+ */
+void SyncSession::onDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight) {
+    if (!isPublishing())
+        return;
+
+    for (int row = topLeft.row(); row <= bottomRight.row(); ++row) {
+        ModelPart* part = model->getItem(topLeft.sibling(row, 0));
+        if (ids.contains(part)) {
+            dirtyParts.insert(ids.value(part));
+        }
+    }
+    scheduleFrame();
+}
+
+/**
+ * VTK callback for modifications of the camera and of part transforms.
+ *
+ * @param caller The camera or transform that was modified.
+ * @param eventId The event ID (unused).
+ * @param clientData The SyncSession.
+ * @param callData Event data (unused).
+ */
+void SyncSession::onObservedModified(vtkObject* caller, unsigned long eventId, void* clientData, void* callData) {
+    Q_UNUSED(eventId);
+    Q_UNUSED(callData);
+    SyncSession* session = static_cast<SyncSession*>(clientData);
+    if (vtkCamera::SafeDownCast(caller)) {
+        session->cameraDirty = true;
+    }
+    else if (session->transformIds.contains(caller)) {
+        session->dirtyParts.insert(session->transformIds.value(caller));
+    }
+    session->scheduleFrame();
+}
+
+/**
+ * Gives a part and its children identifiers and starts watching their transforms.
+ *
+ * @param part The top of the subtree.
+ */
+void SyncSession::registerSubtree(ModelPart* part) {
+    const quint32 id = nextId++;
+    ids.insert(part, id);
+    parts.insert(id, part);
+    transformIds.insert(part->getTransform(), id);
+    transformObservers.insert(id, part->getTransform()->AddObserver(vtkCommand::ModifiedEvent, modifiedCallback));
+    for (int i = 0; i < part->childCount(); ++i) {
+        registerSubtree(part->child(i));
+    }
+}
+
+/**
+ * Forgets a part and its children.
+ *
+ * @param part The top of the subtree.
+ */
+void SyncSession::unregisterSubtree(ModelPart* part) {
+    for (int i = 0; i < part->childCount(); ++i) {
+        unregisterSubtree(part->child(i));
+    }
+
+    const quint32 id = ids.take(part);
+    parts.remove(id);
+    sentState.remove(id);
+    partGeometry.remove(id);
+    dirtyParts.remove(id);
+    transformIds.remove(part->getTransform());
+    part->getTransform()->RemoveObserver(transformObservers.take(id));
+}
+
+/**
+ * Writes add records for a part and its children, parents first.
+ *
+ * @param part The top of the subtree.
+ * @param records The stream receiving the records.
+ * @param recordCount Incremented for every record written.
+ */
+void SyncSession::writeSubtree(ModelPart* part, QDataStream& records, quint32& recordCount) {
+    const quint32 id = ids.value(part);
+    const quint32 parentId = ids.value(part->parentItem(), 0); // 0 is the root
+    const PartState state = currentState(part);
+
+    // Hash each mesh once; parts sharing a mesh share the hash and the follower fetches it once
+    QByteArray hash = partGeometry.value(id);
+    vtkPolyData* polyData = part->getPolyData();
+    if (hash.isEmpty() && polyData) {
+        std::vector<float> coordinates;
+        std::vector<uint32_t> triangles;
+        ModelPart::extractMesh(polyData, coordinates, triangles);
+        hash = hashMesh(coordinates, triangles);
+        partGeometry.insert(id, hash);
+        geometryByHash.insert(hash, polyData);
+    }
+    if (recording && !hash.isEmpty() && !recordedGeometry.contains(hash)) {
+        writeRecord(geometryMessage(hash, polyData)); // Ahead of the frame that adds the part
+        recordedGeometry.insert(hash);
+    }
+
+    records << quint8(kAdd) << id << parentId << state.name << quint8(state.visible)
+        << quint8(state.color.red()) << quint8(state.color.green()) << quint8(state.color.blue()) << hash;
+    const bool identity = isIdentity(state.matrix);
+    records << quint8(identity ? 0 : 1);
+    if (!identity) {
+        for (double value : state.matrix) records << value;
+    }
+    sentState.insert(id, state);
+    ++recordCount;
+
+    for (int i = 0; i < part->childCount(); ++i) {
+        writeSubtree(part->child(i), records, recordCount);
+    }
+}
+
+/**
+ * Starts the frame timer unless a frame is already being collected.
+ */
+void SyncSession::scheduleFrame() {
+    if (!frameTimer.isActive()) {
+        frameTimer.start();
+    }
+}
+
+/**
+ * Sends the changes collected since the last frame as one message. Property and camera records
+ * carry only the fields that differ from what the followers were last sent, so a part whose colour
+ * changed several times in one frame produces a single colour field.
+ */
+void SyncSession::flushFrame() {
+    frameTimer.stop();
+    if (!isPublishing())
+        return;
+    if (peers.isEmpty() && !recording) { // A new follower starts from a snapshot, so nothing needs keeping
+        pendingRecords.clear();
+        pendingRecordCount = 0;
+        dirtyParts.clear();
+        cameraDirty = false;
+        return;
+    }
+
+    QByteArray records = pendingRecords;
+    quint32 recordCount = pendingRecordCount;
+    pendingRecords.clear();
+    pendingRecordCount = 0;
+    QDataStream out(&records, QIODevice::WriteOnly | QIODevice::Append);
+    out.setVersion(kStreamVersion);
+
+    for (quint32 id : dirtyParts) {
+        ModelPart* part = parts.value(id);
+        if (!part)
+            continue;
+
+        const PartState state = currentState(part);
+        PartState& sent = sentState[id];
+        quint8 mask = 0;
+        if (state.name != sent.name) mask |= kName;
+        if (state.visible != sent.visible) mask |= kVisible;
+        if (state.color != sent.color) mask |= kColour;
+        if (state.matrix != sent.matrix) mask |= kMatrix;
+        if (!mask)
+            continue;
+
+        out << quint8(kUpdate) << id << mask;
+        if (mask & kName) out << state.name;
+        if (mask & kVisible) out << quint8(state.visible);
+        if (mask & kColour) out << quint8(state.color.red()) << quint8(state.color.green()) << quint8(state.color.blue());
+        if (mask & kMatrix) {
+            for (double value : state.matrix) out << value;
+        }
+        sent = state;
+        ++recordCount;
+    }
+    dirtyParts.clear();
+
+    if (cameraDirty) {
+        const CameraState camera = currentCamera();
+        quint8 mask = 0;
+        if (camera.position != sentCamera.position) mask |= kPosition;
+        if (camera.focalPoint != sentCamera.focalPoint) mask |= kFocalPoint;
+        if (camera.viewUp != sentCamera.viewUp) mask |= kViewUp;
+        if (camera.viewAngle != sentCamera.viewAngle) mask |= kViewAngle;
+        if (mask) {
+            out << quint8(kCamera) << mask;
+            if (mask & kPosition) writeVector(out, camera.position);
+            if (mask & kFocalPoint) writeVector(out, camera.focalPoint);
+            if (mask & kViewUp) writeVector(out, camera.viewUp);
+            if (mask & kViewAngle) out << camera.viewAngle;
+            sentCamera = camera;
+            ++recordCount;
+        }
+        cameraDirty = false;
+    }
+
+    if (recordCount == 0)
+        return;
+
+    QByteArray message;
+    QDataStream header(&message, QIODevice::WriteOnly);
+    header.setVersion(kStreamVersion);
+    header << quint8(kFrame) << recordCount;
+    message.append(records);
+    for (QLocalSocket* peer : peers) {
+        MessageFraming::send(peer, message);
+    }
+    if (recording) {
+        writeRecord(message);
+    }
+}
+
+/**
+ * Builds a frame that replaces a follower's tree and camera with the current scene.
+ *
+ * @return The snapshot message.
+ */
+QByteArray SyncSession::snapshot() {
+    QByteArray records;
+    quint32 recordCount = 0;
+    QDataStream out(&records, QIODevice::WriteOnly);
+    out.setVersion(kStreamVersion);
+
+    out << quint8(kReset);
+    ++recordCount;
+    ModelPart* root = model->getRootItem();
+    for (int i = 0; i < root->childCount(); ++i) {
+        writeSubtree(root->child(i), out, recordCount);
+    }
+
+    sentCamera = currentCamera();
+    out << quint8(kCamera) << quint8(kPosition | kFocalPoint | kViewUp | kViewAngle);
+    writeVector(out, sentCamera.position);
+    writeVector(out, sentCamera.focalPoint);
+    writeVector(out, sentCamera.viewUp);
+    out << sentCamera.viewAngle;
+    ++recordCount;
+
+    QByteArray message;
+    QDataStream header(&message, QIODevice::WriteOnly);
+    header.setVersion(kStreamVersion);
+    header << quint8(kFrame) << recordCount;
+    message.append(records);
+    return message;
+}
+
+/**
+ * Sends the meshes a follower asked for, one message per mesh.
+ *
+ * @param peer The follower that asked.
+ * @param hashes The content hashes of the meshes.
+ */
+void SyncSession::sendGeometry(QLocalSocket* peer, const QList<QByteArray>& hashes) {
+    for (const QByteArray& hash : hashes) {
+        vtkPolyData* polyData = geometryByHash.value(hash);
+        if (!polyData)
+            continue; // Every part with this mesh has been removed since
+        MessageFraming::send(peer, geometryMessage(hash, polyData));
+    }
+}
+
+/**
+ * Appends a message to the recording with the time since the recording started.
+ *
+ * @param message The message.
+ */
+void SyncSession::writeRecord(const QByteArray& message) {
+    QByteArray entry(4, Qt::Uninitialized);
+    qToBigEndian<quint32>(static_cast<quint32>(recordingClock.elapsed()), entry.data());
+    entry.append(message);
+    MessageFraming::send(recording, entry);
+}
+
+/**
+ * @param part A registered part.
+ * @return The part's current name, visibility, colour and local transform.
+ */
+SyncSession::PartState SyncSession::currentState(ModelPart* part) const {
+    PartState state;
+    state.name = part->data(0).toString();
+    state.visible = part->visible();
+    state.color = part->getColor();
+    state.matrix = localMatrix(part);
+    return state;
+}
+
+/**
+ * @return The current parameters of the active camera.
+ */
+SyncSession::CameraState SyncSession::currentCamera() const {
+    vtkCamera* camera = scene->getRenderer()->GetActiveCamera();
+    CameraState state;
+    camera->GetPosition(state.position.data());
+    camera->GetFocalPoint(state.focalPoint.data());
+    camera->GetViewUp(state.viewUp.data());
+    state.viewAngle = camera->GetViewAngle();
+    return state;
+}
+
+/**
+ * Applies one frame from the publisher. Added parts are collected and inserted into the tree in one
+ * batch per parent; children of parts added in the same frame are attached to them before the
+ * batch goes in, so a snapshot becomes a handful of insertions.
+ *
+ * @param in The frame payload, positioned after the message type.
+ */
+void SyncSession::applyFrame(QDataStream& in) {
+    quint32 recordCount;
+    in >> recordCount;
+
+    QHash<ModelPart*, QList<ModelPart*>> pendingInserts;
+    QList<ModelPart*> pendingOrder;
+    QList<QByteArray> requests;
+    for (quint32 i = 0; i < recordCount && in.status() == QDataStream::Ok; ++i) {
+        quint8 type;
+        in >> type;
+        if (type == kReset) {
+            insertPending(pendingInserts, pendingOrder);
+            ModelPart* root = model->getRootItem();
+            while (root->childCount() > 0) {
+                removeRemotePart(root->child(root->childCount() - 1));
+            }
+            remoteParts.clear();
+            remoteIds.clear();
+            awaitingGeometry.clear();
+            requests.clear();
+        }
+        else if (type == kAdd) {
+            applyAdd(in, pendingInserts, pendingOrder, requests);
+        }
+        else if (type == kRemove) {
+            quint32 id;
+            in >> id;
+            insertPending(pendingInserts, pendingOrder);
+            if (ModelPart* part = remoteParts.value(id)) {
+                removeRemotePart(part);
+            }
+        }
+        else if (type == kUpdate) {
+            quint32 id;
+            quint8 mask;
+            in >> id >> mask;
+            ModelPart* part = remoteParts.value(id);
+            QString name = part ? part->data(0).toString() : QString();
+            bool visible = part ? part->visible() : true;
+            QColor color = part ? part->getColor() : QColor();
+            std::array<double, 16> matrix;
+            if (mask & kName) in >> name;
+            if (mask & kVisible) {
+                quint8 value;
+                in >> value;
+                visible = value != 0;
+            }
+            if (mask & kColour) {
+                quint8 r, g, b;
+                in >> r >> g >> b;
+                color = QColor(r, g, b);
+            }
+            if (mask & kMatrix) {
+                for (double& value : matrix) in >> value;
+            }
+
+            if (!part)
+                continue; // Removed locally
+            if (mask & (kName | kVisible | kColour)) {
+                emit remotePropertiesChanged(part, name, visible, color);
+            }
+            if (mask & kMatrix) {
+                setLocalMatrix(part, matrix);
+            }
+        }
+        else if (type == kCamera) {
+            quint8 mask;
+            in >> mask;
+            vtkCamera* camera = scene->getRenderer()->GetActiveCamera();
+            std::array<double, 3> v;
+            if (mask & kPosition) { readVector(in, v); camera->SetPosition(v.data()); }
+            if (mask & kFocalPoint) { readVector(in, v); camera->SetFocalPoint(v.data()); }
+            if (mask & kViewUp) { readVector(in, v); camera->SetViewUp(v.data()); }
+            if (mask & kViewAngle) {
+                double angle;
+                in >> angle;
+                camera->SetViewAngle(angle);
+            }
+            scene->getRenderer()->ResetCameraClippingRange();
+        }
+        else {
+            emit statusMessage("Sync stream contains an unknown record; ignoring the rest of the frame");
+            break;
+        }
+    }
+    insertPending(pendingInserts, pendingOrder);
+
+    if (!requests.isEmpty() && upstream) {
+        QByteArray request;
+        QDataStream out(&request, QIODevice::WriteOnly);
+        out.setVersion(kStreamVersion);
+        out << quint8(kGeometryRequest) << requests;
+        MessageFraming::send(upstream, request);
+    }
+    emit remoteFrameApplied();
+}
+
+/**
+ * Creates the local copy of a part announced by the publisher.
+ *
+ * @param in The frame payload, positioned after the record type.
+ * @param pendingInserts Parts waiting to be inserted, by parent.
+ * @param pendingOrder Parents of pendingInserts in the order they were first used.
+ * @param requests Receives hashes of meshes that must be fetched.
+ */
+void SyncSession::applyAdd(QDataStream& in, QHash<ModelPart*, QList<ModelPart*>>& pendingInserts, QList<ModelPart*>& pendingOrder, QList<QByteArray>& requests) {
+    quint32 id, parentId;
+    QString name;
+    quint8 visible, r, g, b, hasMatrix;
+    QByteArray hash;
+    in >> id >> parentId >> name >> visible >> r >> g >> b >> hash >> hasMatrix;
+    std::array<double, 16> matrix;
+    if (hasMatrix) {
+        for (double& value : matrix) in >> value;
+    }
+    if (in.status() != QDataStream::Ok)
+        return;
+
+    ModelPart* root = model->getRootItem();
+    ModelPart* parent = parentId ? remoteParts.value(parentId, root) : root;
+    QList<QVariant> data = { QVariant(name), QVariant(visible ? "true" : "false"),
+        QVariant(QString("%1,%2,%3").arg(r).arg(g).arg(b)) };
+    ModelPart* part = new ModelPart(data);
+    part->setColour(r, g, b);
+    remoteParts.insert(id, part);
+    remoteIds.insert(part, id);
+
+    // Parts already in the tree get their new children in one insertion per frame
+    ModelPart* ancestor = parent;
+    while (ancestor && ancestor != root) ancestor = ancestor->parentItem();
+    if (ancestor == root) {
+        if (!pendingInserts.contains(parent)) pendingOrder.append(parent);
+        pendingInserts[parent].append(part);
+    }
+    else {
+        parent->appendChild(part);
+    }
+    if (hasMatrix) {
+        setLocalMatrix(part, matrix);
+    }
+
+    if (!hash.isEmpty()) {
+        if (geometryCache.contains(hash)) {
+            setGeometry(part, geometryCache.value(hash));
+        }
+        else {
+            if (!awaitingGeometry.contains(hash)) requests.append(hash);
+            awaitingGeometry[hash].append(part);
+        }
+    }
+}
+
+/**
+ * Stores a mesh sent by the publisher and gives it to the parts waiting for it.
+ *
+ * @param in The message payload, positioned after the message type.
+ */
+void SyncSession::applyGeometry(QDataStream& in) {
+    QByteArray hash, encoded;
+    in >> hash >> encoded;
+
+    // Decoding checks the declared counts against the data before allocating, and that every
+    // index is in range; the hash catches anything else
+    StlMesh mesh;
+    if (in.status() != QDataStream::Ok
+        || !MeshCodec::decode(reinterpret_cast<const uint8_t*>(encoded.constData()), static_cast<size_t>(encoded.size()), mesh)
+        || hashMesh(mesh.points, mesh.triangles) != hash) {
+        emit statusMessage("Received a corrupt mesh from the publishing viewer");
+        return;
+    }
+
+    vtkSmartPointer<vtkPolyData> polyData = ModelPart::createPolyData(mesh.points, mesh.triangles);
+    geometryCache.insert(hash, polyData);
+    for (ModelPart* part : awaitingGeometry.take(hash)) {
+        setGeometry(part, polyData);
+    }
+    emit remoteFrameApplied();
+}
+
+/**
+ * Inserts the parts collected while applying a frame, one batch per parent.
+ *
+ * @param pendingInserts Parts waiting to be inserted, by parent; emptied.
+ * @param pendingOrder Parents in the order they were first used; emptied.
+ */
+void SyncSession::insertPending(QHash<ModelPart*, QList<ModelPart*>>& pendingInserts, QList<ModelPart*>& pendingOrder) {
+    for (ModelPart* parent : pendingOrder) {
+        model->insertChildren(model->indexOf(parent), pendingInserts.value(parent));
+    }
+    pendingInserts.clear();
+    pendingOrder.clear();
+}
+
+/**
+ * Removes a mirrored part and its children from the tree and the scene.
+ *
+ * @param part The part to remove.
+ */
+void SyncSession::removeRemotePart(ModelPart* part) {
+    scene->removePart(part);
+    model->removeRows(part->row(), 1, model->indexOf(part->parentItem()));
+}
+
+/**
+ * Stops mirroring a part and its children, before they are removed from the tree.
+ *
+ * @param part The top of the subtree.
+ */
+void SyncSession::forgetSubtree(ModelPart* part) {
+    for (int i = 0; i < part->childCount(); ++i) {
+        forgetSubtree(part->child(i));
+    }
+    if (remoteIds.contains(part)) {
+        remoteParts.remove(remoteIds.take(part));
+    }
+    for (auto it = awaitingGeometry.begin(); it != awaitingGeometry.end(); ++it) {
+        it.value().removeAll(part);
+    }
+}
+
+/**
+ * Gives a mirrored part its geometry, coloured like the part.
+ *
+ * @param part The part.
+ * @param polyData The geometry, possibly shared with other parts.
+ */
+void SyncSession::setGeometry(ModelPart* part, vtkSmartPointer<vtkPolyData> polyData) {
+    part->setPolyData(polyData);
+    const QColor color = part->getColor();
+    part->getActor()->GetProperty()->SetDiffuseColor(color.redF(), color.greenF(), color.blueF());
+}
+
+/**
+ * Reads what has arrived on a connection and handles every complete message.
+ *
+ * @param socket The connection with data to read.
+ */
+void SyncSession::onReadyRead(QLocalSocket* socket) {
+    QByteArray& buffer = readBuffers[socket];
+    buffer.append(socket->readAll());
+    QByteArray message;
+    MessageFraming::TakeResult taken;
+    while ((taken = MessageFraming::take(buffer, message)) == MessageFraming::Taken) {
+        handleMessage(socket, message);
+        if (!readBuffers.contains(socket))
+            return; // The connection was closed while handling the message
+    }
+    if (taken == MessageFraming::Corrupt) {
+        emit statusMessage("Sync connection sent a corrupt message; closing it");
+        readBuffers.remove(socket);
+        socket->abort();
+    }
+}
+
+/**
+ * Handles one message from a follower or from the publisher.
+ *
+ * @param socket The connection the message arrived on.
+ * @param message The message payload.
+ */
+void SyncSession::handleMessage(QLocalSocket* socket, const QByteArray& message) {
+    QDataStream in(message);
+    in.setVersion(kStreamVersion);
+    quint8 type;
+    in >> type;
+
+    if (server && type == kHello) {
+        quint16 version;
+        in >> version;
+        if (version != kProtocolVersion) {
+            emit statusMessage(QString("Refused sync follower with protocol version %1").arg(version));
+            readBuffers.remove(socket);
+            socket->disconnectFromServer();
+            return;
+        }
+        flushFrame(); // Existing followers get the pending changes; the new one gets the snapshot
+        if (!peers.contains(socket)) {
+            peers.append(socket);
+        }
+        MessageFraming::send(socket, snapshot());
+        emit statusMessage(QString("Sync follower connected, %1 in total").arg(peers.size()));
+    }
+    else if (server && type == kGeometryRequest) {
+        QList<QByteArray> hashes;
+        in >> hashes;
+        sendGeometry(socket, hashes);
+    }
+    else if ((upstream || replaying) && type == kFrame) {
+        applyFrame(in);
+    }
+    else if ((upstream || replaying) && type == kGeometry) {
+        applyGeometry(in);
+    }
+    else if (replaying && type == kEvent) {
+        QString name;
+        QVariant value;
+        in >> name >> value;
+        emit recordedEvent(name, value);
+    }
+}
+
+/**
+ * Constructs an idle relay.
+ *
+ * @param latencyMs Delay added to every message in each direction, to imitate a remote link.
+ * @param parent The parent QObject.
+ */
+SyncRelay::SyncRelay(int latencyMs, QObject* parent)
+    : QObject(parent),
+    latencyMs(latencyMs),
+    upstream(nullptr),
+    server(nullptr) {
+}
+
+/**
+ * Connects to a publisher (or another relay) and starts accepting followers.
+ *
+ * @param upstreamName The socket name of the publisher.
+ * @param downstreamName The socket name followers connect to.
+ * @param error Receives a description of the failure; may be nullptr.
+ * @return True if the relay is running.
+ */
+bool SyncRelay::start(const QString& upstreamName, const QString& downstreamName, QString* error) {
+    upstream = new QLocalSocket(this);
+    upstream->connectToServer(upstreamName);
+    if (!upstream->waitForConnected(3000)) {
+        if (error) *error = upstream->errorString();
+        return false;
+    }
+    connect(upstream, &QLocalSocket::readyRead, this, [this] {
+        QByteArray& buffer = readBuffers[upstream];
+        buffer.append(upstream->readAll());
+        QByteArray message;
+        MessageFraming::TakeResult taken;
+        while ((taken = MessageFraming::take(buffer, message)) == MessageFraming::Taken) onUpstreamMessage(message);
+        if (taken == MessageFraming::Corrupt) {
+            emit statusMessage("Relay received a corrupt message from the publishing viewer; closing the connection");
+            readBuffers.remove(upstream);
+            upstream->abort();
+        }
+        });
+    connect(upstream, &QLocalSocket::disconnected, this, [this] {
+        emit statusMessage("Relay lost its connection to the publishing viewer");
+        });
+
+    server = new QLocalServer(this);
+    QLocalServer::removeServer(downstreamName);
+    if (!server->listen(downstreamName)) {
+        if (error) *error = server->errorString();
+        return false;
+    }
+    connect(server, &QLocalServer::newConnection, this, [this] {
+        while (QLocalSocket* peer = server->nextPendingConnection()) {
+            downstream.append(peer);
+            connect(peer, &QLocalSocket::readyRead, this, [this, peer] {
+                QByteArray& buffer = readBuffers[peer];
+                buffer.append(peer->readAll());
+                QByteArray message;
+                MessageFraming::TakeResult taken;
+                while ((taken = MessageFraming::take(buffer, message)) == MessageFraming::Taken) onDownstreamMessage(peer, message);
+                if (taken == MessageFraming::Corrupt) {
+                    emit statusMessage("Relay follower sent a corrupt message; closing its connection");
+                    readBuffers.remove(peer);
+                    peer->abort();
+                }
+                });
+            connect(peer, &QLocalSocket::disconnected, this, [this, peer] {
+                downstream.removeAll(peer);
+                readBuffers.remove(peer);
+                peer->deleteLater();
+                emit statusMessage(QString("Relay follower disconnected, %1 remaining").arg(downstream.size()));
+                });
+            emit statusMessage(QString("Relay follower connected, %1 in total").arg(downstream.size()));
+        }
+        });
+    return true;
+}
+
+/**
+ * Passes a publisher message on to every follower, keeping a copy of meshes for later requests.
+ * Snapshots go to every follower too; a follower that is already in sync simply rebuilds the same
+ * tree from meshes it has cached.
+ *
+ * @param message The message payload.
+ */
+void SyncRelay::onUpstreamMessage(const QByteArray& message) {
+    if (messageType(message) == kGeometry) {
+        QDataStream in(message);
+        in.setVersion(kStreamVersion);
+        quint8 type;
+        QByteArray hash;
+        in >> type >> hash;
+        geometryMessages.insert(hash, message);
+    }
+    for (QLocalSocket* peer : downstream) {
+        deliver(peer, message);
+    }
+}
+
+/**
+ * Passes a follower message on to the publisher, answering mesh requests from the cache where it can.
+ *
+ * @param peer The follower that sent the message.
+ * @param message The message payload.
+ */
+void SyncRelay::onDownstreamMessage(QLocalSocket* peer, const QByteArray& message) {
+    if (messageType(message) != kGeometryRequest) {
+        deliver(upstream, message);
+        return;
+    }
+
+    QDataStream in(message);
+    in.setVersion(kStreamVersion);
+    quint8 type;
+    QList<QByteArray> hashes;
+    in >> type >> hashes;
+
+    QList<QByteArray> missing;
+    for (const QByteArray& hash : hashes) {
+        if (geometryMessages.contains(hash)) {
+            deliver(peer, geometryMessages.value(hash));
+        }
+        else {
+            missing.append(hash);
+        }
+    }
+    if (!missing.isEmpty()) {
+        QByteArray request;
+        QDataStream out(&request, QIODevice::WriteOnly);
+        out.setVersion(kStreamVersion);
+        out << quint8(kGeometryRequest) << missing;
+        deliver(upstream, request);
+    }
+}
+
+/**
+ * Sends a message after the configured delay. Messages to one socket keep their order.
+ *
+ * @param socket The destination.
+ * @param message The message payload.
+ */
+void SyncRelay::deliver(QLocalSocket* socket, const QByteArray& message) {
+    if (latencyMs <= 0) {
+        MessageFraming::send(socket, message);
+        return;
+    }
+
+    QPointer<QLocalSocket> destination(socket);
+    QTimer::singleShot(latencyMs, this, [destination, message] {
+        if (destination) MessageFraming::send(destination, message);
+        });
+}
@@ -0,0 +1,206 @@
+/**
+ * @file SyncSession.h
+ *
+ * Defines the SyncSession and SyncRelay classes, which keep several viewer instances showing the
+ * same scene, e.g. a desktop viewer and a VR viewer side by side in a review. One instance publishes
+ * and the others follow. The publisher sends changes to the part tree, part properties and the
+ * camera as compact binary deltas, batched and coalesced into one message per frame. Geometry is
+ * referred to by content hash, and a follower fetches a mesh, compressed with MeshCodec, only the
+ * first time it meets that hash.
+ *
+ * Messages travel over a local socket (a Unix domain socket, or a named pipe on Windows). SyncRelay
+ * stands in for remote peers: it sits between a publisher and its followers with a configurable
+ * delay and answers geometry requests from its own cache, as a relay at another site would.
+ *
+ * A session can also be recorded: the publisher writes the same messages to a file with the time
+ * each was sent, every mesh once before the first frame that uses it, and view settings and VR
+ * commands as events. Replaying the file through a follower rebuilds the same tree, properties and
+ * camera, frame by frame, with no source files or peers, so a recorded review becomes a repeatable
+ * benchmark (see Qt_VTK_bench --mode replay).
+ */
+
+#ifndef VIEWER_SYNCSESSION_H
+#define VIEWER_SYNCSESSION_H
+
+#include <QByteArray>
+#include <QColor>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QVariant>
+#include <array>
+#include <vtkSmartPointer.h>
+#include <vtkWeakPointer.h>
+#include <vtkCallbackCommand.h>
+#include <vtkPolyData.h>
+#include "ModelPartList.h"
+#include "SceneRenderer.h"
+
+class QDataStream;
+class QFile;
+class QLocalServer;
+class QLocalSocket;
+
+/**
+ * @class SyncSession
+ * @brief Publishes this viewer's scene to followers, or follows another viewer's scene.
+ */
+class SyncSession : public QObject {
+    Q_OBJECT
+
+public:
+    /** What a recorded message carries. */
+    enum RecordedKind {
+        RecordedFrame, ///< Changes to the tree, part properties or camera.
+        RecordedGeometry, ///< A mesh used by later frames.
+        RecordedEvent, ///< A view setting or VR command.
+    };
+
+    /** A message read from a session recording. */
+    struct RecordedMessage {
+        quint32 timeMs; ///< When the message was recorded, from the start of the recording.
+        RecordedKind kind; ///< What the message carries.
+        QByteArray message; ///< The message, for replay().
+    };
+
+    SyncSession(ModelPartList* model, SceneRenderer* scene, QObject* parent = nullptr);
+    ~SyncSession();
+
+    bool publish(const QString& name, QString* error = nullptr);
+    bool follow(const QString& name, QString* error = nullptr);
+    bool record(const QString& fileName, QString* error = nullptr);
+    void recordEvent(const QString& name, const QVariant& value);
+    void stop();
+    bool isPublishing() const;
+    bool isFollowing() const;
+    bool isRecording() const;
+
+    static bool loadRecording(const QString& fileName, QList<RecordedMessage>& messages, QString* error = nullptr);
+    void beginReplay();
+    void replay(const QByteArray& message);
+
+signals:
+    /** Emitted on a follower when the publisher changed a part's name, visibility or colour. */
+    void remotePropertiesChanged(ModelPart* part, const QString& name, bool visible, const QColor& color);
+    /** Emitted on a follower after a frame of changes has been applied; the view should be rendered. */
+    void remoteFrameApplied();
+    /** Emitted when peers connect or disconnect, or the session fails. */
+    void statusMessage(const QString& message);
+    /** Emitted while replaying for each recorded view setting or VR command. */
+    void recordedEvent(const QString& name, const QVariant& value);
+
+private:
+    /** Properties of a part as last sent to the followers. */
+    struct PartState {
+        QString name; ///< Name shown in the tree.
+        bool visible = true; ///< Visibility flag of the part itself.
+        QColor color; ///< Part colour.
+        std::array<double, 16> matrix; ///< Local transform, relative to the parent part.
+    };
+
+    /** Camera as last sent to the followers. */
+    struct CameraState {
+        std::array<double, 3> position = {}; ///< Camera position.
+        std::array<double, 3> focalPoint = {}; ///< Point the camera looks at.
+        std::array<double, 3> viewUp = {}; ///< Up direction.
+        double viewAngle = 0.0; ///< Vertical field of view in degrees.
+    };
+
+    // Publisher
+    void onNewConnection();
+    void onRowsInserted(const QModelIndex& parent, int first, int last);
+    void onRowsAboutToBeRemoved(const QModelIndex& parent, int first, int last);
+    void onDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight);
+    static void onObservedModified(vtkObject* caller, unsigned long eventId, void* clientData, void* callData);
+    void registerSubtree(ModelPart* part);
+    void unregisterSubtree(ModelPart* part);
+    void writeSubtree(ModelPart* part, QDataStream& records, quint32& recordCount);
+    void scheduleFrame();
+    void flushFrame();
+    QByteArray snapshot();
+    void sendGeometry(QLocalSocket* peer, const QList<QByteArray>& hashes);
+    void writeRecord(const QByteArray& message);
+    PartState currentState(ModelPart* part) const;
+    CameraState currentCamera() const;
+
+    // Follower
+    void applyFrame(QDataStream& in);
+    void applyAdd(QDataStream& in, QHash<ModelPart*, QList<ModelPart*>>& pendingInserts, QList<ModelPart*>& pendingOrder, QList<QByteArray>& requests);
+    void applyGeometry(QDataStream& in);
+    void insertPending(QHash<ModelPart*, QList<ModelPart*>>& pendingInserts, QList<ModelPart*>& pendingOrder);
+    void removeRemotePart(ModelPart* part);
+    void forgetSubtree(ModelPart* part);
+    void setGeometry(ModelPart* part, vtkSmartPointer<vtkPolyData> polyData);
+
+    // Both
+    void onReadyRead(QLocalSocket* socket);
+    void handleMessage(QLocalSocket* socket, const QByteArray& message);
+
+    ModelPartList* model; ///< Tree being published or mirrored.
+    SceneRenderer* scene; ///< Scene whose camera is published or mirrored.
+    QLocalServer* server; ///< Listening socket while publishing.
+    QLocalSocket* upstream; ///< Connection to the publisher while following.
+    QList<QLocalSocket*> peers; ///< Followers that have asked for the scene and receive every frame.
+    QHash<QLocalSocket*, QByteArray> readBuffers; ///< Partial messages received from each connection.
+
+    QHash<ModelPart*, quint32> ids; ///< Publisher: identifier of every registered part.
+    QHash<quint32, ModelPart*> parts; ///< Publisher: part of every identifier.
+    QHash<quint32, PartState> sentState; ///< Publisher: properties of each part as the followers know them.
+    QHash<quint32, QByteArray> partGeometry; ///< Publisher: content hash of each part's geometry.
+    QHash<QByteArray, vtkWeakPointer<vtkPolyData>> geometryByHash; ///< Publisher: geometry for each hash, while any part uses it.
+    QHash<vtkObject*, quint32> transformIds; ///< Publisher: part identifier of each observed transform.
+    QHash<quint32, unsigned long> transformObservers; ///< Publisher: observer tag on each part's transform.
+    quint32 nextId; ///< Publisher: next part identifier to hand out.
+    QByteArray pendingRecords; ///< Publisher: structural records of the frame being collected.
+    quint32 pendingRecordCount; ///< Publisher: number of records in pendingRecords.
+    QSet<quint32> dirtyParts; ///< Publisher: parts whose properties may have changed this frame.
+    bool cameraDirty; ///< Publisher: whether the camera may have changed this frame.
+    CameraState sentCamera; ///< Publisher: camera as the followers know it.
+    unsigned long cameraObserver; ///< Publisher: observer tag on the active camera.
+    vtkSmartPointer<vtkCallbackCommand> modifiedCallback; ///< Publisher: marks transforms and the camera dirty.
+    QTimer frameTimer; ///< Publisher: sends the collected changes once per frame.
+    QFile* recording; ///< Publisher: session file being written, or nullptr.
+    QElapsedTimer recordingClock; ///< Publisher: time since the recording started.
+    QSet<QByteArray> recordedGeometry; ///< Publisher: hashes of the meshes already in the recording.
+
+    QHash<quint32, ModelPart*> remoteParts; ///< Follower: local part for each publisher identifier.
+    QHash<ModelPart*, quint32> remoteIds; ///< Follower: publisher identifier of each mirrored part.
+    QHash<QByteArray, vtkSmartPointer<vtkPolyData>> geometryCache; ///< Follower: geometry received so far, by hash.
+    QHash<QByteArray, QList<ModelPart*>> awaitingGeometry; ///< Follower: parts waiting for a requested mesh.
+    bool replaying; ///< Follower: whether messages come from a recording rather than a publisher.
+};
+
+/**
+ * @class SyncRelay
+ * @brief Forwards a sync session between local sockets with a delay, standing in for a remote link.
+ */
+class SyncRelay : public QObject {
+    Q_OBJECT
+
+public:
+    explicit SyncRelay(int latencyMs = 0, QObject* parent = nullptr);
+
+    bool start(const QString& upstreamName, const QString& downstreamName, QString* error = nullptr);
+
+signals:
+    /** Emitted when peers connect or disconnect, or the upstream link fails. */
+    void statusMessage(const QString& message);
+
+private:
+    void onUpstreamMessage(const QByteArray& message);
+    void onDownstreamMessage(QLocalSocket* peer, const QByteArray& message);
+    void deliver(QLocalSocket* socket, const QByteArray& message);
+
+    int latencyMs; ///< Delay added to every message in each direction.
+    QLocalSocket* upstream; ///< Connection to the publisher.
+    QLocalServer* server; ///< Listening socket for followers.
+    QList<QLocalSocket*> downstream; ///< Connected followers.
+    QHash<QLocalSocket*, QByteArray> readBuffers; ///< Partial messages received from each connection.
+    QHash<QByteArray, QByteArray> geometryMessages; ///< Geometry messages seen so far, by content hash.
+};
+
+#endif // VIEWER_SYNCSESSION_H
@@ -0,0 +1,480 @@
+/**
+ * @file TaskScheduler.cpp
+ * @brief Implementation of the TaskScheduler and CancellationToken classes.
+ */
+
+#include "TaskScheduler.h"
+#include <QThread>
+#include <algorithm>
+#include <chrono>
+
+namespace {
+
+thread_local TaskScheduler* currentScheduler = nullptr; ///< Scheduler this thread is a worker of, if any.
+thread_local int currentWorker = -1; ///< This thread's index in currentScheduler, or -1.
+thread_local TaskScheduler* taskScheduler = nullptr; ///< Scheduler of the task this thread is running, if any.
+thread_local int taskPriority = -1; ///< Class of the task this thread is running, or -1.
+
+const std::chrono::milliseconds kWaitPoll(1); ///< How often a waiting thread rechecks what it waits for.
+
+} // namespace
+
+/**
+ * Constructor for the CancellationToken class. The token starts not cancelled.
+ */
+CancellationToken::CancellationToken()
+    : cancelled(std::make_shared<std::atomic<bool>>(false)) {
+}
+
+/**
+ * Cancels the token and every copy of it.
+ */
+void CancellationToken::cancel() {
+    cancelled->store(true);
+}
+
+/**
+ * Checks whether the token has been cancelled.
+ *
+ * @return True once cancel() has been called on any copy.
+ */
+bool CancellationToken::isCancelled() const {
+    return cancelled->load();
+}
+
+/**
+ * Gets the scheduler shared by the whole application.
+ *
+ * @return The scheduler, created on first use.
+ */
+TaskScheduler* TaskScheduler::instance() {
+    static TaskScheduler scheduler;
+    return &scheduler;
+}
+
+/**
+ * Constructor for the TaskScheduler class. Starts the worker threads.
+ *
+ * @param threadCount Number of worker threads, or 0 for one per core, and at least two.
+ */
+TaskScheduler::TaskScheduler(int threadCount)
+    : epoch(0), stopping(false), backgroundRunning(0), steals(0) {
+    const int threads = threadCount > 0 ? threadCount : std::max(2, QThread::idealThreadCount());
+    for (int p = 0; p < kPriorityCount; ++p) {
+        queued[p] = 0;
+        peakQueued[p] = 0;
+        running[p] = 0;
+        completed[p] = 0;
+        cancelled[p] = 0;
+    }
+    limits[Interactive] = threads;
+    limits[VisibleLoading] = std::max(1, threads - 1);
+    limits[Analysis] = std::max(1, threads - 1);
+    limits[Maintenance] = std::max(1, threads / 4);
+    backgroundCap = std::max(1, threads - 1);
+
+    for (int i = 0; i < threads; ++i) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+    for (int i = 0; i < threads; ++i) {
+        workers[i]->thread = std::thread(&TaskScheduler::workerLoop, this, i);
+    }
+}
+
+/**
+ * Destructor for the TaskScheduler class. Waits for running tasks, then drops the queued ones
+ * as if they had been cancelled.
+ */
+TaskScheduler::~TaskScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        stopping = true;
+    }
+    wakeup.notify_all();
+    for (auto& worker : workers) {
+        worker->thread.join();
+    }
+
+    auto drop = [this](std::deque<std::unique_ptr<Task>>& queue) {
+        for (auto& task : queue) {
+            if (task->onCancelled) task->onCancelled();
+            --queued[task->priority];
+            ++cancelled[task->priority];
+        }
+        queue.clear();
+    };
+    for (int p = 0; p < kPriorityCount; ++p) {
+        drop(sharedQueues[p]);
+        for (auto& worker : workers) {
+            drop(worker->queues[p]);
+        }
+    }
+}
+
+/**
+ * @return Number of worker threads.
+ */
+int TaskScheduler::threadCount() const {
+    return static_cast<int>(workers.size());
+}
+
+/**
+ * Sets how many tasks of a class may run at once. Tasks already running are not interrupted.
+ *
+ * @param priority The class.
+ * @param limit The limit, at least 1.
+ */
+void TaskScheduler::setConcurrencyLimit(Priority priority, int limit) {
+    limits[priority] = std::max(1, limit);
+    wake();
+}
+
+/**
+ * Gets how many tasks of a class may run at once.
+ *
+ * @param priority The class.
+ * @return The limit.
+ */
+int TaskScheduler::concurrencyLimit(Priority priority) const {
+    return limits[priority].load();
+}
+
+/**
+ * Sets how many tasks of the classes below Interactive may run at once in total, on top of their
+ * own limits. Tasks already running are not interrupted.
+ *
+ * @param limit The limit, at least 1.
+ */
+void TaskScheduler::setBackgroundLimit(int limit) {
+    backgroundCap = std::max(1, limit);
+    wake();
+}
+
+/**
+ * Gets how many tasks of the classes below Interactive may run at once in total.
+ *
+ * @return The limit.
+ */
+int TaskScheduler::backgroundLimit() const {
+    return backgroundCap.load();
+}
+
+/**
+ * Takes a snapshot of the queue depths and counters. The classes are read one after another,
+ * so the snapshot is only consistent when the pool is idle.
+ *
+ * @return The statistics.
+ */
+TaskScheduler::Statistics TaskScheduler::statistics() const {
+    Statistics stats;
+    stats.threads = threadCount();
+    stats.steals = steals.load();
+    stats.backgroundRunning = std::max(0, backgroundRunning.load());
+    stats.backgroundLimit = backgroundCap.load();
+    for (int p = 0; p < kPriorityCount; ++p) {
+        ClassStatistics& entry = stats.classes[p];
+        entry.queued = std::max(0, queued[p].load());
+        entry.peakQueued = peakQueued[p].load();
+        entry.running = std::max(0, running[p].load());
+        entry.limit = limits[p].load();
+        entry.completed = completed[p].load();
+        entry.cancelled = cancelled[p].load();
+    }
+    return stats;
+}
+
+/**
+ * Gets the name of a priority class, for reports.
+ *
+ * @param priority The class.
+ * @return The name, in lower case.
+ */
+const char* TaskScheduler::priorityName(Priority priority) {
+    switch (priority) {
+    case Interactive: return "interactive";
+    case VisibleLoading: return "visible loading";
+    case Analysis: return "analysis";
+    case Maintenance: return "maintenance";
+    }
+    return "unknown";
+}
+
+/**
+ * Queues a task. From a worker thread it goes to that worker's own queue, otherwise to the
+ * shared queue of its class.
+ *
+ * @param priority The task's class.
+ * @param task The work.
+ * @param token If cancelled before the task starts, the task is dropped.
+ * @param onCancelled Called instead of the task when it is dropped; may be empty.
+ */
+void TaskScheduler::post(Priority priority, std::function<void()> task, const CancellationToken& token,
+    std::function<void()> onCancelled) {
+    if (stopping) {
+        if (onCancelled) onCancelled();
+        ++cancelled[priority];
+        return;
+    }
+
+    std::unique_ptr<Task> entry(new Task{ priority, std::move(task), token, std::move(onCancelled) });
+    const int depth = ++queued[priority];
+    int peak = peakQueued[priority].load();
+    while (depth > peak && !peakQueued[priority].compare_exchange_weak(peak, depth)) {
+    }
+
+    if (currentScheduler == this) {
+        Worker& own = *workers[currentWorker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        own.queues[priority].push_back(std::move(entry));
+    }
+    else {
+        std::lock_guard<std::mutex> lock(sharedMutex);
+        sharedQueues[priority].push_back(std::move(entry));
+    }
+    wake();
+}
+
+/**
+ * Blocks until a condition holds. A task that waits lends its slot to other tasks and runs queued
+ * tasks of its own class in the meantime, so it cannot hold the slot the task it waits for needs.
+ * Any other thread only sleeps: running whatever is queued could keep the GUI thread busy with a
+ * long import long after the condition held.
+ *
+ * @param done The condition; checked between tasks and at least every millisecond.
+ */
+void TaskScheduler::waitUntil(const std::function<bool()>& done) {
+    const int self = currentScheduler == this ? currentWorker : -1;
+    const int lent = taskScheduler == this ? taskPriority : -1;
+    if (lent >= 0) {
+        release(lent);
+    }
+
+    while (!done()) {
+        const uint64_t seen = epoch.load();
+        if (lent >= 0) {
+            if (std::unique_ptr<Task> task = take(self, lent)) {
+                execute(std::move(task));
+                continue;
+            }
+        }
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        wakeup.wait_for(lock, kWaitPoll, [this, seen] { return stopping || epoch.load() != seen; });
+    }
+
+    if (lent >= 0) {
+        ++running[lent];
+        if (lent != Interactive) ++backgroundRunning;
+    }
+}
+
+/**
+ * Calls a function for every index below a count, on the caller and up to one helper task per
+ * worker, and waits for all of them.
+ *
+ * @param priority The class of the helper tasks.
+ * @param count Number of indices.
+ * @param body Called once per index.
+ */
+void TaskScheduler::parallelFor(Priority priority, size_t count, const std::function<void(size_t)>& body) {
+    if (count == 0)
+        return;
+
+    struct Progress {
+        std::atomic<size_t> next{ 0 }; ///< Next index to hand out.
+        std::atomic<size_t> finished{ 0 }; ///< Indices done.
+        std::mutex mutex; ///< Guards sleeping on allFinished.
+        std::condition_variable allFinished; ///< Signalled when finished reaches the count.
+    };
+    auto progress = std::make_shared<Progress>();
+    const std::function<void(size_t)>* work = &body;
+    auto drain = [progress, work, count] {
+        // Helpers that start after the last index was handed out find nothing, so body, which
+        // lives on the caller's stack, is only used while the caller is still waiting
+        for (size_t i = progress->next++; i < count; i = progress->next++) {
+            (*work)(i);
+            if (++progress->finished == count) {
+                std::lock_guard<std::mutex> lock(progress->mutex);
+                progress->allFinished.notify_all();
+            }
+        }
+    };
+
+    const size_t helpers = std::min(count - 1, workers.size());
+    for (size_t h = 0; h < helpers; ++h) {
+        post(priority, drain);
+    }
+    drain();
+
+    std::unique_lock<std::mutex> lock(progress->mutex);
+    progress->allFinished.wait(lock, [&progress, count] { return progress->finished.load() == count; });
+}
+
+/**
+ * Body of each worker thread: runs tasks until the scheduler stops, sleeping while there are none
+ * it may take.
+ *
+ * @param index The worker's index.
+ */
+void TaskScheduler::workerLoop(int index) {
+    currentScheduler = this;
+    currentWorker = index;
+    while (!stopping) {
+        const uint64_t seen = epoch.load();
+        if (std::unique_ptr<Task> task = take(index)) {
+            execute(std::move(task));
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        wakeup.wait(lock, [this, seen] { return stopping || epoch.load() != seen; });
+    }
+}
+
+/**
+ * Takes the most urgent task whose class is below its concurrency limit, and claims a slot of
+ * that class for it.
+ *
+ * @param self Index of the calling worker, or -1 for another thread.
+ * @param only Class to take from, or -1 for any.
+ * @return The task, or nullptr if none may run now.
+ */
+std::unique_ptr<TaskScheduler::Task> TaskScheduler::take(int self, int only) {
+    for (int p = 0; p < kPriorityCount; ++p) {
+        if ((only >= 0 && p != only) || queued[p].load() <= 0 || !claim(p))
+            continue;
+        if (std::unique_ptr<Task> task = takeFrom(self, p)) {
+            --queued[p];
+            return task;
+        }
+        --running[p];
+        if (p != Interactive) --backgroundRunning;
+    }
+    return nullptr;
+}
+
+/**
+ * Takes a task of one class: the newest from the caller's own queue, else the oldest shared one,
+ * else the oldest from another worker's queue.
+ *
+ * @param self Index of the calling worker, or -1 for another thread.
+ * @param priority The class.
+ * @return The task, or nullptr if every queue of the class is empty.
+ */
+std::unique_ptr<TaskScheduler::Task> TaskScheduler::takeFrom(int self, int priority) {
+    std::unique_ptr<Task> task;
+    if (self >= 0) {
+        Worker& own = *workers[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.queues[priority].empty()) {
+            task = std::move(own.queues[priority].back());
+            own.queues[priority].pop_back();
+            return task;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(sharedMutex);
+        if (!sharedQueues[priority].empty()) {
+            task = std::move(sharedQueues[priority].front());
+            sharedQueues[priority].pop_front();
+            return task;
+        }
+    }
+
+    const int count = threadCount();
+    for (int i = 1; i <= count; ++i) {
+        const int victim = (self + i) % count;
+        if (victim == self)
+            continue;
+        Worker& other = *workers[victim];
+        std::lock_guard<std::mutex> lock(other.mutex);
+        if (!other.queues[priority].empty()) {
+            task = std::move(other.queues[priority].front());
+            other.queues[priority].pop_front();
+            ++steals;
+            return task;
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * Claims a running slot of a class if it is below its limit and, for the classes below
+ * Interactive, the background classes together are below theirs.
+ *
+ * @param priority The class.
+ * @return True if a slot was claimed.
+ */
+bool TaskScheduler::claim(int priority) {
+    if (priority != Interactive) {
+        int current = backgroundRunning.load();
+        do {
+            if (current >= backgroundCap.load())
+                return false;
+        } while (!backgroundRunning.compare_exchange_weak(current, current + 1));
+    }
+
+    int current = running[priority].load();
+    while (current < limits[priority].load()) {
+        if (running[priority].compare_exchange_weak(current, current + 1))
+            return true;
+    }
+    if (priority != Interactive) {
+        --backgroundRunning;
+    }
+    return false;
+}
+
+/**
+ * Releases a slot claimed by claim(), and wakes the sleeping threads if tasks may be waiting for
+ * it. A background slot can free a task of any background class, not only this one.
+ *
+ * @param priority The class.
+ */
+void TaskScheduler::release(int priority) {
+    --running[priority];
+    if (priority == Interactive) {
+        if (queued[priority] > 0) wake();
+        return;
+    }
+    --backgroundRunning;
+    if (queued[VisibleLoading] > 0 || queued[Analysis] > 0 || queued[Maintenance] > 0) {
+        wake(); // Threads may be asleep on tasks that were over a limit
+    }
+}
+
+/**
+ * Runs a taken task, or drops it if its token was cancelled, then releases its slot.
+ *
+ * @param task The task.
+ */
+void TaskScheduler::execute(std::unique_ptr<Task> task) {
+    const int priority = task->priority;
+    TaskScheduler* outerScheduler = taskScheduler;
+    const int outerPriority = taskPriority;
+    taskScheduler = this;
+    taskPriority = priority;
+
+    if (task->token.isCancelled()) {
+        if (task->onCancelled) task->onCancelled();
+        ++cancelled[priority];
+    }
+    else {
+        task->run();
+        ++completed[priority];
+    }
+    task.reset(); // Releases the task's captures before its slot
+
+    taskScheduler = outerScheduler;
+    taskPriority = outerPriority;
+    release(priority);
+}
+
+/**
+ * Wakes the sleeping threads to look for tasks.
+ */
+void TaskScheduler::wake() {
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        ++epoch;
+    }
+    wakeup.notify_all();
+}
@@ -0,0 +1,210 @@
+/**
+ * @file TaskScheduler.h
+ *
+ * Defines the TaskScheduler class, which runs all of the viewer's background work on one set of
+ * threads, in place of separate QtConcurrent calls on Qt's global pool, so a bulk import cannot
+ * starve the work the user is waiting for. Every task belongs to a priority class: interactive
+ * work for the current frame or a pending user action, loading of parts the user asked to see,
+ * analyses such as slicing and deviation, and cache maintenance. A free thread always takes the
+ * most urgent class first, and each class has a limit on the threads it may occupy at once. The
+ * three background classes together are held to a further limit, by default one thread short of
+ * the pool, so however much loading and analysis is queued a thread stays free for interactive
+ * work.
+ *
+ * Each thread keeps its own queue per class. Tasks posted from a task go to the back of the
+ * poster's queue and are taken back from there, newest first, while their data is still in the
+ * cache; an idle thread steals from the front of another thread's queue. Tasks posted from other
+ * threads wait in a shared queue per class, oldest first.
+ *
+ * A task that waits for another through wait() runs queued tasks of its own class in the
+ * meantime, so waiting inside a task cannot leave the pool stuck on tasks nobody runs. Other
+ * threads, such as the GUI thread, just block in wait(), and only take their own elements in
+ * blockingMap(), so they never run an unrelated long task.
+ */
+
+#ifndef VIEWER_TASKSCHEDULER_H
+#define VIEWER_TASKSCHEDULER_H
+
+#include <QFuture>
+#include <QFutureInterface>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @class CancellationToken
+ * @brief Shared flag that tells tasks their result is no longer wanted.
+ *
+ * Copies share the flag. Tasks still queued when it is set are dropped, and their futures are
+ * cancelled; a running task can check isCancelled() to stop early.
+ */
+class CancellationToken {
+public:
+    CancellationToken();
+
+    void cancel();
+    bool isCancelled() const;
+
+private:
+    std::shared_ptr<std::atomic<bool>> cancelled; ///< The shared flag.
+};
+
+/**
+ * @class TaskScheduler
+ * @brief Priority-aware work-stealing thread pool for background work.
+ */
+class TaskScheduler {
+public:
+    /** Priority classes, most urgent first. */
+    enum Priority {
+        Interactive = 0, ///< Work a frame or the user is waiting on right now.
+        VisibleLoading = 1, ///< Loading parts and point cloud nodes the user asked to see.
+        Analysis = 2, ///< Slicing, deviation, mass properties.
+        Maintenance = 3, ///< Rebuilding caches, e.g. collision proxies.
+    };
+    static const int kPriorityCount = 4; ///< Number of priority classes.
+
+    /** Queue depth and throughput of one priority class. */
+    struct ClassStatistics {
+        int queued = 0; ///< Tasks waiting to start.
+        int peakQueued = 0; ///< Most tasks ever waiting at once.
+        int running = 0; ///< Tasks running now.
+        int limit = 0; ///< Most tasks allowed to run at once.
+        uint64_t completed = 0; ///< Tasks run to completion.
+        uint64_t cancelled = 0; ///< Tasks dropped because their token was cancelled.
+    };
+
+    /** Snapshot of the scheduler's queues. */
+    struct Statistics {
+        int threads = 0; ///< Worker threads.
+        int backgroundRunning = 0; ///< Tasks of the background classes running now.
+        int backgroundLimit = 0; ///< Most tasks of the background classes allowed to run at once.
+        uint64_t steals = 0; ///< Tasks taken from another thread's queue.
+        ClassStatistics classes[kPriorityCount]; ///< Per priority class.
+    };
+
+    static TaskScheduler* instance();
+
+    explicit TaskScheduler(int threadCount = 0);
+    ~TaskScheduler();
+
+    int threadCount() const;
+    void setConcurrencyLimit(Priority priority, int limit);
+    int concurrencyLimit(Priority priority) const;
+    void setBackgroundLimit(int limit);
+    int backgroundLimit() const;
+    Statistics statistics() const;
+    static const char* priorityName(Priority priority);
+
+    void post(Priority priority, std::function<void()> task, const CancellationToken& token = CancellationToken(),
+        std::function<void()> onCancelled = nullptr);
+    void waitUntil(const std::function<bool()>& done);
+
+    /**
+     * Runs a function on the pool, as QtConcurrent::run() does.
+     *
+     * @param priority The task's class.
+     * @param function The function; it is copied.
+     * @param token Drops the task if cancelled before it starts.
+     * @return A future for the function's result, cancelled if the task is dropped.
+     */
+    template <typename Function>
+    auto run(Priority priority, Function function, const CancellationToken& token = CancellationToken()) -> QFuture<decltype(function())> {
+        using Result = decltype(function());
+        auto promise = std::make_shared<QFutureInterface<Result>>();
+        promise->reportStarted();
+        QFuture<Result> future = promise->future();
+        post(priority, [promise, function]() mutable {
+                if constexpr (std::is_void<Result>::value) {
+                    function();
+                }
+                else {
+                    promise->reportResult(function());
+                }
+                promise->reportFinished();
+            }, token, [promise] {
+                promise->reportCanceled();
+                promise->reportFinished();
+            });
+        return future;
+    }
+
+    /**
+     * Waits for a future from run(). Inside a task, runs queued tasks of the same class in the
+     * meantime.
+     *
+     * @param future The future.
+     */
+    template <typename T>
+    void wait(const QFuture<T>& future) {
+        waitUntil([&future] { return future.isFinished(); });
+    }
+
+    /**
+     * Calls a function on every element of a sequence in parallel and waits, as
+     * QtConcurrent::blockingMap() does. The calling thread takes elements too.
+     *
+     * @param priority The class of the helper tasks.
+     * @param sequence A random access sequence.
+     * @param function Called once per element, with a reference to it.
+     */
+    template <typename Sequence, typename Function>
+    void blockingMap(Priority priority, Sequence& sequence, Function function) {
+        auto first = std::begin(sequence);
+        parallelFor(priority, static_cast<size_t>(std::distance(first, std::end(sequence))),
+            [&first, &function](size_t i) { function(first[i]); });
+    }
+
+private:
+    /** A queued task. */
+    struct Task {
+        Priority priority; ///< Class the task runs in.
+        std::function<void()> run; ///< The work.
+        CancellationToken token; ///< Checked when the task is taken.
+        std::function<void()> onCancelled; ///< Called instead of run if the token is cancelled; may be empty.
+    };
+
+    /** A worker thread and its queues. */
+    struct Worker {
+        std::thread thread; ///< The thread.
+        std::mutex mutex; ///< Guards queues.
+        std::deque<std::unique_ptr<Task>> queues[kPriorityCount]; ///< Tasks posted by this thread, per class.
+    };
+
+    void parallelFor(Priority priority, size_t count, const std::function<void(size_t)>& body);
+    void workerLoop(int index);
+    std::unique_ptr<Task> take(int self, int only = -1);
+    std::unique_ptr<Task> takeFrom(int self, int priority);
+    bool claim(int priority);
+    void release(int priority);
+    void execute(std::unique_ptr<Task> task);
+    void wake();
+
+    std::vector<std::unique_ptr<Worker>> workers; ///< The worker threads.
+    std::mutex sharedMutex; ///< Guards sharedQueues.
+    std::deque<std::unique_ptr<Task>> sharedQueues[kPriorityCount]; ///< Tasks posted from outside the pool, per class.
+    std::mutex wakeMutex; ///< Guards sleeping on wakeup.
+    std::condition_variable wakeup; ///< Signalled when work is posted or the pool stops.
+    std::atomic<uint64_t> epoch; ///< Incremented on every wake(), so a thread cannot miss one.
+    std::atomic<bool> stopping; ///< Set, under wakeMutex, when the pool is shutting down.
+    std::atomic<int> queued[kPriorityCount]; ///< Tasks waiting, per class.
+    std::atomic<int> peakQueued[kPriorityCount]; ///< Most tasks waiting at once, per class.
+    std::atomic<int> running[kPriorityCount]; ///< Tasks running, per class.
+    std::atomic<int> limits[kPriorityCount]; ///< Concurrency limit, per class.
+    std::atomic<int> backgroundRunning; ///< Tasks running in the classes below Interactive.
+    std::atomic<int> backgroundCap; ///< Concurrency limit of the classes below Interactive together.
+    std::atomic<uint64_t> completed[kPriorityCount]; ///< Tasks completed, per class.
+    std::atomic<uint64_t> cancelled[kPriorityCount]; ///< Tasks dropped, per class.
+    std::atomic<uint64_t> steals; ///< Tasks stolen from another worker.
+};
+
+#endif // VIEWER_TASKSCHEDULER_H
@@ -9,6 +9,8 @@
 
 #include "VRRenderThread.h"
 
+#include <algorithm>
+
 
 /* Vtk headers */
 #include <vtkActor.h>
@@ -27,6 +29,10 @@
 #include <vtkDataSetmapper.h>
 #include <vtkCallbackCommand.h>
 #include <vtkLight.h>
+#include <vtkMatrix4x4.h>
+#include <vtkOpenVRInteractorStyle.h>
+#include <vtkOpenGLState.h>
+#include <vtk_glew.h>
 
 /*
 void VRRenderThread::setupLighting(double intensity, double position[3], double color[3])
@@ -52,10 +58,18 @@ VRRenderThread::VRRenderThread( QObject* parent ) {
 	/* Initialise actor list */
 	actors = vtkActorCollection::New();
 
+	/* Parts travel with the partMoved() and contactsChanged() signals */
+	qRegisterMetaType<ModelPart*>("ModelPart*");
+	qRegisterMetaType<QVector<double>>("QVector<double>");
+
+	/* The desktop mirror is off until MainWindow asks for it */
+	mirrorInterval = 0;
+
 	/* Initialise command variables */
 	rotateX = 0.;
 	rotateY = 0.;
 	rotateZ = 0.;
+	shadows = false;
 }
 
 
@@ -86,6 +100,144 @@ void VRRenderThread::addActorOffline( vtkSmartPointer<vtkActor> actor ) {
 }
 
 
+void VRRenderThread::addActorOffline( vtkSmartPointer<vtkActor> actor, ModelPart* part ) {
+
+	if (!this->isRunning()) {
+		addActorOffline(actor);
+		actorParts.append(qMakePair(actor.GetPointer(), part));
+	}
+}
+
+
+void VRRenderThread::setCollisionProxy( ModelPart* part, std::shared_ptr<const CollisionProxy> proxy ) {
+
+	/* The render thread picks these up between events, see updateCollisions() */
+	QMutexLocker locker(&mutex);
+	pendingProxies.append(qMakePair(part, proxy));
+}
+
+
+void VRRenderThread::setMirror( int intervalMs, const QSize& size ) {
+
+	QMutexLocker locker(&mutex);
+	mirrorInterval = intervalMs;
+	mirrorSize = size;
+}
+
+
+/* Records the grabbable actors once the scene has been built. Each actor's UserMatrix holds the
+ * world matrix of its part when it was added, and addActorOffline() has since moved it into the
+ * VR scene, so the actor's full matrix is M = P * W where P is that placement. A grab changes
+ * M; the part's new world matrix is then P^-1 * M, with P^-1 = W * M^-1 taken now.
+ */
+void VRRenderThread::setupGrabBodies() {
+	bodies.clear();
+	for (const auto& entry : actorParts) {
+		GrabBody body;
+		body.actor = entry.first;
+		body.part = entry.second;
+		double* colour = body.actor->GetProperty()->GetDiffuseColor();
+		std::copy(colour, colour + 3, body.colour);
+		body.syncPending = false;
+		body.lastSync = std::chrono::steady_clock::now();
+		bodies.push_back(body);
+	}
+	placeGrabBodies();
+}
+
+
+/* Takes the current actor matrices as the placements of the parts, after the whole scene has
+ * been moved by an animation rather than a grab
+ */
+void VRRenderThread::placeGrabBodies() {
+	for (size_t i = 0; i < bodies.size(); ++i) {
+		GrabBody& body = bodies[i];
+		vtkNew<vtkMatrix4x4> world, inverse, toModel;
+		if (body.actor->GetUserMatrix()) {
+			world->DeepCopy(body.actor->GetUserMatrix());
+		}
+		vtkMatrix4x4::Invert(body.actor->GetMatrix(), inverse);
+		vtkMatrix4x4::Multiply4x4(world, inverse, toModel);
+		std::copy(toModel->GetData(), toModel->GetData() + 16, body.toModel);
+		std::copy(world->GetData(), world->GetData() + 16, body.world);
+		std::copy(body.actor->GetMatrix()->GetData(), body.actor->GetMatrix()->GetData() + 16, body.matrix);
+		collisions.setTransform(static_cast<int>(i), body.matrix);
+	}
+}
+
+
+/* Adds newly arrived collision proxies, then finds the actors whose matrix has changed since the
+ * last call (by the controller, as nothing else moves single actors) and updates their contacts. Actors in contact
+ * are tinted red until they separate. Moved parts are reported to the GUI thread, throttled so
+ * that the tree, the sync session and the mass properties are not updated every frame.
+ */
+void VRRenderThread::updateCollisions() {
+	{
+		QMutexLocker locker(&mutex);
+		for (const auto& entry : pendingProxies) {
+			for (size_t i = 0; i < bodies.size(); ++i) {
+				if (bodies[i].part == entry.first && entry.second) {
+					collisions.setBody(static_cast<int>(i), entry.second, bodies[i].actor->GetMatrix()->GetData());
+				}
+			}
+		}
+		/* Keep proxies for parts whose actors have not been seen yet, i.e. before run() */
+		if (!bodies.empty()) {
+			pendingProxies.clear();
+		}
+	}
+
+	const auto now = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < bodies.size(); ++i) {
+		GrabBody& body = bodies[i];
+		const int id = static_cast<int>(i);
+
+		const double* matrix = body.actor->GetMatrix()->GetData();
+		if (!std::equal(matrix, matrix + 16, body.matrix)) {
+			std::copy(matrix, matrix + 16, body.matrix);
+			vtkMatrix4x4::Multiply4x4(body.toModel, body.matrix, body.world);
+			body.syncPending = true;
+
+			if (collisions.hasBody(id)) {
+				collisions.setTransform(id, body.matrix);
+				std::vector<int> touching = collisions.contacts(id);
+
+				/* Contacts are symmetric, so drop this body from its old partners and add it to the new */
+				for (int other : body.touching) {
+					std::vector<int>& list = bodies[other].touching;
+					list.erase(std::remove(list.begin(), list.end(), id), list.end());
+				}
+				for (int other : touching) {
+					bodies[other].touching.push_back(id);
+				}
+				if (touching.size() != body.touching.size()) {
+					emit contactsChanged(body.part, static_cast<int>(touching.size()), collisions.statistics().ms);
+				}
+				body.touching = touching;
+			}
+		}
+
+		if (body.syncPending && std::chrono::duration_cast<std::chrono::milliseconds>(now - body.lastSync).count() >= 100) {
+			emit partMoved(body.part, QVector<double>(body.world, body.world + 16));
+			body.syncPending = false;
+			body.lastSync = now;
+		}
+	}
+
+	/* Tint or restore the actors */
+	for (GrabBody& body : bodies) {
+		double target[3] = { 1.0, 0.2, 0.2 };
+		if (body.touching.empty()) {
+			std::copy(body.colour, body.colour + 3, target);
+		}
+		double* current = body.actor->GetProperty()->GetDiffuseColor();
+		if (current[0] != target[0] || current[1] != target[1] || current[2] != target[2]) {
+			body.actor->GetProperty()->SetDiffuseColor(target);
+		}
+	}
+}
+
+
 
 void VRRenderThread::issueCommand( int cmd, double value ) {
 
@@ -107,9 +259,73 @@ void VRRenderThread::issueCommand( int cmd, double value ) {
 		case ROTATE_Z:
 			this->rotateZ = value;
 			break;
+
+		/* Any non-zero value turns shadows on */
+		case SHADOWS:
+			this->shadows = value != 0.;
+			break;
 	}
 }
 
+/* Copies the left eye into the mirror image. The eye has already been rendered and resolved for
+ * the headset, so this costs one GPU blit, which also does the scaling, and reading back a
+ * desktop-sized image rather than rendering the scene a second time. It runs in the render
+ * thread between frames, where the VR window's context is current.
+ */
+void VRRenderThread::grabMirrorFrame() {
+	QSize size;
+	{
+		QMutexLocker locker(&mutex);
+		if (mirrorInterval <= 0 || mirrorSize.isEmpty())
+			return;
+		if (std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - mirrorLast).count() < mirrorInterval)
+			return;
+		size = mirrorSize;
+	}
+	mirrorLast = std::chrono::steady_clock::now();
+
+	int eyeWidth = 0, eyeHeight = 0;
+	window->GetRenderBufferSize(eyeWidth, eyeHeight);
+	if (eyeWidth <= 0 || eyeHeight <= 0)
+		return;
+
+	/* Centre crop of the eye with the aspect ratio of the mirror */
+	int cropWidth = eyeWidth, cropHeight = eyeHeight;
+	if (eyeWidth * size.height() > eyeHeight * size.width()) {
+		cropWidth = eyeHeight * size.width() / size.height();
+	}
+	else {
+		cropHeight = eyeWidth * size.height() / size.width();
+	}
+	const int x0 = (eyeWidth - cropWidth) / 2;
+	const int y0 = (eyeHeight - cropHeight) / 2;
+
+	if (!mirrorBuffer || mirrorBuffer->GetLastSize()[0] != size.width() || mirrorBuffer->GetLastSize()[1] != size.height()) {
+		mirrorBuffer = vtkSmartPointer<vtkOpenGLFramebufferObject>::New();
+		mirrorBuffer->SetContext(window);
+		mirrorBuffer->PopulateFramebuffer(size.width(), size.height());
+	}
+
+	/* VTK gives bottom-up rows, QImage wants top-down */
+	QImage image(size, QImage::Format_RGB888);
+	vtkOpenGLState* state = window->GetState();
+	state->PushFramebufferBindings();
+	state->vtkglBindFramebuffer(GL_READ_FRAMEBUFFER, window->GetLeftResolveBufferId());
+	mirrorBuffer->Bind(GL_DRAW_FRAMEBUFFER);
+	glBlitFramebuffer(x0, y0, x0 + cropWidth, y0 + cropHeight, 0, 0, size.width(), size.height(), GL_COLOR_BUFFER_BIT, GL_LINEAR);
+	mirrorBuffer->Bind(GL_READ_FRAMEBUFFER);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	std::vector<unsigned char> pixels(static_cast<size_t>(size.width()) * size.height() * 3);
+	glReadPixels(0, 0, size.width(), size.height(), GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+	state->PopFramebufferBindings();
+
+	const size_t rowBytes = static_cast<size_t>(size.width()) * 3;
+	for (int y = 0; y < size.height(); ++y) {
+		std::copy(pixels.begin() + y * rowBytes, pixels.begin() + (y + 1) * rowBytes, image.scanLine(size.height() - 1 - y));
+	}
+	emit mirrorFrame(image);
+}
+
 /* This function runs in a separate thread. This means that the program 
  * can fork into two separate execution paths. This thread is triggered by
  * calling VRRenderThread::start()
@@ -160,6 +376,11 @@ void VRRenderThread::run() {
 	 */
 	interactor = vtkOpenVRRenderWindowInteractor::New();									
 	interactor->SetRenderWindow(window);													
+
+	/* Pull the trigger to grab and move the part under the controller */
+	vtkNew<vtkOpenVRInteractorStyle> style;
+	style->MapInputToAction(vtkCommand::Select3DEvent, VTKIS_POSITION_PROP);
+	interactor->SetInteractorStyle(style);
 	interactor->Initialize();
 	window->Render();
 	
@@ -170,9 +391,17 @@ void VRRenderThread::run() {
 	 */
 	endRender = false;
 	t_last = std::chrono::steady_clock::now();
+	setupGrabBodies();
+	shadowCache.reset(new ShadowCache(renderer));
 
 	while( !interactor->GetDone() && !this->endRender ) {
+		/* Shadow passes are swapped in between frames; the maps are only baked again when a part moves */
+		if (shadowCache->shadows() != shadows) {
+			shadowCache->setShadows(shadows);
+		}
 		interactor->DoOneEvent( window, renderer );
+		updateCollisions();
+		grabMirrorFrame();
 
 		/* Check to see if enough time has elapsed since last update 
 		 * This looks overcomplicated (and it is, C++ loves to make things unecessarily complicated!) but
@@ -185,7 +414,8 @@ void VRRenderThread::run() {
 		 * interfere with the interator processes and make the simulation unresponsive. If it is too large
 		 * the animations will be jerky. Play with the value to see what works best.
 		 */
-		if (std::chrono::duration_cast <std::chrono::milliseconds> (std::chrono::steady_clock::now() - t_last).count() > 20) {
+		if (std::chrono::duration_cast <std::chrono::milliseconds> (std::chrono::steady_clock::now() - t_last).count() > 20
+			&& (rotateX != 0. || rotateY != 0. || rotateZ != 0.)) {
 
 			/* Do things that might need doing ... */
 			vtkActorCollection* actorList = renderer->GetActors();
@@ -208,11 +438,15 @@ void VRRenderThread::run() {
 			while ((a = (vtkActor*)actorList->GetNextActor())) {
 				a->RotateZ(rotateZ);
 			}
+
+			/* The whole scene has turned, the parts have not moved relative to each other */
+			placeGrabBodies();
 			
 			/* Remember time now */
 			t_last = std::chrono::steady_clock::now();
 		}
 	}
+	shadowCache.reset();
 	window->Finalize();
 }
 
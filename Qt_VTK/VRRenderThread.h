@@ -10,11 +10,24 @@
 #define VR_RENDER_THREAD_H
 
 /* Project headers */
+#include "CollisionWorld.h"
+#include "ModelPart.h"
+#include "ShadowCache.h"
 
 /* Qt headers */
 #include <QThread>
 #include <QMutex>
 #include <QWaitCondition>
+#include <QList>
+#include <QPair>
+#include <QVector>
+#include <QImage>
+#include <QSize>
+
+/* Standard headers */
+#include <chrono>
+#include <memory>
+#include <vector>
 
 /* Vtk headers */
 #include <vtkActor.h>
@@ -25,6 +38,9 @@
 #include <vtkActorCollection.h>
 #include <vtkCommand.h>
 #include <vtkLight.h>
+#include <vtkOpenGLFramebufferObject.h>
+
+Q_DECLARE_METATYPE(ModelPart*)
 
 
 
@@ -43,7 +59,8 @@ public:
         END_RENDER,
         ROTATE_X,
         ROTATE_Y,
-        ROTATE_Z
+        ROTATE_Z,
+        SHADOWS
     } Command;
 
 
@@ -62,6 +79,23 @@ public:
      */
     void addActorOffline(vtkSmartPointer<vtkActor> actor);
 
+    /** As above, for an actor that shows a part. The controller trigger grabs and moves
+      * the actor, its contacts with other parts are flagged once their collision proxies
+      * have arrived, and its new position is reported back through partMoved()
+      */
+    void addActorOffline(vtkSmartPointer<vtkActor> actor, ModelPart* part);
+
+    /** Hands over the collision proxy of a part, before or after rendering has started.
+      * Thread safe.
+      */
+    void setCollisionProxy(ModelPart* part, std::shared_ptr<const CollisionProxy> proxy);
+
+    /** Turns the desktop mirror on or off. While on, the left eye image is scaled down
+      * to size on the GPU, centre-cropped to its aspect ratio, and passed out through
+      * mirrorFrame() every intervalMs. An interval of 0 turns the mirror off. Thread safe.
+      */
+    void setMirror(int intervalMs, const QSize& size);
+
 
     /** This allows commands to be issued to the VR thread in a thread safe way. 
       * Function will set variables within the class to indicate the type of
@@ -70,12 +104,43 @@ public:
     void issueCommand( int cmd, double value );
 
 
+signals:
+    /** A grabbed part has moved; world is its new row-major world matrix in model
+      * coordinates. Emitted at most ten times a second while the part moves and once
+      * more after it stops
+      */
+    void partMoved(ModelPart* part, const QVector<double>& world);
+
+    /** The number of parts a moved part touches has changed */
+    void contactsChanged(ModelPart* part, int contacts, double queryMs);
+
+    /** A new mirror image of the left eye, see setMirror() */
+    void mirrorFrame(const QImage& image);
+
 protected:
     /** This is a re-implementation of a QThread function 
       */
     void run() override;
 
 private:
+    /** An actor that can be grabbed, and what is needed to flag its contacts and report its pose */
+    struct GrabBody {
+        vtkActor*           actor;          /*< The VR actor */
+        ModelPart*          part;           /*< The part it shows; only handed back to the GUI thread */
+        double              toModel[16];    /*< Maps the actor's VR matrix to the part's world matrix */
+        double              world[16];      /*< Latest world matrix of the part */
+        double              matrix[16];     /*< Actor matrix when last checked */
+        double              colour[3];      /*< Diffuse colour to restore when contact ends */
+        std::vector<int>    touching;       /*< Bodies in contact with this one */
+        bool                syncPending;    /*< Moved since partMoved() was last emitted */
+        std::chrono::time_point<std::chrono::steady_clock> lastSync; /*< When partMoved() was last emitted */
+    };
+
+    void setupGrabBodies();
+    void placeGrabBodies();
+    void updateCollisions();
+    void grabMirrorFrame();
+
     /* Standard VTK VR Classes */
     vtkSmartPointer<vtkOpenVRRenderWindow>              window;
     vtkSmartPointer<vtkOpenVRRenderWindowInteractor>    interactor;
@@ -90,6 +155,22 @@ private:
     /** List of actors that will need to be added to the VR scene */
     vtkSmartPointer<vtkActorCollection>                 actors;
 
+    /** Parts shown by actors added with addActorOffline(actor, part) */
+    QList<QPair<vtkActor*, ModelPart*>>                 actorParts;
+
+    /** Proxies handed over by setCollisionProxy() and not yet used, guarded by mutex */
+    QList<QPair<ModelPart*, std::shared_ptr<const CollisionProxy>>> pendingProxies;
+
+    /** Grabbable actors and their proxies, used only by the render thread */
+    std::vector<GrabBody>                               bodies;
+    CollisionWorld                                      collisions;
+
+    /* Desktop mirror settings, guarded by mutex, and the buffer the eye is scaled into */
+    int                                                 mirrorInterval;
+    QSize                                               mirrorSize;
+    vtkSmartPointer<vtkOpenGLFramebufferObject>         mirrorBuffer;
+    std::chrono::time_point<std::chrono::steady_clock>  mirrorLast;
+
     /** A timer to help implement animations and visual effects */
     std::chrono::time_point<std::chrono::steady_clock>  t_last;
 
@@ -104,6 +185,10 @@ private:
     double rotateX;         /*< Degrees to rotate around X axis (per time-step) */
     double rotateY;         /*< Degrees to rotate around Y axis (per time-step) */
     double rotateZ;         /*< Degrees to rotate around Z axis (per time-step) */
+    bool shadows;           /*< Whether parts cast shadows, set by the SHADOWS command */
+
+    /** Shadow maps for the VR renderer, baked once for both eyes and reused until the scene changes */
+    std::unique_ptr<ShadowCache>                        shadowCache;
 };
 
 
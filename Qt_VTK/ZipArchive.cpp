@@ -0,0 +1,255 @@
+/**
+ * @file ZipArchive.cpp
+ * @brief Implementation of the ZipArchive class.
+ *
+ * Only the structures needed for reading are parsed: the end of central directory record (and its
+ * ZIP64 variant), the central directory, and the fixed part of each local header. Split archives
+ * are not supported.
+ */
+
+#include "ZipArchive.h"
+#include <algorithm>
+#include <climits>
+#include <vtk_zlib.h>
+
+namespace {
+
+const uint32_t kEndOfCentralDirectory = 0x06054b50;
+const uint32_t kZip64EndOfCentralDirectory = 0x06064b50;
+const uint32_t kZip64Locator = 0x07064b50;
+const uint32_t kCentralHeader = 0x02014b50;
+const uint32_t kLocalHeader = 0x04034b50;
+const uint64_t kEndRecordSize = 22;
+const uint64_t kCentralHeaderSize = 46;
+const uint64_t kLocalHeaderSize = 30;
+const uint64_t kMaxDeflateRatio = 1032; ///< Deflate cannot expand data by more than this.
+const uint64_t kMaxEntrySize = uint64_t(1) << 33; ///< Largest entry extracted, 8 GiB; far beyond any part the viewer can show.
+
+uint16_t read16(const unsigned char* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+uint32_t read32(const unsigned char* p) {
+    return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+uint64_t read64(const unsigned char* p) {
+    return uint64_t(read32(p)) | (uint64_t(read32(p + 4)) << 32);
+}
+
+bool fail(QString* error, const QString& message) {
+    if (error) *error = message;
+    return false;
+}
+
+} // namespace
+
+/**
+ * Constructs a closed archive.
+ */
+ZipArchive::ZipArchive() : data(nullptr), size(0) {
+}
+
+/**
+ * Unmaps and closes the archive.
+ */
+ZipArchive::~ZipArchive() {
+    if (data) {
+        file.unmap(const_cast<unsigned char*>(data));
+    }
+}
+
+/**
+ * Opens an archive and reads its table of contents.
+ *
+ * @param fileName Path of the ZIP file.
+ * @param error Optional; receives a description of the problem if the archive cannot be read.
+ * @return True on success.
+ */
+bool ZipArchive::open(const QString& fileName, QString* error) {
+    file.setFileName(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return fail(error, file.errorString());
+
+    size = static_cast<uint64_t>(file.size());
+    if (size < kEndRecordSize)
+        return fail(error, "File is too small to be a ZIP archive");
+
+    data = file.map(0, file.size());
+    if (!data)
+        return fail(error, file.errorString());
+
+    return readCentralDirectory(error);
+}
+
+/**
+ * Gets the file entries of the archive.
+ *
+ * @return The entries, in central directory order. Directory entries are not included.
+ */
+const std::vector<ZipArchive::Entry>& ZipArchive::entries() const {
+    return m_entries;
+}
+
+/**
+ * Locates the end of central directory record and parses every central directory header.
+ */
+bool ZipArchive::readCentralDirectory(QString* error) {
+    // The end record is followed by a comment of up to 64 KiB, so search backwards for it
+    uint64_t end = size - kEndRecordSize;
+    uint64_t stop = size > kEndRecordSize + 0xFFFF ? size - kEndRecordSize - 0xFFFF : 0;
+    for (;; --end) {
+        if (read32(data + end) == kEndOfCentralDirectory)
+            break;
+        if (end == stop)
+            return fail(error, "Not a ZIP archive (no end of central directory record)");
+    }
+
+    uint64_t entryCount = read16(data + end + 10);
+    uint64_t directorySize = read32(data + end + 12);
+    uint64_t directoryOffset = read32(data + end + 16);
+
+    // ZIP64 archives keep the real values in a second record, found through a locator
+    if (end >= 20 && read32(data + end - 20) == kZip64Locator) {
+        uint64_t recordOffset = read64(data + end - 20 + 8);
+        if (recordOffset > size || size - recordOffset < 56 || read32(data + recordOffset) != kZip64EndOfCentralDirectory)
+            return fail(error, "Corrupt ZIP64 end of central directory record");
+        entryCount = read64(data + recordOffset + 32);
+        directorySize = read64(data + recordOffset + 40);
+        directoryOffset = read64(data + recordOffset + 48);
+    }
+
+    // Offsets and sizes come from the file, so compare against the space left rather than adding
+    // them, which a crafted 64-bit value could wrap
+    if (directoryOffset > size || directorySize > size - directoryOffset)
+        return fail(error, "Central directory lies outside the file");
+
+    m_entries.clear();
+    m_entries.reserve(static_cast<size_t>(std::min<uint64_t>(entryCount, directorySize / kCentralHeaderSize)));
+
+    uint64_t offset = directoryOffset;
+    const uint64_t directoryEnd = directoryOffset + directorySize;
+    for (uint64_t i = 0; i < entryCount; ++i) {
+        if (offset + kCentralHeaderSize > directoryEnd || read32(data + offset) != kCentralHeader)
+            return fail(error, "Corrupt central directory");
+
+        const unsigned char* header = data + offset;
+        uint16_t nameLength = read16(header + 28);
+        uint16_t extraLength = read16(header + 30);
+        uint16_t commentLength = read16(header + 32);
+        if (offset + kCentralHeaderSize + nameLength + extraLength + commentLength > directoryEnd)
+            return fail(error, "Corrupt central directory");
+
+        Entry entry;
+        entry.flags = read16(header + 8);
+        entry.method = read16(header + 10);
+        entry.crc = read32(header + 16);
+        entry.compressedSize = read32(header + 20);
+        entry.uncompressedSize = read32(header + 24);
+        entry.localHeaderOffset = read32(header + 42);
+
+        const char* name = reinterpret_cast<const char*>(header + kCentralHeaderSize);
+        entry.name = (entry.flags & 0x0800) ? QString::fromUtf8(name, nameLength) : QString::fromLatin1(name, nameLength);
+        entry.name.replace('\\', '/');
+
+        // Sizes and offsets that overflow 32 bits are stored in the ZIP64 extra field, in this order
+        const unsigned char* extra = header + kCentralHeaderSize + nameLength;
+        for (uint16_t pos = 0; pos + 4 <= extraLength;) {
+            uint16_t id = read16(extra + pos);
+            uint16_t length = read16(extra + pos + 2);
+            const unsigned char* field = extra + pos + 4;
+            const unsigned char* fieldEnd = field + std::min<int>(length, extraLength - pos - 4);
+            if (id == 0x0001) {
+                if (entry.uncompressedSize == 0xFFFFFFFF && field + 8 <= fieldEnd) { entry.uncompressedSize = read64(field); field += 8; }
+                if (entry.compressedSize == 0xFFFFFFFF && field + 8 <= fieldEnd) { entry.compressedSize = read64(field); field += 8; }
+                if (entry.localHeaderOffset == 0xFFFFFFFF && field + 8 <= fieldEnd) { entry.localHeaderOffset = read64(field); }
+            }
+            pos += 4 + length;
+        }
+
+        if (!entry.name.endsWith('/')) {
+            m_entries.push_back(entry);
+        }
+        offset += kCentralHeaderSize + nameLength + extraLength + commentLength;
+    }
+    return true;
+}
+
+/**
+ * Decompresses one entry into a new buffer. Safe to call from several threads at once.
+ *
+ * @param entry An entry returned by entries().
+ * @param buffer Receives the extracted data.
+ * @param error Optional; receives a description of the problem if extraction fails.
+ * @return True if the entry was extracted and its checksum matched.
+ */
+bool ZipArchive::extract(const Entry& entry, AlignedBuffer& buffer, QString* error) const {
+    if (entry.flags & 0x0001)
+        return fail(error, "Encrypted entries are not supported");
+    if (entry.method != 0 && entry.method != 8)
+        return fail(error, QString("Unsupported compression method %1").arg(entry.method));
+
+    // The local header repeats the name and has its own extra field, so its length must be read
+    uint64_t offset = entry.localHeaderOffset;
+    if (offset > size || size - offset < kLocalHeaderSize || read32(data + offset) != kLocalHeader)
+        return fail(error, "Corrupt local header");
+    offset += kLocalHeaderSize + read16(data + offset + 26) + read16(data + offset + 28);
+    if (offset > size || entry.compressedSize > size - offset)
+        return fail(error, "Entry data lies outside the file");
+    const unsigned char* source = data + offset;
+
+    // The size to allocate comes from the header, so check it is one the data could produce
+    const uint64_t largest = entry.method == 0 ? entry.compressedSize : entry.compressedSize * kMaxDeflateRatio + 1024;
+    if (entry.uncompressedSize > largest || entry.uncompressedSize > kMaxEntrySize || entry.uncompressedSize > SIZE_MAX - AlignedBuffer::alignment)
+        return fail(error, "Entry size is implausible for its compressed data");
+
+    buffer = AlignedBuffer(static_cast<size_t>(entry.uncompressedSize));
+    if (!buffer.data())
+        return fail(error, "Out of memory");
+    unsigned char* target = reinterpret_cast<unsigned char*>(buffer.data());
+
+    if (entry.method == 0) {
+        if (entry.compressedSize != entry.uncompressedSize)
+            return fail(error, "Stored entry sizes do not match");
+        std::copy(source, source + entry.uncompressedSize, target);
+    }
+    else {
+        z_stream stream = {};
+        if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) // Raw deflate, no zlib header
+            return fail(error, "Could not initialise decompressor");
+
+        uint64_t inputLeft = entry.compressedSize;
+        uint64_t outputLeft = entry.uncompressedSize;
+        stream.next_in = const_cast<Bytef*>(source);
+        stream.next_out = target;
+        int status = Z_OK;
+        while (status == Z_OK) {
+            // avail_in/avail_out are 32-bit, so large entries are fed in slices
+            if (stream.avail_in == 0) {
+                stream.avail_in = static_cast<uInt>(std::min<uint64_t>(inputLeft, UINT_MAX));
+                inputLeft -= stream.avail_in;
+            }
+            if (stream.avail_out == 0) {
+                stream.avail_out = static_cast<uInt>(std::min<uint64_t>(outputLeft, UINT_MAX));
+                outputLeft -= stream.avail_out;
+            }
+            status = inflate(&stream, Z_NO_FLUSH);
+            if (status == Z_BUF_ERROR && (stream.avail_in != 0 || inputLeft != 0) && (stream.avail_out != 0 || outputLeft != 0))
+                status = Z_OK; // Progress is still possible
+        }
+        uint64_t produced = stream.total_out;
+        inflateEnd(&stream);
+        if (status != Z_STREAM_END || produced != entry.uncompressedSize)
+            return fail(error, "Corrupt compressed data");
+    }
+
+    uLong crc = crc32(0L, Z_NULL, 0);
+    for (uint64_t done = 0; done < entry.uncompressedSize;) {
+        uInt length = static_cast<uInt>(std::min<uint64_t>(entry.uncompressedSize - done, UINT_MAX));
+        crc = crc32(crc, target + done, length);
+        done += length;
+    }
+    if (static_cast<uint32_t>(crc) != entry.crc)
+        return fail(error, "Checksum mismatch");
+    return true;
+}
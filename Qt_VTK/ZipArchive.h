@@ -0,0 +1,55 @@
+/**
+ * @file ZipArchive.h
+ *
+ * Defines the ZipArchive class, a small read-only ZIP reader used to import STL bundles without
+ * extracting them to disk. The archive is memory-mapped and its central directory is parsed once;
+ * entries can then be decompressed independently, and from several threads at the same time.
+ * Stored and deflated entries are supported, which covers archives written by common tools.
+ */
+
+#ifndef VIEWER_ZIPARCHIVE_H
+#define VIEWER_ZIPARCHIVE_H
+
+#include <QFile>
+#include <QString>
+#include <cstdint>
+#include <vector>
+#include "BulkFileReader.h"
+
+/**
+ * @class ZipArchive
+ * @brief Read-only access to the entries of a ZIP file.
+ */
+class ZipArchive {
+public:
+    /**
+     * @struct Entry
+     * @brief One file in the archive, as described by the central directory.
+     */
+    struct Entry {
+        QString name; ///< Path inside the archive, using '/' separators.
+        uint16_t method; ///< Compression method: 0 for stored, 8 for deflate.
+        uint16_t flags; ///< General purpose flags; bit 0 marks encrypted entries.
+        uint32_t crc; ///< CRC-32 of the extracted data.
+        uint64_t compressedSize; ///< Size of the data in the archive.
+        uint64_t uncompressedSize; ///< Size of the extracted data.
+        uint64_t localHeaderOffset; ///< Offset of the entry's local header from the start of the archive.
+    };
+
+    ZipArchive();
+    ~ZipArchive();
+
+    bool open(const QString& fileName, QString* error = nullptr);
+    const std::vector<Entry>& entries() const;
+    bool extract(const Entry& entry, AlignedBuffer& buffer, QString* error = nullptr) const;
+
+private:
+    bool readCentralDirectory(QString* error);
+
+    QFile file; ///< The archive file.
+    const unsigned char* data; ///< Memory-mapped contents of the archive.
+    uint64_t size; ///< Size of the archive in bytes.
+    std::vector<Entry> m_entries; ///< File entries; directories are skipped.
+};
+
+#endif // VIEWER_ZIPARCHIVE_H
@@ -0,0 +1,1298 @@
+/**
+ * @file benchmark.cpp
+ * @brief Entry point of Qt_VTK_bench, the offscreen benchmark harness.
+ *
+ * Renders an assembly offscreen through SceneRenderer, the same scene setup the main window uses,
+ * while playing back scripted camera paths, and prints frame-time percentiles, draw calls and
+ * triangles per frame as JSON, optionally with the parts that cost the most to draw. Further
+ * modes time the SIMD geometry kernels, the bulk import path, the layer slicer, feature edge
+ * extraction, the mesh codec and deviation analysis, replay sessions recorded in the viewer as
+ * regression benchmarks, measure how long interactive work waits behind a busy task scheduler,
+ * and time adding thousands of rows to the part tree with a view attached.
+ *
+ * Examples:
+ *   Qt_VTK_bench --synthetic 2000 --paths orbit,zoom --frames 360 --output render.json
+ *   Qt_VTK_bench --input assembly.zip --culling --impostors
+ *   Qt_VTK_bench --synthetic 500 --shadows --contact-shadow
+ *   Qt_VTK_bench --input assembly.zip --paths orbit --profile-parts 20
+ *   Qt_VTK_bench --mode kernels
+ *   Qt_VTK_bench --mode import --input parts/ --cold
+ *   Qt_VTK_bench --mode slice --input bracket.stl --spacing 0.05
+ *   Qt_VTK_bench --mode edges --input assembly.zip --angle 30
+ *   Qt_VTK_bench --mode codec --input assembly.zip --bits 0,16,12
+ *   Qt_VTK_bench --mode deviation --input housing.stl --points 10000000
+ *   Qt_VTK_bench --mode replay --input review.vrec --realtime
+ *   Qt_VTK_bench --mode scheduler --tasks 2000
+ *   Qt_VTK_bench --mode insert --rows 10000
+ *
+ * On machines without a GPU, run against Mesa's software rasteriser, e.g.
+ *   LIBGL_ALWAYS_SOFTWARE=1 xvfb-run -s "-screen 0 1920x1080x24" Qt_VTK_bench ...
+ * or use a VTK build with OSMesa or EGL offscreen support, which needs no X server.
+ */
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+#include <QThread>
+#include <QTreeView>
+#include <vtkCamera.h>
+#include <vtkFeatureEdges.h>
+#include <vtkMath.h>
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <vtkProperty.h>
+#include <vtkRenderWindow.h>
+#include <vtkSTLReader.h>
+#include <vtkSphereSource.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <random>
+#include <vector>
+#include "AssemblyImporter.h"
+#include "BulkFileReader.h"
+#include "DeviationAnalysis.h"
+#include "FeatureEdges.h"
+#include "GeometryKernels.h"
+#include "MeshCodec.h"
+#include "ModelPart.h"
+#include "ModelPartList.h"
+#include "SceneRenderer.h"
+#include "Slicer.h"
+#include "StlParser.h"
+#include "SyncSession.h"
+#include "TaskScheduler.h"
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef VIEWER_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+
+/**
+ * Summarises a series of samples as mean, percentiles and maximum.
+ */
+QJsonObject summarize(std::vector<double> samples) {
+    QJsonObject summary;
+    if (samples.empty())
+        return summary;
+
+    std::sort(samples.begin(), samples.end());
+    auto percentile = [&samples](double p) {
+        size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * samples.size()));
+        return samples[std::min(samples.size() - 1, rank > 0 ? rank - 1 : 0)];
+    };
+    summary["mean"] = std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+    summary["p50"] = percentile(50);
+    summary["p90"] = percentile(90);
+    summary["p95"] = percentile(95);
+    summary["p99"] = percentile(99);
+    summary["max"] = samples.back();
+    return summary;
+}
+
+/**
+ * Builds a synthetic assembly of spheres on a grid, in groups of 50 so the tree has some depth.
+ */
+ModelPart* buildSyntheticAssembly(int partCount, int resolution) {
+    ModelPart* assembly = new ModelPart({ "Synthetic", "true", "255,255,255" });
+    const int side = std::max(1, static_cast<int>(std::ceil(std::cbrt(static_cast<double>(partCount)))));
+    std::mt19937 generator(31);
+    std::uniform_real_distribution<double> radius(0.5, 1.4);
+
+    ModelPart* group = nullptr;
+    for (int i = 0; i < partCount; ++i) {
+        if (i % 50 == 0) {
+            group = new ModelPart({ QString("Group %1").arg(i / 50), "true", "255,255,255" });
+            assembly->appendChild(group);
+        }
+
+        vtkNew<vtkSphereSource> sphere;
+        sphere->SetRadius(radius(generator));
+        sphere->SetCenter(3.0 * (i % side), 3.0 * ((i / side) % side), 3.0 * (i / (side * side)));
+        sphere->SetThetaResolution(resolution);
+        sphere->SetPhiResolution(resolution);
+        sphere->Update();
+
+        ModelPart* part = new ModelPart({ QString("Part %1").arg(i), "true", "255,255,255" });
+        part->setPolyData(sphere->GetOutput());
+        part->setColour(static_cast<unsigned char>(80 + i * 37 % 170), static_cast<unsigned char>(80 + i * 61 % 170), 200);
+        part->getActor()->GetProperty()->SetDiffuseColor(part->getColor().redF(), part->getColor().greenF(), part->getColor().blueF());
+        group->appendChild(part);
+    }
+    return assembly;
+}
+
+/**
+ * Counts the parts with geometry and their triangles.
+ */
+void countGeometry(ModelPart* part, int& parts, long long& triangles) {
+    if (part->getPolyData()) {
+        ++parts;
+        triangles += part->getPolyData()->GetNumberOfPolys();
+    }
+    for (int i = 0; i < part->childCount(); ++i) {
+        countGeometry(part->child(i), parts, triangles);
+    }
+}
+
+/**
+ * Extracts one "name: value" line from vtkRenderWindow::ReportCapabilities().
+ */
+QString capability(const QString& report, const QString& name) {
+    for (const QString& line : report.split('\n')) {
+        if (line.trimmed().startsWith(name)) {
+            return line.section(':', 1).trimmed();
+        }
+    }
+    return QString();
+}
+
+/**
+ * Renders the scene along each camera path and reports per-frame statistics.
+ */
+QJsonObject runRenderBenchmark(const QCommandLineParser& options) {
+    QJsonObject result;
+    result["benchmark"] = "render";
+
+    ModelPart* root = new ModelPart({ "Root", "true", "255,255,255" });
+    root->setVisible(true);
+    QStringList errors;
+    ModelPart* assembly = options.isSet("input")
+        ? AssemblyImporter::importPath(options.value("input"), &errors)
+        : buildSyntheticAssembly(options.value("synthetic").toInt(), options.value("resolution").toInt());
+    if (!assembly) {
+        result["error"] = "No geometry could be loaded: " + errors.join("; ");
+        delete root;
+        return result;
+    }
+    root->appendChild(assembly);
+
+    int partCount = 0;
+    long long triangleCount = 0;
+    countGeometry(root, partCount, triangleCount);
+    QJsonObject scene;
+    scene["source"] = options.isSet("input") ? options.value("input") : QString("synthetic");
+    scene["parts"] = partCount;
+    scene["triangles"] = triangleCount;
+    scene["loadErrors"] = errors.size();
+    result["scene"] = scene;
+
+    const int width = options.value("width").toInt();
+    const int height = options.value("height").toInt();
+    const int frames = std::max(1, options.value("frames").toInt());
+    SceneRenderer sceneRenderer;
+    sceneRenderer.setOcclusionCulling(options.isSet("culling"));
+    sceneRenderer.setImpostors(options.isSet("impostors"));
+    sceneRenderer.setShadows(options.isSet("shadows"));
+    sceneRenderer.setContactShadow(options.isSet("contact-shadow"));
+    sceneRenderer.setCollectStatistics(true);
+    sceneRenderer.setRoot(root);
+
+    vtkNew<vtkRenderWindow> renderWindow;
+    renderWindow->SetOffScreenRendering(1);
+    renderWindow->SetSize(width, height);
+    renderWindow->AddRenderer(sceneRenderer.getRenderer());
+    renderWindow->Render();
+
+    const QString capabilities = QString::fromUtf8(renderWindow->ReportCapabilities());
+    QJsonObject settings;
+    settings["width"] = width;
+    settings["height"] = height;
+    settings["framesPerPath"] = frames;
+    settings["occlusionCulling"] = options.isSet("culling");
+    settings["impostors"] = options.isSet("impostors");
+    settings["shadows"] = options.isSet("shadows");
+    settings["contactShadow"] = options.isSet("contact-shadow");
+    settings["profileParts"] = options.value("profile-parts").toInt();
+    settings["glVendor"] = capability(capabilities, "OpenGL vendor string");
+    settings["glRenderer"] = capability(capabilities, "OpenGL renderer string");
+    settings["glVersion"] = capability(capabilities, "OpenGL version string");
+    settings["simd"] = GeometryKernels::name(GeometryKernels::instructionSet());
+    result["settings"] = settings;
+
+    QJsonArray paths;
+    for (const QString& path : options.value("paths").split(',', Qt::SkipEmptyParts)) {
+        sceneRenderer.resetCamera();
+        vtkCamera* camera = sceneRenderer.getRenderer()->GetActiveCamera();
+
+        // Each path returns to its starting view, so a looping playback has no jump
+        auto step = [&](int frame) {
+            if (path == "orbit") {
+                camera->Azimuth(360.0 / frames);
+            }
+            else if (path == "zoom") {
+                const double factor = std::pow(8.0, 2.0 / frames); // In to 8x over the first half, then back out
+                camera->Dolly(frame < frames / 2 ? factor : 1.0 / factor);
+            }
+            else if (path == "flyby") {
+                camera->Azimuth(180.0 / frames);
+                camera->Elevation(std::sin(2.0 * vtkMath::Pi() * frame / frames) * 0.5);
+                camera->Dolly(frame < frames / 2 ? 1.01 : 1.0 / 1.01);
+                camera->OrthogonalizeViewUp();
+            }
+            sceneRenderer.getRenderer()->ResetCameraClippingRange();
+        };
+
+        for (int i = 0; i < 10; ++i) { // Warm up buffers and shader caches off the clock
+            renderWindow->Render();
+            QCoreApplication::processEvents();
+        }
+
+        std::vector<double> frameMs, prepareMs, drawCalls, triangles, culled, impostors;
+        const ShadowCache::Statistics shadowsBefore = sceneRenderer.shadowStatistics();
+        QElapsedTimer timer;
+        for (int frame = 0; frame < frames; ++frame) {
+            step(frame);
+            timer.start();
+            renderWindow->Render();
+            renderWindow->WaitForCompletion();
+            frameMs.push_back(timer.nsecsElapsed() / 1e6);
+
+            SceneRenderer::FrameStats stats = sceneRenderer.lastFrameStats();
+            prepareMs.push_back(stats.prepareMs);
+            drawCalls.push_back(stats.drawnProps);
+            triangles.push_back(static_cast<double>(stats.triangles));
+            culled.push_back(stats.culled);
+            impostors.push_back(stats.impostors);
+
+            QCoreApplication::processEvents(); // Let impostor captures run between frames, as in the viewer
+        }
+
+        QJsonObject report;
+        report["name"] = path;
+        report["frames"] = frames;
+        report["frameMs"] = summarize(frameMs);
+        report["fps"] = 1000.0 / std::max(1e-9, std::accumulate(frameMs.begin(), frameMs.end(), 0.0) / frames);
+        report["prepareMs"] = summarize(prepareMs);
+        report["drawCalls"] = summarize(drawCalls);
+        report["triangles"] = summarize(triangles);
+        report["culledParts"] = summarize(culled);
+        report["impostorParts"] = summarize(impostors);
+        const ShadowCache::Statistics shadowsAfter = sceneRenderer.shadowStatistics();
+        report["shadowBakes"] = shadowsAfter.bakes - shadowsBefore.bakes;
+        report["contactShadowBakes"] = shadowsAfter.contactBakes - shadowsBefore.contactBakes;
+
+        // Profiling waits for the GPU after every frame, so it runs as a second pass off the clock
+        const int profiledParts = options.value("profile-parts").toInt();
+        if (profiledParts > 0) {
+            sceneRenderer.setRenderProfiling(true);
+            for (int frame = 0; frame < frames; ++frame) {
+                step(frame);
+                renderWindow->Render();
+                QCoreApplication::processEvents();
+            }
+            const RenderProfiler::Profile profile = sceneRenderer.renderProfile();
+            sceneRenderer.setRenderProfiling(false);
+
+            std::vector<std::pair<double, ModelPart*>> ranked;
+            for (const auto& entry : profile.parts) {
+                ranked.emplace_back(entry.second.costMs(), entry.first);
+            }
+            const size_t count = std::min(static_cast<size_t>(profiledParts), ranked.size());
+            std::partial_sort(ranked.begin(), ranked.begin() + count, ranked.end(),
+                [](const std::pair<double, ModelPart*>& a, const std::pair<double, ModelPart*>& b) { return a.first > b.first; });
+
+            const double totalMs = profile.totalMs();
+            QJsonArray costliest;
+            for (size_t i = 0; i < count; ++i) {
+                const RenderProfiler::PartCost& cost = profile.parts.at(ranked[i].second);
+                QJsonObject part;
+                part["name"] = ranked[i].second->data(0).toString();
+                part["costMs"] = cost.costMs();
+                part["share"] = totalMs > 0.0 ? cost.costMs() / totalMs : 0.0;
+                part["cpuMs"] = cost.cpuMs;
+                part["gpuMs"] = cost.gpuMs;
+                part["drawCalls"] = cost.drawCalls;
+                part["triangles"] = cost.triangles;
+                costliest.append(part);
+            }
+            QJsonObject attribution;
+            attribution["frames"] = profile.frames;
+            attribution["gpuTimed"] = profile.gpuTimed;
+            attribution["totalMs"] = totalMs;
+            attribution["unattributedMs"] = profile.unattributed.costMs();
+            attribution["costliestParts"] = costliest;
+            report["renderCost"] = attribution;
+        }
+        paths.append(report);
+    }
+    result["paths"] = paths;
+
+    sceneRenderer.setRoot(nullptr);
+    delete root;
+    return result;
+}
+
+/**
+ * Times every geometry kernel with every supported instruction set and checks each against the
+ * scalar reference.
+ */
+QJsonObject runKernelBenchmark(const QCommandLineParser& options) {
+    const size_t pointCount = options.value("points").toULongLong();
+    const size_t triangleCount = pointCount * 2;
+    std::mt19937 generator(82);
+    std::uniform_real_distribution<float> coordinate(-100.0f, 100.0f);
+    std::vector<float> points(pointCount * 3);
+    for (float& v : points) v = coordinate(generator);
+    std::vector<uint32_t> triangles(triangleCount * 3);
+    for (size_t t = 0; t < triangleCount; ++t) { // Mostly local connectivity, like a real mesh
+        uint32_t base = static_cast<uint32_t>(generator() % (pointCount - 2));
+        triangles[t * 3] = base;
+        triangles[t * 3 + 1] = base + 1;
+        triangles[t * 3 + 2] = base + 2;
+    }
+    const double matrix[16] = { 0.8, -0.6, 0, 5, 0.6, 0.8, 0, -3, 0, 0, 1, 2, 0.001, 0.002, 0.003, 1 };
+    const double box[6] = { -100, 100, -100, 100, -100, 100 };
+
+    std::vector<float> out3(std::max(pointCount, triangleCount) * 3), out4(pointCount * 4);
+    std::vector<uint16_t> quantized(pointCount * 3);
+    const int repeats = 5;
+
+    // Results of the scalar reference, for the correctness columns
+    struct Outputs {
+        double bounds[6];
+        std::vector<float> transformed, projected, normals;
+        std::vector<uint16_t> quantized;
+        double centroid[3], area, integrals[10];
+    };
+    auto compute = [&](Outputs& o) {
+        GeometryKernels::bounds(points.data(), pointCount, o.bounds);
+        o.transformed.resize(pointCount * 3);
+        GeometryKernels::transformPoints(points.data(), o.transformed.data(), pointCount, matrix);
+        o.projected.resize(pointCount * 4);
+        GeometryKernels::projectPoints(points.data(), o.projected.data(), pointCount, matrix);
+        o.normals.resize(triangleCount * 3);
+        GeometryKernels::faceNormals(points.data(), triangles.data(), triangleCount, o.normals.data());
+        o.quantized.resize(pointCount * 3);
+        GeometryKernels::quantize(points.data(), pointCount, box, o.quantized.data());
+        GeometryKernels::centroidAndArea(points.data(), triangles.data(), triangleCount, o.centroid, o.area);
+        GeometryKernels::volumeIntegrals(points.data(), triangles.data(), triangleCount, o.integrals);
+    };
+    auto maxDifference = [](const std::vector<float>& a, const std::vector<float>& b) {
+        double d = 0.0;
+        for (size_t i = 0; i < a.size(); ++i) d = std::max(d, static_cast<double>(std::fabs(a[i] - b[i])));
+        return d;
+    };
+
+    const GeometryKernels::InstructionSet original = GeometryKernels::instructionSet();
+    GeometryKernels::setInstructionSet(GeometryKernels::Scalar);
+    Outputs reference;
+    compute(reference);
+
+    QJsonArray sets;
+    for (int set = GeometryKernels::Scalar; set <= GeometryKernels::bestSupported(); ++set) {
+        if (!GeometryKernels::setInstructionSet(GeometryKernels::InstructionSet(set)))
+            continue;
+
+        auto bestOf = [&](auto&& kernel) {
+            double best = 1e300;
+            for (int r = 0; r < repeats; ++r) {
+                QElapsedTimer timer;
+                timer.start();
+                kernel();
+                best = std::min(best, timer.nsecsElapsed() / 1e6);
+            }
+            return best;
+        };
+        QJsonObject ms;
+        double bounds[6], centroid[3], area, integrals[10];
+        ms["bounds"] = bestOf([&] { GeometryKernels::bounds(points.data(), pointCount, bounds); });
+        ms["transformPoints"] = bestOf([&] { GeometryKernels::transformPoints(points.data(), out3.data(), pointCount, matrix); });
+        ms["projectPoints"] = bestOf([&] { GeometryKernels::projectPoints(points.data(), out4.data(), pointCount, matrix); });
+        ms["faceNormals"] = bestOf([&] { GeometryKernels::faceNormals(points.data(), triangles.data(), triangleCount, out3.data()); });
+        ms["quantize"] = bestOf([&] { GeometryKernels::quantize(points.data(), pointCount, box, quantized.data()); });
+        ms["centroidAndArea"] = bestOf([&] { GeometryKernels::centroidAndArea(points.data(), triangles.data(), triangleCount, centroid, area); });
+        ms["volumeIntegrals"] = bestOf([&] { GeometryKernels::volumeIntegrals(points.data(), triangles.data(), triangleCount, integrals); });
+
+        Outputs outputs;
+        compute(outputs);
+        int quantizeError = 0;
+        for (size_t i = 0; i < outputs.quantized.size(); ++i) {
+            quantizeError = std::max(quantizeError, std::abs(int(outputs.quantized[i]) - int(reference.quantized[i])));
+        }
+        QJsonObject error;
+        error["bounds"] = std::fabs(outputs.bounds[0] - reference.bounds[0]) + std::fabs(outputs.bounds[5] - reference.bounds[5]);
+        error["transformPoints"] = maxDifference(outputs.transformed, reference.transformed);
+        error["projectPoints"] = maxDifference(outputs.projected, reference.projected);
+        error["faceNormals"] = maxDifference(outputs.normals, reference.normals);
+        error["quantize"] = quantizeError;
+        error["areaRelative"] = reference.area > 0 ? std::fabs(outputs.area - reference.area) / reference.area : 0.0;
+        error["volumeRelative"] = reference.integrals[0] != 0 ? std::fabs(outputs.integrals[0] - reference.integrals[0]) / std::fabs(reference.integrals[0]) : 0.0;
+
+        QJsonObject entry;
+        entry["instructionSet"] = GeometryKernels::name(GeometryKernels::InstructionSet(set));
+        entry["bestMs"] = ms;
+        entry["maxErrorVsScalar"] = error;
+        sets.append(entry);
+    }
+    GeometryKernels::setInstructionSet(original);
+
+    QJsonObject result;
+    result["benchmark"] = "kernels";
+    result["points"] = static_cast<double>(pointCount);
+    result["triangles"] = static_cast<double>(triangleCount);
+    result["instructionSets"] = sets;
+    return result;
+}
+
+/**
+ * Asks the kernel to drop a file from the page cache, so the next read comes from storage.
+ */
+void evictFromCache(const QString& fileName) {
+#if defined(Q_OS_UNIX) && defined(POSIX_FADV_DONTNEED)
+    int fd = ::open(QFile::encodeName(fileName).constData(), O_RDONLY);
+    if (fd >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        ::close(fd);
+    }
+#else
+    Q_UNUSED(fileName);
+#endif
+}
+
+/**
+ * Compares the bulk import path (BulkFileReader and StlParser) against reading each file with
+ * vtkSTLReader in turn, as the viewer used to.
+ */
+QJsonObject runImportBenchmark(const QCommandLineParser& options) {
+    QJsonObject result;
+    result["benchmark"] = "import";
+
+    QStringList fileNames;
+    const QString input = options.value("input");
+    if (QFileInfo(input).isDir()) {
+        QDirIterator it(input, QStringList() << "*.stl" << "*.STL", QDir::Files, QDirIterator::Subdirectories);
+        while (it.hasNext()) fileNames.append(it.next());
+    }
+    else if (!input.isEmpty()) {
+        fileNames.append(input);
+    }
+    if (fileNames.isEmpty()) {
+        result["error"] = "--mode import needs --input with an STL file or a folder of them";
+        return result;
+    }
+
+    const bool cold = options.isSet("cold");
+    auto prepare = [&] {
+        if (cold) {
+            for (const QString& fileName : fileNames) evictFromCache(fileName);
+        }
+    };
+
+    qint64 bytes = 0;
+    std::atomic<long long> bulkTriangles(0);
+    prepare();
+    QElapsedTimer timer;
+    timer.start();
+    BulkFileReader reader;
+    bytes = reader.readAll(fileNames, [&bulkTriangles](FileReadResult& file) {
+        StlMesh mesh;
+        if (file.error.isEmpty() && StlParser::parse(file.buffer.data(), file.buffer.size(), mesh)) {
+            bulkTriangles += static_cast<long long>(mesh.triangles.size() / 3);
+        }
+        });
+    const double bulkSeconds = timer.nsecsElapsed() / 1e9;
+
+    prepare();
+    long long vtkTriangles = 0;
+    timer.start();
+    for (const QString& fileName : fileNames) {
+        vtkNew<vtkSTLReader> stlReader;
+        stlReader->SetFileName(QFile::encodeName(fileName).constData());
+        stlReader->Update();
+        vtkTriangles += stlReader->GetOutput()->GetNumberOfPolys();
+    }
+    const double vtkSeconds = timer.nsecsElapsed() / 1e9;
+
+    const double megabytes = bytes / (1024.0 * 1024.0);
+    auto report = [&](double seconds, long long triangles) {
+        QJsonObject entry;
+        entry["seconds"] = seconds;
+        entry["megabytesPerSecond"] = seconds > 0 ? megabytes / seconds : 0.0;
+        entry["filesPerSecond"] = seconds > 0 ? fileNames.size() / seconds : 0.0;
+        entry["triangles"] = static_cast<double>(triangles);
+        return entry;
+    };
+    QJsonObject bulk = report(bulkSeconds, bulkTriangles);
+    bulk["backend"] = BulkFileReader::backendName();
+    result["files"] = fileNames.size();
+    result["megabytes"] = megabytes;
+    result["cold"] = cold;
+    result["bulk"] = bulk; // Reads and parses only; parsing runs on the reader threads here
+    result["vtkSTLReader"] = report(vtkSeconds, vtkTriangles);
+    return result;
+}
+
+/**
+ * Slices an assembly at a fixed layer spacing and reports the layer and contour counts and the
+ * time taken by each stage.
+ */
+QJsonObject runSliceBenchmark(const QCommandLineParser& options) {
+    QJsonObject result;
+    result["benchmark"] = "slice";
+
+    QStringList errors;
+    ModelPart* assembly = options.isSet("input")
+        ? AssemblyImporter::importPath(options.value("input"), &errors)
+        : buildSyntheticAssembly(options.value("synthetic").toInt(), options.value("resolution").toInt());
+    if (!assembly) {
+        result["error"] = "No geometry could be loaded: " + errors.join("; ");
+        return result;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    Slicer slicer;
+    slicer.addPart(assembly);
+    const double gatherMs = timer.nsecsElapsed() / 1e6;
+    delete assembly;
+
+    const double spacing = options.value("spacing").toDouble();
+    const std::vector<Slicer::Layer> layers = slicer.slice(spacing);
+    const Slicer::Statistics statistics = slicer.statistics();
+
+    result["source"] = options.isSet("input") ? options.value("input") : QString("synthetic");
+    result["spacing"] = spacing;
+    result["threads"] = QThread::idealThreadCount();
+    result["triangles"] = static_cast<double>(statistics.triangles);
+    result["layers"] = statistics.layers;
+    result["segments"] = static_cast<double>(statistics.segments);
+    result["contours"] = static_cast<double>(statistics.contours);
+    result["openContours"] = static_cast<double>(statistics.openContours);
+    result["gatherMs"] = gatherMs;
+    result["sortMs"] = statistics.sortMs;
+    result["sliceMs"] = statistics.sliceMs;
+    result["trianglesPerSecond"] = statistics.triangles / std::max(1e-9, (statistics.sortMs + statistics.sliceMs) / 1000.0);
+    return result;
+}
+
+/**
+ * Extracts the feature edges of every part of an assembly with FeatureEdges, on one thread and on
+ * all cores, and with vtkFeatureEdges for comparison, reporting the times and output sizes.
+ */
+QJsonObject runEdgesBenchmark(const QCommandLineParser& options) {
+    QJsonObject result;
+    result["benchmark"] = "edges";
+
+    QStringList errors;
+    ModelPart* assembly = options.isSet("input")
+        ? AssemblyImporter::importPath(options.value("input"), &errors)
+        : buildSyntheticAssembly(options.value("synthetic").toInt(), options.value("resolution").toInt());
+    if (!assembly) {
+        result["error"] = "No geometry could be loaded: " + errors.join("; ");
+        return result;
+    }
+
+    struct Mesh {
+        vtkSmartPointer<vtkPolyData> polyData;
+        std::vector<float> points;
+        std::vector<uint32_t> triangles;
+        size_t edges = 0;
+    };
+    std::vector<Mesh> meshes;
+    std::vector<ModelPart*> stack = { assembly };
+    while (!stack.empty()) {
+        ModelPart* part = stack.back();
+        stack.pop_back();
+        if (part->getPolyData()) {
+            Mesh mesh;
+            mesh.polyData = part->getPolyData();
+            ModelPart::extractMesh(mesh.polyData, mesh.points, mesh.triangles);
+            meshes.push_back(std::move(mesh));
+        }
+        for (int i = 0; i < part->childCount(); ++i) {
+            stack.push_back(part->child(i));
+        }
+    }
+    delete assembly;
+
+    const double angle = options.value("angle").toDouble();
+    long long triangles = 0;
+    for (const Mesh& mesh : meshes) {
+        triangles += static_cast<long long>(mesh.triangles.size() / 3);
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    for (Mesh& mesh : meshes) {
+        mesh.edges = FeatureEdges::extract(mesh.points.data(), mesh.triangles.data(), mesh.triangles.size() / 3, angle).size() / 2;
+    }
+    const double serialMs = timer.nsecsElapsed() / 1e6;
+
+    timer.restart();
+    TaskScheduler::instance()->blockingMap(TaskScheduler::Interactive, meshes, [angle](Mesh& mesh) {
+        mesh.edges = FeatureEdges::extract(mesh.points.data(), mesh.triangles.data(), mesh.triangles.size() / 3, angle).size() / 2;
+        });
+    const double parallelMs = timer.nsecsElapsed() / 1e6;
+
+    long long edges = 0;
+    for (const Mesh& mesh : meshes) {
+        edges += static_cast<long long>(mesh.edges);
+    }
+
+    // vtkFeatureEdges copies the points it uses into a new data set, which the overlay avoids
+    long long vtkEdges = 0;
+    long long vtkBytes = 0;
+    timer.restart();
+    for (const Mesh& mesh : meshes) {
+        vtkNew<vtkFeatureEdges> filter;
+        filter->SetInputData(mesh.polyData);
+        filter->BoundaryEdgesOn();
+        filter->FeatureEdgesOn();
+        filter->NonManifoldEdgesOn();
+        filter->ManifoldEdgesOff();
+        filter->ColoringOff();
+        filter->SetFeatureAngle(angle);
+        filter->Update();
+        vtkEdges += filter->GetOutput()->GetNumberOfLines();
+        vtkBytes += static_cast<long long>(filter->GetOutput()->GetActualMemorySize()) * 1024;
+    }
+    const double vtkMs = timer.nsecsElapsed() / 1e6;
+
+    result["source"] = options.isSet("input") ? options.value("input") : QString("synthetic");
+    result["angle"] = angle;
+    result["threads"] = QThread::idealThreadCount();
+    result["parts"] = static_cast<int>(meshes.size());
+    result["triangles"] = static_cast<double>(triangles);
+    result["edges"] = static_cast<double>(edges);
+    result["edgeBytes"] = static_cast<double>(edges * 2 * sizeof(vtkIdType));
+    result["serialMs"] = serialMs;
+    result["parallelMs"] = parallelMs;
+    result["vtkFeatureEdges"] = QJsonObject{
+        { "edges", static_cast<double>(vtkEdges) },
+        { "bytes", static_cast<double>(vtkBytes) },
+        { "ms", vtkMs },
+    };
+    return result;
+}
+
+/**
+ * Encodes and decodes every part of an assembly with MeshCodec at each requested grid resolution,
+ * and compresses the raw arrays with zstd when it is built in, reporting size ratios against the
+ * raw float and index arrays and throughput in raw bytes per second.
+ */
+QJsonObject runCodecBenchmark(const QCommandLineParser& options) {
+    QJsonObject result;
+    result["benchmark"] = "codec";
+
+    QStringList errors;
+    ModelPart* assembly = options.isSet("input")
+        ? AssemblyImporter::importPath(options.value("input"), &errors)
+        : buildSyntheticAssembly(options.value("synthetic").toInt(), options.value("resolution").toInt());
+    if (!assembly) {
+        result["error"] = "No geometry could be loaded: " + errors.join("; ");
+        return result;
+    }
+
+    std::vector<StlMesh> meshes;
+    std::vector<ModelPart*> stack = { assembly };
+    while (!stack.empty()) {
+        ModelPart* part = stack.back();
+        stack.pop_back();
+        if (part->getPolyData()) {
+            StlMesh mesh;
+            ModelPart::extractMesh(part->getPolyData(), mesh.points, mesh.triangles);
+            meshes.push_back(std::move(mesh));
+        }
+        for (int i = 0; i < part->childCount(); ++i) {
+            stack.push_back(part->child(i));
+        }
+    }
+    delete assembly;
+
+    double rawBytes = 0.0;
+    for (const StlMesh& mesh : meshes) {
+        rawBytes += static_cast<double>(mesh.points.size() * sizeof(float) + mesh.triangles.size() * sizeof(uint32_t));
+    }
+    auto throughput = [rawBytes](double ms) { return rawBytes / std::max(ms, 1e-6) / 1e6; }; // MB/s
+
+    QJsonArray codecs;
+    for (const QString& value : options.value("bits").split(',', Qt::SkipEmptyParts)) {
+        const int bits = value.toInt();
+        std::vector<std::vector<uint8_t>> encoded(meshes.size());
+
+        QElapsedTimer timer;
+        timer.start();
+        for (size_t i = 0; i < meshes.size(); ++i) {
+            encoded[i] = MeshCodec::encode(meshes[i], bits);
+        }
+        const double encodeMs = timer.nsecsElapsed() / 1e6;
+
+        double encodedBytes = 0.0, maxError = 0.0;
+        for (const std::vector<uint8_t>& data : encoded) {
+            encodedBytes += static_cast<double>(data.size());
+            maxError = std::max(maxError, MeshCodec::maxError(data.data(), data.size()));
+        }
+
+        StlMesh decoded;
+        bool ok = true;
+        timer.restart();
+        for (const std::vector<uint8_t>& data : encoded) {
+            ok = MeshCodec::decode(data.data(), data.size(), decoded) && ok;
+        }
+        const double decodeMs = timer.nsecsElapsed() / 1e6;
+
+        // Many parts at once, as when a cached assembly is opened
+        std::vector<StlMesh> outputs(meshes.size());
+        std::vector<size_t> indices(meshes.size());
+        std::iota(indices.begin(), indices.end(), 0);
+        timer.restart();
+        TaskScheduler::instance()->blockingMap(TaskScheduler::VisibleLoading, indices, [&](size_t i) {
+            MeshCodec::decode(encoded[i].data(), encoded[i].size(), outputs[i]);
+            });
+        const double parallelDecodeMs = timer.nsecsElapsed() / 1e6;
+
+        // The codec keeps vertices in order, so the decoded points line up with the originals
+        double measuredError = 0.0;
+        for (size_t i = 0; i < meshes.size(); ++i) {
+            for (size_t j = 0; j < meshes[i].points.size() && j < outputs[i].points.size(); ++j) {
+                measuredError = std::max(measuredError, std::fabs(static_cast<double>(meshes[i].points[j]) - outputs[i].points[j]));
+            }
+        }
+
+        codecs.append(QJsonObject{
+            { "bits", bits },
+            { "bytes", encodedBytes },
+            { "ratio", rawBytes / std::max(encodedBytes, 1.0) },
+            { "maxError", maxError },
+            { "measuredError", measuredError },
+            { "encodeMs", encodeMs },
+            { "decodeMs", decodeMs },
+            { "encodeMBps", throughput(encodeMs) },
+            { "decodeMBps", throughput(decodeMs) },
+            { "parallelDecodeMBps", throughput(parallelDecodeMs) },
+            { "ok", ok },
+            });
+    }
+    result["meshCodec"] = codecs;
+
+#ifdef VIEWER_HAVE_ZSTD
+    QJsonArray zstd;
+    for (int level : { 1, 3, 9 }) {
+        std::vector<std::vector<char>> compressed(meshes.size());
+        std::vector<char> raw;
+        QElapsedTimer timer;
+        timer.start();
+        for (size_t i = 0; i < meshes.size(); ++i) {
+            const StlMesh& mesh = meshes[i];
+            raw.resize(mesh.points.size() * sizeof(float) + mesh.triangles.size() * sizeof(uint32_t));
+            std::memcpy(raw.data(), mesh.points.data(), mesh.points.size() * sizeof(float));
+            std::memcpy(raw.data() + mesh.points.size() * sizeof(float), mesh.triangles.data(), mesh.triangles.size() * sizeof(uint32_t));
+            compressed[i].resize(ZSTD_compressBound(raw.size()));
+            compressed[i].resize(ZSTD_compress(compressed[i].data(), compressed[i].size(), raw.data(), raw.size(), level));
+        }
+        const double encodeMs = timer.nsecsElapsed() / 1e6;
+
+        double compressedBytes = 0.0;
+        for (const std::vector<char>& data : compressed) {
+            compressedBytes += static_cast<double>(data.size());
+        }
+
+        timer.restart();
+        for (size_t i = 0; i < meshes.size(); ++i) {
+            raw.resize(meshes[i].points.size() * sizeof(float) + meshes[i].triangles.size() * sizeof(uint32_t));
+            ZSTD_decompress(raw.data(), raw.size(), compressed[i].data(), compressed[i].size());
+        }
+        const double decodeMs = timer.nsecsElapsed() / 1e6;
+
+        zstd.append(QJsonObject{
+            { "level", level },
+            { "bytes", compressedBytes },
+            { "ratio", rawBytes / std::max(compressedBytes, 1.0) },
+            { "encodeMBps", throughput(encodeMs) },
+            { "decodeMBps", throughput(decodeMs) },
+            });
+    }
+    result["zstd"] = zstd;
+#endif
+
+    result["source"] = options.isSet("input") ? options.value("input") : QString("synthetic");
+    result["threads"] = QThread::idealThreadCount();
+    result["parts"] = static_cast<int>(meshes.size());
+    result["rawBytes"] = rawBytes;
+    return result;
+}
+
+} // namespace
+
+/**
+ * Measures points scattered around the surface of an assembly against the assembly itself, as a
+ * scan would be compared with its CAD model, and reports the hierarchy build time and the query
+ * rate. The points lie on random triangles with Gaussian noise along the normal, in triangle order
+ * like the Morton-ordered points of a scan.
+ */
+QJsonObject runDeviationBenchmark(const QCommandLineParser& options) {
+    QJsonObject result;
+    result["benchmark"] = "deviation";
+
+    QStringList errors;
+    ModelPart* assembly = options.isSet("input")
+        ? AssemblyImporter::importPath(options.value("input"), &errors)
+        : buildSyntheticAssembly(options.value("synthetic").toInt(), options.value("resolution").toInt());
+    if (!assembly) {
+        result["error"] = "No geometry could be loaded: " + errors.join("; ");
+        return result;
+    }
+
+    std::vector<float> points;
+    std::vector<uint32_t> triangles;
+    std::vector<ModelPart*> stack = { assembly };
+    while (!stack.empty()) {
+        ModelPart* part = stack.back();
+        stack.pop_back();
+        if (part->getPolyData()) {
+            std::vector<float> local;
+            std::vector<uint32_t> indices;
+            ModelPart::extractMesh(part->getPolyData(), local, indices);
+            const uint32_t base = static_cast<uint32_t>(points.size() / 3);
+            points.resize(points.size() + local.size());
+            GeometryKernels::transformPoints(local.data(), points.data() + base * 3, local.size() / 3, part->getTransform()->GetMatrix()->GetData());
+            for (uint32_t index : indices) triangles.push_back(base + index);
+        }
+        for (int i = 0; i < part->childCount(); ++i) {
+            stack.push_back(part->child(i));
+        }
+    }
+    delete assembly;
+    const size_t triangleCount = triangles.size() / 3;
+    if (triangleCount == 0) {
+        result["error"] = "The assembly has no triangles";
+        return result;
+    }
+
+    DeviationAnalysis analysis;
+    analysis.addMesh(points.data(), points.size() / 3, triangles.data(), triangleCount);
+    analysis.build();
+
+    double bounds[6];
+    GeometryKernels::bounds(points.data(), points.size() / 3, bounds);
+    const double diagonal = std::sqrt((bounds[1] - bounds[0]) * (bounds[1] - bounds[0]) + (bounds[3] - bounds[2]) * (bounds[3] - bounds[2]) + (bounds[5] - bounds[4]) * (bounds[5] - bounds[4]));
+    const double noise = 1e-4 * diagonal;
+
+    const size_t count = options.value("points").toULongLong();
+    std::mt19937 random(1);
+    std::vector<uint32_t> picks(count);
+    std::uniform_int_distribution<uint32_t> pick(0, static_cast<uint32_t>(triangleCount - 1));
+    for (uint32_t& t : picks) t = pick(random);
+    std::sort(picks.begin(), picks.end());
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::normal_distribution<float> offset(0.0f, static_cast<float>(noise));
+    std::vector<float> samples(3 * count);
+    for (size_t i = 0; i < count; ++i) {
+        const float* a = &points[3 * triangles[3 * picks[i]]];
+        const float* b = &points[3 * triangles[3 * picks[i] + 1]];
+        const float* c = &points[3 * triangles[3 * picks[i] + 2]];
+        float u = unit(random), v = unit(random);
+        if (u + v > 1.0f) {
+            u = 1.0f - u;
+            v = 1.0f - v;
+        }
+        double n[3];
+        const double e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+        const double e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+        vtkMath::Cross(e1, e2, n);
+        const double length = std::max(vtkMath::Norm(n), 1e-30);
+        const float d = offset(random);
+        for (int k = 0; k < 3; ++k) {
+            samples[3 * i + k] = static_cast<float>(a[k] + u * e1[k] + v * e2[k] + d * n[k] / length);
+        }
+    }
+
+    const std::vector<float> distances = analysis.measure(samples.data(), count);
+    const DeviationAnalysis::Statistics statistics = analysis.statistics();
+    DeviationAnalysis::Summary summary(noise, 4.0 * noise, 16);
+    summary.add(distances.data(), distances.size());
+
+    result["source"] = options.isSet("input") ? options.value("input") : QString("synthetic");
+    result["threads"] = QThread::idealThreadCount();
+    result["triangles"] = static_cast<double>(statistics.triangles);
+    result["nodes"] = static_cast<double>(statistics.nodes);
+    result["points"] = static_cast<double>(statistics.points);
+    result["noise"] = noise;
+    result["buildMs"] = statistics.buildMs;
+    result["queryMs"] = statistics.queryMs;
+    result["pointsPerSecond"] = statistics.points / std::max(1e-9, statistics.queryMs / 1000.0);
+    result["withinOneSigma"] = summary.count ? static_cast<double>(summary.within) / summary.count : 0.0; // About 0.68 if the signs and distances are right
+    result["rms"] = summary.rms();
+    return result;
+}
+
+/**
+ * Replays a session recorded by the viewer (Qt_VTK --record-session), rendering offscreen after
+ * every recorded frame, and reports how long applying and drawing the frames took. At full speed
+ * the frames are replayed back to back; with --realtime each is replayed when it was recorded and
+ * the lag behind the recording is reported as well. View settings are applied as recorded; VR
+ * commands have no headset to go to and are only counted.
+ */
+QJsonObject runReplayBenchmark(const QCommandLineParser& options) {
+    QJsonObject result;
+    result["benchmark"] = "replay";
+    if (!options.isSet("input")) {
+        result["error"] = "--mode replay needs --input with a session recording";
+        return result;
+    }
+
+    QList<SyncSession::RecordedMessage> messages;
+    QString error;
+    if (!SyncSession::loadRecording(options.value("input"), messages, &error)) {
+        result["error"] = "Could not read " + options.value("input") + ": " + error;
+        return result;
+    }
+
+    ModelPartList model("Parts List");
+    SceneRenderer sceneRenderer;
+    sceneRenderer.setCollectStatistics(true);
+    sceneRenderer.setRoot(model.getRootItem());
+    SyncSession session(&model, &sceneRenderer);
+    QObject::connect(&session, &SyncSession::remotePropertiesChanged, [](ModelPart* part, const QString& name, bool visible, const QColor& color) {
+        part->set(0, name);
+        part->set(1, visible ? "true" : "false");
+        part->set(2, QString("%1,%2,%3").arg(color.red()).arg(color.green()).arg(color.blue()));
+        part->setColour(color.red(), color.green(), color.blue());
+        part->setVisible(visible);
+        if (part->getActor()) {
+            part->getActor()->GetProperty()->SetDiffuseColor(color.redF(), color.greenF(), color.blueF());
+        }
+        });
+    int appliedEvents = 0, ignoredEvents = 0;
+    QObject::connect(&session, &SyncSession::recordedEvent, [&](const QString& name, const QVariant& value) {
+        const bool enabled = value.toBool();
+        ++appliedEvents;
+        if (name == "occlusionCulling") sceneRenderer.setOcclusionCulling(enabled);
+        else if (name == "impostors") sceneRenderer.setImpostors(enabled);
+        else if (name == "featureEdges") sceneRenderer.setFeatureEdges(enabled);
+        else if (name == "hiddenLineRemoval") sceneRenderer.setHiddenLineRemoval(enabled);
+        else if (name == "shadows") sceneRenderer.setShadows(enabled);
+        else if (name == "contactShadow") sceneRenderer.setContactShadow(enabled);
+        else {
+            --appliedEvents;
+            ++ignoredEvents;
+        }
+        });
+    session.beginReplay();
+
+    const int width = options.value("width").toInt();
+    const int height = options.value("height").toInt();
+    vtkNew<vtkRenderWindow> renderWindow;
+    renderWindow->SetOffScreenRendering(1);
+    renderWindow->SetSize(width, height);
+    renderWindow->SetNumberOfLayers(2);
+    renderWindow->AddRenderer(sceneRenderer.getRenderer());
+    renderWindow->AddRenderer(sceneRenderer.getEdgeRenderer());
+
+    const bool realtime = options.isSet("realtime");
+    int frames = 0, meshes = 0;
+    std::vector<double> applyMs, frameMs, lagMs, prepareMs, drawCalls, triangles;
+    QElapsedTimer clock, timer;
+    clock.start();
+    for (const SyncSession::RecordedMessage& entry : messages) {
+        if (realtime && entry.kind == SyncSession::RecordedFrame) {
+            const qint64 wait = entry.timeMs - clock.elapsed();
+            if (wait > 0) QThread::msleep(static_cast<unsigned long>(wait));
+        }
+
+        timer.start();
+        session.replay(entry.message);
+        if (entry.kind != SyncSession::RecordedFrame) {
+            meshes += entry.kind == SyncSession::RecordedGeometry;
+            continue;
+        }
+        applyMs.push_back(timer.nsecsElapsed() / 1e6);
+
+        timer.start();
+        renderWindow->Render();
+        renderWindow->WaitForCompletion();
+        frameMs.push_back(timer.nsecsElapsed() / 1e6);
+        if (realtime) {
+            lagMs.push_back(std::max<double>(0.0, clock.elapsed() - static_cast<double>(entry.timeMs)));
+        }
+        ++frames;
+
+        SceneRenderer::FrameStats stats = sceneRenderer.lastFrameStats();
+        prepareMs.push_back(stats.prepareMs);
+        drawCalls.push_back(stats.drawnProps);
+        triangles.push_back(static_cast<double>(stats.triangles));
+        QCoreApplication::processEvents(); // Let impostor captures and point cloud loads run, as in the viewer
+    }
+    const double replayMs = clock.nsecsElapsed() / 1e6;
+
+    int partCount = 0;
+    long long triangleCount = 0;
+    countGeometry(model.getRootItem(), partCount, triangleCount);
+
+    QJsonObject recording;
+    recording["file"] = options.value("input");
+    recording["messages"] = messages.size();
+    recording["frames"] = frames;
+    recording["meshes"] = meshes;
+    recording["events"] = appliedEvents + ignoredEvents;
+    recording["durationMs"] = messages.isEmpty() ? 0.0 : static_cast<double>(messages.last().timeMs);
+    result["recording"] = recording;
+
+    QJsonObject scene;
+    scene["parts"] = partCount;
+    scene["triangles"] = triangleCount;
+    result["finalScene"] = scene;
+
+    result["realtime"] = realtime;
+    result["width"] = width;
+    result["height"] = height;
+    result["replayMs"] = replayMs;
+    result["applyMs"] = summarize(applyMs);
+    result["frameMs"] = summarize(frameMs);
+    result["fps"] = frames / std::max(1e-9, std::accumulate(frameMs.begin(), frameMs.end(), 0.0) / 1000.0);
+    result["prepareMs"] = summarize(prepareMs);
+    result["drawCalls"] = summarize(drawCalls);
+    result["triangles"] = summarize(triangles);
+    if (realtime) {
+        result["lagMs"] = summarize(lagMs);
+    }
+    result["appliedEvents"] = appliedEvents;
+    result["ignoredEvents"] = ignoredEvents; // VR commands and mirroring
+    return result;
+}
+
+/**
+ * Converts a snapshot of the task scheduler's queues to JSON, one entry per priority class.
+ */
+QJsonObject schedulerStatistics(const TaskScheduler::Statistics& statistics) {
+    QJsonObject classes;
+    for (int p = 0; p < TaskScheduler::kPriorityCount; ++p) {
+        const TaskScheduler::ClassStatistics& entry = statistics.classes[p];
+        classes[TaskScheduler::priorityName(static_cast<TaskScheduler::Priority>(p))] = QJsonObject{
+            { "limit", entry.limit },
+            { "peakQueued", entry.peakQueued },
+            { "completed", static_cast<double>(entry.completed) },
+            { "cancelled", static_cast<double>(entry.cancelled) },
+        };
+    }
+    return QJsonObject{
+        { "threads", statistics.threads },
+        { "backgroundLimit", statistics.backgroundLimit },
+        { "steals", static_cast<double>(statistics.steals) },
+        { "classes", classes },
+    };
+}
+
+/**
+ * Floods a task scheduler with loading and analysis tasks, as a bulk import during a deviation
+ * analysis does, and measures how long interactive tasks posted meanwhile wait to start. Posting
+ * the same probes in the loading class, behind the flood, as on a single first-in first-out pool,
+ * gives the baseline.
+ */
+QJsonObject runSchedulerBenchmark(const QCommandLineParser& options) {
+    const int taskCount = std::max(1, options.value("tasks").toInt());
+    const double taskMs = 2.0; // About the time to parse a small STL file
+    const unsigned long probeIntervalMs = 5;
+    auto spin = [](double ms) {
+        QElapsedTimer busy;
+        busy.start();
+        while (busy.nsecsElapsed() < ms * 1e6) {
+        }
+    };
+
+    auto measure = [&](TaskScheduler::Priority probeClass) {
+        TaskScheduler scheduler;
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < taskCount; ++i) {
+            scheduler.post(i % 4 == 3 ? TaskScheduler::Analysis : TaskScheduler::VisibleLoading, [&spin, taskMs] { spin(taskMs); });
+        }
+
+        std::vector<double> latencyMs;
+        for (;;) {
+            const TaskScheduler::Statistics statistics = scheduler.statistics();
+            if (statistics.classes[TaskScheduler::VisibleLoading].queued + statistics.classes[TaskScheduler::Analysis].queued == 0)
+                break;
+            QElapsedTimer posted;
+            posted.start();
+            QFuture<double> started = scheduler.run(probeClass, [&posted] { return posted.nsecsElapsed() / 1e6; });
+            started.waitForFinished(); // Not wait(), which would run the flood on this thread
+            latencyMs.push_back(started.result());
+            QThread::msleep(probeIntervalMs);
+        }
+        const double drainMs = timer.nsecsElapsed() / 1e6;
+
+        QJsonObject entry;
+        entry["probes"] = static_cast<int>(latencyMs.size());
+        entry["startLatencyMs"] = summarize(latencyMs);
+        entry["drainMs"] = drainMs;
+        entry["scheduler"] = schedulerStatistics(scheduler.statistics());
+        return entry;
+    };
+
+    QJsonObject result;
+    result["benchmark"] = "scheduler";
+    result["tasks"] = taskCount;
+    result["taskMs"] = taskMs;
+    result["prioritized"] = measure(TaskScheduler::Interactive);
+    result["fifo"] = measure(TaskScheduler::VisibleLoading);
+    return result;
+}
+
+/**
+ * Adds rows to the part tree while a tree view shows it, as a large import does, and times the
+ * model calls and the view's update separately. Inserting every part with one insertChildren()
+ * call, as the main window's batched flush does, is compared with a call per part.
+ */
+QJsonObject runInsertBenchmark(const QCommandLineParser& options) {
+    const int rowCount = std::max(1, options.value("rows").toInt());
+
+    auto measure = [rowCount](bool batched) {
+        ModelPartList model("Parts List");
+        QTreeView view;
+        view.setModel(&model);
+        view.resize(800, 600);
+        view.show();
+        QCoreApplication::processEvents();
+
+        QList<ModelPart*> parts;
+        for (int i = 0; i < rowCount; ++i) {
+            parts.append(new ModelPart({ QString("part %1").arg(i), "true", "255,255,255" }));
+        }
+
+        QElapsedTimer timer;
+        timer.start();
+        if (batched) {
+            model.insertChildren(QModelIndex(), parts);
+        }
+        else {
+            for (ModelPart* part : parts) {
+                model.insertChildren(QModelIndex(), { part });
+            }
+        }
+        const double insertMs = timer.nsecsElapsed() / 1e6;
+
+        // Lay out and paint the new rows, as the next pass of the event loop would
+        timer.restart();
+        view.scrollToBottom();
+        view.viewport()->repaint();
+        QCoreApplication::processEvents();
+        const double viewMs = timer.nsecsElapsed() / 1e6;
+
+        QJsonObject entry;
+        entry["insertMs"] = insertMs;
+        entry["viewUpdateMs"] = viewMs;
+        entry["totalMs"] = insertMs + viewMs;
+        entry["rows"] = model.rowCount(QModelIndex());
+        return entry;
+    };
+
+    QJsonObject result;
+    result["benchmark"] = "insert";
+    result["rows"] = rowCount;
+    result["batched"] = measure(true);
+    result["perRow"] = measure(false);
+    return result;
+}
+
+/**
+ * Parses the command line, runs the requested benchmark and writes its JSON report.
+ *
+ * @param argc The number of command-line arguments.
+ * @param argv The array of command-line arguments.
+ * @return 0 on success, 1 if the benchmark could not run.
+ */
+int main(int argc, char* argv[]) {
+    // The insert benchmark drives a tree view, which needs a GUI application; nothing is ever
+    // shown on screen, so default to the offscreen platform and run without a display
+    if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QApplication application(argc, argv);
+    QCoreApplication::setApplicationName("Qt_VTK_bench");
+
+    QCommandLineParser options;
+    options.setApplicationDescription("Offscreen rendering, kernel and import benchmarks for the model viewer.");
+    options.addHelpOption();
+    options.addOptions({
+        { "mode", "Benchmark to run: render, kernels, import, slice, edges, codec, deviation, replay, scheduler or insert.", "mode", "render" },
+        { "input", "STL file, folder or ZIP archive to load instead of the synthetic assembly; a session recording for replay.", "path" },
+        { "synthetic", "Number of parts in the synthetic assembly.", "count", "1000" },
+        { "resolution", "Sphere resolution of synthetic parts (about 2 * r^2 triangles).", "r", "32" },
+        { "paths", "Comma-separated camera paths: orbit, zoom, flyby.", "list", "orbit,zoom" },
+        { "frames", "Frames per camera path.", "count", "360" },
+        { "width", "Render width in pixels.", "pixels", "1280" },
+        { "height", "Render height in pixels.", "pixels", "720" },
+        { "culling", "Enable occlusion culling." },
+        { "impostors", "Enable impostors for distant parts." },
+        { "shadows", "Enable cached shadow maps." },
+        { "contact-shadow", "Enable the baked contact shadow on the floor." },
+        { "profile-parts", "Profile each camera path again and report the costliest parts.", "count", "0" },
+        { "points", "Number of points for the kernel and deviation benchmarks.", "count", "4000000" },
+        { "spacing", "Layer spacing for the slice benchmark, in model units.", "distance", "0.1" },
+        { "angle", "Feature angle for the edges benchmark, in degrees.", "degrees", "30" },
+        { "bits", "Comma-separated grid resolutions for the codec benchmark; 0 is lossless.", "list", "0,16,12" },
+        { "tasks", "Background tasks to queue for the scheduler benchmark.", "count", "2000" },
+        { "rows", "Rows to add to the part tree for the insert benchmark.", "count", "10000" },
+        { "cold", "Evict input files from the page cache before each import run." },
+        { "realtime", "Replay a session at its recorded pace instead of as fast as possible." },
+        { "output", "Write the JSON report to this file instead of standard output.", "file" },
+    });
+    options.process(application);
+
+    const QString mode = options.value("mode");
+    QJsonObject result;
+    if (mode == "render") {
+        result = runRenderBenchmark(options);
+    }
+    else if (mode == "kernels") {
+        result = runKernelBenchmark(options);
+    }
+    else if (mode == "import") {
+        result = runImportBenchmark(options);
+    }
+    else if (mode == "slice") {
+        result = runSliceBenchmark(options);
+    }
+    else if (mode == "edges") {
+        result = runEdgesBenchmark(options);
+    }
+    else if (mode == "codec") {
+        result = runCodecBenchmark(options);
+    }
+    else if (mode == "deviation") {
+        result = runDeviationBenchmark(options);
+    }
+    else if (mode == "replay") {
+        result = runReplayBenchmark(options);
+    }
+    else if (mode == "scheduler") {
+        result = runSchedulerBenchmark(options);
+    }
+    else if (mode == "insert") {
+        result = runInsertBenchmark(options);
+    }
+    else {
+        result["error"] = "Unknown mode " + mode;
+    }
+
+    const QByteArray json = QJsonDocument(result).toJson();
+    if (options.isSet("output")) {
+        QFile file(options.value("output"));
+        if (!file.open(QIODevice::WriteOnly)) {
+            QTextStream(stderr) << "Could not write " << file.fileName() << ": " << file.errorString() << "\n";
+            return 1;
+        }
+        file.write(json);
+    }
+    else {
+        QTextStream(stdout) << json;
+    }
+    return result.contains("error") ? 1 : 0;
+}
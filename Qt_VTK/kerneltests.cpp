@@ -0,0 +1,279 @@
+/**
+ * @file kerneltests.cpp
+ * @brief Entry point of Qt_VTK_kernel_tests, the correctness tests of the geometry kernels.
+ *
+ * Runs every kernel with each instruction set the CPU supports and compares the results with the
+ * scalar reference, on inputs near the origin, offset by thousands of units as parts in a large
+ * assembly are, and at large coordinates. Counts that leave ragged tails after the last full
+ * register and degenerate triangles are included. Prints one line per failure and exits with 1 if
+ * there were any. The mass properties of a part far from the origin are also checked against
+ * their exact values.
+ *
+ * Example:
+ *   Qt_VTK_kernel_tests
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+#include "GeometryKernels.h"
+
+namespace {
+
+int failures = 0; ///< Checks failed so far.
+
+/** A triangle mesh and where it came from, for failure messages. */
+struct Mesh {
+    std::string name; ///< Description of the input.
+    std::vector<float> points; ///< Packed x, y, z coordinates.
+    std::vector<uint32_t> triangles; ///< Three vertex indices per triangle.
+};
+
+/**
+ * Records a failure if two values differ by more than a tolerance.
+ */
+void expectNear(double actual, double expected, double tolerance, const std::string& what) {
+    if (!(std::fabs(actual - expected) <= tolerance)) {
+        std::printf("FAIL %s: %.9g, expected %.9g (tolerance %.3g)\n", what.c_str(), actual, expected, tolerance);
+        ++failures;
+    }
+}
+
+/**
+ * Builds the surface of an axis-aligned box, each face split into n x n squares of two triangles,
+ * wound counter-clockwise seen from outside.
+ */
+Mesh box(const double centre[3], const double half[3], int n, const std::string& name) {
+    Mesh mesh;
+    mesh.name = name;
+    for (int axis = 0; axis < 3; ++axis) {
+        for (int sign = -1; sign <= 1; sign += 2) {
+            const int u = (axis + 1) % 3, v = (axis + 2) % 3;
+            const uint32_t base = static_cast<uint32_t>(mesh.points.size() / 3);
+            for (int i = 0; i <= n; ++i) {
+                for (int j = 0; j <= n; ++j) {
+                    double p[3];
+                    p[axis] = centre[axis] + sign * half[axis];
+                    p[u] = centre[u] - half[u] + 2.0 * half[u] * i / n;
+                    p[v] = centre[v] - half[v] + 2.0 * half[v] * j / n;
+                    for (int k = 0; k < 3; ++k) mesh.points.push_back(static_cast<float>(p[k]));
+                }
+            }
+            for (int i = 0; i < n; ++i) {
+                for (int j = 0; j < n; ++j) {
+                    const uint32_t a = base + i * (n + 1) + j, b = a + n + 1, c = b + 1, d = a + 1;
+                    const uint32_t outward[6] = { a, b, c, a, c, d };
+                    const uint32_t inward[6] = { a, c, b, a, d, c };
+                    mesh.triangles.insert(mesh.triangles.end(), sign > 0 ? outward : inward, (sign > 0 ? outward : inward) + 6);
+                }
+            }
+        }
+    }
+    return mesh;
+}
+
+/**
+ * Builds a random triangle soup with some degenerate triangles.
+ */
+Mesh soup(size_t pointCount, size_t triangleCount, double offset, double extent, unsigned seed, const std::string& name) {
+    std::mt19937 generator(seed);
+    std::uniform_real_distribution<double> coordinate(-extent, extent);
+    std::uniform_int_distribution<uint32_t> vertex(0, static_cast<uint32_t>(pointCount - 1));
+    Mesh mesh;
+    mesh.name = name;
+    for (size_t i = 0; i < pointCount * 3; ++i) {
+        mesh.points.push_back(static_cast<float>(offset + coordinate(generator)));
+    }
+    for (size_t t = 0; t < triangleCount; ++t) {
+        const uint32_t a = vertex(generator);
+        const bool degenerate = t % 17 == 5;
+        mesh.triangles.push_back(a);
+        mesh.triangles.push_back(degenerate ? a : vertex(generator));
+        mesh.triangles.push_back(vertex(generator));
+    }
+    return mesh;
+}
+
+/** Largest absolute coordinate of a mesh, the scale its rounding errors are relative to. */
+double magnitude(const Mesh& mesh) {
+    double m = 1.0;
+    for (float v : mesh.points) m = std::max(m, static_cast<double>(std::fabs(v)));
+    return m;
+}
+
+/** Largest extent of a mesh along any axis. */
+double extent(const Mesh& mesh) {
+    double b[6];
+    GeometryKernels::bounds(mesh.points.data(), mesh.points.size() / 3, b);
+    return std::max(1e-6, std::max(b[1] - b[0], std::max(b[3] - b[2], b[5] - b[4])));
+}
+
+/** Results of every kernel on one mesh. */
+struct Results {
+    double bounds[6];
+    std::vector<float> transformed;
+    std::vector<float> projected;
+    std::vector<float> normals;
+    std::vector<uint16_t> quantized;
+    double centroid[3];
+    double area;
+    double integrals[10];
+};
+
+/**
+ * Runs every kernel on a mesh with the current instruction set.
+ */
+Results runKernels(const Mesh& mesh) {
+    static const double matrix[16] = {
+        0.8, -0.6, 0.0, 12.5,
+        0.6, 0.8, 0.0, -40.0,
+        0.0, 0.0, 1.0, 7.25,
+        0.001, 0.002, 0.003, 1.0
+    };
+    const size_t pointCount = mesh.points.size() / 3;
+    const size_t triangleCount = mesh.triangles.size() / 3;
+    Results r;
+    GeometryKernels::bounds(mesh.points.data(), pointCount, r.bounds);
+    r.transformed.resize(pointCount * 3);
+    GeometryKernels::transformPoints(mesh.points.data(), r.transformed.data(), pointCount, matrix);
+    r.projected.resize(pointCount * 4);
+    GeometryKernels::projectPoints(mesh.points.data(), r.projected.data(), pointCount, matrix);
+    r.normals.resize(triangleCount * 3);
+    GeometryKernels::faceNormals(mesh.points.data(), mesh.triangles.data(), triangleCount, r.normals.data());
+    r.quantized.resize(pointCount * 3);
+    GeometryKernels::quantize(mesh.points.data(), pointCount, r.bounds, r.quantized.data());
+    GeometryKernels::centroidAndArea(mesh.points.data(), mesh.triangles.data(), triangleCount, r.centroid, r.area);
+    GeometryKernels::volumeIntegrals(mesh.points.data(), mesh.triangles.data(), triangleCount, r.integrals);
+    return r;
+}
+
+/**
+ * Compares the results of one instruction set with the scalar reference.
+ */
+void compare(const Mesh& mesh, const Results& expected, const Results& actual, const char* set) {
+    const std::string prefix = std::string(set) + " " + mesh.name + " ";
+    const double scale = magnitude(mesh);
+    const double size = extent(mesh);
+    const float eps = 1e-6f;
+
+    for (int i = 0; i < 6; ++i) {
+        expectNear(actual.bounds[i], expected.bounds[i], 0.0, prefix + "bounds");
+    }
+    for (size_t i = 0; i < expected.transformed.size(); ++i) {
+        expectNear(actual.transformed[i], expected.transformed[i], 4 * eps * (scale + 50.0), prefix + "transformPoints[" + std::to_string(i) + "]");
+    }
+    for (size_t i = 0; i < expected.projected.size(); ++i) {
+        expectNear(actual.projected[i], expected.projected[i], 4 * eps * (scale + 50.0), prefix + "projectPoints[" + std::to_string(i) + "]");
+    }
+    // Normals come from differences of nearby coordinates, so their error grows with the offset
+    const double normalTolerance = 1e-3 * std::max(1.0, scale / size);
+    for (size_t i = 0; i < expected.normals.size(); ++i) {
+        expectNear(actual.normals[i], expected.normals[i], normalTolerance, prefix + "faceNormals[" + std::to_string(i) + "]");
+    }
+    for (size_t i = 0; i < expected.quantized.size(); ++i) {
+        expectNear(actual.quantized[i], expected.quantized[i], 1.0, prefix + "quantize[" + std::to_string(i) + "]");
+    }
+
+    expectNear(actual.area, expected.area, 1e-5 * std::max(1.0, expected.area), prefix + "area");
+    for (int k = 0; k < 3; ++k) {
+        expectNear(actual.centroid[k], expected.centroid[k], 1e-5 * size, prefix + "centroid");
+    }
+
+    // Volume integrals about the mesh, compared at the scale of each moment about its centre
+    const double volumeScale = std::max(1e-9, std::fabs(expected.integrals[0]));
+    expectNear(actual.integrals[0], expected.integrals[0], 1e-5 * volumeScale + 1e-9 * size * size * size, prefix + "volume");
+    for (int k = 1; k < 4; ++k) {
+        expectNear(actual.integrals[k], expected.integrals[k], 1e-5 * volumeScale * (scale + size) + 1e-9 * size * size * size * scale, prefix + "first moment");
+    }
+    for (int k = 4; k < 10; ++k) {
+        expectNear(actual.integrals[k], expected.integrals[k], 1e-5 * volumeScale * (scale + size) * (scale + size) + 1e-9 * size * size * size * scale * scale, prefix + "second moment");
+    }
+}
+
+/**
+ * Checks the mass properties of a part far from the origin against their exact values, as
+ * MassProperties derives them: a 10-unit cube centred at (3000, 1000, 500) has volume 1000 and,
+ * at unit density, moments of inertia of 1000 * (10^2 + 10^2) / 12 about its centroid.
+ */
+void checkOffsetPart(const char* set) {
+    const double centre[3] = { 3000.0, 1000.0, 500.0 };
+    const double half[3] = { 5.0, 5.0, 5.0 };
+    const Mesh mesh = box(centre, half, 16, "offset part");
+    double integrals[10];
+    GeometryKernels::volumeIntegrals(mesh.points.data(), mesh.triangles.data(), mesh.triangles.size() / 3, integrals);
+
+    const std::string prefix = std::string(set) + " offset part ";
+    const double volume = integrals[0];
+    expectNear(volume, 1000.0, 1e-6, prefix + "volume");
+    double c[3];
+    for (int k = 0; k < 3; ++k) {
+        c[k] = integrals[1 + k] / volume;
+        expectNear(c[k], centre[k], 1e-4, prefix + "centroid");
+    }
+    // Second moments about the centroid, then the diagonal of the inertia tensor
+    const double sxx = integrals[4] - volume * c[0] * c[0];
+    const double syy = integrals[5] - volume * c[1] * c[1];
+    const double szz = integrals[6] - volume * c[2] * c[2];
+    const double expected = 1000.0 * 200.0 / 12.0;
+    const double tolerance = 1e-5 * expected; // Float sums in the vector kernels, about the mesh
+    expectNear(syy + szz, expected, tolerance, prefix + "Ixx");
+    expectNear(sxx + szz, expected, tolerance, prefix + "Iyy");
+    expectNear(sxx + syy, expected, tolerance, prefix + "Izz");
+    // Products of inertia vanish for a cube
+    expectNear(integrals[7] - volume * c[0] * c[1], 0.0, tolerance, prefix + "Ixy");
+    expectNear(integrals[8] - volume * c[1] * c[2], 0.0, tolerance, prefix + "Iyz");
+    expectNear(integrals[9] - volume * c[2] * c[0], 0.0, tolerance, prefix + "Izx");
+}
+
+} // namespace
+
+/**
+ * Runs the tests.
+ *
+ * @return 0 if every check passed, 1 otherwise.
+ */
+int main() {
+    std::vector<Mesh> meshes;
+    const double origin[3] = { 0.0, 0.0, 0.0 };
+    const double offset[3] = { 3000.0, 1000.0, 500.0 };
+    const double far[3] = { -1.5e5, 2.5e5, 8.0e4 };
+    const double unit[3] = { 0.5, 0.5, 0.5 };
+    const double cube[3] = { 5.0, 5.0, 5.0 };
+    const double slab[3] = { 40.0, 3.0, 12.0 };
+    meshes.push_back(box(origin, unit, 1, "unit box"));
+    meshes.push_back(box(origin, slab, 7, "slab at origin"));
+    meshes.push_back(box(offset, cube, 16, "cube at (3000, 1000, 500)"));
+    meshes.push_back(box(offset, slab, 9, "slab at (3000, 1000, 500)"));
+    meshes.push_back(box(far, cube, 11, "cube at (-1.5e5, 2.5e5, 8e4)"));
+    for (size_t count : { size_t(0), size_t(1), size_t(3), size_t(7), size_t(17), size_t(33), size_t(1001) }) {
+        meshes.push_back(soup(std::max<size_t>(count, 3), count, 0.0, 100.0, 7 + static_cast<unsigned>(count), "soup of " + std::to_string(count) + " at origin"));
+        meshes.push_back(soup(std::max<size_t>(count, 3), count, 3000.0, 10.0, 11 + static_cast<unsigned>(count), "soup of " + std::to_string(count) + " at 3000"));
+    }
+
+    std::vector<Results> reference;
+    GeometryKernels::setInstructionSet(GeometryKernels::Scalar);
+    for (const Mesh& mesh : meshes) {
+        reference.push_back(runKernels(mesh));
+    }
+    checkOffsetPart(GeometryKernels::name(GeometryKernels::Scalar));
+
+    int tested = 0;
+    for (int set = GeometryKernels::SSE2; set <= GeometryKernels::AVX512; ++set) {
+        const GeometryKernels::InstructionSet instructionSet = GeometryKernels::InstructionSet(set);
+        if (instructionSet > GeometryKernels::bestSupported() || !GeometryKernels::setInstructionSet(instructionSet)) {
+            std::printf("skip %s: not supported\n", GeometryKernels::name(instructionSet));
+            continue;
+        }
+        for (size_t m = 0; m < meshes.size(); ++m) {
+            compare(meshes[m], reference[m], runKernels(meshes[m]), GeometryKernels::name(instructionSet));
+        }
+        checkOffsetPart(GeometryKernels::name(instructionSet));
+        ++tested;
+    }
+
+    std::printf("%d instruction set(s) compared with scalar on %d input(s): %d failure(s)\n", tested, static_cast<int>(meshes.size()), failures);
+    return failures ? 1 : 0;
+}
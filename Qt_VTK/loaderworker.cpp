@@ -0,0 +1,125 @@
+/**
+ * @file loaderworker.cpp
+ * @brief Entry point of Qt_VTK_loader, the worker process that parses STL files for the viewer.
+ *
+ * The viewer's LoaderPool starts a few of these and talks to each over its standard input and
+ * output, one line per message:
+ *
+ *   viewer: load <key> <path>          worker: mesh <points> <triangles>   or   error <message>
+ *   viewer: release                    (after a mesh reply, once the viewer has mapped the segment)
+ *
+ * For a mesh reply the worker has written the mesh into a new shared-memory segment under the key
+ * chosen by the viewer (see SharedMesh.h); it stays attached until the release line arrives so the
+ * segment cannot disappear before the viewer maps it. Parsing here means a malformed file can only
+ * crash this process, and the parse buffers never touch the viewer's heap. The worker frees
+ * everything and hands its heap back to the system after each job.
+ */
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QSharedMemory>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include "SharedMesh.h"
+#include "StlParser.h"
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+namespace {
+
+/**
+ * Writes one reply line and flushes it, so the viewer sees it straight away.
+ */
+void reply(const QString& line) {
+    QByteArray bytes = line.toUtf8();
+    bytes.replace('\n', ' ');
+    std::cout << bytes.constData() << '\n' << std::flush;
+}
+
+/**
+ * Parses a file into a shared-memory segment under the given key.
+ */
+bool load(const QString& fileName, QSharedMemory& segment, StlMesh& mesh, QString& error) {
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        error = file.errorString();
+        return false;
+    }
+
+    // Parse straight from the page cache rather than copying the file into the heap
+    const qint64 size = file.size();
+    const uchar* data = size > 0 ? file.map(0, size) : nullptr;
+    QByteArray contents;
+    if (!data) {
+        contents = file.readAll();
+        data = reinterpret_cast<const uchar*>(contents.constData());
+    }
+
+    std::string parseError;
+    if (!StlParser::parse(reinterpret_cast<const char*>(data), static_cast<size_t>(size), mesh, &parseError)) {
+        error = QString::fromStdString(parseError);
+        return false;
+    }
+    return SharedMesh::write(mesh, segment, &error);
+}
+
+/**
+ * Returns freed memory to the system, so one large file does not leave this process bloated.
+ */
+void trimHeap() {
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+}
+
+} // namespace
+
+/**
+ * Serves load requests from standard input until the viewer closes it.
+ *
+ * @param argc The number of command-line arguments.
+ * @param argv The array of command-line arguments.
+ * @return 0 when standard input is closed.
+ */
+int main(int argc, char* argv[]) {
+    QCoreApplication application(argc, argv);
+    std::ios::sync_with_stdio(false);
+
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        const QString request = QString::fromUtf8(line.c_str(), static_cast<int>(line.size()));
+        if (!request.startsWith("load ")) {
+            reply("error Unexpected request: " + request);
+            continue;
+        }
+
+        const QString key = request.section(' ', 1, 1);
+        const QString fileName = request.section(' ', 2);
+        QSharedMemory segment(key);
+        QString error;
+        SharedMeshHeader header = {};
+        {
+            StlMesh mesh;
+            if (load(fileName, segment, mesh, error)) {
+                header = SharedMesh::layout(mesh.points.size() / 3, mesh.triangles.size() / 3);
+            }
+        }
+        trimHeap();
+
+        if (!error.isEmpty()) {
+            reply("error " + error);
+            continue;
+        }
+        reply(QString("mesh %1 %2").arg(header.pointCount).arg(header.triangleCount));
+
+        // Hold the segment until the viewer has mapped it; end of input means the viewer is gone
+        if (!std::getline(std::cin, line) || line != "release") {
+            break;
+        }
+        segment.detach();
+    }
+    return 0;
+}
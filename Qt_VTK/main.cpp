@@ -1,6 +1,10 @@
 #include "mainwindow.h"
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QDebug>
 #include <QIcon>
+#include <QTextStream>
+#include "SyncSession.h"
 
 
 /**
@@ -9,6 +13,16 @@
  *
  * Initializes the QApplication object, creates the main window, and enters the application's main event loop.
  *
+ * Viewer instances can be linked for reviews:
+ *   Qt_VTK --sync-publish review                  publish this viewer's scene
+ *   Qt_VTK --sync-follow review                   mirror the scene published as "review"
+ *   Qt_VTK --sync-relay review --sync-listen far --sync-latency 80
+ *                                                 run a windowless relay standing in for a remote site;
+ *                                                 followers of "far" see the scene 80 ms late
+ *
+ * Sessions can be recorded for replay as benchmarks (Qt_VTK_bench --mode replay --input review.vrec):
+ *   Qt_VTK --record-session review.vrec
+ *
  * @param argc The number of command-line arguments.
  * @param argv The array of command-line arguments.
  * @return Returns the exit code of the application.
@@ -17,8 +31,43 @@ int main(int argc, char* argv[])
 {
 	QApplication a(argc, argv); // Create the QApplication instance.
 
+	QCommandLineParser options;
+	options.addHelpOption();
+	options.addOptions({
+		{ "sync-publish", "Publish this viewer's scene under a local socket name.", "name" },
+		{ "sync-follow", "Mirror the scene published under a local socket name.", "name" },
+		{ "sync-relay", "Run only a relay that forwards the named session.", "name" },
+		{ "sync-listen", "Socket name the relay accepts followers on.", "name", "relay" },
+		{ "sync-latency", "Delay the relay adds in each direction, in milliseconds.", "ms", "0" },
+		{ "record-session", "Record the session to a file for replay.", "file" },
+	});
+	options.process(a);
+
+	QString error;
+	if (options.isSet("sync-relay")) {
+		SyncRelay relay(options.value("sync-latency").toInt());
+		QObject::connect(&relay, &SyncRelay::statusMessage, [](const QString& message) {
+			QTextStream(stdout) << message << Qt::endl;
+		});
+		if (!relay.start(options.value("sync-relay"), options.value("sync-listen"), &error)) {
+			QTextStream(stderr) << "Could not start relay: " << error << Qt::endl;
+			return 1;
+		}
+		return a.exec();
+	}
+
 	MainWindow w; // Create the main window.
 
+	if (options.isSet("sync-publish") && !w.startSync(true, options.value("sync-publish"), &error)) {
+		qWarning() << "Could not publish scene:" << error;
+	}
+	else if (options.isSet("sync-follow") && !w.startSync(false, options.value("sync-follow"), &error)) {
+		qWarning() << "Could not follow scene:" << error;
+	}
+	else if (options.isSet("record-session") && !w.startRecording(options.value("record-session"), &error)) {
+		qWarning() << "Could not record session:" << error;
+	}
+
 
 	w.setWindowIcon(QIcon(":/Downloads/logo.png"));
 
@@ -8,6 +8,7 @@
  */
 
 #include <QFileDialog>
+#include <QHeaderView>
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 #include "OptionDialog.h"
@@ -17,6 +18,7 @@
 #include <vtkRenderer.h>
 #include <vtkCylinderSource.h>
 #include <vtkPolyDataMapper.h>
+#include <vtkNew.h>
 #include <vtkActor.h>
 #include <vtkProperty.h>
 #include <vtkCamera.h>
@@ -27,9 +29,28 @@
 #include <QInputDialog>
 #include <vtkTransform.h>
 #include <vtkTransformPolyDataFilter.h>
-#include <QtConcurrent/QtConcurrentRun>
 #include <vtkRenderer.h>
 #include <vtkLight.h>
+#include <vtkMatrix4x4.h>
+#include <vtkImageData.h>
+#include <vtkTexture.h>
+#include <QTimer>
+#include <QSemaphore>
+#include <QHash>
+#include "BulkFileReader.h"
+#include "AssemblyImporter.h"
+#include "PointCloud.h"
+#include "SceneRenderer.h"
+#include "TaskScheduler.h"
+#include "Slicer.h"
+#include "DeviationAnalysis.h"
+#include "CollisionProxy.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
 
 
  /**
@@ -43,16 +64,30 @@
 MainWindow::MainWindow(QWidget* parent) :
     QMainWindow(parent),
     ui(new Ui::MainWindow),
-    partList(nullptr) {
+    partList(nullptr),
+    scene(nullptr),
+    loaderPool(nullptr),
+    massProperties(nullptr),
+    attributes(nullptr),
+    sync(nullptr),
+    lastLoadId(0),
+    mirrorInterval(200) {
     ui->setupUi(this);
     initializePartList();
+    massProperties = new MassProperties(partList, this);
+    attributes = new AttributeStore(partList, this);
     setupTreeView();
     setupActions();
     setupRenderer();
     connectSignals();
     vrThread = new VRRenderThread(this);
+    connect(vrThread, &VRRenderThread::mirrorFrame, this, &MainWindow::showVRMirrorFrame);
+    connect(vrThread, &VRRenderThread::partMoved, this, &MainWindow::applyVRMove);
+    connect(vrThread, &VRRenderThread::contactsChanged, this, &MainWindow::showVRContacts);
     connect(ui->pushButtonVrRender, &QPushButton::clicked, this, &MainWindow::startVRRendering);
-
+    if (LoaderPool::available()) {
+        loaderPool = new LoaderPool(0, this);
+    }
 }
 
 /**
@@ -61,6 +96,15 @@ MainWindow::MainWindow(QWidget* parent) :
  * Cleans up the user interface and the dynamically allocated partList.
  */
 MainWindow::~MainWindow() {
+    // Drop the background tasks that have not started, and wait for the rest: they use the tree
+    // and report back to this window, so both must outlive them
+    backgroundWork.cancel();
+    for (const QFuture<void>& task : backgroundTasks) {
+        TaskScheduler::instance()->wait(task);
+    }
+    delete loaderPool; // Before the tree goes: files in progress still report back to this window
+    delete sync; // Stops watching the parts' transforms while they still exist
+    delete massProperties; // Also detaches from the parts' transforms
     delete ui;
     delete partList;
     delete vrThread;
@@ -69,6 +113,21 @@ MainWindow::~MainWindow() {
 
 
 
+/**
+ * @brief Runs work for this window on the task scheduler.
+ *
+ * The work is dropped if the window closes before it starts, and the window waits for it on
+ * closing if it has started, so it may use the window and the tree until it returns.
+ *
+ * @param priority The work's class.
+ * @param work The work.
+ */
+void MainWindow::runInBackground(TaskScheduler::Priority priority, std::function<void()> work) {
+    backgroundTasks.erase(std::remove_if(backgroundTasks.begin(), backgroundTasks.end(),
+        [](const QFuture<void>& task) { return task.isFinished(); }), backgroundTasks.end());
+    backgroundTasks.append(TaskScheduler::instance()->run(priority, std::move(work), backgroundWork));
+}
+
 /**
  * @brief Initializes the part list model.
  *
@@ -87,6 +146,22 @@ void MainWindow::initializePartList() {
 void MainWindow::setupTreeView() {
     ui->treeView->setModel(partList);
     ui->treeView->setContextMenuPolicy(Qt::ActionsContextMenu);
+    ui->treeView->setColumnHidden(ModelPartList::kRenderCostColumn, true);
+
+    // Rows are sorted only when the render cost header is clicked; clicks on the other headers
+    // leave the tree in the order it was built, which sync sessions and recordings mirror
+    QHeaderView* header = ui->treeView->header();
+    header->setSectionsClickable(true);
+    header->setSortIndicator(-1, Qt::AscendingOrder);
+    header->setSortIndicatorShown(true);
+    connect(header, &QHeaderView::sortIndicatorChanged, this, [this, header](int column, Qt::SortOrder order) {
+        if (column != ModelPartList::kRenderCostColumn) {
+            const QSignalBlocker blocker(header);
+            header->setSortIndicator(-1, Qt::AscendingOrder);
+            return;
+        }
+        partList->sort(column, order);
+    });
     addModelPartToTree();
 }
 
@@ -96,9 +171,8 @@ void MainWindow::setupTreeView() {
  * Creates a root item and a child item, appending the child to the root in the tree.
  */
 void MainWindow::addModelPartToTree() {
-    ModelPart* rootItem = partList->getRootItem();
     ModelPart* childItem = new ModelPart({ "Model", "true", "255,255,255" });
-    rootItem->appendChild(childItem);
+    partList->insertChildren(QModelIndex(), { childItem });
 }
 
 /**
@@ -110,6 +184,7 @@ void MainWindow::setupActions() {
     createAction(&actionItemOptions, tr("Item Options"), &MainWindow::on_actionItemOptions_triggered);
     createAction(&actionNewGroup, tr("New Group"), &MainWindow::on_actionNewGroup_triggered);
     createAction(&actionDeleteItem, tr("Delete Item"), &MainWindow::on_actionDeleteFile_triggered);
+    createAction(&actionMoveItem, tr("Move Item"), &MainWindow::on_actionMoveItem_triggered);
     
 }
 
@@ -134,12 +209,19 @@ void MainWindow::createAction(QAction** action, const QString& text, void (MainW
 void MainWindow::setupRenderer() {
     renderWindow = vtkSmartPointer<vtkGenericOpenGLRenderWindow>::New();
     ui->vtkWidget->setRenderWindow(renderWindow);
-    renderer = vtkSmartPointer<vtkRenderer>::New();
-    renderWindow->AddRenderer(renderer);
-
-
-
-    addFloor(); // Add the floor to the scene
+    scene = new SceneRenderer(this);
+    renderWindow->SetNumberOfLayers(2);
+    renderWindow->AddRenderer(scene->getRenderer());
+    renderWindow->AddRenderer(scene->getEdgeRenderer());
+
+    connect(scene, &SceneRenderer::impostorsUpdated, this, [this] { renderWindow->Render(); });
+    connect(scene, &SceneRenderer::pointCloudsUpdated, this, [this] { renderWindow->Render(); });
+    connect(scene, &SceneRenderer::cullingChanged, this, [this](int culled, int tested, double elapsedMs) {
+        emit statusUpdateMessage(QString("Occlusion culling: %1 of %2 parts hidden (%3%) in %4 ms")
+            .arg(culled).arg(tested)
+            .arg(tested ? 100.0 * culled / tested : 0.0, 0, 'f', 1)
+            .arg(elapsedMs, 0, 'f', 2), 2000);
+        });
 }
 
 
@@ -153,6 +235,15 @@ void MainWindow::connectSignals() {
     connect(ui->actionItem_Options, &QAction::triggered, this, &MainWindow::on_actionItemOptions_triggered);
     connect(ui->actionNew_Group, &QAction::triggered, this, &MainWindow::on_actionNewGroup_triggered);
     connect(ui->actionSearch_Items, &QAction::triggered, this, &MainWindow::on_actionSearchItem_triggered);
+    connect(ui->actionOcclusion_Culling, &QAction::toggled, this, &MainWindow::setOcclusionCulling);
+    connect(ui->actionImpostors, &QAction::toggled, this, &MainWindow::setImpostors);
+    connect(ui->actionMirror_VR, &QAction::toggled, this, &MainWindow::setVRMirror);
+    connect(ui->actionFeature_Edges, &QAction::toggled, this, &MainWindow::setFeatureEdges);
+    connect(ui->actionHidden_Line_Removal, &QAction::toggled, this, &MainWindow::setHiddenLineRemoval);
+    connect(ui->actionShadows, &QAction::toggled, this, &MainWindow::setShadows);
+    connect(ui->actionContact_Shadow, &QAction::toggled, this, &MainWindow::setContactShadow);
+    connect(ui->actionRecord_Session, &QAction::toggled, this, &MainWindow::setSessionRecording);
+    connect(ui->actionRender_Cost_Heat_Map, &QAction::toggled, this, &MainWindow::setRenderCostHeatMap);
 }
 
 /**
@@ -178,8 +269,8 @@ void MainWindow::handleTreeClicked() {
  * @brief Triggered when the 'Item Options' action is activated.
  *
  * Opens a dialog for editing the properties (name, visibility, color) of the selected item.
- * If changes are confirmed, it applies the updated properties to the selected item
- * and all its child items recursively.
+ * If changes are confirmed, it applies the updated properties to the selected item and its color
+ * to all its child items recursively. Children inherit the visibility through the item's scene node.
  */
 void MainWindow::on_actionItemOptions_triggered() {
     QModelIndex index = ui->treeView->currentIndex();
@@ -202,7 +293,8 @@ void MainWindow::on_actionItemOptions_triggered() {
     if (dialog.exec() == QDialog::Accepted) {
         QColor color = dialog.getColor();
         applyPropertiesToPart(selectedPart, dialog.getName(), dialog.getVisibility(), color, true);
-        updateChildrenProperties(selectedPart, dialog.getVisibility(), color);
+        updateChildrenProperties(selectedPart, color);
+        renderWindow->Render();
         emit statusUpdateMessage("Item and its children updated.", 2000);
     }
 }
@@ -211,15 +303,17 @@ void MainWindow::on_actionItemOptions_triggered() {
  * @brief Applies specified properties to a part.
  *
  * Sets the provided name, visibility, and color to the specified part. If updateName is true,
- * the name of the part is updated along with its visibility and color.
+ * the name of the part is updated along with its visibility and color. The caller is responsible
+ * for re-rendering once all changes have been applied.
  *
  * @param part The part to which the properties will be applied.
  * @param name The new name to set, applicable only if updateName is true.
  * @param visibility The new visibility state to apply.
  * @param color The new color to apply.
  * @param updateName Flag to determine whether to update the part's name.
+ * @param notify False when the caller notifies the tree of a whole batch of parts at once.
  */
-void MainWindow::applyPropertiesToPart(ModelPart* part, const QString& name, bool visibility, const QColor& color, bool updateName) {
+void MainWindow::applyPropertiesToPart(ModelPart* part, const QString& name, bool visibility, const QColor& color, bool updateName, bool notify) {
     if (!part) return;
 
     if (updateName) {
@@ -231,105 +325,655 @@ void MainWindow::applyPropertiesToPart(ModelPart* part, const QString& name, boo
     part->setColour(color.red(), color.green(), color.blue());
     part->setVisible(visibility);
 
-    QAbstractItemModel* model = ui->treeView->model();
-    QModelIndex startIndex = model->index(part->row(), 0);
-    QModelIndex endIndex = model->index(part->row(), model->columnCount());
-    model->dataChanged(startIndex, endIndex);
-    ui->treeView->update(startIndex);
+    if (notify) {
+        partList->notifyPartChanged(part);
+    }
 
     vtkSmartPointer<vtkActor> actor = part->getActor();
     if (actor) {
-        actor->SetVisibility(visibility);
         actor->GetProperty()->SetDiffuseColor(color.red() / 255.0, color.green() / 255.0, color.blue() / 255.0);
-        updateRender();
     }
 }
 
 /**
- * @brief Recursively updates the properties of child parts.
+ * @brief Links this viewer with other instances, either publishing its scene or mirroring another's.
  *
- * Applies the specified visibility and color recursively to all child parts of the given part.
- * The name of the child parts is not updated.
+ * A follower's tree and camera are replaced by the publisher's and then kept in step with it.
+ *
+ * @param publish True to publish this scene; false to follow a publisher.
+ * @param name The local socket name of the session.
+ * @param error Receives a description of the failure; may be nullptr.
+ * @return True if the session started.
+ */
+bool MainWindow::startSync(bool publish, const QString& name, QString* error) {
+    return publish ? syncSession()->publish(name, error) : syncSession()->follow(name, error);
+}
+
+/**
+ * @brief Starts recording the session to a file, for replay with Qt_VTK_bench --mode replay.
+ *
+ * The recording starts with the current scene and then captures every change to the tree, part
+ * properties and camera, and every view setting and VR command, with its time.
+ *
+ * @param fileName The recording to write.
+ * @param error Receives a description of the failure; may be nullptr.
+ * @return True if the recording started.
+ */
+bool MainWindow::startRecording(const QString& fileName, QString* error) {
+    const bool started = syncSession()->record(fileName, error);
+    const QSignalBlocker blocker(ui->actionRecord_Session);
+    ui->actionRecord_Session->setChecked(started);
+    if (started) {
+        // Settings already on are part of the starting state
+        recordEvent("occlusionCulling", scene->occlusionCulling());
+        recordEvent("impostors", scene->impostors());
+        recordEvent("featureEdges", scene->featureEdges());
+        recordEvent("hiddenLineRemoval", scene->hiddenLineRemoval());
+        recordEvent("shadows", scene->shadows());
+        recordEvent("contactShadow", scene->contactShadow());
+    }
+    return started;
+}
+
+/**
+ * @brief Creates the sync session on first use.
+ *
+ * @return The session.
+ */
+SyncSession* MainWindow::syncSession() {
+    if (!sync) {
+        sync = new SyncSession(partList, scene, this);
+        connect(sync, &SyncSession::remotePropertiesChanged, this, [this](ModelPart* part, const QString& name, bool visible, const QColor& color) {
+            applyPropertiesToPart(part, name, visible, color);
+            });
+        connect(sync, &SyncSession::remoteFrameApplied, this, [this] { renderWindow->Render(); });
+        connect(sync, &SyncSession::statusMessage, this, [this](const QString& message) {
+            emit statusUpdateMessage(message, 5000);
+            });
+    }
+    return sync;
+}
+
+/**
+ * @brief Adds a view setting or VR command to the session recording, if one is running.
+ *
+ * @param name What was set.
+ * @param value The new value.
+ */
+void MainWindow::recordEvent(const QString& name, const QVariant& value) {
+    if (sync) {
+        sync->recordEvent(name, value);
+    }
+}
+
+/**
+ * @brief Sends a command to the VR thread and records it.
+ *
+ * @param command A VRRenderThread command.
+ * @param value The command's argument.
+ */
+void MainWindow::issueVRCommand(int command, double value) {
+    recordEvent("vrCommand", QVariantList{ command, value });
+    vrThread->issueCommand(command, value);
+}
+
+/**
+ * @brief Recursively updates the color of child parts.
+ *
+ * Applies the specified color recursively to all child parts of the given part. The name and
+ * visibility of the child parts are not updated; visibility is inherited from the parent's node.
  *
  * @param part The part whose children will be updated.
- * @param visibility The visibility state to apply to all child parts.
  * @param color The color to apply to all child parts.
  */
-void MainWindow::updateChildrenProperties(ModelPart* part, bool visibility, const QColor& color) {
+void MainWindow::updateChildrenProperties(ModelPart* part, const QColor& color) {
     for (int i = 0; i < part->childCount(); ++i) {
         ModelPart* child = part->child(i);
-        applyPropertiesToPart(child, QString(), visibility, color, false); // false to not update name
-        updateChildrenProperties(child, visibility, color); // Recursive call
+        applyPropertiesToPart(child, QString(), child->visible(), color, false); // false to not update name
+        updateChildrenProperties(child, color); // Recursive call
     }
 }
 
 /**
  * @brief Updates the renderer with the current tree structure.
  *
- * Iterates over the top-level items in the tree and updates the rendering accordingly.
- * This includes resetting the camera and updating the render view.
+ * Hands the part tree to the scene renderer, resets the camera and updates the render view.
  */
 void MainWindow::updateRender() {
-    renderer->RemoveAllViewProps(); // Remove existing actors
+    scene->setRoot(partList->getRootItem());
+    renderWindow->Render();
 
-   
+    if (vrThread->isRunning()) {
+        startVRRendering();
+    }
+}
 
-    int topLevelItemCount = partList->rowCount(QModelIndex());
-    
+/**
+ * @brief Enables or disables occlusion culling.
+ *
+ * @param enabled True to cull hidden parts every frame.
+ */
+void MainWindow::setOcclusionCulling(bool enabled) {
+    scene->setOcclusionCulling(enabled);
+    recordEvent("occlusionCulling", enabled);
+    renderWindow->Render();
+}
 
-   
-    for (int i = 0; i < topLevelItemCount; ++i) {
-        QModelIndex topLevelIndex = partList->index(i, 0, QModelIndex());
-        updateRenderFromTree(topLevelIndex);
-        
+/**
+ * @brief Enables or disables billboard impostors for distant parts.
+ *
+ * @param enabled True to draw parts smaller than a few pixels as cached images.
+ */
+void MainWindow::setImpostors(bool enabled) {
+    scene->setImpostors(enabled);
+    recordEvent("impostors", enabled);
+    renderWindow->Render();
+}
+
+/**
+ * @brief Shows or hides the feature edge overlay.
+ *
+ * @param enabled True to outline the sharp and boundary edges of every part.
+ */
+void MainWindow::setFeatureEdges(bool enabled) {
+    scene->setFeatureEdges(enabled);
+    recordEvent("featureEdges", enabled);
+    renderWindow->Render();
+}
+
+/**
+ * @brief Chooses whether surfaces hide the feature edges behind them.
+ *
+ * @param enabled True to hide edges behind surfaces.
+ */
+void MainWindow::setHiddenLineRemoval(bool enabled) {
+    scene->setHiddenLineRemoval(enabled);
+    recordEvent("hiddenLineRemoval", enabled);
+    renderWindow->Render();
+}
+
+/**
+ * @brief Turns part shadows on or off, in the viewport and the headset.
+ *
+ * @param enabled True for parts to cast shadows on each other and the floor.
+ */
+void MainWindow::setShadows(bool enabled) {
+    scene->setShadows(enabled);
+    recordEvent("shadows", enabled);
+    issueVRCommand(VRRenderThread::SHADOWS, enabled ? 1. : 0.);
+    renderWindow->Render();
+}
+
+/**
+ * @brief Shows or hides the soft contact shadow on the floor under the parts.
+ *
+ * @param enabled True to darken the floor under the parts.
+ */
+void MainWindow::setContactShadow(bool enabled) {
+    scene->setContactShadow(enabled);
+    recordEvent("contactShadow", enabled);
+    renderWindow->Render();
+}
+
+/**
+ * @brief Shows the headset view in the desktop viewport instead of the scene.
+ *
+ * While mirroring, the scene renderer is taken out of the render window, so the desktop draws
+ * nothing but the latest mirror image as a textured background and VR keeps the GPU to itself.
+ *
+ * @param enabled True to mirror; the user is asked for the rate.
+ */
+void MainWindow::setVRMirror(bool enabled) {
+    if (enabled) {
+        bool ok = false;
+        const int rate = QInputDialog::getInt(this, tr("Mirror VR Headset"), tr("Mirror images per second:"),
+            1000 / mirrorInterval, 1, 30, 1, &ok);
+        if (!ok) {
+            const QSignalBlocker blocker(ui->actionMirror_VR);
+            ui->actionMirror_VR->setChecked(false);
+            return;
+        }
+        mirrorInterval = 1000 / rate;
+
+        if (!mirrorRenderer) {
+            mirrorImage = vtkSmartPointer<vtkImageData>::New();
+            vtkNew<vtkTexture> texture;
+            texture->SetInputData(mirrorImage);
+            texture->InterpolateOn();
+            mirrorRenderer = vtkSmartPointer<vtkRenderer>::New();
+            mirrorRenderer->SetBackground(0.0, 0.0, 0.0);
+            mirrorRenderer->SetBackgroundTexture(texture);
+            mirrorRenderer->TexturedBackgroundOn();
+        }
+        mirrorImage->Initialize();
+        renderWindow->RemoveRenderer(scene->getRenderer());
+        renderWindow->RemoveRenderer(scene->getEdgeRenderer());
+        renderWindow->AddRenderer(mirrorRenderer);
+        vrThread->setMirror(mirrorInterval, vrMirrorSize());
+        emit statusUpdateMessage(QString("Mirroring the VR headset at %1 image(s) per second").arg(rate), 3000);
+    }
+    else {
+        vrThread->setMirror(0, QSize());
+        if (mirrorRenderer) {
+            renderWindow->RemoveRenderer(mirrorRenderer);
+        }
+        renderWindow->AddRenderer(scene->getRenderer());
+        renderWindow->AddRenderer(scene->getEdgeRenderer());
+    }
+    recordEvent("vrMirror", enabled ? mirrorInterval : 0);
+    renderWindow->Render();
+}
+
+/**
+ * @brief Starts or stops recording the session.
+ *
+ * A sync session in progress is ended first, after asking.
+ *
+ * @param enabled True to record; the user is asked for the file.
+ */
+void MainWindow::setSessionRecording(bool enabled) {
+    if (!enabled) {
+        if (sync && sync->isRecording()) {
+            sync->stop();
+            emit statusUpdateMessage("Session recording stopped", 3000);
+        }
+        return;
     }
 
-    renderer->ResetCamera();
-    renderer->GetActiveCamera()->Azimuth(30);
-    renderer->GetActiveCamera()->Elevation(30);
-    renderer->ResetCameraClippingRange();
-    
-    renderer->Render();
+    const QSignalBlocker blocker(ui->actionRecord_Session);
+    ui->actionRecord_Session->setChecked(false);
+    if (sync && (sync->isPublishing() || sync->isFollowing())
+        && QMessageBox::question(this, tr("Record Session"), tr("Recording ends the sync session in progress. Continue?")) != QMessageBox::Yes)
+        return;
+    const QString fileName = QFileDialog::getSaveFileName(this, tr("Record Session"), QDir::homePath(), tr("Session Recordings (*.vrec)"));
+    if (fileName.isEmpty())
+        return;
+    QString error;
+    if (!startRecording(fileName, &error)) {
+        QMessageBox::warning(this, tr("Record Session"), tr("Could not write %1: %2").arg(fileName, error));
+    }
+}
 
-    if (vrThread->isRunning()) {
-        startVRRendering();
+/**
+ * @brief Profiles a few frames of the current view and colours each part by what it costs to
+ * draw, or restores the parts' colours.
+ *
+ * The costs also fill the tree's render cost column; sorting by it lists the parts worth
+ * decimating or instancing first. The profile is a snapshot and is not updated as the view changes.
+ *
+ * @param enabled True to profile and show the heat map, false to restore the colours.
+ */
+void MainWindow::setRenderCostHeatMap(bool enabled) {
+    if (!enabled) {
+        applyHeatMap(partList->getRootItem(), nullptr, 0.0);
+        partList->clearRenderProfile();
+        ui->treeView->setColumnHidden(ModelPartList::kRenderCostColumn, true);
+        renderWindow->Render();
+        return;
+    }
+
+    const int profiledFrames = 10;
+    scene->setRenderProfiling(true);
+    for (int frame = 0; frame < profiledFrames; ++frame) {
+        renderWindow->Render();
+    }
+    const RenderProfiler::Profile profile = scene->renderProfile();
+    scene->setRenderProfiling(false);
+
+    if (profile.parts.empty()) {
+        const QSignalBlocker blocker(ui->actionRender_Cost_Heat_Map);
+        ui->actionRender_Cost_Heat_Map->setChecked(false);
+        QMessageBox::information(this, tr("Render Cost Heat Map"), tr("No parts were drawn. Show some parts in the viewport and try again."));
+        return;
     }
 
- 
+    ModelPart* costliest = nullptr;
+    double maxCost = 0.0, cpuMs = profile.unattributed.cpuMs, gpuMs = profile.unattributed.gpuMs;
+    for (const auto& entry : profile.parts) {
+        cpuMs += entry.second.cpuMs;
+        gpuMs += entry.second.gpuMs;
+        if (!costliest || entry.second.costMs() > maxCost) {
+            costliest = entry.first;
+            maxCost = entry.second.costMs();
+        }
+    }
+    applyHeatMap(partList->getRootItem(), &profile, maxCost);
+    partList->setRenderProfile(profile);
+    ui->treeView->setColumnHidden(ModelPartList::kRenderCostColumn, false);
+    ui->treeView->resizeColumnToContents(ModelPartList::kRenderCostColumn);
+    renderWindow->Render();
+
+    emit statusUpdateMessage(QString("Render cost over %1 frames: %2 ms CPU, %3 per frame; costliest part %4 at %5% of the frame")
+        .arg(profile.frames)
+        .arg(cpuMs, 0, 'f', 2)
+        .arg(profile.gpuTimed ? QString("%1 ms GPU").arg(gpuMs, 0, 'f', 2) : QString("GPU not measured"))
+        .arg(costliest->data(0).toString())
+        .arg(profile.totalMs() > 0.0 ? 100.0 * maxCost / profile.totalMs() : 0.0, 0, 'f', 1), 10000);
 }
 
+/**
+ * @brief Colours the actors of a subtree by render cost, or restores their own colours. Only
+ * the actors change, so the parts' colours in the tree are untouched.
+ *
+ * @param part The root of the subtree.
+ * @param profile The costs to show, or nullptr to restore the parts' colours.
+ * @param maxCost The cost of the costliest part in the profile, drawn hottest.
+ */
+void MainWindow::applyHeatMap(ModelPart* part, const RenderProfiler::Profile* profile, double maxCost) {
+    if (vtkActor* actor = part->getActor()) {
+        QColor color = part->getColor();
+        if (profile) {
+            auto it = profile->parts.find(part);
+            unsigned char rgb[3];
+            RenderProfiler::heatColour(it != profile->parts.end() ? it->second.costMs() : 0.0, maxCost, rgb);
+            color = QColor(rgb[0], rgb[1], rgb[2]);
+        }
+        actor->GetProperty()->SetDiffuseColor(color.redF(), color.greenF(), color.blueF());
+    }
+    for (int i = 0; i < part->childCount(); ++i) {
+        applyHeatMap(part->child(i), profile, maxCost);
+    }
+}
 
 /**
- * @brief Recursively adds actors to the renderer from the tree structure.
+ * @brief Displays a mirror image from the VR thread.
  *
- * Starting from the provided tree index, this function adds corresponding actors
- * to the renderer. It recurses through all child items, adding each to the renderer.
+ * Images arriving after mirroring was turned off are dropped. The VR thread is asked for a new
+ * size when the viewport has been resized.
  *
- * @param index The model index to start adding actors from.
+ * @param image The left eye, scaled to the viewport's aspect ratio.
  */
-void MainWindow::updateRenderFromTree(const QModelIndex& index) {
-    if (index.isValid()) {
-        ModelPart* selectedPart = static_cast<ModelPart*>(index.internalPointer());
-        if (selectedPart) {
-            vtkActor* actor = selectedPart->getActor();
-            if (actor) {
-                renderer->AddActor(actor);
-            }
+void MainWindow::showVRMirrorFrame(const QImage& image) {
+    if (!ui->actionMirror_VR->isChecked() || image.isNull())
+        return;
+
+    // The texture wants bottom-up RGB rows
+    const QImage rgb = image.convertToFormat(QImage::Format_RGB888);
+    if (mirrorImage->GetDimensions()[0] != rgb.width() || mirrorImage->GetDimensions()[1] != rgb.height()) {
+        mirrorImage->SetDimensions(rgb.width(), rgb.height(), 1);
+        mirrorImage->AllocateScalars(VTK_UNSIGNED_CHAR, 3);
+    }
+    unsigned char* pixels = static_cast<unsigned char*>(mirrorImage->GetScalarPointer());
+    const size_t rowBytes = static_cast<size_t>(rgb.width()) * 3;
+    for (int y = 0; y < rgb.height(); ++y) {
+        std::memcpy(pixels + (rgb.height() - 1 - y) * rowBytes, rgb.constScanLine(y), rowBytes);
+    }
+    mirrorImage->Modified();
+    renderWindow->Render();
+
+    const QSize size = vrMirrorSize();
+    if (size != image.size()) {
+        vrThread->setMirror(mirrorInterval, size);
+    }
+}
+
+/**
+ * @brief Chooses the size of the VR mirror image.
+ *
+ * @return The viewport size, scaled down to at most 640 pixels wide; the GPU scales the eye to
+ *         this before it is read back.
+ */
+QSize MainWindow::vrMirrorSize() const {
+    const QSize viewport = ui->vtkWidget->size();
+    if (viewport.width() <= 640)
+        return viewport;
+    return QSize(640, std::max(1, viewport.height() * 640 / viewport.width()));
+}
+
+/**
+ * @brief Slot triggered to set the density of the selected part or group.
+ *
+ * A density set on a group applies to every part below it that has none of its own.
+ */
+void MainWindow::on_actionSet_Density_triggered() {
+    QModelIndex index = ui->treeView->currentIndex();
+    if (!index.isValid()) {
+        QMessageBox::warning(this, tr("Set Density"), tr("Select a part or group first."));
+        return;
+    }
+    ModelPart* part = static_cast<ModelPart*>(index.internalPointer());
+
+    bool ok;
+    const double density = QInputDialog::getDouble(this, tr("Set Density"),
+        tr("Density of %1, in mass per cubic model unit (0 to inherit, currently %2):").arg(part->data(0).toString()).arg(part->effectiveDensity()),
+        part->density(), 0.0, 1e9, 9, &ok);
+    if (ok) {
+        massProperties->setDensity(part, density);
+    }
+}
+
+/**
+ * @brief Slot triggered to show the mass properties of the selected part, or of the whole scene
+ * if nothing is selected.
+ */
+void MainWindow::on_actionMass_Properties_triggered() {
+    QModelIndex index = ui->treeView->currentIndex();
+    ModelPart* part = index.isValid() ? static_cast<ModelPart*>(index.internalPointer()) : partList->getRootItem();
+
+    auto start = std::chrono::steady_clock::now();
+    const MassProperties::Result result = massProperties->compute(part);
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (result.meshes == 0) {
+        QMessageBox::information(this, tr("Mass Properties"), tr("%1 has no meshes.").arg(part->data(0).toString()));
+        return;
+    }
+
+    const double* I = result.inertia;
+    QMessageBox::information(this, tr("Mass Properties"), tr(
+        "%1 (%2 mesh(es))\n\n"
+        "Volume: %3\n"
+        "Mass: %4\n"
+        "Centre of mass: (%5, %6, %7)\n\n"
+        "Inertia about the centre of mass:\n"
+        "  Ixx %8   Ixy %9   Ixz %10\n"
+        "  Iyx %11   Iyy %12   Iyz %13\n"
+        "  Izx %14   Izy %15   Izz %16")
+        .arg(part->data(0).toString()).arg(result.meshes)
+        .arg(result.volume, 0, 'g', 8).arg(result.mass, 0, 'g', 8)
+        .arg(result.centre[0], 0, 'g', 8).arg(result.centre[1], 0, 'g', 8).arg(result.centre[2], 0, 'g', 8)
+        .arg(I[0], 0, 'g', 6).arg(I[1], 0, 'g', 6).arg(I[2], 0, 'g', 6)
+        .arg(I[3], 0, 'g', 6).arg(I[4], 0, 'g', 6).arg(I[5], 0, 'g', 6)
+        .arg(I[6], 0, 'g', 6).arg(I[7], 0, 'g', 6).arg(I[8], 0, 'g', 6));
+    emit statusUpdateMessage(QString("Mass properties: %1 part(s) recomputed in %2 ms").arg(result.recomputed).arg(ms, 0, 'f', 1), 5000);
+}
+
+/**
+ * @brief Slot triggered to slice the selected parts, or the whole scene if none is selected.
+ *
+ * The geometry is copied in world coordinates on this thread and sliced on the thread pool. The
+ * contours are previewed in the viewport, thinned to a couple of hundred layers so dense stacks
+ * stay legible, and written as a CLI file if a file name was given.
+ */
+void MainWindow::on_actionSlice_Parts_triggered() {
+    bool ok;
+    const double spacing = QInputDialog::getDouble(this, tr("Slice Parts"), tr("Layer thickness:"), 0.1, 0.001, 1000.0, 3, &ok);
+    if (!ok) return;
+    const QString fileName = QFileDialog::getSaveFileName(this, tr("Export Layers (cancel to preview only)"), QDir::homePath(), tr("Common Layer Interface (*.cli)"));
+
+    auto slicer = std::make_shared<Slicer>();
+    const QModelIndexList selected = ui->treeView->selectionModel()->selectedRows();
+    if (selected.isEmpty()) {
+        slicer->addPart(partList->getRootItem());
+    }
+    for (const QModelIndex& index : selected) {
+        slicer->addPart(static_cast<ModelPart*>(index.internalPointer()));
+    }
+    if (slicer->triangleCount() == 0) {
+        emit statusUpdateMessage("Nothing visible to slice", 5000);
+        return;
+    }
+    emit statusUpdateMessage(QString("Slicing %1 triangles...").arg(slicer->triangleCount()), 0);
+
+    runInBackground(TaskScheduler::Analysis, [this, slicer, spacing, fileName] {
+        auto layers = std::make_shared<std::vector<Slicer::Layer>>(slicer->slice(spacing));
+        const Slicer::Statistics statistics = slicer->statistics();
+        QString error;
+        const bool written = fileName.isEmpty() || Slicer::writeCli(fileName, *layers, &error);
+        const int every = std::max<int>(1, static_cast<int>(layers->size()) / 200);
+        vtkSmartPointer<vtkPolyData> contours = Slicer::toPolyData(*layers, every);
+
+        QMetaObject::invokeMethod(this, [this, contours, statistics, fileName, written, error] {
+                if (slicePreview) {
+                    scene->getRenderer()->RemoveActor(slicePreview);
+                }
+                vtkNew<vtkPolyDataMapper> mapper;
+                mapper->SetInputData(contours);
+                slicePreview = vtkSmartPointer<vtkActor>::New();
+                slicePreview->SetMapper(mapper);
+                slicePreview->GetProperty()->SetColor(1.0, 0.55, 0.0);
+                slicePreview->GetProperty()->SetLineWidth(2.0);
+                slicePreview->PickableOff();
+                scene->getRenderer()->AddActor(slicePreview);
+                renderWindow->Render();
+
+                QString message = QString("Sliced %1 triangles into %2 layers in %3 ms")
+                    .arg(statistics.triangles).arg(statistics.layers).arg(statistics.sortMs + statistics.sliceMs, 0, 'f', 0);
+                if (statistics.openContours > 0) {
+                    message += QString(", %1 open contour(s): the mesh has holes").arg(statistics.openContours);
+                }
+                if (!written) {
+                    QMessageBox::warning(this, tr("Slice Parts"), tr("Could not write %1: %2").arg(fileName, error));
+                }
+                else if (!fileName.isEmpty()) {
+                    message += ", written to " + QFileInfo(fileName).fileName();
+                }
+                emit statusUpdateMessage(message, 0);
+            }, Qt::QueuedConnection);
+        });
+}
+
+/**
+ * @brief Slot triggered to colour the current part by its distance from the other selected parts.
+ *
+ * The current part is measured against the surface of the other selected parts, e.g. a revised
+ * part against the previous revision, or a scan against its CAD model. The reference is copied in
+ * world coordinates on this thread and the distances are computed on the thread pool. A mesh is
+ * coloured per vertex; a scan is summarised from every point in the file and then coloured node by
+ * node as the nodes are loaded for display.
+ */
+void MainWindow::on_actionCompare_Deviation_triggered() {
+    const QModelIndex current = ui->treeView->currentIndex();
+    ModelPart* measured = current.isValid() ? static_cast<ModelPart*>(current.internalPointer()) : nullptr;
+    std::shared_ptr<PointCloud> cloud = measured ? measured->getPointCloud() : nullptr;
+    if (!measured || (!measured->getPolyData() && !cloud)) {
+        QMessageBox::information(this, tr("Compare Deviation"), tr("Select the reference parts, then make the part or scan to measure the current item."));
+        return;
+    }
+
+    auto analysis = std::make_shared<DeviationAnalysis>();
+    for (const QModelIndex& index : ui->treeView->selectionModel()->selectedRows()) {
+        if (index.internalPointer() != measured) {
+            analysis->addPart(static_cast<ModelPart*>(index.internalPointer()));
         }
-        int rows = partList->rowCount(index);
-        for (int i = 0; i < rows; ++i) {
-            updateRenderFromTree(partList->index(i, 0, index));
+    }
+    if (analysis->triangleCount() == 0) {
+        QMessageBox::information(this, tr("Compare Deviation"), tr("Select at least one visible reference part besides %1.").arg(measured->data(0).toString()));
+        return;
+    }
+
+    bool ok;
+    const double tolerance = QInputDialog::getDouble(this, tr("Compare Deviation"), tr("Tolerance, in model units:"), 0.1, 1e-6, 1e6, 6, &ok);
+    if (!ok) return;
+    const double range = 4.0 * tolerance;
+    const int binCount = 16;
+
+    std::array<double, 16> matrix;
+    std::copy(measured->getTransform()->GetMatrix()->GetData(), measured->getTransform()->GetMatrix()->GetData() + 16, matrix.begin());
+    std::vector<float> coordinates;
+    if (!cloud) {
+        std::vector<uint32_t> indices;
+        ModelPart::extractMesh(measured->getPolyData(), coordinates, indices);
+    }
+    const QString name = measured->data(0).toString();
+    emit statusUpdateMessage(QString("Measuring %1 against %2 triangles...").arg(name).arg(analysis->triangleCount()), 0);
+
+    runInBackground(TaskScheduler::Analysis, [this, analysis, measured, cloud, matrix, coordinates = std::move(coordinates), tolerance, range, binCount, name] {
+        analysis->build();
+        DeviationAnalysis::Summary summary(tolerance, range, binCount);
+        vtkSmartPointer<vtkUnsignedCharArray> colours;
+        if (cloud) {
+            summary = analysis->measureCloud(*cloud, matrix.data(), tolerance, range, binCount);
+        }
+        else {
+            const std::vector<float> distances = analysis->measure(coordinates.data(), coordinates.size() / 3, matrix.data());
+            summary.add(distances.data(), distances.size());
+            colours = vtkSmartPointer<vtkUnsignedCharArray>::New();
+            colours->SetName("Deviation");
+            colours->SetNumberOfComponents(3);
+            colours->SetNumberOfTuples(static_cast<vtkIdType>(distances.size()));
+            DeviationAnalysis::colourMap(distances.data(), distances.size(), tolerance, range, colours->GetPointer(0));
+        }
+        const DeviationAnalysis::Statistics statistics = analysis->statistics();
+
+        QMetaObject::invokeMethod(this, [this, analysis, measured, cloud, matrix, colours, summary, statistics, tolerance, range, name] {
+                if (!containsPart(measured))
+                    return; // Deleted while measuring
+                if (cloud) {
+                    cloud->setColouring(std::make_shared<const PointCloud::Colouring>(
+                        [analysis, matrix, tolerance, range](const float* xyz, quint32 count, unsigned char* rgb) {
+                            std::vector<float> distances(count);
+                            analysis->measureRange(xyz, count, matrix.data(), distances.data());
+                            DeviationAnalysis::colourMap(distances.data(), count, tolerance, range, rgb);
+                        }));
+                }
+                else {
+                    measured->setVertexColours(colours);
+                }
+                renderWindow->Render();
+
+                QString histogram;
+                const double binWidth = 2.0 * summary.range / summary.bins.size();
+                const uint64_t peak = std::max<uint64_t>(1, *std::max_element(summary.bins.begin(), summary.bins.end()));
+                for (size_t i = summary.bins.size(); i-- > 0;) {
+                    histogram += QString("%1 .. %2  %3\n")
+                        .arg(-summary.range + i * binWidth, 9, 'f', 4).arg(-summary.range + (i + 1) * binWidth, 9, 'f', 4)
+                        .arg(QString(static_cast<int>(40 * summary.bins[i] / peak), QChar('#')));
+                }
+                const double percent = summary.count ? 100.0 / summary.count : 0.0;
+                QMessageBox::information(this, tr("Compare Deviation"), tr(
+                    "%1: %2 point(s) against %3 triangle(s)\n\n"
+                    "Within +/-%4: %5%\n"
+                    "Above %6: %7%   Below -%6: %8%\n"
+                    "Min %9   Max %10\n"
+                    "Mean %11   RMS %12\n\n%13")
+                    .arg(name).arg(summary.count).arg(statistics.triangles)
+                    .arg(summary.tolerance).arg(summary.within * percent, 0, 'f', 2)
+                    .arg(summary.range).arg(summary.above * percent, 0, 'f', 2).arg(summary.below * percent, 0, 'f', 2)
+                    .arg(summary.min, 0, 'g', 6).arg(summary.max, 0, 'g', 6)
+                    .arg(summary.mean(), 0, 'g', 6).arg(summary.rms(), 0, 'g', 6)
+                    .arg(histogram));
+                emit statusUpdateMessage(QString("Deviation: %1 points in %2 ms (hierarchy %3 ms)")
+                    .arg(statistics.points).arg(statistics.queryMs, 0, 'f', 0).arg(statistics.buildMs, 0, 'f', 0), 0);
+            }, Qt::QueuedConnection);
+        });
+}
+
+/**
+ * @brief Slot triggered to restore the colours of the selected parts after a deviation comparison.
+ */
+void MainWindow::on_actionClear_Deviation_triggered() {
+    QModelIndexList selected = ui->treeView->selectionModel()->selectedRows();
+    if (selected.isEmpty() && ui->treeView->currentIndex().isValid()) {
+        selected.append(ui->treeView->currentIndex());
+    }
+    for (const QModelIndex& index : selected) {
+        ModelPart* part = static_cast<ModelPart*>(index.internalPointer());
+        part->setVertexColours(nullptr);
+        if (std::shared_ptr<PointCloud> cloud = part->getPointCloud()) {
+            cloud->setColouring(nullptr);
         }
     }
+    renderWindow->Render();
 }
 
 void MainWindow::updateRenderFromTreeVR(const QModelIndex& index) {
     if (index.isValid()) {
         ModelPart* selectedPart = static_cast<ModelPart*>(index.internalPointer());
-        if (selectedPart) {
+        if (selectedPart && selectedPart->effectiveVisible()) {
             vtkSmartPointer<vtkActor> newActor = selectedPart->getNewActor(); // Create a new actor for VR
             if (newActor) {
-                vrThread->addActorOffline(newActor); // Add the new actor to VR
+                vrThread->addActorOffline(newActor, selectedPart); // Add the new actor to VR
+                requestCollisionProxy(selectedPart);
             }
         }
         int rows = partList->rowCount(index);
@@ -339,10 +983,184 @@ void MainWindow::updateRenderFromTreeVR(const QModelIndex& index) {
     }
 }
 
+/**
+ * @brief Imports BOM attributes for the parts from a CSV file.
+ *
+ * Rows are joined to parts by name; the counts of matched and unmatched rows are reported so
+ * naming mismatches show up straight away.
+ */
+void MainWindow::on_actionImport_Attributes_triggered() {
+    const QString fileName = QFileDialog::getOpenFileName(this, tr("Import Attributes"), QString(),
+        tr("CSV Files (*.csv *.txt);;All Files (*)"));
+    if (fileName.isEmpty())
+        return;
+
+    AttributeStore::ImportResult result;
+    QString error;
+    if (!attributes->importCsv(fileName, &result, &error)) {
+        QMessageBox::warning(this, tr("Import Attributes"), tr("Could not read %1: %2").arg(fileName, error));
+        return;
+    }
+    QString message = tr("%1 of %2 row(s) matched, %3 part(s) now have %4")
+        .arg(result.matched).arg(result.rows).arg(result.parts).arg(result.columns.join(", "));
+    if (!result.unmatched.isEmpty()) {
+        message += tr("\n\nNo part named: %1").arg(QStringList(result.unmatched.mid(0, 20)).join(", "));
+        if (result.unmatched.size() > 20) message += tr(" and %1 more").arg(result.unmatched.size() - 20);
+    }
+    QMessageBox::information(this, tr("Import Attributes"), message);
+}
+
+/**
+ * @brief Colours and hides parts by rules over their attributes.
+ *
+ * All parts a rule list touches are updated first and the tree and render window are told once
+ * at the end, so a rule like "colour by supplier" over a hundred thousand parts is one scene
+ * update rather than one per part.
+ */
+void MainWindow::on_actionAttribute_Rules_triggered() {
+    if (attributes->columns().isEmpty()) {
+        QMessageBox::information(this, tr("Attribute Rules"), tr("Import attributes first."));
+        return;
+    }
+    if (attributeRules.isEmpty()) {
+        attributeRules = QString("colour by %1\n").arg(attributes->columns().first());
+    }
+
+    bool ok;
+    const QString text = QInputDialog::getMultiLineText(this, tr("Attribute Rules"),
+        tr("One rule per line, later rules win. Columns: %1\n"
+           "e.g. colour by supplier / hide where type = fastener / colour #ff8000 where mass between 1 and 5")
+        .arg(attributes->columns().join(", ")), attributeRules, &ok);
+    if (!ok)
+        return;
+    attributeRules = text;
+
+    QList<AttributeStore::Rule> rules;
+    QString error;
+    if (!AttributeStore::parseRules(text, &rules, &error)) {
+        QMessageBox::warning(this, tr("Attribute Rules"), error);
+        return;
+    }
+    const AttributeStore::Outcome outcome = attributes->evaluate(rules);
+    if (!outcome.unknownColumns.isEmpty()) {
+        QMessageBox::warning(this, tr("Attribute Rules"), tr("Unknown column(s), rules skipped: %1").arg(outcome.unknownColumns.join(", ")));
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < outcome.parts.size(); ++i) {
+        ModelPart* part = outcome.parts[i];
+        const QColor colour = outcome.colours[i].isValid() ? outcome.colours[i] : part->getColor();
+        const bool visible = outcome.visibility[i] < 0 ? part->visible() : outcome.visibility[i] == 1;
+        applyPropertiesToPart(part, QString(), visible, colour, false, false);
+    }
+    partList->notifyPartsChanged(outcome.parts);
+    renderWindow->Render();
+    const double applyMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    emit statusUpdateMessage(QString("Rules applied to %1 part(s): %2 ms to evaluate, %3 ms to update the scene")
+        .arg(outcome.parts.size()).arg(outcome.ms, 0, 'f', 1).arg(applyMs, 0, 'f', 1), 5000);
+}
+
+/**
+ * @brief Hands the collision proxy of a part to the VR thread, building it first if needed.
+ *
+ * Proxies are built on the thread pool and kept in the part until its mesh changes, so starting
+ * VR again does not rebuild them. A part removed or reloaded while its proxy was being built is
+ * left alone.
+ *
+ * @param part The part shown in VR.
+ */
+void MainWindow::requestCollisionProxy(ModelPart* part) {
+    if (std::shared_ptr<const CollisionProxy> proxy = part->getCollisionProxy()) {
+        vrThread->setCollisionProxy(part, proxy);
+        return;
+    }
+    vtkSmartPointer<vtkPolyData> polyData = part->getPolyData();
+    if (!polyData)
+        return;
+
+    runInBackground(TaskScheduler::Maintenance, [this, part, polyData] {
+        std::vector<float> points;
+        std::vector<uint32_t> triangles;
+        ModelPart::extractMesh(polyData, points, triangles);
+        auto proxy = std::make_shared<const CollisionProxy>(
+            CollisionProxy::build(points.data(), triangles.data(), triangles.size() / 3));
+
+        QMetaObject::invokeMethod(this, [this, part, polyData, proxy] {
+            if (!containsPart(part) || part->getPolyData() != polyData)
+                return;
+            part->setCollisionProxy(proxy);
+            vrThread->setCollisionProxy(part, proxy);
+        }, Qt::QueuedConnection);
+    });
+}
+
+/**
+ * @brief Checks whether a part is still in the tree.
+ *
+ * @param part The part to look for.
+ * @return True if the part is the root or one of its descendants.
+ */
+bool MainWindow::containsPart(ModelPart* part) const {
+    QList<ModelPart*> stack = { partList->getRootItem() };
+    while (!stack.isEmpty()) {
+        ModelPart* current = stack.takeLast();
+        if (current == part)
+            return true;
+        for (int i = 0; i < current->childCount(); ++i) {
+            stack.append(current->child(i));
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Moves a part to where it was placed in VR.
+ *
+ * The part's local transform is set so that its world matrix matches the VR one, which the
+ * desktop view, a running sync session and the mass properties all pick up.
+ *
+ * @param part The grabbed part.
+ * @param world Its new row-major world matrix.
+ */
+void MainWindow::applyVRMove(ModelPart* part, const QVector<double>& world) {
+    if (world.size() != 16 || !containsPart(part))
+        return;
+
+    vtkNew<vtkMatrix4x4> local;
+    local->DeepCopy(world.constData());
+    if (ModelPart* parent = part->parentItem()) {
+        vtkNew<vtkMatrix4x4> parentInverse;
+        vtkMatrix4x4::Invert(parent->getTransform()->GetMatrix(), parentInverse);
+        vtkMatrix4x4::Multiply4x4(parentInverse, local, local);
+    }
+    vtkTransform* transform = part->getTransform();
+    transform->Identity();
+    transform->Concatenate(local);
+    renderWindow->Render();
+}
+
+/**
+ * @brief Reports the contacts of a part moved in VR.
+ *
+ * @param part The moved part.
+ * @param contacts Number of parts it touches.
+ * @param queryMs Time taken by the contact query.
+ */
+void MainWindow::showVRContacts(ModelPart* part, int contacts, double queryMs) {
+    if (!containsPart(part))
+        return;
+    const QString name = part->data(0).toString();
+    const QString message = contacts == 0
+        ? QString("%1 is clear").arg(name)
+        : QString("%1 touches %2 part(s) (%3 ms)").arg(name).arg(contacts).arg(queryMs, 0, 'f', 2);
+    emit statusUpdateMessage(message, 3000);
+}
+
 void MainWindow::startVRRendering() {
     
    
-    vrThread->issueCommand(0, 0);
+    issueVRCommand(0, 0);
 
     int topLevelItemCount = partList->rowCount(QModelIndex());
     for (int i = 0; i < topLevelItemCount; ++i) {
@@ -368,59 +1186,360 @@ void MainWindow::startVRRendering() {
  * creates a new ModelPart that is appended to the tree and rendered in the viewport.
  */
 void MainWindow::on_actionOpen_File_triggered() {
-    QStringList fileNames = QFileDialog::getOpenFileNames(this, tr("Open Files"), QDir::homePath(), tr("STL Files (*.stl);;Text Files (*.txt)"));
-    for (const QString& fileName : fileNames) {
-        if (!fileName.isEmpty()) {
-            createModelPartFromFile(fileName);
-        }
+    QStringList fileNames = QFileDialog::getOpenFileNames(this, tr("Open Files"), QDir::homePath(), tr("STL Files (*.stl);;Point Clouds (*.ply *.xyz);;Text Files (*.txt)"));
+    fileNames.removeAll(QString());
+    if (!fileNames.isEmpty()) {
+        loadFiles(fileNames);
     }
 }
 
 /**
  * @brief Creates a ModelPart from a file and adds it to the tree.
  *
- * Given a file name, this function creates a new ModelPart, loads the data from the file,
- * and appends it to the model tree, updating the rendering accordingly.
- *
  * @param fileName The name of the file to create the ModelPart from.
  */
 void MainWindow::createModelPartFromFile(const QString& fileName) {
-    // Run the STL loading in a separate thread
-    QtConcurrent::run([this, fileName] {
-        // This code is now running in a separate thread
-        QFileInfo fileInfo(fileName);
-        QString justFileName = fileInfo.fileName();
-
-        QList<QVariant> data = { QVariant(justFileName), QVariant("true"), QVariant("255,255,255") };
-        ModelPart* newPart = new ModelPart(data);
-
-        // Load STL file (heavy operation)
-        newPart->loadSTL(fileName);
-
-        QColor whiteColor(255, 255, 255);
-        newPart->setColour(whiteColor.red(), whiteColor.green(), whiteColor.blue());
-        newPart->setVisible(true);
-
-        // Once done, schedule the following code to be run on the main thread
-        QMetaObject::invokeMethod(this, [this, newPart, fileName] {
-                QModelIndex currentIndex = ui->treeView->currentIndex();
-                ModelPart* parentPart = currentIndex.isValid() ? static_cast<ModelPart*>(currentIndex.internalPointer()) : partList->getRootItem();
-                parentPart->appendChild(newPart);
-
-                QAbstractItemModel* model = ui->treeView->model();
-                model->dataChanged(model->index(newPart->row(), 0), model->index(newPart->row(), model->columnCount() - 1));
-                emit model->dataChanged(model->index(newPart->row(), 0), model->index(newPart->row(), model->columnCount() - 1));
-                emit model->layoutChanged();
-
-                updateRender();
-                addFloor(); // Re-add the floor every time the scene is updated
-                emit statusUpdateMessage(QString("Loaded STL file: %1").arg(fileName), 5000);
+    loadFiles({ fileName });
+}
+
+/**
+ * @brief Loads a set of STL files in the background and adds them to the tree.
+ *
+ * The files are read by a BulkFileReader, which keeps many reads in flight at once, and each file
+ * is parsed on the thread pool as soon as its bytes arrive. Once every pool slot is busy the reader
+ * thread parses the file itself, so a large import cannot read far ahead of the parsers. Finished parts
+ * are queued for insertion under the item that was selected when the load was requested.
+ *
+ * When the loader worker executable is installed, files are parsed out of process instead; see
+ * loadFilesInWorkers().
+ *
+ * Point clouds are split off to loadPointClouds().
+ *
+ * @param requestedFiles The STL and point cloud files to load.
+ */
+void MainWindow::loadFiles(const QStringList& requestedFiles) {
+    const QModelIndex parentIndex = ui->treeView->currentIndex();
+    QStringList fileNames;
+    QStringList pointClouds;
+    for (const QString& fileName : requestedFiles) {
+        (PointCloud::isPointCloudFile(fileName) ? pointClouds : fileNames).append(fileName);
+    }
+    if (!pointClouds.isEmpty()) {
+        loadPointClouds(pointClouds, beginLoad(parentIndex, pointClouds.size()));
+    }
+    if (fileNames.isEmpty())
+        return;
+
+    if (loaderPool) {
+        loadFilesInWorkers(fileNames, beginLoad(parentIndex, fileNames.size()));
+        return;
+    }
+
+    const int load = beginLoad(parentIndex, 1);
+    runInBackground(TaskScheduler::VisibleLoading, [this, fileNames, load] {
+        const CancellationToken token = backgroundWork;
+        const int parsers = TaskScheduler::instance()->concurrencyLimit(TaskScheduler::VisibleLoading);
+        auto parseSlots = std::make_shared<QSemaphore>(parsers);
+
+        auto start = std::chrono::steady_clock::now();
+        BulkFileReader reader;
+        qint64 bytes = reader.readAll(fileNames, [this, load, parseSlots, token](FileReadResult& result) {
+            if (!result.error.isEmpty()) {
+                qWarning() << "Could not read" << result.fileName << ":" << result.error;
+                return;
+            }
+
+            auto file = std::make_shared<FileReadResult>(std::move(result));
+            auto parse = [this, load, file] {
+                QList<QVariant> data = { QVariant(QFileInfo(file->fileName).fileName()), QVariant("true"), QVariant("255,255,255") };
+                ModelPart* newPart = new ModelPart(data);
+
+                QString error;
+                bool loaded = newPart->loadSTL(file->buffer.data(), file->buffer.size(), &error);
+                file->buffer = AlignedBuffer(); // Release the file contents before waiting on the GUI thread
+                if (!loaded) {
+                    qWarning() << "Could not load" << file->fileName << ":" << error;
+                    delete newPart;
+                    return;
+                }
+                newPart->setColour(255, 255, 255);
+
+                QMetaObject::invokeMethod(this, [this, newPart, load] {
+                        queuePartInsertion(load, newPart);
+                    }, Qt::QueuedConnection);
+            };
+
+            // When the parsers are saturated, parse on the reader thread; this throttles reading
+            if (parseSlots->tryAcquire()) {
+                TaskScheduler::instance()->post(TaskScheduler::VisibleLoading, [parse, parseSlots] {
+                    parse();
+                    parseSlots->release();
+                    }, token, [parseSlots] { parseSlots->release(); });
+            }
+            else {
+                parse();
+            }
+            });
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        double megabytes = bytes / (1024.0 * 1024.0);
+        QString report = QString("read %1 MB in %2 s (%3 MB/s, %4)")
+            .arg(megabytes, 0, 'f', 1)
+            .arg(seconds, 0, 'f', 2)
+            .arg(seconds > 0 ? megabytes / seconds : 0.0, 0, 'f', 0)
+            .arg(BulkFileReader::backendName());
+        // Wait, running parse tasks meanwhile, until every one has queued its part or been dropped
+        TaskScheduler::instance()->waitUntil([parseSlots, parsers] { return parseSlots->available() == parsers; });
+        QMetaObject::invokeMethod(this, [this, report, load] {
+                importReport = report;
+                finishLoad(load);
+            }, Qt::QueuedConnection);
+    });
+}
+
+/**
+ * @brief Opens point cloud files in the background and adds them to the tree.
+ *
+ * A file opened for the first time is converted to an octree file next to it, which can take
+ * minutes for a large scan; later opens take a moment. Each cloud becomes one part.
+ *
+ * @param fileNames The PLY and XYZ files to open.
+ * @param load The load the parts belong to, from beginLoad() with a task per file.
+ */
+void MainWindow::loadPointClouds(const QStringList& fileNames, int load) {
+    emit statusUpdateMessage(QString("Indexing %1 point cloud(s)...").arg(fileNames.size()), 0);
+    for (const QString& fileName : fileNames) {
+        runInBackground(TaskScheduler::VisibleLoading, [this, fileName, load] {
+            QList<QVariant> data = { QVariant(QFileInfo(fileName).fileName()), QVariant("true"), QVariant("255,255,255") };
+            ModelPart* newPart = new ModelPart(data);
+            newPart->setColour(255, 255, 255);
+
+            auto start = std::chrono::steady_clock::now();
+            QString error;
+            if (!newPart->loadPointCloud(fileName, &error)) {
+                delete newPart;
+                QString message = QString("Could not load %1: %2").arg(QFileInfo(fileName).fileName(), error);
+                QMetaObject::invokeMethod(this, [this, message, load] {
+                        emit statusUpdateMessage(message, 5000);
+                        finishLoad(load);
+                    }, Qt::QueuedConnection);
+                return;
+            }
+
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            QString report = QString("%1 points, opened in %2 s")
+                .arg(newPart->getPointCloud()->pointCount())
+                .arg(seconds, 0, 'f', 2);
+            QMetaObject::invokeMethod(this, [this, newPart, load, report] {
+                    importReport = report;
+                    queuePartInsertion(load, newPart);
+                    finishLoad(load);
+                }, Qt::QueuedConnection);
+            });
+    }
+}
+
+/**
+ * @brief Loads a set of STL files through the loader worker processes and adds them to the tree.
+ *
+ * The workers read and parse the files and the meshes arrive in shared memory, so the file contents
+ * and parse buffers never enter this process. A file that crashes or hangs its worker fails on its
+ * own and the remaining files carry on with a fresh worker.
+ *
+ * @param fileNames The STL files to load.
+ * @param load The load the parts belong to, from beginLoad() with a task per file.
+ */
+void MainWindow::loadFilesInWorkers(const QStringList& fileNames, int load) {
+    auto remaining = std::make_shared<std::atomic<int>>(fileNames.size());
+    auto failed = std::make_shared<std::atomic<int>>(0);
+    auto start = std::chrono::steady_clock::now();
+
+    for (const QString& fileName : fileNames) {
+        loaderPool->load(fileName, [this, load, remaining, failed, start](const QString& fileName, vtkSmartPointer<vtkPolyData> polyData, const QString& error) {
+            if (polyData) {
+                QList<QVariant> data = { QVariant(QFileInfo(fileName).fileName()), QVariant("true"), QVariant("255,255,255") };
+                ModelPart* newPart = new ModelPart(data);
+                newPart->setPolyData(polyData);
+                newPart->buildFeatureEdges(); // Still on the loader's thread, so import stays parallel
+                newPart->setColour(255, 255, 255);
+
+                QMetaObject::invokeMethod(this, [this, newPart, load] {
+                        queuePartInsertion(load, newPart);
+                        finishLoad(load);
+                    }, Qt::QueuedConnection);
+            }
+            else {
+                qWarning() << "Could not load" << fileName << ":" << error;
+                ++*failed;
+                QString message = QString("Could not load %1: %2").arg(QFileInfo(fileName).fileName(), error);
+                QMetaObject::invokeMethod(this, [this, message, load] {
+                        emit statusUpdateMessage(message, 5000);
+                        finishLoad(load);
+                    }, Qt::QueuedConnection);
+            }
+
+            if (--*remaining == 0) {
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                QString report = QString("parsed out of process in %1 s").arg(seconds, 0, 'f', 2);
+                if (*failed > 0) {
+                    report += QString(", %1 file(s) failed").arg(failed->load());
+                }
+                QMetaObject::invokeMethod(this, [this, report] {
+                        importReport = report;
+                    }, Qt::QueuedConnection);
+            }
+            });
+    }
+}
+
+/**
+ * @brief Slot triggered to import a folder of STL files as a group hierarchy.
+ */
+void MainWindow::on_actionImport_Folder_triggered() {
+    QString path = QFileDialog::getExistingDirectory(this, tr("Import Folder"), QDir::homePath());
+    if (!path.isEmpty()) {
+        importAssembly(path, false);
+    }
+}
+
+/**
+ * @brief Slot triggered to import the STL files in a ZIP archive as a group hierarchy.
+ */
+void MainWindow::on_actionImport_ZIP_triggered() {
+    QString fileName = QFileDialog::getOpenFileName(this, tr("Import ZIP"), QDir::homePath(), tr("ZIP Archives (*.zip)"));
+    if (!fileName.isEmpty()) {
+        importAssembly(fileName, true);
+    }
+}
+
+/**
+ * @brief Imports a folder or ZIP archive in the background and adds it to the tree.
+ *
+ * The whole hierarchy is built off the GUI thread and then queued as a single part, so the tree
+ * receives one insertion however many groups and files the assembly contains.
+ *
+ * @param path The folder or archive to import.
+ * @param isZip True if path is a ZIP archive.
+ */
+void MainWindow::importAssembly(const QString& path, bool isZip) {
+    const int load = beginLoad(ui->treeView->currentIndex(), 1);
+    emit statusUpdateMessage(QString("Importing %1...").arg(QFileInfo(path).fileName()), 0);
+
+    runInBackground(TaskScheduler::VisibleLoading, [this, path, isZip, load] {
+        QStringList errors;
+        ModelPart* assembly = isZip ? AssemblyImporter::importZip(path, &errors) : AssemblyImporter::importDirectory(path, &errors);
+        for (const QString& error : errors) {
+            qWarning() << "Import:" << error;
+        }
+
+        QMetaObject::invokeMethod(this, [this, assembly, path, errors, load] {
+                if (assembly) {
+                    queuePartInsertion(load, assembly);
+                }
+                finishLoad(load);
+                if (!errors.isEmpty()) {
+                    QMessageBox::warning(this, tr("Import"), tr("%1 file(s) in %2 could not be loaded:\n%3")
+                        .arg(errors.size()).arg(QFileInfo(path).fileName()).arg(errors.mid(0, 10).join("\n")));
+                }
+                else if (!assembly) {
+                    emit statusUpdateMessage(QString("No STL files found in %1").arg(QFileInfo(path).fileName()), 5000);
+                }
             }, Qt::QueuedConnection);
     });
 }
 
+/**
+ * @brief Registers a load and where its parts go.
+ *
+ * Model indexes may only be created, copied and destroyed on the model's thread, so the parent is
+ * kept here and background work carries only the returned id. Each of the load's tasks calls
+ * finishLoad() on the GUI thread once it can queue no more parts.
+ *
+ * @param parentIndex The item to add the parts under; invalid for the root.
+ * @param tasks Number of finishLoad() calls that end the load.
+ * @return The load's id.
+ */
+int MainWindow::beginLoad(const QModelIndex& parentIndex, int tasks) {
+    const int load = ++lastLoadId;
+    pendingLoads.insert(load, PendingLoad{ QPersistentModelIndex(parentIndex), tasks });
+    return load;
+}
 
+/**
+ * @brief Records that one task of a load is done, and forgets the load after its last.
+ *
+ * @param load The load's id.
+ */
+void MainWindow::finishLoad(int load) {
+    auto entry = pendingLoads.find(load);
+    if (entry != pendingLoads.end() && --entry->tasks <= 0) {
+        pendingLoads.erase(entry);
+    }
+}
 
+/**
+ * @brief Queues a loaded part for insertion into the tree.
+ *
+ * Parts that finish loading close together are inserted by a single flush at the next pass of the
+ * event loop, so a bulk import produces one model notification and one render per parent rather
+ * than one per file.
+ *
+ * @param load The load the part belongs to; its parent is looked up now, on the GUI thread.
+ * @param part The loaded part. Ownership passes to the tree once inserted.
+ */
+void MainWindow::queuePartInsertion(int load, ModelPart* part) {
+    pendingInsertions.append(qMakePair(pendingLoads.value(load).parent, part));
+    if (pendingInsertions.size() == 1) {
+        QTimer::singleShot(0, this, &MainWindow::flushPendingInsertions);
+    }
+}
+
+/**
+ * @brief Inserts all queued parts, grouped by parent, and refreshes the scene once.
+ *
+ * Parts whose parent was deleted while they were loading are added to the root instead.
+ */
+void MainWindow::flushPendingInsertions() {
+    if (pendingInsertions.isEmpty()) return;
+
+    QList<QPair<QPersistentModelIndex, ModelPart*>> batch;
+    batch.swap(pendingInsertions);
+
+    // A folder or ZIP import arrives as one group, so count the parts inside what was loaded
+    int loadedCount = 0;
+    QList<ModelPart*> stack;
+    for (const QPair<QPersistentModelIndex, ModelPart*>& entry : batch) {
+        stack.append(entry.second);
+    }
+    while (!stack.isEmpty()) {
+        ModelPart* part = stack.takeLast();
+        if (part->childCount() == 0) ++loadedCount;
+        for (int i = 0; i < part->childCount(); ++i) {
+            stack.append(part->child(i));
+        }
+    }
+
+    // Group by parent in one pass, keeping parents in the order their first part arrived
+    QList<ModelPart*> parents;
+    QHash<ModelPart*, QList<ModelPart*>> children;
+    for (const QPair<QPersistentModelIndex, ModelPart*>& entry : batch) {
+        ModelPart* parent = partList->getItem(entry.first);
+        QList<ModelPart*>& siblings = children[parent];
+        if (siblings.isEmpty()) parents.append(parent);
+        siblings.append(entry.second);
+    }
+    for (ModelPart* parent : parents) {
+        partList->insertChildren(partList->indexOf(parent), children.value(parent));
+    }
+
+    updateRender();
+    QString message = QString("Loaded %1 part(s)").arg(loadedCount);
+    if (!importReport.isEmpty()) {
+        message += ", " + importReport;
+        importReport.clear();
+    }
+    emit statusUpdateMessage(message, 5000);
+}
 
 /**
  * @brief Slot triggered to handle the creation of a new group.
@@ -430,18 +1549,39 @@ void MainWindow::createModelPartFromFile(const QString& fileName) {
  */
 void MainWindow::on_actionNewGroup_triggered() {
     newGroupDialog = new NewGroupDialog(this);
-    QModelIndex index = ui->treeView->currentIndex();
+    QPersistentModelIndex index(ui->treeView->currentIndex());
     connect(newGroupDialog, &NewGroupDialog::accepted, [this, index]() {
         QString groupName = newGroupDialog->getGroupName();
-        ModelPart* parentPart = index.isValid() ? static_cast<ModelPart*>(index.internalPointer()) : this->partList->getRootItem();
         ModelPart* newGroup = new ModelPart({ groupName, "true", "255,255,255" });
-        parentPart->appendChild(newGroup);
-        ui->treeView->model()->layoutChanged();
+        partList->insertChildren(index, { newGroup });
         });
 
     newGroupDialog->show();
 }
 
+/**
+ * @brief Slot triggered to move the currently selected part or group.
+ *
+ * Asks for an offset and applies it to the item's transform. Descendants follow through the
+ * transform chain, so moving a group is a single update however large it is.
+ */
+void MainWindow::on_actionMoveItem_triggered() {
+    QModelIndex currentIndex = ui->treeView->currentIndex();
+    if (!currentIndex.isValid()) {
+        QMessageBox::warning(this, tr("Selection Error"), tr("Please select an item to move."));
+        return;
+    }
+
+    bool ok;
+    QString offset = QInputDialog::getText(this, tr("Move Item"), tr("Offset (x,y,z):"), QLineEdit::Normal, "0,0,0", &ok);
+    QStringList components = offset.split(',');
+    if (!ok || components.size() != 3) return;
+
+    ModelPart* selectedPart = static_cast<ModelPart*>(currentIndex.internalPointer());
+    selectedPart->getTransform()->Translate(components[0].toDouble(), components[1].toDouble(), components[2].toDouble());
+    renderWindow->Render();
+}
+
 /**
  * @brief Slot triggered to delete the currently selected file/part.
  *
@@ -477,6 +1617,7 @@ void MainWindow::on_actionDeleteFile_triggered() {
     if (response == QMessageBox::Yes) {
         removeActorsRecursively(selectedItem);
         if (model->removeRows(currentIndex.row(), 1, currentIndex.parent())) {
+            renderWindow->Render();
             emit statusUpdateMessage("Item deleted successfully.", 5000);
         }
         else {
@@ -486,26 +1627,15 @@ void MainWindow::on_actionDeleteFile_triggered() {
 }
 
 /**
- * @brief Recursively removes vtkActor objects from the renderer for a ModelPart and its descendants.
+ * @brief Recursively releases render state held for a ModelPart and its descendants.
  *
- * Iterates over the ModelPart hierarchy, removing each associated vtkActor from the renderer.
- * It ensures the graphical representation is consistent with the tree view's structure.
+ * The parts' actors leave the scene together with the part's node when it is removed from the
+ * tree; this clears the extra state kept outside the tree, such as cached impostors.
  *
  * @param part The ModelPart to start removal from; does nothing if null.
  */
 void MainWindow::removeActorsRecursively(ModelPart* part) {
-    if (!part) return;
-
-    vtkSmartPointer<vtkActor> actor = part->getActor();
-    if (actor) {
-        renderer->RemoveActor(actor);
-    }
-
-    for (int i = 0; i < part->childCount(); ++i) {
-        removeActorsRecursively(part->child(i));
-    }
-
-    renderWindow->Render();
+    scene->removePart(part);
 }
 
 
@@ -554,29 +1684,4 @@ void MainWindow::selectItemInTreeView(const QModelIndex& index) {
     ui->treeView->selectionModel()->select(index, QItemSelectionModel::Select | QItemSelectionModel::Rows);
 }
 
-void MainWindow::addFloor() {
-    vtkSmartPointer<vtkPlaneSource> planeSource = vtkSmartPointer<vtkPlaneSource>::New();
-    planeSource->Update();
-
-    double scale = 500.0; // Adjust the scale as needed
-
-    vtkSmartPointer<vtkTransform> transform = vtkSmartPointer<vtkTransform>::New();
-    transform->Translate(50.0, 50.0, -10.0); // Adjust positioning if needed
-    transform->RotateX(0); // Rotating 90 degrees around the X-axis
-    transform->Scale(scale, scale, 1); // Scaling the plane
-
-    vtkSmartPointer<vtkTransformPolyDataFilter> transformFilter = vtkSmartPointer<vtkTransformPolyDataFilter>::New();
-    transformFilter->SetInputConnection(planeSource->GetOutputPort());
-    transformFilter->SetTransform(transform);
-    transformFilter->Update();
-
-    vtkSmartPointer<vtkPolyDataMapper> mapper = vtkSmartPointer<vtkPolyDataMapper>::New();
-    mapper->SetInputConnection(transformFilter->GetOutputPort());
-
-    vtkSmartPointer<vtkActor> actor = vtkSmartPointer<vtkActor>::New();
-    actor->SetMapper(mapper);
-    actor->GetProperty()->SetColor(0.8, 0.8, 0.8); // Set the floor color
-
-    renderer->AddActor(actor);
-}
 
@@ -12,13 +12,27 @@
 
 #include <QMainWindow>
 #include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QPersistentModelIndex>
 #include <vtkSmartPointer.h>
 #include <vtkRenderer.h>
+#include <vtkActor.h>
 #include <vtkGenericOpenGLRenderWindow.h>
+#include <vtkImageData.h>
+#include <vector>
 #include "ModelPartList.h" 
 #include "ModelPart.h" 
 #include "NewGroupDialog.h"
 #include "VRRenderThread.h"
+#include "SceneRenderer.h"
+#include "LoaderPool.h"
+#include "SyncSession.h"
+#include "MassProperties.h"
+#include "AttributeStore.h"
+#include "TaskScheduler.h"
 
 
 
@@ -43,10 +57,11 @@ public:
     ~MainWindow();
 
     void updateRender();
-    void updateRenderFromTree(const QModelIndex& index);
     void updateRenderFromTreeVR(const QModelIndex& index);
-    void applyPropertiesToPart(ModelPart* part, const QString& name, bool visibility, const QColor& color, bool updateName = true);
-    void updateChildrenProperties(ModelPart* part, bool visibility, const QColor& color);
+    void applyPropertiesToPart(ModelPart* part, const QString& name, bool visibility, const QColor& color, bool updateName = true, bool notify = true);
+    bool startSync(bool publish, const QString& name, QString* error = nullptr);
+    bool startRecording(const QString& fileName, QString* error = nullptr);
+    void updateChildrenProperties(ModelPart* part, const QColor& color);
     void initializePartList();
     void setupTreeView();
     void setupActions();
@@ -67,26 +82,86 @@ public slots:
     void on_actionItemOptions_triggered();
     void on_actionNewGroup_triggered();
     void on_actionDeleteFile_triggered();
+    void on_actionMoveItem_triggered();
     void createModelPartFromFile(const QString& fileName);
+    void loadFiles(const QStringList& fileNames);
+    void on_actionImport_Folder_triggered();
+    void on_actionImport_ZIP_triggered();
+    void loadFilesInWorkers(const QStringList& fileNames, int load);
+    void loadPointClouds(const QStringList& fileNames, int load);
+    void importAssembly(const QString& path, bool isZip);
+    int beginLoad(const QModelIndex& parentIndex, int tasks);
+    void finishLoad(int load);
+    void queuePartInsertion(int load, ModelPart* part);
+    void flushPendingInsertions();
     void removeActorsRecursively(ModelPart* part);
     void on_actionSearchItem_triggered();
-    void addFloor();
     void startVRRendering();
+    void setOcclusionCulling(bool enabled);
+    void setImpostors(bool enabled);
+    void setFeatureEdges(bool enabled);
+    void setHiddenLineRemoval(bool enabled);
+    void setShadows(bool enabled);
+    void setContactShadow(bool enabled);
+    void setVRMirror(bool enabled);
+    void setSessionRecording(bool enabled);
+    void setRenderCostHeatMap(bool enabled);
+    void showVRMirrorFrame(const QImage& image);
+    void on_actionSlice_Parts_triggered();
+    void on_actionSet_Density_triggered();
+    void on_actionMass_Properties_triggered();
+    void on_actionCompare_Deviation_triggered();
+    void on_actionClear_Deviation_triggered();
+    void on_actionImport_Attributes_triggered();
+    void on_actionAttribute_Rules_triggered();
+    void applyVRMove(ModelPart* part, const QVector<double>& world);
+    void showVRContacts(ModelPart* part, int contacts, double queryMs);
 
 private:
+    /** Where the parts of a load in progress go, kept on the GUI thread; background work only carries its id. */
+    struct PendingLoad {
+        QPersistentModelIndex parent; ///< The item the parts are added under.
+        int tasks; ///< Background tasks that may still queue parts for this load.
+    };
+
+    SyncSession* syncSession();
+    void runInBackground(TaskScheduler::Priority priority, std::function<void()> work);
+    void recordEvent(const QString& name, const QVariant& value);
+    void issueVRCommand(int command, double value);
+    void requestCollisionProxy(ModelPart* part);
+    void applyHeatMap(ModelPart* part, const RenderProfiler::Profile* profile, double maxCost);
+    bool containsPart(ModelPart* part) const;
+    QSize vrMirrorSize() const;
+
     Ui::MainWindow* ui; ///< User interface for the main window.
     ModelPartList* partList; ///< List of model parts displayed in the tree view.
-    vtkSmartPointer<vtkRenderer> renderer; ///< Renderer for displaying VTK objects.
+    SceneRenderer* scene; ///< Renderer for the part tree, with per-frame culling and impostors.
+    LoaderPool* loaderPool; ///< Out-of-process STL parsers, or nullptr if the worker executable is missing.
+    MassProperties* massProperties; ///< Mass properties of the tree, kept up to date as parts change.
+    AttributeStore* attributes; ///< BOM metadata imported for the parts.
+    QString attributeRules; ///< Rules last applied, offered again for editing.
+    SyncSession* sync; ///< Link to other viewer instances or session recording, or nullptr until first used.
     vtkSmartPointer<vtkGenericOpenGLRenderWindow> renderWindow; ///< OpenGL render window for VTK rendering.
-    vtkSmartPointer<vtkActor> floorActor;
     QAction* actionNewGroup; ///<        Action to create a new group in the tree view.
     NewGroupDialog* newGroupDialog; ///< Dialog for creating new groups.
     QAction* actionDeleteGroup; ///< Action to delete a selected group.
     QAction* actionItemOptions; ///< Action to modify item options.
     QAction* actionDeleteItem; ///< Action to delete a selected item.
+    QAction* actionMoveItem; ///< Action to move a selected item.
     QAction* actionSearch_Items;
 
     VRRenderThread* vrThread;
+
+    QList<QPair<QPersistentModelIndex, ModelPart*>> pendingInsertions; ///< Loaded parts waiting to be added to the tree.
+    QHash<int, PendingLoad> pendingLoads; ///< Loads in progress, by id.
+    int lastLoadId; ///< Id given to the most recent load.
+    CancellationToken backgroundWork; ///< Cancelled on close, dropping background tasks that report back to this window.
+    QList<QFuture<void>> backgroundTasks; ///< Tasks from runInBackground() that may still be running; waited for on close.
+    QString importReport; ///< Read throughput of the last bulk import, shown when its parts are inserted.
+    vtkSmartPointer<vtkActor> slicePreview; ///< Contours of the last slice; dropped when the tree next changes.
+    vtkSmartPointer<vtkRenderer> mirrorRenderer; ///< Draws only the VR mirror image, in place of the scene, while mirroring.
+    vtkSmartPointer<vtkImageData> mirrorImage; ///< Latest VR mirror image, bottom-up RGB.
+    int mirrorInterval; ///< Milliseconds between VR mirror images; the last rate chosen.
 };
 
 #endif // MAINWINDOW_H
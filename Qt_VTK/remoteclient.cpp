@@ -0,0 +1,56 @@
+/**
+ * @file remoteclient.cpp
+ * @brief Entry point of Qt_VTK_client, the thin client of the remote rendering mode.
+ *
+ * Shows the frames a Qt_VTK_server renders and sends interaction back. Drag with the left button
+ * to orbit, with the middle or right button to pan, use the wheel to zoom and R to reset the view:
+ *   Qt_VTK_client [--host render-box] [--port 47110] [--png] [--quality 80]
+ *
+ * For a repeatable measurement, script an orbit and write frame rate, bandwidth and
+ * input-to-photon latency to a report. This also runs without a display:
+ *   QT_QPA_PLATFORM=offscreen Qt_VTK_client --script-frames 500 --report remote.json
+ */
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+#include "RemoteClient.h"
+#include "RemoteProtocol.h"
+
+int main(int argc, char* argv[]) {
+    QApplication application(argc, argv);
+    QApplication::setApplicationName("Qt_VTK_client");
+
+    QCommandLineParser options;
+    options.setApplicationDescription("Thin client for a remote model viewer render server.");
+    options.addHelpOption();
+    options.addOptions({
+        { "host", "Render server to connect to.", "host", "localhost" },
+        { "port", "Port the render server listens on.", "port", QString::number(RemoteProtocol::kDefaultPort) },
+        { "png", "Ask for lossless PNG tiles instead of JPEG." },
+        { "quality", "JPEG quality from 0 to 100.", "quality", "80" },
+        { "size", "Initial view size.", "WxH", "1280x720" },
+        { "script-frames", "Orbit for this many frames, write a report and quit.", "count" },
+        { "report", "File the scripted run writes its JSON report to; standard output if not given.", "file" },
+    });
+    options.process(application);
+
+    RemoteClient client;
+    const QStringList size = options.value("size").split('x');
+    if (size.size() == 2) {
+        client.resize(size[0].toInt(), size[1].toInt());
+    }
+    client.setTileFormat(options.isSet("png"), options.value("quality").toInt());
+    if (options.isSet("script-frames")) {
+        client.setScript(options.value("script-frames").toInt(), options.value("report"));
+    }
+
+    QString error;
+    if (!client.connectToServer(options.value("host"), static_cast<quint16>(options.value("port").toUInt()), &error)) {
+        QTextStream(stderr) << "Could not connect to " << options.value("host") << ": " << error << "\n";
+        return 1;
+    }
+    client.setWindowTitle("Remote view");
+    client.show();
+    return application.exec();
+}
@@ -0,0 +1,64 @@
+/**
+ * @file remoteserver.cpp
+ * @brief Entry point of Qt_VTK_server, the render server of the remote rendering mode.
+ *
+ * Loads an assembly, renders it offscreen on this machine's GPU and streams the changed parts of
+ * each frame to a Qt_VTK_client, which sends camera input back:
+ *   Qt_VTK_server --input assembly.zip [--port 47110]
+ *
+ * Throughput is printed once a second. On machines without a display, run against Mesa's software
+ * rasteriser or a VTK build with EGL offscreen support, as for Qt_VTK_bench.
+ */
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QStringList>
+#include <QTextStream>
+#include "AssemblyImporter.h"
+#include "ModelPart.h"
+#include "RemoteProtocol.h"
+#include "RemoteRenderServer.h"
+
+int main(int argc, char* argv[]) {
+    QCoreApplication application(argc, argv);
+    QCoreApplication::setApplicationName("Qt_VTK_server");
+
+    QCommandLineParser options;
+    options.setApplicationDescription("Renders an assembly offscreen and streams it to a remote thin client.");
+    options.addHelpOption();
+    options.addOptions({
+        { "input", "STL file, folder or ZIP archive to serve.", "path" },
+        { "port", "TCP port to listen on.", "port", QString::number(RemoteProtocol::kDefaultPort) },
+    });
+    options.process(application);
+
+    if (!options.isSet("input")) {
+        QTextStream(stderr) << "No --input given\n";
+        return 1;
+    }
+
+    ModelPart root({ "Root", "true", "255,255,255" });
+    root.setVisible(true);
+    QStringList errors;
+    ModelPart* assembly = AssemblyImporter::importPath(options.value("input"), &errors);
+    for (const QString& error : errors) {
+        QTextStream(stderr) << error << "\n";
+    }
+    if (!assembly) {
+        QTextStream(stderr) << "No geometry could be loaded from " << options.value("input") << "\n";
+        return 1;
+    }
+    root.appendChild(assembly);
+
+    RemoteRenderServer server(&root);
+    QObject::connect(&server, &RemoteRenderServer::statusMessage, [](const QString& message) {
+        QTextStream(stdout) << message << Qt::endl;
+        });
+    QString error;
+    if (!server.listen(static_cast<quint16>(options.value("port").toUInt()), &error)) {
+        QTextStream(stderr) << "Could not listen: " << error << "\n";
+        return 1;
+    }
+    QTextStream(stdout) << "Listening on port " << options.value("port") << Qt::endl;
+    return application.exec();
+}
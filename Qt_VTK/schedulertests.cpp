@@ -0,0 +1,157 @@
+/**
+ * @file schedulertests.cpp
+ * @brief Entry point of Qt_VTK_scheduler_tests, the tests of the task scheduler's guarantees.
+ *
+ * Floods a scheduler with loading and analysis tasks together, as a bulk import during a
+ * deviation analysis does, and checks that the background classes never occupy every worker and
+ * that interactive tasks posted meanwhile start within a fraction of one flood task. Also checks
+ * that a thread outside the pool waiting for a task never runs flood tasks itself, and that tasks
+ * waiting for tasks of their own class, at a limit of one, finish. Prints one line per failure and
+ * exits with 1 if there were any.
+ *
+ * Example:
+ *   Qt_VTK_scheduler_tests
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+#include "TaskScheduler.h"
+
+namespace {
+
+int failures = 0; ///< Checks failed so far.
+
+using Clock = std::chrono::steady_clock;
+
+/**
+ * Records a failure if a condition does not hold.
+ */
+void expect(bool condition, const std::string& what) {
+    if (!condition) {
+        std::printf("FAIL %s\n", what.c_str());
+        ++failures;
+    }
+}
+
+/**
+ * Milliseconds elapsed since a time point.
+ */
+double elapsedMs(Clock::time_point since) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+}
+
+/**
+ * Floods loading and analysis at once and probes interactive start latency meanwhile. The flood
+ * tasks sleep rather than spin, so the result does not depend on how many cores the machine has.
+ */
+void checkInteractiveLatency(int threads) {
+    const int floodTasks = 40; // Per class
+    const auto floodTask = std::chrono::milliseconds(20);
+    const double allowedMs = 10.0; // Half a flood task; a busy pool would make probes wait longer
+
+    TaskScheduler scheduler(threads);
+    std::atomic<int> active{ 0 };
+    std::atomic<int> peak{ 0 };
+    auto flood = [&active, &peak, floodTask] {
+        const int now = ++active;
+        int seen = peak.load();
+        while (now > seen && !peak.compare_exchange_weak(seen, now)) {
+        }
+        std::this_thread::sleep_for(floodTask);
+        --active;
+    };
+    for (int i = 0; i < floodTasks; ++i) {
+        scheduler.post(TaskScheduler::VisibleLoading, flood);
+        scheduler.post(TaskScheduler::Analysis, flood);
+    }
+
+    double worstMs = 0.0;
+    int probes = 0;
+    for (;;) {
+        const TaskScheduler::Statistics statistics = scheduler.statistics();
+        if (statistics.classes[TaskScheduler::VisibleLoading].queued + statistics.classes[TaskScheduler::Analysis].queued == 0)
+            break;
+        const Clock::time_point posted = Clock::now();
+        QFuture<double> started = scheduler.run(TaskScheduler::Interactive, [posted] { return elapsedMs(posted); });
+        scheduler.wait(started);
+        worstMs = std::max(worstMs, started.result());
+        ++probes;
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    scheduler.waitUntil([&active] { return active.load() == 0; });
+
+    const std::string name = std::to_string(threads) + " threads";
+    expect(probes > 0, name + ": no probe ran during the flood");
+    expect(peak.load() <= threads - 1, name + ": " + std::to_string(peak.load()) + " flood tasks ran at once");
+    char latency[128];
+    std::snprintf(latency, sizeof(latency), ": interactive task waited %.2f ms to start, allowed %.2f ms", worstMs, allowedMs);
+    expect(worstMs <= allowedMs, name + latency);
+}
+
+/**
+ * Waits from this thread, which is not a worker, for a task queued behind a flood, and checks
+ * that none of the flood ran here.
+ */
+void checkOutsideWaitRunsNothing() {
+    TaskScheduler scheduler(2);
+    const std::thread::id self = std::this_thread::get_id();
+    std::atomic<int> ranHere{ 0 };
+    for (int i = 0; i < 20; ++i) {
+        scheduler.post(TaskScheduler::VisibleLoading, [&ranHere, self] {
+            if (std::this_thread::get_id() == self) ++ranHere;
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        });
+    }
+    QFuture<int> last = scheduler.run(TaskScheduler::VisibleLoading, [] { return 1; });
+    scheduler.wait(last);
+    expect(last.result() == 1, "outside wait: wrong result");
+    expect(ranHere.load() == 0, "outside wait: " + std::to_string(ranHere.load()) + " flood task(s) ran on the waiting thread");
+}
+
+/**
+ * Runs tasks that wait for tasks of their own class, with that class limited to one thread, so
+ * they only finish if a waiting task runs the ones it waits for.
+ */
+void checkNestedWait(int threads) {
+    TaskScheduler scheduler(threads);
+    scheduler.setConcurrencyLimit(TaskScheduler::VisibleLoading, 1);
+    std::vector<QFuture<int>> outer;
+    for (int i = 0; i < 50; ++i) {
+        outer.push_back(scheduler.run(TaskScheduler::VisibleLoading, [&scheduler, i] {
+            QFuture<int> inner = scheduler.run(TaskScheduler::VisibleLoading, [i] { return 2 * i; });
+            scheduler.wait(inner);
+            return inner.result();
+        }));
+    }
+    int sum = 0;
+    for (QFuture<int>& future : outer) {
+        scheduler.wait(future);
+        sum += future.result();
+    }
+    expect(sum == 2 * 1225, std::to_string(threads) + " threads: nested waits summed to " + std::to_string(sum));
+}
+
+} // namespace
+
+/**
+ * Runs the checks.
+ *
+ * @return 0 if every check passed, 1 otherwise.
+ */
+int main() {
+    const Clock::time_point start = Clock::now();
+    for (int threads : { 2, 4, 8 }) {
+        checkInteractiveLatency(threads);
+        checkNestedWait(threads);
+    }
+    checkNestedWait(1);
+    checkOutsideWaitRunsNothing();
+
+    std::printf("scheduler checks done in %.0f ms: %d failure(s)\n", elapsedMs(start), failures);
+    return failures ? 1 : 0;
+}